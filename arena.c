@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+
+struct arena_chunk {
+	struct arena_chunk *prev;
+	size_t size;
+	size_t used;
+	uint8_t data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+static struct arena_chunk *arena_new_chunk(size_t size)
+{
+	struct arena_chunk *c;
+
+	c = (struct arena_chunk *) malloc(sizeof(struct arena_chunk) + size);
+	assert(c != NULL);
+
+	c->prev = NULL;
+	c->size = size;
+	c->used = 0;
+
+	return c;
+}
+
+struct arena *arena_create(size_t chunk_size)
+{
+	struct arena *a;
+
+	a = (struct arena *) calloc(1, sizeof(struct arena));
+	assert(a != NULL);
+
+	a->chunk_size = chunk_size;
+	a->head = arena_new_chunk(chunk_size);
+	a->stats.chunks = 1;
+
+	return a;
+}
+
+void arena_destroy(struct arena *a)
+{
+	struct arena_chunk *c;
+
+	if (!a) {
+		return;
+	}
+
+	while (a->head) {
+		c = a->head;
+		a->head = c->prev;
+		free(c);
+	}
+	free(a);
+}
+
+/* Memory is not cleared, aligned like malloc() */
+void *arena_alloc(struct arena *a, size_t size)
+{
+	struct arena_chunk *c = a->head;
+	size_t aligned = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+	void *ptr;
+
+	if (c->used + aligned > c->size) {
+		/* Oversized requests get a chunk of their own */
+		c = arena_new_chunk(aligned > a->chunk_size ? aligned : a->chunk_size);
+		c->prev = a->head;
+		a->head = c;
+		a->stats.chunks++;
+	}
+
+	ptr = &c->data[c->used];
+	c->used += aligned;
+
+	a->stats.allocs++;
+	a->stats.bytes += size;
+
+	return ptr;
+}
+
+char *arena_strdup(struct arena *a, const char *str)
+{
+	size_t len = strlen(str) + 1;
+
+	return (char *) memcpy(arena_alloc(a, len), str, len);
+}
+
+char *arena_printf(struct arena *a, const char *fmt, ...)
+{
+	va_list ap;
+	char *str;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	assert(len >= 0);
+
+	str = (char *) arena_alloc(a, len + 1);
+
+	va_start(ap, fmt);
+	vsnprintf(str, len + 1, fmt, ap);
+	va_end(ap);
+
+	return str;
+}
+
+/* Release all allocations, the first chunk is kept for reuse */
+void arena_reset(struct arena *a)
+{
+	struct arena_chunk *c;
+
+	while (a->head->prev) {
+		c = a->head;
+		a->head = c->prev;
+		free(c);
+	}
+	a->head->used = 0;
+
+	memset(&a->stats, 0, sizeof(a->stats));
+	a->stats.chunks = 1;
+}
+
+void arena_mark(struct arena *a, struct arena_mark *mark)
+{
+	mark->chunk = a->head;
+	mark->used = a->head->used;
+}
+
+/* Release everything allocated after arena_mark(), statistics are kept */
+void arena_rewind(struct arena *a, const struct arena_mark *mark)
+{
+	struct arena_chunk *c;
+
+	while (a->head != mark->chunk) {
+		assert(a->head->prev != NULL);
+		c = a->head;
+		a->head = c->prev;
+		free(c);
+		a->stats.chunks--;
+	}
+	a->head->used = mark->used;
+}
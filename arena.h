@@ -0,0 +1,39 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Bump allocator, everything is released at once by arena_reset() */
+
+struct arena_chunk;
+
+/* Usage since the last reset */
+struct arena_stats {
+	uint64_t allocs;
+	uint64_t bytes;		/* Requested bytes */
+	uint64_t chunks;	/* Chunks in use, the first one is kept across resets */
+};
+
+struct arena {
+	struct arena_chunk *head;	/* Current chunk, older ones are linked through prev */
+	size_t chunk_size;
+	struct arena_stats stats;
+};
+
+/* Position to roll back to, for temporary allocations */
+struct arena_mark {
+	struct arena_chunk *chunk;
+	size_t used;
+};
+
+struct arena *arena_create(size_t chunk_size);
+void arena_destroy(struct arena *a);
+void *arena_alloc(struct arena *a, size_t size);
+char *arena_strdup(struct arena *a, const char *str);
+char *arena_printf(struct arena *a, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void arena_reset(struct arena *a);
+void arena_mark(struct arena *a, struct arena_mark *mark);
+void arena_rewind(struct arena *a, const struct arena_mark *mark);
+
+#endif
@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <osmocom/gsm/gsm48_ie.h>
+
+#include "arfcn_set.h"
+
+/* Bits selected by mask of the libosmocore layout */
+static void arfcn_set_from_freq(struct arfcn_set *set, const struct gsm_sysinfo_freq *freq, uint8_t mask)
+{
+	unsigned i;
+
+	arfcn_set_clear(set);
+
+	for (i = 0; i < ARFCN_MAX; i++) {
+		if (freq[i].mask & mask) {
+			arfcn_set_add(set, i);
+		}
+	}
+}
+
+int arfcn_set_decode(struct arfcn_set *set, const uint8_t *data, uint8_t len)
+{
+	struct gsm_sysinfo_freq freq[ARFCN_MAX];
+	int ret;
+
+	memset(freq, 0, sizeof(freq));
+	ret = gsm48_decode_freq_list(freq, (uint8_t *) data, len, 0xff, 0x01);
+	arfcn_set_from_freq(set, freq, 0x01);
+
+	return ret;
+}
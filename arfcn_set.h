@@ -0,0 +1,97 @@
+#ifndef ARFCN_SET_H
+#define ARFCN_SET_H
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Set of GSM ARFCNs (0..1023), one bit each. Used instead of the
+ * libosmocore per-ARFCN mask arrays, which are only needed when decoding
+ * frequency lists.
+ */
+
+#define ARFCN_MAX 1024
+#define ARFCN_SET_WORDS (ARFCN_MAX / 64)
+
+/* Packed, sets are embedded in packed structs */
+struct arfcn_set {
+	uint64_t w[ARFCN_SET_WORDS];
+} __attribute__((packed));
+
+static inline void arfcn_set_clear(struct arfcn_set *set)
+{
+	memset(set, 0, sizeof(*set));
+}
+
+static inline void arfcn_set_add(struct arfcn_set *set, unsigned arfcn)
+{
+	set->w[(arfcn % ARFCN_MAX) / 64] |= 1ULL << (arfcn % 64);
+}
+
+static inline int arfcn_set_test(const struct arfcn_set *set, unsigned arfcn)
+{
+	return !!(set->w[(arfcn % ARFCN_MAX) / 64] & (1ULL << (arfcn % 64)));
+}
+
+static inline unsigned arfcn_set_count(const struct arfcn_set *set)
+{
+	unsigned i, count = 0;
+
+	for (i = 0; i < ARFCN_SET_WORDS; i++) {
+		count += __builtin_popcountll(set->w[i]);
+	}
+
+	return count;
+}
+
+static inline int arfcn_set_empty(const struct arfcn_set *set)
+{
+	unsigned i;
+
+	for (i = 0; i < ARFCN_SET_WORDS; i++) {
+		if (set->w[i]) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* dst = a & ~b, ARFCNs of a missing in b */
+static inline void arfcn_set_andnot(struct arfcn_set *dst, const struct arfcn_set *a, const struct arfcn_set *b)
+{
+	unsigned i;
+
+	for (i = 0; i < ARFCN_SET_WORDS; i++) {
+		dst->w[i] = a->w[i] & ~b->w[i];
+	}
+}
+
+/* First ARFCN >= from in the set, -1 if there is none */
+static inline int arfcn_set_next(const struct arfcn_set *set, unsigned from)
+{
+	unsigned i = from / 64;
+	uint64_t w;
+
+	if (from >= ARFCN_MAX) {
+		return -1;
+	}
+
+	w = set->w[i] & (~0ULL << (from % 64));
+	while (!w) {
+		if (++i == ARFCN_SET_WORDS) {
+			return -1;
+		}
+		w = set->w[i];
+	}
+
+	return i * 64 + __builtin_ctzll(w);
+}
+
+#define arfcn_set_for_each(arfcn, set) \
+	for (arfcn = arfcn_set_next(set, 0); arfcn >= 0; arfcn = arfcn_set_next(set, arfcn + 1))
+
+/* Decode a cell channel description or frequency list IE into set */
+int arfcn_set_decode(struct arfcn_set *set, const uint8_t *data, uint8_t len);
+
+#endif
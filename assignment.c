@@ -6,7 +6,26 @@
 
 #include "assignment.h"
 
-void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_freq *cell_arfcns, struct gsm_assignment *ga)
+/* Hopping ARFCNs are numbered from ARFCN 1 upwards, ARFCN 0 comes last */
+static int ma_next(const struct arfcn_set *set, int arfcn)
+{
+	int next;
+
+	if (arfcn == 0) {
+		return -1;
+	}
+	next = arfcn_set_next(set, arfcn < 0 ? 1 : arfcn + 1);
+	if (next < 0 && arfcn_set_test(set, 0)) {
+		return 0;
+	}
+
+	return next;
+}
+
+#define ma_for_each(arfcn, set) \
+	for (arfcn = ma_next(set, -1); arfcn >= 0; arfcn = ma_next(set, arfcn))
+
+void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct arfcn_set *cell_arfcns, struct gsm_assignment *ga)
 {
 	struct gsm48_ass_cmd *ac;
 	struct gsm48_ho_cmd *hoc;
@@ -17,7 +36,7 @@ void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_fr
 	uint8_t *ma = 0;
 	uint8_t ma_len;
 	uint8_t ch_type, ch_subch, ch_ts;
-	unsigned i, mask;
+	struct arfcn_set *ca = NULL;
 
 	if (!ga)
 		return;
@@ -59,14 +78,13 @@ void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_fr
 
 	ma_len = 0;
 	ma = NULL;
-	mask = 0;
 
 	/* Cell channel description */
 	if (TLVP_PRESENT(&tp, GSM48_IE_CELL_CH_DESC)) {
 		const uint8_t *v = TLVP_VAL(&tp, GSM48_IE_CELL_CH_DESC);
 		uint8_t len = TLVP_LEN(&tp, GSM48_IE_CELL_CH_DESC);
-		gsm48_decode_freq_list(cell_arfcns, (uint8_t *) v, len, 0xff, 0x02);
-		mask = 0x02;
+		arfcn_set_decode(&cell_arfcns[ASSIGN_CELL_CH_DESC], v, len);
+		ca = &cell_arfcns[ASSIGN_CELL_CH_DESC];
 	} else if (TLVP_PRESENT(&tp, GSM48_IE_MA_AFTER)) {
 		/* Mobile allocation */
 		const uint8_t *v = TLVP_VAL(&tp, GSM48_IE_MA_AFTER);
@@ -74,23 +92,20 @@ void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_fr
 
 		ma_len = len;
 		ma = (uint8_t *) v;
-		mask = 0x01;
+		ca = &cell_arfcns[ASSIGN_CELL_ALLOC];
 	} else if (TLVP_PRESENT(&tp, GSM48_IE_FREQ_L_AFTER)) {
 		/* Frequency list after time */
 		const uint8_t *v = TLVP_VAL(&tp, GSM48_IE_FREQ_L_AFTER);
 		uint8_t len = TLVP_LEN(&tp, GSM48_IE_FREQ_L_AFTER);
-		gsm48_decode_freq_list(cell_arfcns, (uint8_t *) v, len, 0xff, 0x04);
+		arfcn_set_decode(&cell_arfcns[ASSIGN_FREQ_LIST], v, len);
 		ma_len = 0;
 		ma = NULL;
-		mask = 0x04;
+		ca = &cell_arfcns[ASSIGN_FREQ_LIST];
 	} else {
 		/* Use the old one */
-		for (i=0; i<1024; i++) {
-			cell_arfcns[i].mask &= ~0x02;
-			if (cell_arfcns[i].mask & 0x01) {
-				cell_arfcns[i].mask |= 0x02;
-				mask = 0x02;
-			}
+		cell_arfcns[ASSIGN_CELL_CH_DESC] = cell_arfcns[ASSIGN_CELL_ALLOC];
+		if (!arfcn_set_empty(&cell_arfcns[ASSIGN_CELL_CH_DESC])) {
+			ca = &cell_arfcns[ASSIGN_CELL_CH_DESC];
 		}
 	}
 
@@ -121,7 +136,7 @@ void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_fr
 		ga->h0.band_arfcn = arfcn;
 	} else {
 		/* Hopping */
-		uint16_t arfcn;
+		int arfcn;
 		int i, j, k;
 
 		ga->tsc = cd->h1.tsc;
@@ -134,9 +149,13 @@ void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_fr
 			if (ma_len == 0) {
 				return;
 			}
-			for (i=1, j=0; i<=1024; i++) {
-				arfcn = i & 1023;
-				if (cell_arfcns[arfcn].mask & mask) {
+			j = 0;
+			if (ca) {
+				ma_for_each(arfcn, ca) {
+					/* Stay within the MA bitmap and ga->h1.ma */
+					if (j >= ma_len * 8 || ga->h1.ma_len >= 128) {
+						break;
+					}
 					k = ma_len - (j>>3) - 1;
 					if (ma[k] & (1 << (j&7))) {
 						ga->h1.ma[ga->h1.ma_len++] = arfcn;
@@ -156,9 +175,8 @@ void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_fr
 				}
 			}
 		} else {
-			for (i=1; i<=1024; i++) {
-				arfcn = i & 1023;
-				if (cell_arfcns[arfcn].mask & mask) {
+			if (ca) {
+				ma_for_each(arfcn, ca) {
 					if (ga->h1.ma_len < 128) {
 						ga->h1.ma[ga->h1.ma_len++] = arfcn;
 					}
@@ -4,6 +4,17 @@
 #include <stdint.h>
 #include <osmocom/gsm/gsm48_ie.h>
 
+#include "arfcn_set.h"
+
+/* ARFCN sets a hopping mobile allocation may refer to */
+enum assign_source {
+	ASSIGN_CELL_ALLOC,	/* Cell allocation of the serving cell */
+	ASSIGN_CELL_CH_DESC,	/* Cell channel description IE */
+	ASSIGN_FREQ_LIST,	/* Frequency list after time IE */
+
+	ASSIGN_SRC_MAX
+};
+
 struct gsm_assignment {
 	int chan_nr;
 	int tsc;
@@ -24,6 +35,6 @@ struct gsm_assignment {
 	uint16_t bcch_arfcn;
 };
 
-void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct gsm_sysinfo_freq *cell_arfcns, struct gsm_assignment *ga);
+void parse_assignment(struct gsm48_hdr *hdr, unsigned len, struct arfcn_set *cell_arfcns, struct gsm_assignment *ga);
 
 #endif
@@ -6,6 +6,13 @@
 #include <sqlite3.h>
 #endif
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define HEX_NEON
+#endif
+
 #include "bit_func.h"
 
 inline int not_zero(uint8_t *t, unsigned size)
@@ -147,6 +154,138 @@ inline unsigned hex_str2bin(const char *str, uint8_t *vec, unsigned len)
 	return i/2;
 }
 
+static int hex_nibble(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	c |= 0x20;
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+
+	return -1;
+}
+
+#if defined(__SSE2__)
+/* Nibble values of 16 hex digits, 0 if any character is not a digit */
+static inline int hex_nibbles16(const char *str, __m128i *nib)
+{
+	__m128i v = _mm_loadu_si128((const __m128i *) str);
+	__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+				      _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+	__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+				      _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+
+	if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xffff) {
+		return 0;
+	}
+
+	*nib = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+			    _mm_and_si128(alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+
+	return 1;
+}
+
+/* 32 hex digits into 16 bytes, 0 if they are not all digits */
+static inline int hex_block32(const char *str, uint8_t *out)
+{
+	__m128i a, b;
+
+	if (!hex_nibbles16(str, &a) || !hex_nibbles16(str + 16, &b)) {
+		return 0;
+	}
+
+	/* 16 bit lanes hold the high nibble in the low byte */
+	a = _mm_or_si128(_mm_slli_epi16(a, 4), _mm_srli_epi16(a, 8));
+	b = _mm_or_si128(_mm_slli_epi16(b, 4), _mm_srli_epi16(b, 8));
+	a = _mm_and_si128(a, _mm_set1_epi16(0x00ff));
+	b = _mm_and_si128(b, _mm_set1_epi16(0x00ff));
+	_mm_storeu_si128((__m128i *) out, _mm_packus_epi16(a, b));
+
+	return 1;
+}
+#elif defined(HEX_NEON)
+static inline int hex_nibbles16(const char *str, uint8x16_t *nib)
+{
+	uint8x16_t v = vld1q_u8((const uint8_t *) str);
+	uint8x16_t lower = vorrq_u8(v, vdupq_n_u8(0x20));
+	uint8x16_t digit = vandq_u8(vcgeq_u8(v, vdupq_n_u8('0')), vcleq_u8(v, vdupq_n_u8('9')));
+	uint8x16_t alpha = vandq_u8(vcgeq_u8(lower, vdupq_n_u8('a')), vcleq_u8(lower, vdupq_n_u8('f')));
+	uint64x2_t valid = vreinterpretq_u64_u8(vorrq_u8(digit, alpha));
+
+	if ((vgetq_lane_u64(valid, 0) & vgetq_lane_u64(valid, 1)) != ~0ULL) {
+		return 0;
+	}
+
+	*nib = vorrq_u8(vandq_u8(digit, vsubq_u8(v, vdupq_n_u8('0'))),
+			vandq_u8(alpha, vsubq_u8(lower, vdupq_n_u8('a' - 10))));
+
+	return 1;
+}
+
+static inline int hex_block32(const char *str, uint8_t *out)
+{
+	uint8x16_t a, b;
+	uint8x16x2_t nib;
+
+	if (!hex_nibbles16(str, &a) || !hex_nibbles16(str + 16, &b)) {
+		return 0;
+	}
+
+	/* Even digits are the high nibbles */
+	nib = vuzpq_u8(a, b);
+	vst1q_u8(out, vorrq_u8(vshlq_n_u8(nib.val[0], 4), nib.val[1]));
+
+	return 1;
+}
+#endif
+
+/*
+ * Like osmo_hexparse(): len hex digits into out, whitespace is skipped.
+ * Returns the number of bytes, -1 for other characters, an odd number of
+ * digits or more than out_len bytes. Runs of 32 digits take the SIMD path.
+ */
+int hex_parse(const char *str, unsigned len, uint8_t *out, unsigned out_len)
+{
+	unsigned i = 0;
+	unsigned n = 0;
+	int hi = -1;
+	int v;
+
+	while (i < len) {
+#if defined(__SSE2__) || defined(HEX_NEON)
+		if (hi < 0 && len - i >= 32 && out_len - n >= 16 && hex_block32(str + i, out + n)) {
+			i += 32;
+			n += 16;
+			continue;
+		}
+#endif
+		if (str[i] == ' ' || str[i] == '\t' || str[i] == '\n' || str[i] == '\r') {
+			i++;
+			continue;
+		}
+
+		v = hex_nibble(str[i++]);
+		if (v < 0) {
+			return -1;
+		}
+
+		if (hi < 0) {
+			hi = v;
+			continue;
+		}
+		if (n == out_len) {
+			return -1;
+		}
+		out[n++] = hi << 4 | v;
+		hi = -1;
+	}
+
+	return hi < 0 ? (int) n : -1;
+}
+
 inline int bcd2str(uint8_t *bcd, char *s, unsigned len, unsigned off)
 {
 	char code[] = {'0', '1', '2', '3', '4', '5', '6', '7',
@@ -284,6 +423,29 @@ char * strescape_or_null(char *str)
 	return escaped;
 }
 
+/* Like strescape_or_null(), the result lives in the arena */
+char * arena_strescape_or_null(struct arena *a, char *str)
+{
+#ifdef USE_SQLITE
+	char *escaped;
+#endif
+
+	if (!str || !str[0]) {
+		return arena_strdup(a, "NULL");
+	}
+
+#ifdef USE_SQLITE
+	escaped = sqlite3_mprintf("%Q", str);
+	str = arena_strdup(a, escaped);
+	sqlite3_free(escaped);
+	return str;
+#else
+	basic_sanitize(str);
+
+	return arena_printf(a, "'%s'", str);
+#endif
+}
+
 char * sgets(char *s, unsigned len, const char **input)
 {
 	const char *next = *input;
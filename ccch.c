@@ -143,7 +143,7 @@ void process_ccch(struct session_info *s, struct burst_buf *bb, struct l1ctl_bur
 		return;
 
 	/* fill new message structure */
-	m = malloc(sizeof(struct radio_message));
+	m = radio_msg_alloc();
 	m->chan_nr = bi->chan_nr;
 
 	if (bi->flags & BI_FLG_SACCH) {
@@ -157,7 +157,7 @@ void process_ccch(struct session_info *s, struct burst_buf *bb, struct l1ctl_bur
 
 	memcpy(&m->bb, bb, sizeof(*bb));
 
-	m->info[0] = 0;
+	msg_info_clear(&m->info);
 
 	s->new_msg = m;
 
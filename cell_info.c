@@ -1,11 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <arpa/inet.h>
 
 #include "session.h"
 #include "cell_info.h"
 #include "bit_func.h"
+#include "perf.h"
+#include "trace.h"
+#include "arfcn_set.h"
 
 #ifdef USE_MYSQL
 #include "mysql_api.h"
@@ -15,13 +19,6 @@
 #include "sqlite_api.h"
 #endif
 
-#define MASK_BCCH	0x01
-#define MASK_NEIGH_2	0x02
-#define MASK_NEIGH_2b	0x04
-#define MASK_NEIGH_2t	0x08
-#define MASK_NEIGH_5	0x10
-#define MASK_NEIGH_5b	0x20
-#define MASK_NEIGH_5t	0x40
 
 #ifndef SQLITE_QUERY
 #define SQLITE_QUERY 0
@@ -43,6 +40,7 @@
 
 static unsigned cell_info_id;
 static struct llist_head cell_list;
+static struct llist_head dirty_list;	/* Cells changed since the last dump */
 static unsigned output_sqlite = 1;
 static uint32_t previous_ts = 0;
 static struct session_info s;
@@ -64,6 +62,15 @@ enum si_index {
 	SI_MAX
 };
 
+/* ARFCN lists, one set per SI source */
+enum arfcn_source {
+	SRC_BCCH = 0,
+	SRC_NEIGH_2, SRC_NEIGH_2b, SRC_NEIGH_2t,
+	SRC_NEIGH_5, SRC_NEIGH_5b, SRC_NEIGH_5t,
+
+	SRC_MAX
+};
+
 const char * si_name[] = {
 	"SI1",
 	"SI2", "SI2b", "SI2t", "SI2q",
@@ -106,17 +113,27 @@ struct cell_info {
 	uint8_t pwr_offset;
 	uint8_t gprs;
 
-	struct gsm_sysinfo_freq arfcn_list[1024];
+	struct arfcn_set arfcns[SRC_MAX];
+	struct arfcn_set arfcns_stored[SRC_MAX];	/* Already written to arfcn_list */
 
 	uint32_t si_counter[SI_MAX];
 	uint8_t si_data[SI_MAX][20];
 	uint16_t a_count[SI_MAX];
 
 	struct llist_head entry;
+	struct llist_head dirty;	/* Linked into dirty_list while has_changed */
 } __attribute__((packed));
 
 void cell_make_sql(struct cell_info *ci, char *query, unsigned len, int sqlite);
-void arfcn_list_make_sql(struct cell_info *ci, enum si_index index, char *query, unsigned len, int sqlite);
+int arfcn_list_make_sql(struct cell_info *ci, enum si_index index, char *query, unsigned len, int sqlite);
+
+static void cell_mark_changed(struct cell_info *ci)
+{
+	ci->has_changed = 1;
+	if (llist_empty(&ci->dirty)) {
+		llist_add_tail(&ci->dirty, &dirty_list);
+	}
+}
 
 void paging_reset()
 {
@@ -133,7 +150,7 @@ void cell_dump(uint32_t timestamp, int forced, int on_destroy)
 	char query[8192];
 	struct cell_info *ci, *ci2;
 	unsigned time_delta;
-	int i;
+	int i, more;
 
 	/* Elapsed time from measurement start */
 	time_delta = timestamp - previous_ts;
@@ -147,33 +164,31 @@ void cell_dump(uint32_t timestamp, int forced, int on_destroy)
 	if (!forced && RATE_LIMIT && (time_delta < DUMP_INTERVAL))
 		return;
 
-	/* Dump cell_info and arfcn_list */
-	llist_for_each_entry_safe(ci, ci2, &cell_list, entry) {
-		/* Check if any update is needed */
-		if (!ci->has_changed) {
-			continue;
-		}
-
-		/* Store only useful cell data */
+	/* Dump cell_info and arfcn_list of changed cells */
+	llist_for_each_entry_safe(ci, ci2, &dirty_list, dirty) {
+		/* Store only useful cell data, incomplete cells stay dirty */
 		if (!ci->mcc || !ci->lac || !ci->cid) {
 			continue;
 		}
 
 		/* Store main cell_info */
 		cell_make_sql(ci, query, sizeof(query), output_sqlite);
-		if (s.sql_callback && strlen(query))
-			(*s.sql_callback)(query);
+		if (s.sql_callback && query[0])
+			PERF_TIME(PERF_SQL_CALLBACK, (*s.sql_callback)(query));
 
-		/* Append queries for ARFCN storage */
+		/* Append queries for ARFCN storage, split if the buffer is full */
 		for (i = 0; i < SI_MAX; i++) {
-			arfcn_list_make_sql(ci, i, query, sizeof(query), output_sqlite);
-			if (s.sql_callback && strlen(query)) {
-				(*s.sql_callback)(query);
-			}
+			do {
+				more = arfcn_list_make_sql(ci, i, query, sizeof(query), output_sqlite);
+				if (s.sql_callback && query[0]) {
+					PERF_TIME(PERF_SQL_CALLBACK, (*s.sql_callback)(query));
+				}
+			} while (more);
 		}
 
 		ci->stored = 1;
 		ci->has_changed = 0;
+		llist_del_init(&ci->dirty);
 		//llist_del(&ci->entry);
                 /*
                  * FIXME: Elements should be deallocated on deletion. However,
@@ -189,22 +204,38 @@ void cell_dump(uint32_t timestamp, int forced, int on_destroy)
 			llist_del(&ci->entry);
 			free(ci);
 		}
+		INIT_LLIST_HEAD(&dirty_list);
 	}
 
 	previous_ts = timestamp;
 }
 
+/* Forget all cells without storing them */
+void cell_reset()
+{
+	struct cell_info *ci, *ci2;
+
+	llist_for_each_entry_safe(ci, ci2, &cell_list, entry) {
+		llist_del(&ci->entry);
+		free(ci);
+	}
+	INIT_LLIST_HEAD(&dirty_list);
+
+	paging_reset();
+}
+
 static void console_callback(const char *sql)
 {
 	assert(sql != NULL);
 
 	printf("SQL: %s\n", sql);
-	fflush(stdout);
+	TRACE1(TRACE_DEBUG, TRACE_SQL, strlen(sql));
 }
 
 void cell_init(unsigned start_id, uint32_t unix_time, int callback)
 {
 	INIT_LLIST_HEAD(&cell_list);
+	INIT_LLIST_HEAD(&dirty_list);
 
 	paging_reset();
 
@@ -246,6 +277,12 @@ void cell_destroy(unsigned *last_cid)
 	*last_cid = cell_info_id;
 }
 
+/* ID the next new cell will get */
+unsigned cell_next_id()
+{
+	return cell_info_id;
+}
+
 uint16_t get_mcc(uint8_t *digits)
 {
 	uint16_t mcc;
@@ -306,28 +343,28 @@ int si_index(uint8_t msg_type)
 	return -1;
 }
 
-uint8_t si_mask(enum si_index index)
+int si_source(enum si_index index)
 {
 	switch (index) {
 	case SI1:
-		return MASK_BCCH;
+		return SRC_BCCH;
 	case SI2:
-		return MASK_NEIGH_2;
+		return SRC_NEIGH_2;
 	case SI2b:
-		return MASK_NEIGH_2b;
+		return SRC_NEIGH_2b;
 	case SI2t:
-		return MASK_NEIGH_2t;
+		return SRC_NEIGH_2t;
 	case SI5:
-		return MASK_NEIGH_5;
+		return SRC_NEIGH_5;
 	case SI5b:
-		return MASK_NEIGH_5b;
+		return SRC_NEIGH_5b;
 	case SI5t:
-		return MASK_NEIGH_5t;
+		return SRC_NEIGH_5t;
 	default:
-		return 0;
+		return -1;
 	}
 
-	return 0;
+	return -1;
 }
 
 int single_arfcn(struct radio_message *m)
@@ -403,6 +440,7 @@ void set_bsic(uint32_t tv_sec, uint16_t arfcn, uint8_t bsic)
 		if (ci->bsic < 0) {
 //			printf("Setting BSIC %d for ARFCN %d\n", bsic, arfcn);
 			ci->bsic = bsic;
+			cell_mark_changed(ci);
 		}
 	}
 }
@@ -454,31 +492,22 @@ struct cell_info * get_from_cid(struct session_info *s)
 
 uint16_t arfcn_count(struct cell_info *ci, enum si_index index)
 {
-	int i;
-	uint16_t count = 0;
-	uint8_t mask;
+	int src;
 
 	assert(ci != 0);
 	assert(index >= 0);
 	assert(index < SI_MAX);
 
-	mask = si_mask(index);
-
-	if (!mask) {
-		return count;
+	src = si_source(index);
+	if (src < 0) {
+		return 0;
 	}
 
 	if (ci->si_counter[index] == 0) {
-		return count;
-	}
-
-	for (i=0; i<1024; i++) {
-		if (ci->arfcn_list[i].mask & mask) {
-			count++;
-		}
+		return 0;
 	}
 
-	return count;
+	return arfcn_set_count(&ci->arfcns[src]);
 }
 
 /* code imported from Osmocom-BB sysinfo.c */
@@ -674,6 +703,7 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 		}
 		ci = (struct cell_info *) malloc(sizeof(struct cell_info));
 		memset(ci, 0, sizeof(*ci));
+		INIT_LLIST_HEAD(&ci->dirty);
 		ci->bsic = -1;
 		ci->bcch_arfcn = single_arfcn(s->new_msg);
 	}
@@ -683,32 +713,28 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 		if (!parse)
 			break;
 		si1 = (struct gsm48_system_information_type_1 *) ((uint8_t *)dtap - 1);
-		gsm48_decode_freq_list(	ci->arfcn_list, si1->cell_channel_description,
-					sizeof(si1->cell_channel_description), 0xff, MASK_BCCH);
+		arfcn_set_decode(&ci->arfcns[SRC_BCCH], si1->cell_channel_description, sizeof(si1->cell_channel_description));
 		break;
 
 	case GSM48_MT_RR_SYSINFO_2:
 		if (!parse)
 			break;
 		si2 = (struct gsm48_system_information_type_2 *) ((uint8_t *)dtap - 1);
-		gsm48_decode_freq_list(	ci->arfcn_list, si2->bcch_frequency_list,
-					sizeof(si2->bcch_frequency_list), 0xff, MASK_NEIGH_2);
+		arfcn_set_decode(&ci->arfcns[SRC_NEIGH_2], si2->bcch_frequency_list, sizeof(si2->bcch_frequency_list));
 		break;
 
 	case GSM48_MT_RR_SYSINFO_2bis:
 		if (!parse)
 			break;
 		si2b = (struct gsm48_system_information_type_2bis *) ((uint8_t *)dtap - 1);
-		gsm48_decode_freq_list(	ci->arfcn_list, si2b->bcch_frequency_list,
-					sizeof(si2b->bcch_frequency_list), 0xff, MASK_NEIGH_2b);
+		arfcn_set_decode(&ci->arfcns[SRC_NEIGH_2b], si2b->bcch_frequency_list, sizeof(si2b->bcch_frequency_list));
 		break;
 
 	case GSM48_MT_RR_SYSINFO_2ter:
 		if (!parse)
 			break;
 		si2t = (struct gsm48_system_information_type_2ter *) ((uint8_t *)dtap - 1);
-		gsm48_decode_freq_list(	ci->arfcn_list, si2t->ext_bcch_frequency_list,
-					sizeof(si2t->ext_bcch_frequency_list), 0xff, MASK_NEIGH_2t);
+		arfcn_set_decode(&ci->arfcns[SRC_NEIGH_2t], si2t->ext_bcch_frequency_list, sizeof(si2t->ext_bcch_frequency_list));
 		break;
 
 	case GSM48_MT_RR_SYSINFO_2quater:
@@ -766,8 +792,7 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 			s->arfcn = ci->bcch_arfcn;
 		}
 		si5 = (struct gsm48_system_information_type_5 *) dtap;
-		gsm48_decode_freq_list(	ci->arfcn_list, si5->bcch_frequency_list,
-					sizeof(si5->bcch_frequency_list), 0xff, MASK_NEIGH_5);
+		arfcn_set_decode(&ci->arfcns[SRC_NEIGH_5], si5->bcch_frequency_list, sizeof(si5->bcch_frequency_list));
 		break;
 
 	case GSM48_MT_RR_SYSINFO_5bis:
@@ -783,8 +808,7 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 			s->arfcn = ci->bcch_arfcn;
 		}
 		si5b = (struct gsm48_system_information_type_5bis *) dtap;
-		gsm48_decode_freq_list(	ci->arfcn_list, si5b->bcch_frequency_list,
-					sizeof(si5b->bcch_frequency_list), 0xff, MASK_NEIGH_5b);
+		arfcn_set_decode(&ci->arfcns[SRC_NEIGH_5b], si5b->bcch_frequency_list, sizeof(si5b->bcch_frequency_list));
 		break;
 
 	case GSM48_MT_RR_SYSINFO_5ter:
@@ -800,8 +824,7 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 			s->arfcn = ci->bcch_arfcn;
 		}
 		si5t = (struct gsm48_system_information_type_5ter *) dtap;
-		gsm48_decode_freq_list(	ci->arfcn_list, si5t->bcch_frequency_list,
-					sizeof(si5t->bcch_frequency_list), 0xff, MASK_NEIGH_5t);
+		arfcn_set_decode(&ci->arfcns[SRC_NEIGH_5t], si5t->bcch_frequency_list, sizeof(si5t->bcch_frequency_list));
 		break;
 
 	case GSM48_MT_RR_SYSINFO_6:
@@ -836,7 +859,7 @@ void handle_sysinfo(struct session_info *s, struct gsm48_hdr *dtap, unsigned len
 	}
 
 	/* Fill or update structure fields */
-	ci->has_changed = 1;
+	cell_mark_changed(ci);
 	ci->last_seen = s->new_msg->timestamp;
 	if (!ci->bcch_arfcn) {
 		ci->bcch_arfcn = single_arfcn(s->new_msg);
@@ -946,11 +969,15 @@ void handle_paging3()
 	paging_inc(0, GSM_MI_TYPE_TMSI);
 }
 
-void arfcn_list_make_sql(struct cell_info *ci, enum si_index index, char *query, unsigned len, int sqlite)
+/*
+ * Only ARFCNs not yet written for this SI are included. Returns 1 if the
+ * query buffer filled up and another call is needed for the rest.
+ */
+int arfcn_list_make_sql(struct cell_info *ci, enum si_index index, char *query, unsigned len, int sqlite)
 {
-	unsigned offset;
-	uint8_t mask;
-	int i;
+	struct arfcn_set pending;
+	unsigned offset, start;
+	int src, arfcn, ret;
 
 	assert(ci != NULL);
 	assert(query != NULL);
@@ -958,37 +985,55 @@ void arfcn_list_make_sql(struct cell_info *ci, enum si_index index, char *query,
 	assert(index < SI_MAX);
 
 	if (!len) {
-		return;
+		return 0;
 	}
 
 	query[0] = 0;
 
 	/* Sanity checks */
-	mask = si_mask(index);
-	if (!mask) {
-		return;
+	src = si_source(index);
+	if (src < 0) {
+		return 0;
 	}
 	if (ci->si_counter[index] == 0) {
-		return;
+		return 0;
 	}
 	if (ci->a_count[index] == 0) {
-		return;
+		return 0;
+	}
+
+	arfcn_set_andnot(&pending, &ci->arfcns[src], &ci->arfcns_stored[src]);
+	if (arfcn_set_empty(&pending)) {
+		return 0;
 	}
 
-	snprintf(query, len, "INSERT %sIGNORE INTO arfcn_list (id, source, arfcn) VALUES ", sqlite ? "OR " : "");
+	ret = snprintf(query, len, "INSERT %sIGNORE INTO arfcn_list (id, source, arfcn) VALUES ", sqlite ? "OR " : "");
+	if (ret < 0 || (unsigned) ret >= len) {
+		query[0] = 0;
+		return 0;
+	}
+	start = offset = ret;
 
-	for (i = 0; i < 1024; i++) {
-		if (ci->arfcn_list[i].mask & mask) {
-			offset = strlen(query);
-			snprintf(&query[offset], len-offset, "(%d,'%s',%d),", ci->id, si_name[index], i);
+	arfcn_set_for_each(arfcn, &pending) {
+		ret = snprintf(&query[offset], len-offset, "(%d,'%s',%d),", ci->id, si_name[index], arfcn);
+		if (ret < 0 || (unsigned) ret >= len-offset) {
+			/* Keep the complete entries, the rest goes into the next query */
+			query[offset] = 0;
+			break;
 		}
+		offset += ret;
+		arfcn_set_add(&ci->arfcns_stored[src], arfcn);
 	}
 
-	offset = strlen(query);
+	if (offset == start) {
+		query[0] = 0;
+		return 0;
+	}
 
-	assert(offset > 0);
+	/* Replace the trailing comma */
+	query[offset-1] = ';';
 
-	snprintf(&query[offset-1], len-offset+1, ";");
+	return arfcn >= 0;
 }
 
 void cell_make_sql(struct cell_info *ci, char *query, unsigned len, int sqlite)
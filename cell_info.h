@@ -9,6 +9,8 @@ struct session_info;
 
 void cell_init(unsigned start_id, uint32_t unix_time, int callback);
 void cell_destroy();
+void cell_reset();
+unsigned cell_next_id();
 void cell_dump(uint32_t timestamp, int forced, int on_destroy);
 void paging_reset();
 void paging_make_sql(int sid, char *query, unsigned len);
@@ -125,9 +125,7 @@ int explore_session(int id)
 		char *data = row[3];
 		struct radio_message *m;
 
-		m = (struct radio_message *) malloc(sizeof(struct radio_message));
-		if (m == 0)
-			return 0;
+		m = radio_msg_alloc();
 
 		memset(m, 0, sizeof(struct radio_message));
 
@@ -148,7 +146,7 @@ int explore_session(int id)
 		default:
 			printf("unhandled channel %d in session %d\n", channel, id);
 			fflush(stdout);
-			free(m);
+			radio_msg_free(m);
 			continue;
 		}
 		m->msg_len = 23;
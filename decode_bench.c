@@ -0,0 +1,627 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <assert.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/a5.h>
+#include <osmocom/rrc/UL-DCCH-Message.h>
+#include <osmocom/rrc/DL-DCCH-Message.h>
+#include <osmocom/rrc/BCCH-BCH-Message.h>
+
+#include "session.h"
+#include "process.h"
+#include "cch.h"
+#include "crc.h"
+#include "sch.h"
+#include "ccch.h"
+#include "viterbi.h"
+#include "bit_func.h"
+#include "gsm_interleave.h"
+#include "l3_handler.h"
+#include "lte_nas_eps.h"
+#include "lte_nas_eps_mm.h"
+#include "umts_rrc.h"
+#include "sms.h"
+
+#define MAX_RRC_MSGS 4096
+#define BENCH_RUNS 5
+#define BENCH_RUN_NS 50000000.0
+
+/* Not exported through headers */
+void session_make_sql(struct session_info *s, char *query, unsigned q_len, uint8_t sqlite);
+struct cell_info;
+void cell_make_sql(struct cell_info *ci, char *query, unsigned len, int sqlite);
+
+/*
+ * Allocation counting, wraps the glibc allocator. The bench is single
+ * threaded, so plain counters are fine.
+ */
+static int bench_counting = 0;
+static uint64_t bench_allocs = 0;
+static uint64_t bench_alloc_bytes = 0;
+
+#ifdef __GLIBC__
+#define BENCH_HAVE_ALLOCS 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+	if (bench_counting) {
+		bench_allocs++;
+		bench_alloc_bytes += size;
+	}
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (bench_counting) {
+		bench_allocs++;
+		bench_alloc_bytes += nmemb * size;
+	}
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (bench_counting) {
+		bench_allocs++;
+		bench_alloc_bytes += size;
+	}
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+#else
+#define BENCH_HAVE_ALLOCS 0
+#endif
+
+/* SACCH FIRE code, same as cch.c */
+static const uint8_t parity_polynomial[PARITY_SIZE + 1] = {
+	1, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 1, 0,
+	0, 1, 0, 0, 0, 0, 0, 1,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 1, 0, 0,
+	1
+};
+
+static const uint8_t parity_remainder[PARITY_SIZE] = {
+	1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1
+};
+
+/* SDCCH UL I-frame carrying an MM Identity Response (IMSI) */
+static const uint8_t lapdm_frame[23] = {
+	0x01, 0x00, 0x2d, 0x05, 0x59, 0x08, 0x29, 0x26,
+	0x40, 0x11, 0x32, 0x54, 0x76, 0x98, 0x2b, 0x2b,
+	0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b
+};
+
+/* NAS EMM Tracking Area Update Accept with GUTI */
+static const uint8_t nas_tau_accept[] = {
+	0x07, 0x49, 0x00, 0x5a, 0x49, 0x50, 0x0b, 0xf6,
+	0x62, 0xf2, 0x20, 0x80, 0x01, 0x01, 0xc1, 0x23,
+	0x45, 0x67, 0x13, 0x62, 0xf2, 0x20, 0x12, 0x34
+};
+
+/* SMS-DELIVER, 7 bit text "hello" */
+static const uint8_t sms_deliver[] = {
+	0x04, 0x0b, 0x91, 0x94, 0x71, 0x12, 0x34, 0x56,
+	0xf8, 0x00, 0x00, 0x21, 0x10, 0x91, 0x21, 0x43,
+	0x65, 0x80, 0x05, 0xe8, 0x32, 0x9b, 0xfd, 0x06
+};
+
+static const uint8_t a5_key[8] = { 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0 };
+
+struct rrc_msg {
+	uint8_t data[256];
+	int len;
+};
+
+struct rrc_corpus {
+	const char *name;
+	asn_TYPE_descriptor_t *td;
+	struct rrc_msg *msgs;
+	unsigned n_msgs;
+	unsigned next;
+};
+
+static struct rrc_corpus rrc_corpus[] = {
+	{ "bcch", &asn_DEF_BCCH_BCH_Message, NULL, 0, 0 },
+	{ "ul_dcch", &asn_DEF_UL_DCCH_Message, NULL, 0, 0 },
+	{ "dl_dcch", &asn_DEF_DL_DCCH_Message, NULL, 0, 0 },
+};
+
+/* Inputs prepared once by bench_setup() */
+static struct session_info *bs;
+static struct radio_message bench_msg;
+static struct radio_message cipher_msg;
+static uint8_t sig_bits[PARITY_OUTPUT_SIZE];
+static uint8_t sig_bits_err[PARITY_OUTPUT_SIZE];
+static int8_t sig_soft[CONV_SIZE];
+static uint8_t sig_interleaved[CONV_SIZE];
+static uint8_t sch_burst[148];
+static uint64_t cell_buf[8192];	/* zeroed, larger than struct cell_info */
+static char query[16384];
+static char smsc[] = "+491710760000";
+static volatile int sink;
+
+static void bench_setup()
+{
+	uint8_t coded[CONV_SIZE];
+	uint8_t raw[4*114];
+	uint8_t ks[114];
+	uint32_t rnd = 0x1234567;
+	unsigned i, j;
+
+	process_init();
+	session_init(1, 0, NULL, CALLBACK_NONE);
+
+	bs = &_s[0];
+	bs->mcc = 262;
+	bs->mnc = 1;
+	bs->lac = 1000;
+	bs->cid = 4711;
+	bs->new_msg = &bench_msg;
+
+	/* Channel coded LAPDm frame */
+	expand_lsb(lapdm_frame, sig_bits, DATA_BLOCK_SIZE);
+	memset(&sig_bits[DATA_BLOCK_SIZE], 0, CONV_INPUT_SIZE - DATA_BLOCK_SIZE);
+	parity_encode(sig_bits, DATA_BLOCK_SIZE, parity_polynomial, &sig_bits[DATA_BLOCK_SIZE], PARITY_SIZE);
+	conv_cch_encode(sig_bits, coded, PARITY_OUTPUT_SIZE);
+	for (i = 0; i < CONV_SIZE; i++) {
+		sig_soft[i] = coded[i] ? -127 : 127;
+	}
+	gsm_inter_sacch(coded, sig_interleaved);
+
+	/* A single bit error, corrected by the FIRE code */
+	memcpy(sig_bits_err, sig_bits, sizeof(sig_bits_err));
+	sig_bits_err[17] ^= 1;
+
+	/* Fixed pseudo random SCH burst */
+	for (i = 0; i < sizeof(sch_burst); i++) {
+		rnd ^= rnd << 13;
+		rnd ^= rnd >> 17;
+		rnd ^= rnd << 5;
+		sch_burst[i] = rnd & 1;
+	}
+
+	/* A5/1 ciphered uplink SDCCH bursts */
+	encode_signalling(lapdm_frame, raw);
+	memset(&cipher_msg, 0, sizeof(cipher_msg));
+	cipher_msg.rat = RAT_GSM;
+	cipher_msg.flags = MSG_SDCCH | MSG_CIPHERED;
+	for (j = 0; j < 4; j++) {
+		cipher_msg.bb.fn[j] = 1000 + j;
+		cipher_msg.bb.arfcn[j] = 42 | ARFCN_UPLINK;
+		cipher_msg.bb.snr[j] = 255;
+		osmo_a5(1, a5_key, cipher_msg.bb.fn[j], NULL, ks);
+		for (i = 0; i < 114; i++) {
+			cipher_msg.bb.data[j*114 + i] = raw[j*114 + i] ^ ks[i];
+		}
+	}
+	cipher_msg.bb.count = 4;
+	bs->cipher = 1;
+	memcpy(bs->key, a5_key, sizeof(bs->key));
+}
+
+static void op_conv_cch_decode()
+{
+	uint8_t out[PARITY_OUTPUT_SIZE];
+
+	conv_cch_decode(sig_soft, out, CONV_INPUT_SIZE);
+	sink = out[0];
+}
+
+static void op_fc_check_crc()
+{
+	unsigned char out[DATA_BLOCK_SIZE + PARITY_SIZE];
+	FC_CTX ctx;
+
+	FC_init(&ctx, PARITY_SIZE, DATA_BLOCK_SIZE);
+	sink = FC_check_crc(&ctx, sig_bits_err, out);
+}
+
+static void op_parity_check()
+{
+	sink = parity_check(sig_bits, DATA_BLOCK_SIZE, parity_polynomial, parity_remainder, PARITY_SIZE);
+}
+
+static void op_gsm_deinter_sacch()
+{
+	uint8_t out[CONV_SIZE];
+
+	gsm_deinter_sacch(sig_interleaved, out);
+	sink = out[0];
+}
+
+static void op_decode_sch()
+{
+	int t1, t2, t3, ncc, bcc;
+
+	sink = decode_sch(sch_burst, &t1, &t2, &t3, &ncc, &bcc);
+}
+
+static void op_try_decode()
+{
+	struct radio_message *m = &bench_msg;
+
+	memcpy(m, &cipher_msg, sizeof(*m));
+	memset(bs->chan_sdcch, 0, sizeof(bs->chan_sdcch));
+	bs->new_msg = m;
+	sink = try_decode(bs, m);
+}
+
+static void op_handle_lapdm()
+{
+	uint8_t frame[sizeof(lapdm_frame)];
+
+	memcpy(frame, lapdm_frame, sizeof(frame));
+	memset(bs->chan_sdcch, 0, sizeof(bs->chan_sdcch));
+	bs->new_msg = &bench_msg;
+	handle_lapdm(bs, &bs->chan_sdcch[1], frame, sizeof(frame), 1000, 1);
+}
+
+static void op_uper_decode(struct rrc_corpus *rc)
+{
+	struct rrc_msg *rm = &rc->msgs[rc->next];
+	asn_dec_rval_t rv;
+	void *p = NULL;
+
+	rc->next = (rc->next + 1) % rc->n_msgs;
+
+	rrc_arena_enter();
+	rv = uper_decode(NULL, rc->td, &p, rm->data, rm->len, 0, 0);
+	sink = rv.code;
+	rrc_arena_leave();
+}
+
+/* Decoding without the arena, every tree node is freed on its own */
+static void op_uper_decode_heap(struct rrc_corpus *rc)
+{
+	struct rrc_msg *rm = &rc->msgs[rc->next];
+	asn_dec_rval_t rv;
+	void *p = NULL;
+
+	rc->next = (rc->next + 1) % rc->n_msgs;
+
+	rv = uper_decode(NULL, rc->td, &p, rm->data, rm->len, 0, 0);
+	sink = rv.code;
+	ASN_STRUCT_FREE(*rc->td, p);
+}
+
+static void op_uper_bcch()
+{
+	op_uper_decode(&rrc_corpus[0]);
+}
+
+static void op_uper_ul_dcch()
+{
+	op_uper_decode(&rrc_corpus[1]);
+}
+
+static void op_uper_dl_dcch()
+{
+	op_uper_decode(&rrc_corpus[2]);
+}
+
+static void op_uper_heap_bcch()
+{
+	op_uper_decode_heap(&rrc_corpus[0]);
+}
+
+static void op_uper_heap_ul_dcch()
+{
+	op_uper_decode_heap(&rrc_corpus[1]);
+}
+
+static void op_uper_heap_dl_dcch()
+{
+	op_uper_decode_heap(&rrc_corpus[2]);
+}
+
+static void op_parse_naseps_mm_msg()
+{
+	uint8_t raw[sizeof(nas_tau_accept)];
+	naseps_msg_t *msg;
+
+	memcpy(raw, nas_tau_accept, sizeof(raw));
+	msg = parse_naseps_mm_msg(raw, sizeof(raw), 0);
+	if (msg) {
+		cleanup_naseps_msg(msg);
+	}
+}
+
+static void op_handle_tpdu()
+{
+	uint8_t tpdu[sizeof(sms_deliver)];
+
+	memcpy(tpdu, sms_deliver, sizeof(tpdu));
+	msg_info_clear(&bench_msg.info);
+	bs->new_msg = &bench_msg;
+	handle_tpdu(bs, tpdu, sizeof(tpdu), 1, smsc);
+	session_free_sms_list(bs);
+	arena_reset(bs->arena);
+}
+
+static void op_session_make_sql()
+{
+	session_make_sql(bs, query, sizeof(query), 1);
+	sink = query[0];
+}
+
+static void op_cell_make_sql()
+{
+	cell_make_sql((struct cell_info *) cell_buf, query, sizeof(query), 1);
+	sink = query[0];
+}
+
+struct bench_case {
+	const char *name;
+	void (*op)();
+	struct rrc_corpus *corpus;	/* skipped if the corpus is empty */
+};
+
+static struct bench_case cases[] = {
+	{ "conv_cch_decode", op_conv_cch_decode, NULL },
+	{ "FC_check_crc", op_fc_check_crc, NULL },
+	{ "parity_check", op_parity_check, NULL },
+	{ "gsm_deinter_sacch", op_gsm_deinter_sacch, NULL },
+	{ "decode_sch", op_decode_sch, NULL },
+	{ "try_decode_a5_1", op_try_decode, NULL },
+	{ "handle_lapdm", op_handle_lapdm, NULL },
+	{ "uper_decode_bcch", op_uper_bcch, &rrc_corpus[0] },
+	{ "uper_decode_ul_dcch", op_uper_ul_dcch, &rrc_corpus[1] },
+	{ "uper_decode_dl_dcch", op_uper_dl_dcch, &rrc_corpus[2] },
+	{ "uper_heap_bcch", op_uper_heap_bcch, &rrc_corpus[0] },
+	{ "uper_heap_ul_dcch", op_uper_heap_ul_dcch, &rrc_corpus[1] },
+	{ "uper_heap_dl_dcch", op_uper_heap_dl_dcch, &rrc_corpus[2] },
+	{ "parse_naseps_mm_msg", op_parse_naseps_mm_msg, NULL },
+	{ "handle_tpdu", op_handle_tpdu, NULL },
+	{ "session_make_sql", op_session_make_sql, NULL },
+	{ "cell_make_sql", op_cell_make_sql, NULL },
+};
+
+struct bench_result {
+	uint64_t iterations;
+	double ns_per_op;
+	double allocs_per_op;
+	double bytes_per_op;
+};
+
+static double now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double time_op(void (*op)(), uint64_t n)
+{
+	double t;
+	uint64_t i;
+
+	t = now_ns();
+	for (i = 0; i < n; i++) {
+		op();
+	}
+
+	return now_ns() - t;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Calibrate the iteration count, then take the median of BENCH_RUNS runs */
+static void run_case(struct bench_case *bc, double run_ns, struct bench_result *r)
+{
+	double t[BENCH_RUNS];
+	uint64_t n = 1;
+	double dt;
+	int i;
+
+	/* Warm up and scale n until a run takes about run_ns */
+	while ((dt = time_op(bc->op, n)) < run_ns / 4) {
+		n *= 2;
+	}
+	n = n * run_ns / (dt > 0 ? dt : 1);
+	if (!n) {
+		n = 1;
+	}
+
+	bench_allocs = 0;
+	bench_alloc_bytes = 0;
+	bench_counting = 1;
+	for (i = 0; i < BENCH_RUNS; i++) {
+		t[i] = time_op(bc->op, n) / n;
+	}
+	bench_counting = 0;
+
+	qsort(t, BENCH_RUNS, sizeof(double), cmp_double);
+
+	r->iterations = n * BENCH_RUNS;
+	r->ns_per_op = t[BENCH_RUNS/2];
+	r->allocs_per_op = (double) bench_allocs / r->iterations;
+	r->bytes_per_op = (double) bench_alloc_bytes / r->iterations;
+}
+
+/* One "<bcch|ul_dcch|dl_dcch> <hex>" message per line */
+static void load_rrc_corpus(const char *filename)
+{
+	char line[1024];
+	char type[16];
+	char hex[600];
+	struct rrc_corpus *rc;
+	struct rrc_msg *rm;
+	unsigned i;
+	int len;
+	FILE *f;
+
+	f = fopen(filename, "r");
+	if (!f) {
+		perror(filename);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%15s %599s", type, hex) != 2) {
+			continue;
+		}
+		rc = NULL;
+		for (i = 0; i < ARRAY_SIZE(rrc_corpus); i++) {
+			if (!strcmp(type, rrc_corpus[i].name)) {
+				rc = &rrc_corpus[i];
+			}
+		}
+		if (!rc || rc->n_msgs >= MAX_RRC_MSGS) {
+			continue;
+		}
+		if (!rc->msgs) {
+			rc->msgs = (struct rrc_msg *) calloc(MAX_RRC_MSGS, sizeof(struct rrc_msg));
+			assert(rc->msgs != NULL);
+		}
+		rm = &rc->msgs[rc->n_msgs];
+		len = osmo_hexparse(hex, rm->data, sizeof(rm->data));
+		if (len > 0) {
+			rm->len = len;
+			rc->n_msgs++;
+		}
+	}
+
+	fclose(f);
+}
+
+static int selected(const char *name, int argc, char **argv)
+{
+	int i;
+
+	if (!argc) {
+		return 1;
+	}
+	for (i = 0; i < argc; i++) {
+		if (strstr(name, argv[i])) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [-r <rrc_corpus>] [-o <json>] [-t <tag>] [-m <ms>] [filter...]\n", progname);
+	printf("	-r <file>  - RRC messages for uper_decode, \"<bcch|ul_dcch|dl_dcch> <hex>\" per line\n");
+	printf("	-o <file>  - Write results as JSON to <file>\n");
+	printf("	-t <tag>   - Version tag stored in the JSON output\n");
+	printf("	-m <ms>    - Duration of each timed run (default %.0f ms)\n", BENCH_RUN_NS / 1e6);
+	printf("	[filter]   - Only run benchmarks whose name contains [filter]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_result r;
+	const char *json_name = NULL;
+	const char *tag = "";
+	double run_ns = BENCH_RUN_NS;
+	FILE *json = NULL;
+	unsigned i;
+	int first = 1;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "r:o:t:m:h")) != -1) {
+		switch (ch) {
+		case 'r':
+			load_rrc_corpus(optarg);
+			break;
+		case 'o':
+			json_name = optarg;
+			break;
+		case 't':
+			tag = optarg;
+			break;
+		case 'm':
+			run_ns = atof(optarg) * 1e6;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	msg_verbose = 0;
+	bench_setup();
+
+	if (json_name) {
+		json = fopen(json_name, "w");
+		if (!json) {
+			perror(json_name);
+			return 1;
+		}
+		fprintf(json, "{\n\t\"tag\": \"%s\",\n\t\"timestamp\": %lu,\n\t\"compiler\": \"%s\",\n"
+			"\t\"allocs_counted\": %s,\n\t\"results\": [",
+			tag, (unsigned long) time(NULL), __VERSION__, BENCH_HAVE_ALLOCS ? "true" : "false");
+	}
+
+	printf("%-22s %12s %12s %14s %12s %12s\n", "benchmark", "iterations", "ns/op", "ops/s", "allocs/op", "bytes/op");
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		struct bench_case *bc = &cases[i];
+
+		if (!selected(bc->name, argc, argv)) {
+			continue;
+		}
+		if (bc->corpus && !bc->corpus->n_msgs) {
+			printf("%-22s skipped, no %s messages (-r)\n", bc->name, bc->corpus->name);
+			continue;
+		}
+
+		run_case(bc, run_ns, &r);
+
+		printf("%-22s %12llu %12.1f %14.0f %12.2f %12.1f\n", bc->name,
+			(unsigned long long) r.iterations, r.ns_per_op, 1e9 / r.ns_per_op,
+			r.allocs_per_op, r.bytes_per_op);
+
+		if (json) {
+			fprintf(json, "%s\n\t\t{\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, "
+				"\"ops_per_s\": %.0f, \"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f}",
+				first ? "" : ",", bc->name, (unsigned long long) r.iterations,
+				r.ns_per_op, 1e9 / r.ns_per_op, r.allocs_per_op, r.bytes_per_op);
+			first = 0;
+		}
+	}
+
+	if (json) {
+		fprintf(json, "\n\t]\n}\n");
+		fclose(json);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(rrc_corpus); i++) {
+		free(rrc_corpus[i].msgs);
+	}
+	rrc_arena_destroy();
+
+	return 0;
+}
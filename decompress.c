@@ -0,0 +1,557 @@
+/* fopencookie(), CPU_* */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "decompress.h"
+
+#if defined(USE_ZLIB) || defined(USE_ZSTD) || defined(USE_LZMA)
+#define DECOMPRESS_THREAD
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef USE_LZMA
+#include <lzma.h>
+#endif
+
+enum decompress_format decompress_detect(const uint8_t *data, size_t len)
+{
+	if (len >= 2 && data[0] == 0x1f && data[1] == 0x8b) {
+		return DECOMPRESS_GZIP;
+	}
+	if (len >= 4 && !memcmp(data, "\x28\xb5\x2f\xfd", 4)) {
+		return DECOMPRESS_ZSTD;
+	}
+	if (len >= 6 && !memcmp(data, "\xfd" "7zXZ\x00", 6)) {
+		return DECOMPRESS_XZ;
+	}
+
+	return DECOMPRESS_NONE;
+}
+
+#ifdef DECOMPRESS_THREAD
+
+/* Output ring, the parser reads while the thread fills the next slots */
+#define DECOMPRESS_SLOTS 8
+#define DECOMPRESS_SLOT_SIZE (1024 * 1024)
+#define DECOMPRESS_IN_SIZE (256 * 1024)
+#define DECOMPRESS_STDIO_BUF (64 * 1024)
+
+struct decompress;
+
+/*
+ * One decoder call, advances in and out. Returns 1 at the end of a
+ * compressed stream, -1 on corrupt data.
+ */
+typedef int (*decode_fn)(struct decompress *d, const uint8_t **in, size_t *in_len,
+			uint8_t **out, size_t *out_len);
+
+struct decompress_slot {
+	uint8_t *data;
+	size_t len;
+};
+
+struct decompress {
+	int fd;
+	decode_fn decode;
+	void (*end)(struct decompress *d);
+	union {
+#ifdef USE_ZLIB
+		z_stream z;
+#endif
+#ifdef USE_ZSTD
+		ZSTD_DStream *zstd;
+#endif
+#ifdef USE_LZMA
+		lzma_stream xz;
+#endif
+	} codec;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct decompress_slot slot[DECOMPRESS_SLOTS];
+	unsigned head;		/* Slots filled by the thread */
+	unsigned tail;		/* Slots consumed by the reader */
+	size_t offset;		/* Read position in the tail slot */
+	int done;		/* No more slots will be filled */
+	int error;		/* errno reported after the last byte */
+	int stop;		/* Reader closed the stream */
+
+	uint8_t in[DECOMPRESS_IN_SIZE];
+};
+
+#ifdef USE_ZLIB
+static int decode_gzip(struct decompress *d, const uint8_t **in, size_t *in_len,
+			uint8_t **out, size_t *out_len)
+{
+	z_stream *z = &d->codec.z;
+	int ret;
+
+	z->next_in = (Bytef *) *in;
+	z->avail_in = *in_len;
+	z->next_out = *out;
+	z->avail_out = *out_len;
+
+	ret = inflate(z, Z_NO_FLUSH);
+
+	*in = z->next_in;
+	*in_len = z->avail_in;
+	*out = z->next_out;
+	*out_len = z->avail_out;
+
+	/* Concatenated members, as written by pigz or appending gzip */
+	if (ret == Z_STREAM_END) {
+		inflateReset(z);
+		return 1;
+	}
+
+	return (ret == Z_OK || ret == Z_BUF_ERROR) ? 0 : -1;
+}
+
+static void end_gzip(struct decompress *d)
+{
+	inflateEnd(&d->codec.z);
+}
+#endif
+
+#ifdef USE_ZSTD
+static int decode_zstd(struct decompress *d, const uint8_t **in, size_t *in_len,
+			uint8_t **out, size_t *out_len)
+{
+	ZSTD_inBuffer ib = { *in, *in_len, 0 };
+	ZSTD_outBuffer ob = { *out, *out_len, 0 };
+	size_t ret;
+
+	ret = ZSTD_decompressStream(d->codec.zstd, &ob, &ib);
+
+	*in += ib.pos;
+	*in_len -= ib.pos;
+	*out += ob.pos;
+	*out_len -= ob.pos;
+
+	if (ZSTD_isError(ret)) {
+		return -1;
+	}
+
+	/* 0 means a frame is complete and flushed */
+	return ret == 0;
+}
+
+static void end_zstd(struct decompress *d)
+{
+	ZSTD_freeDStream(d->codec.zstd);
+}
+#endif
+
+#ifdef USE_LZMA
+static int decode_xz(struct decompress *d, const uint8_t **in, size_t *in_len,
+			uint8_t **out, size_t *out_len)
+{
+	lzma_stream *s = &d->codec.xz;
+	lzma_ret ret;
+
+	s->next_in = *in;
+	s->avail_in = *in_len;
+	s->next_out = *out;
+	s->avail_out = *out_len;
+
+	ret = lzma_code(s, LZMA_RUN);
+
+	*in = s->next_in;
+	*in_len = s->avail_in;
+	*out = s->next_out;
+	*out_len = s->avail_out;
+
+	/* Concatenated streams get a new decoder */
+	if (ret == LZMA_STREAM_END) {
+		lzma_end(s);
+		memset(s, 0, sizeof(*s));
+		if (lzma_stream_decoder(s, UINT64_MAX, 0) != LZMA_OK) {
+			return -1;
+		}
+		return 1;
+	}
+
+	return (ret == LZMA_OK || ret == LZMA_BUF_ERROR) ? 0 : -1;
+}
+
+static void end_xz(struct decompress *d)
+{
+	lzma_end(&d->codec.xz);
+}
+#endif
+
+static int decompress_codec_init(struct decompress *d, enum decompress_format format)
+{
+	switch (format) {
+#ifdef USE_ZLIB
+	case DECOMPRESS_GZIP:
+		/* Window size from the gzip header */
+		if (inflateInit2(&d->codec.z, 15 + 32) != Z_OK) {
+			return -1;
+		}
+		d->decode = decode_gzip;
+		d->end = end_gzip;
+		return 0;
+#endif
+#ifdef USE_ZSTD
+	case DECOMPRESS_ZSTD:
+		d->codec.zstd = ZSTD_createDStream();
+		if (!d->codec.zstd) {
+			return -1;
+		}
+		ZSTD_initDStream(d->codec.zstd);
+		d->decode = decode_zstd;
+		d->end = end_zstd;
+		return 0;
+#endif
+#ifdef USE_LZMA
+	case DECOMPRESS_XZ:
+		if (lzma_stream_decoder(&d->codec.xz, UINT64_MAX, 0) != LZMA_OK) {
+			return -1;
+		}
+		d->decode = decode_xz;
+		d->end = end_xz;
+		return 0;
+#endif
+	default:
+		return -1;
+	}
+}
+
+/* Next empty slot, NULL once the reader is gone */
+static uint8_t *slot_get(struct decompress *d)
+{
+	uint8_t *data;
+
+	pthread_mutex_lock(&d->mutex);
+	while (d->head - d->tail == DECOMPRESS_SLOTS && !d->stop) {
+		pthread_cond_wait(&d->cond, &d->mutex);
+	}
+	data = d->stop ? NULL : d->slot[d->head % DECOMPRESS_SLOTS].data;
+	pthread_mutex_unlock(&d->mutex);
+
+	return data;
+}
+
+static void slot_put(struct decompress *d, size_t len)
+{
+	if (!len) {
+		return;
+	}
+
+	pthread_mutex_lock(&d->mutex);
+	d->slot[d->head % DECOMPRESS_SLOTS].len = len;
+	d->head++;
+	pthread_cond_broadcast(&d->cond);
+	pthread_mutex_unlock(&d->mutex);
+}
+
+static void *decompress_thread(void *arg)
+{
+	struct decompress *d = (struct decompress *) arg;
+	const uint8_t *in = NULL;
+	size_t in_len = 0;
+	uint8_t *out;
+	size_t out_len = DECOMPRESS_SLOT_SIZE;
+	size_t in_before, out_before;
+	int complete = 1;
+	int pending = 0;
+	int error = 0;
+	ssize_t n;
+	int ret;
+
+	out = slot_get(d);
+
+	while (out) {
+		/* Decoders may hold output back when a slot runs full */
+		if (!in_len && !pending) {
+			n = read(d->fd, d->in, sizeof(d->in));
+			if (n < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				error = errno;
+				break;
+			}
+			if (n == 0) {
+				/* Input ends inside a compressed stream */
+				if (!complete) {
+					error = EIO;
+				}
+				break;
+			}
+			in = d->in;
+			in_len = n;
+		}
+
+		in_before = in_len;
+		out_before = out_len;
+
+		ret = d->decode(d, &in, &in_len, &out, &out_len);
+		if (ret < 0) {
+			error = EIO;
+			break;
+		}
+
+		if (ret == 1) {
+			complete = 1;
+		} else if (in_len != in_before || out_len != out_before) {
+			complete = 0;
+		}
+		pending = (out_len == 0);
+
+		if (!out_len) {
+			slot_put(d, DECOMPRESS_SLOT_SIZE);
+			out = slot_get(d);
+			out_len = DECOMPRESS_SLOT_SIZE;
+		}
+	}
+
+	if (out) {
+		slot_put(d, DECOMPRESS_SLOT_SIZE - out_len);
+	}
+
+	pthread_mutex_lock(&d->mutex);
+	d->done = 1;
+	d->error = error;
+	pthread_cond_broadcast(&d->cond);
+	pthread_mutex_unlock(&d->mutex);
+
+	return NULL;
+}
+
+/* Blocks only until some data is there, like read() on a pipe */
+static ssize_t decompress_read(void *cookie, char *buf, size_t size)
+{
+	struct decompress *d = (struct decompress *) cookie;
+	struct decompress_slot *s;
+	size_t done = 0;
+	size_t n;
+
+	pthread_mutex_lock(&d->mutex);
+
+	while (done < size) {
+		while (d->head == d->tail && !d->done && !done) {
+			pthread_cond_wait(&d->cond, &d->mutex);
+		}
+		if (d->head == d->tail) {
+			break;
+		}
+
+		/* The thread does not touch filled slots */
+		s = &d->slot[d->tail % DECOMPRESS_SLOTS];
+		n = s->len - d->offset;
+		if (n > size - done) {
+			n = size - done;
+		}
+		pthread_mutex_unlock(&d->mutex);
+		memcpy(buf + done, s->data + d->offset, n);
+		pthread_mutex_lock(&d->mutex);
+
+		done += n;
+		d->offset += n;
+		if (d->offset == s->len) {
+			d->offset = 0;
+			d->tail++;
+			pthread_cond_broadcast(&d->cond);
+		}
+	}
+
+	if (!done && d->error) {
+		errno = d->error;
+		pthread_mutex_unlock(&d->mutex);
+		return -1;
+	}
+
+	pthread_mutex_unlock(&d->mutex);
+
+	return done;
+}
+
+static void decompress_free(struct decompress *d)
+{
+	unsigned i;
+
+	for (i = 0; i < DECOMPRESS_SLOTS; i++) {
+		free(d->slot[i].data);
+	}
+	pthread_cond_destroy(&d->cond);
+	pthread_mutex_destroy(&d->mutex);
+	close(d->fd);
+	free(d);
+}
+
+static int decompress_close(void *cookie)
+{
+	struct decompress *d = (struct decompress *) cookie;
+
+	pthread_mutex_lock(&d->mutex);
+	d->stop = 1;
+	pthread_cond_broadcast(&d->cond);
+	pthread_mutex_unlock(&d->mutex);
+
+	pthread_join(d->thread, NULL);
+	d->end(d);
+	decompress_free(d);
+
+	return 0;
+}
+
+/* Keep the decoder off the CPU the parser is running on */
+static void decompress_set_affinity(pthread_t thread)
+{
+	cpu_set_t set;
+	int cpu = sched_getcpu();
+
+	if (cpu < 0 || sched_getaffinity(0, sizeof(set), &set) < 0) {
+		return;
+	}
+	if (CPU_COUNT(&set) < 2 || !CPU_ISSET(cpu, &set)) {
+		return;
+	}
+
+	CPU_CLR(cpu, &set);
+	pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+static FILE *decompress_stream(int fd, enum decompress_format format)
+{
+	cookie_io_functions_t io = {
+		.read = decompress_read,
+		.write = NULL,
+		.seek = NULL,
+		.close = decompress_close,
+	};
+	struct decompress *d;
+	unsigned i;
+	FILE *f;
+
+	d = (struct decompress *) calloc(1, sizeof(struct decompress));
+	if (!d) {
+		close(fd);
+		return NULL;
+	}
+	d->fd = fd;
+	pthread_mutex_init(&d->mutex, NULL);
+	pthread_cond_init(&d->cond, NULL);
+
+	for (i = 0; i < DECOMPRESS_SLOTS; i++) {
+		d->slot[i].data = (uint8_t *) malloc(DECOMPRESS_SLOT_SIZE);
+		if (!d->slot[i].data) {
+			decompress_free(d);
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	if (decompress_codec_init(d, format) < 0) {
+		decompress_free(d);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	if (pthread_create(&d->thread, NULL, decompress_thread, d) != 0) {
+		d->end(d);
+		decompress_free(d);
+		errno = EAGAIN;
+		return NULL;
+	}
+	decompress_set_affinity(d->thread);
+
+	f = fopencookie(d, "rb", io);
+	if (!f) {
+		decompress_close(d);
+		return NULL;
+	}
+	setvbuf(f, NULL, _IOFBF, DECOMPRESS_STDIO_BUF);
+
+	return f;
+}
+
+#endif
+
+static int decompress_supported(enum decompress_format format)
+{
+	switch (format) {
+	case DECOMPRESS_NONE:
+		return 1;
+#ifdef USE_ZLIB
+	case DECOMPRESS_GZIP:
+		return 1;
+#endif
+#ifdef USE_ZSTD
+	case DECOMPRESS_ZSTD:
+		return 1;
+#endif
+#ifdef USE_LZMA
+	case DECOMPRESS_XZ:
+		return 1;
+#endif
+	default:
+		return 0;
+	}
+}
+
+FILE *decompress_open(const char *filename)
+{
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	return decompress_fdopen(fd);
+}
+
+FILE *decompress_fdopen(int fd)
+{
+	enum decompress_format format;
+	uint8_t magic[6];
+	FILE *f;
+	ssize_t n;
+
+	n = pread(fd, magic, sizeof(magic), 0);
+	format = decompress_detect(magic, n > 0 ? n : 0);
+
+	if (!decompress_supported(format)) {
+		close(fd);
+		errno = EPROTONOSUPPORT;
+		return NULL;
+	}
+
+#ifdef DECOMPRESS_THREAD
+	if (format != DECOMPRESS_NONE) {
+		return decompress_stream(fd, format);
+	}
+#endif
+
+	f = fdopen(fd, "rb");
+	if (!f) {
+		close(fd);
+	}
+
+	return f;
+}
+
+size_t decompress_memory()
+{
+#ifdef DECOMPRESS_THREAD
+	return DECOMPRESS_SLOTS * DECOMPRESS_SLOT_SIZE + DECOMPRESS_IN_SIZE + DECOMPRESS_STDIO_BUF;
+#else
+	return 0;
+#endif
+}
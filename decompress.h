@@ -0,0 +1,36 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Transparent input decompression. Compressed files are recognized by
+ * their magic number and decoded by a helper thread into a ring of large
+ * buffers, readers get a FILE with the plain byte stream.
+ */
+
+enum decompress_format {
+	DECOMPRESS_NONE,
+	DECOMPRESS_GZIP,
+	DECOMPRESS_ZSTD,
+	DECOMPRESS_XZ,
+};
+
+/* Format of a file starting with data, at least 6 bytes are needed */
+enum decompress_format decompress_detect(const uint8_t *data, size_t len);
+
+/*
+ * Like fopen(filename, "rb"). Returns NULL with errno set to
+ * EPROTONOSUPPORT for compressed files if the format was not built in.
+ */
+FILE *decompress_open(const char *filename);
+
+/* Same for an open file, fd is owned by the stream or closed on errors */
+FILE *decompress_fdopen(int fd);
+
+/* Buffers held by an open compressed stream */
+size_t decompress_memory();
+
+#endif
@@ -0,0 +1,1270 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+#include <osmocom/core/utils.h>
+
+#include "diag_input.h"
+#include "diag_structs.h"
+
+/*
+ * Synthetic DIAG stream generator. Emits HDLC framed log records as read
+ * by process_file(), with made up subscribers going through typical
+ * GSM/UMTS/LTE procedures.
+ */
+
+#define OUT_BUF_SIZE (4*1024*1024)
+#define MAX_TEMPLATES 1024
+#define MAX_RECORD 512
+#define N_CELLS 64
+
+/* Seconds between UNIX and GPS epoch, DIAG timestamps count 1.25 ms ticks */
+#define GPS_EPOCH 315964800ULL
+#define TICKS_PER_SEC 800
+
+#define L2_PAD 0x2b
+
+enum scenario {
+	SC_LU,
+	SC_MOC,
+	SC_MTC,
+	SC_SMS,
+	SC_ATTACH,
+	SC_TAU,
+	SC_MAX
+};
+
+static const char *scenario_names[SC_MAX] = { "lu", "moc", "mtc", "sms", "attach", "tau" };
+static unsigned scenario_weight[SC_MAX] = { 30, 15, 15, 10, 15, 15 };
+
+/* RRC payloads, taken from the template file or random filler */
+enum rrc_kind {
+	RRC_UMTS_UL_DCCH,
+	RRC_UMTS_DL_CCCH,
+	RRC_UMTS_DL_DCCH,
+	RRC_UMTS_BCCH,
+	RRC_LTE_UL_CCCH,
+	RRC_LTE_DL_CCCH,
+	RRC_LTE_UL_DCCH,
+	RRC_LTE_DL_DCCH,
+	RRC_LTE_BCCH,
+	RRC_MAX
+};
+
+static const struct {
+	const char *name;
+	uint8_t filler_len;
+} rrc_kinds[RRC_MAX] = {
+	{ "umts_ul_dcch", 24 },
+	{ "umts_dl_ccch", 40 },
+	{ "umts_dl_dcch", 32 },
+	{ "umts_bcch", 30 },
+	{ "lte_ul_ccch", 6 },
+	{ "lte_dl_ccch", 24 },
+	{ "lte_ul_dcch", 20 },
+	{ "lte_dl_dcch", 40 },
+	{ "lte_bcch", 28 },
+};
+
+struct template {
+	uint8_t len;
+	uint8_t data[255];
+};
+
+static struct template *templates[RRC_MAX];
+static unsigned n_templates[RRC_MAX];
+
+struct gen_cell {
+	uint16_t mcc;
+	uint16_t mnc;
+	uint16_t lac;
+	uint16_t cid;
+	uint16_t arfcn;
+	uint8_t bsic;
+};
+
+static struct gen_cell cells[N_CELLS];
+
+/* Subscriber of the current session */
+struct sub {
+	uint8_t imsi[15];
+	uint32_t tmsi;
+	uint32_t m_tmsi;
+	uint8_t msisdn[11];
+	struct gen_cell *cell;
+	uint8_t umts;
+};
+
+static FILE *out;
+static uint8_t *out_buf;
+static unsigned out_used = 0;
+static uint64_t out_bytes = 0;
+static uint64_t out_records = 0;
+static uint64_t rnd_state = 1;
+static uint64_t ticks;
+static unsigned umts_percent = 30;
+static unsigned meas_per_msg = 1;
+
+/* Slicing-by-8 tables */
+static uint16_t crc_table[8][256];
+
+static uint64_t rnd()
+{
+	/* xorshift64* */
+	rnd_state ^= rnd_state >> 12;
+	rnd_state ^= rnd_state << 25;
+	rnd_state ^= rnd_state >> 27;
+
+	return rnd_state * 0x2545f4914f6cdd1dULL;
+}
+
+static unsigned rnd_range(unsigned n)
+{
+	return (rnd() >> 32) % n;
+}
+
+static void rnd_bytes(uint8_t *p, unsigned n)
+{
+	uint64_t r = 0;
+	unsigned i;
+
+	for (i = 0; i < n; i++) {
+		if (!(i & 7)) {
+			r = rnd();
+		}
+		p[i] = r;
+		r >>= 8;
+	}
+}
+
+/* CRC-16/X.25 as used by the DIAG HDLC framing */
+static void crc_init()
+{
+	unsigned i, j;
+	uint16_t c;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++) {
+			c = (c & 1) ? (c >> 1) ^ 0x8408 : c >> 1;
+		}
+		crc_table[0][i] = c;
+	}
+	for (i = 0; i < 256; i++) {
+		for (j = 1; j < 8; j++) {
+			c = crc_table[j - 1][i];
+			crc_table[j][i] = (c >> 8) ^ crc_table[0][c & 0xff];
+		}
+	}
+}
+
+static uint16_t crc16(const uint8_t *p, unsigned len)
+{
+	uint16_t crc = 0xffff;
+
+	for (; len >= 8; len -= 8, p += 8) {
+		crc ^= p[0] | p[1] << 8;
+		crc = crc_table[7][crc & 0xff] ^ crc_table[6][crc >> 8] ^
+			crc_table[5][p[2]] ^ crc_table[4][p[3]] ^
+			crc_table[3][p[4]] ^ crc_table[2][p[5]] ^
+			crc_table[1][p[6]] ^ crc_table[0][p[7]];
+	}
+	for (; len; len--, p++) {
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ *p) & 0xff];
+	}
+
+	return crc ^ 0xffff;
+}
+
+static void out_flush()
+{
+	if (out_used && fwrite(out_buf, out_used, 1, out) != 1) {
+		err(1, "write");
+	}
+	out_used = 0;
+}
+
+/* Non-zero if any byte of x equals b */
+static inline uint64_t has_byte(uint64_t x, uint8_t b)
+{
+	x ^= 0x0101010101010101ULL * b;
+
+	return (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+}
+
+/* HDLC escape a record, append the CRC and the closing flag */
+static void out_frame(uint8_t *frame, unsigned len)
+{
+	uint16_t crc;
+	uint8_t *p;
+	uint8_t b;
+	unsigned i;
+
+	if (out_used + 2*len + 8 > OUT_BUF_SIZE) {
+		out_flush();
+	}
+
+	/* The frame buffer has room for the CRC */
+	crc = crc16(frame, len);
+	frame[len++] = crc & 0xff;
+	frame[len++] = crc >> 8;
+
+	p = &out_buf[out_used];
+	for (i = 0; i < len; i++) {
+		/* Copy 8 bytes at once if none needs escaping */
+		if (!(i & 7) && i + 8 <= len) {
+			uint64_t w;
+
+			memcpy(&w, &frame[i], 8);
+			if (!(has_byte(w, 0x7d) | has_byte(w, 0x7e))) {
+				memcpy(p, &w, 8);
+				p += 8;
+				i += 7;
+				continue;
+			}
+		}
+		b = frame[i];
+		if ((uint8_t) (b - 0x7d) < 2) {
+			*p++ = 0x7d;
+			*p++ = b ^ 0x20;
+		} else {
+			*p++ = b;
+		}
+	}
+	*p++ = 0x7e;
+
+	out_bytes += p - &out_buf[out_used];
+	out_used = p - out_buf;
+	out_records++;
+}
+
+/* Log record with msg_type, msg_subtype, data_len and data */
+static void emit(uint16_t protocol, uint8_t type, uint8_t subtype, uint8_t data_len, const uint8_t *data, unsigned n)
+{
+	uint8_t frame[MAX_RECORD];
+	struct diag_packet *dp = (struct diag_packet *) frame;
+
+	if (sizeof(*dp) + n + 2 > sizeof(frame)) {
+		return;
+	}
+
+	dp->msg_class = 0x0010;
+	dp->len = n + 15;
+	dp->inner_len = n + 15;
+	dp->msg_protocol = protocol;
+	dp->timestamp = ticks;
+	dp->msg_type = type;
+	dp->msg_subtype = subtype;
+	dp->data_len = data_len;
+	memcpy(dp->data, data, n);
+
+	out_frame(frame, sizeof(*dp) + n);
+
+	/* 10 - 200 ms between records */
+	ticks += 8 + rnd_range(152);
+}
+
+/* Log record whose body starts at msg_type (L1 measurements) */
+static void emit_raw(uint16_t protocol, const void *body, unsigned n)
+{
+	uint8_t frame[MAX_RECORD];
+	struct diag_packet *dp = (struct diag_packet *) frame;
+
+	dp->msg_class = 0x0010;
+	dp->len = n + 12;
+	dp->inner_len = n + 12;
+	dp->msg_protocol = protocol;
+	dp->timestamp = ticks;
+	memcpy(&dp->msg_type, body, n);
+
+	out_frame(frame, 16 + n);
+}
+
+static uint16_t arfcn_and_band(uint16_t arfcn)
+{
+	/* Band 8/9 (GSM 900/1800) is what the parser looks at */
+	return (arfcn < 512 ? 8 : 9) << 12 | (arfcn & 0x0fff);
+}
+
+/* 0x506C and 0x5071 for the serving cell and a few neighbours */
+static void emit_measurements(struct sub *su)
+{
+	uint8_t buf[1 + 6*sizeof(struct surrounding_cell)];
+	struct gsm_l1_burst_metrics bm;
+	struct gsm_l1_surround_cell_ba_list *ba = (struct gsm_l1_surround_cell_ba_list *) buf;
+	struct gen_cell *c;
+	unsigned i, n;
+
+	memset(&bm, 0, sizeof(bm));
+	bm.channel = 1;
+	for (i = 0; i < 4; i++) {
+		bm.metrics[i].frame_number = (ticks / 4 + i) % 2715648;
+		bm.metrics[i].arfcn_and_band = arfcn_and_band(su->cell->arfcn);
+		bm.metrics[i].rssi = 20000 + rnd_range(50000);
+		bm.metrics[i].rx_power = -(int16_t) (50 + rnd_range(60));
+		bm.metrics[i].snr_estimate = rnd_range(40000);
+		bm.metrics[i].gain_state = rnd_range(4);
+	}
+	emit_raw(0x506C, &bm, sizeof(bm));
+
+	n = 1 + rnd_range(6);
+	memset(buf, 0, sizeof(buf));
+	ba->cell_count = n;
+	for (i = 0; i < n; i++) {
+		c = &cells[rnd_range(N_CELLS)];
+		ba->surr_cells[i].bcch_arfcn_and_band = arfcn_and_band(c->arfcn);
+		ba->surr_cells[i].rx_power = -(int16_t) (60 + rnd_range(50));
+		ba->surr_cells[i].bsic_known = 1;
+		ba->surr_cells[i].bsic_this.ncc = c->bsic >> 3;
+		ba->surr_cells[i].bsic_this.bcc = c->bsic & 7;
+		ba->surr_cells[i].frame_number_offset = rnd_range(51*26);
+		ba->surr_cells[i].time_offset = rnd_range(5000);
+	}
+	emit_raw(0x5071, buf, 1 + n*sizeof(struct surrounding_cell));
+}
+
+/*
+ * GSM records
+ */
+
+static void gsm_rr(struct sub *su, uint8_t ul, const uint8_t *msg, unsigned n)
+{
+	unsigned i;
+
+	emit(0x512f, ul ? 0x00 : 0x80, 0, n, msg, n);
+
+	for (i = 0; i < meas_per_msg; i++) {
+		emit_measurements(su);
+	}
+}
+
+/* BCCH/CCCH blocks are padded to 23 octets */
+static void gsm_l2(uint8_t type, const uint8_t *msg, unsigned n)
+{
+	uint8_t block[23];
+
+	memset(block, L2_PAD, sizeof(block));
+	memcpy(block, msg, n < sizeof(block) ? n : sizeof(block));
+
+	emit(0x512f, type, 0, sizeof(block), block, sizeof(block));
+}
+
+static void dtap(uint8_t ul, const uint8_t *msg, unsigned n)
+{
+	uint8_t data[258];
+
+	data[0] = 0;
+	data[1] = 0;
+	memcpy(&data[2], msg, n);
+
+	emit(0x713a, ul, n, n + 2, data, n + 2);
+}
+
+/*
+ * RRC records
+ */
+
+static const struct template *rrc_payload(enum rrc_kind kind, struct template *filler)
+{
+	if (n_templates[kind]) {
+		return &templates[kind][rnd_range(n_templates[kind])];
+	}
+
+	filler->len = rrc_kinds[kind].filler_len;
+	rnd_bytes(filler->data, filler->len);
+
+	return filler;
+}
+
+static void umts_rrc(enum rrc_kind kind)
+{
+	static const uint8_t msg_type[RRC_MAX] = {
+		[RRC_UMTS_UL_DCCH] = 1,
+		[RRC_UMTS_DL_CCCH] = 2,
+		[RRC_UMTS_DL_DCCH] = 3,
+		[RRC_UMTS_BCCH] = 4,
+	};
+	struct template filler;
+	const struct template *t = rrc_payload(kind, &filler);
+	uint8_t data[256];
+
+	data[0] = 0;
+	memcpy(&data[1], t->data, t->len);
+
+	emit(0x412f, msg_type[kind], 0, t->len, data, t->len + 1);
+}
+
+static void lte_rrc(struct sub *su, enum rrc_kind kind)
+{
+	/* Qualcomm channel types, see handle_4G() */
+	static const uint8_t chan[RRC_MAX] = {
+		[RRC_LTE_BCCH] = 2,
+		[RRC_LTE_DL_CCCH] = 5,
+		[RRC_LTE_DL_DCCH] = 6,
+		[RRC_LTE_UL_CCCH] = 7,
+		[RRC_LTE_UL_DCCH] = 8,
+	};
+	struct template filler;
+	const struct template *t = rrc_payload(kind, &filler);
+	uint16_t earfcn = 1300 + su->cell->arfcn;
+	uint8_t data[256 + 10];
+
+	memset(data, 0, 10);
+	data[0] = (kind == RRC_LTE_UL_CCCH || kind == RRC_LTE_UL_DCCH);
+	data[3] = earfcn & 0xff;
+	data[4] = earfcn >> 8;
+	data[7] = chan[kind];
+	data[8] = t->len;
+	data[9] = 0;
+	memcpy(&data[10], t->data, t->len);
+
+	emit(0xb0c0, 0, 0, 0, data, t->len + 10);
+}
+
+/* NAS EMM, protected messages go to 0xb0ea/0xb0eb */
+static void lte_nas(uint8_t ul, uint8_t protected, const uint8_t *msg, unsigned n)
+{
+	uint8_t data[256];
+	uint16_t protocol;
+
+	if (protected) {
+		protocol = ul ? 0xb0eb : 0xb0ea;
+	} else {
+		protocol = ul ? 0xb0ed : 0xb0ec;
+	}
+
+	data[0] = 0;
+	memcpy(&data[1], msg, n);
+
+	emit(protocol, 0, 0, n, data, n + 1);
+}
+
+/*
+ * Information elements
+ */
+
+static unsigned put_lai(uint8_t *p, struct gen_cell *c)
+{
+	p[0] = ((c->mcc / 10) % 10) << 4 | (c->mcc / 100);
+	p[1] = 0xf0 | (c->mcc % 10);
+	p[2] = (c->mnc % 10) << 4 | ((c->mnc / 10) % 10);
+	p[3] = c->lac >> 8;
+	p[4] = c->lac & 0xff;
+
+	return 5;
+}
+
+/* Mobile identity (LV), IMSI */
+static unsigned put_mi_imsi(uint8_t *p, struct sub *su)
+{
+	unsigned i;
+
+	p[0] = 8;
+	p[1] = su->imsi[0] << 4 | 0x09;
+	for (i = 1; i < 15; i += 2) {
+		p[2 + i/2] = su->imsi[i + 1] << 4 | su->imsi[i];
+	}
+
+	return 9;
+}
+
+/* Mobile identity (LV), TMSI */
+static unsigned put_mi_tmsi(uint8_t *p, uint32_t tmsi)
+{
+	p[0] = 5;
+	p[1] = 0xf4;
+	p[2] = tmsi >> 24;
+	p[3] = tmsi >> 16;
+	p[4] = tmsi >> 8;
+	p[5] = tmsi;
+
+	return 6;
+}
+
+static unsigned put_mi(uint8_t *p, struct sub *su)
+{
+	if (su->tmsi && rnd_range(4)) {
+		return put_mi_tmsi(p, su->tmsi);
+	}
+	return put_mi_imsi(p, su);
+}
+
+/* Semi-octet digits, odd numbers padded with 0xf */
+static unsigned put_bcd(uint8_t *p, const uint8_t *digits, unsigned n)
+{
+	unsigned i;
+
+	for (i = 0; i < n; i += 2) {
+		p[i/2] = (i + 1 < n ? digits[i + 1] : 0xf) << 4 | digits[i];
+	}
+
+	return (n + 1) / 2;
+}
+
+/* International number (LV) */
+static unsigned put_number(uint8_t *p, const uint8_t *digits, unsigned n)
+{
+	p[1] = 0x91;
+	p[0] = 1 + put_bcd(&p[2], digits, n);
+
+	return 1 + p[0];
+}
+
+static unsigned put_guti(uint8_t *p, struct sub *su)
+{
+	struct gen_cell *c = su->cell;
+
+	p[0] = 11;
+	p[1] = 0xf6;
+	p[2] = ((c->mcc / 10) % 10) << 4 | (c->mcc / 100);
+	p[3] = 0xf0 | (c->mcc % 10);
+	p[4] = (c->mnc % 10) << 4 | ((c->mnc / 10) % 10);
+	p[5] = 0x80;
+	p[6] = 0x01;
+	p[7] = 0x01;
+	p[8] = su->m_tmsi >> 24;
+	p[9] = su->m_tmsi >> 16;
+	p[10] = su->m_tmsi >> 8;
+	p[11] = su->m_tmsi;
+
+	return 12;
+}
+
+/*
+ * Procedures
+ */
+
+static void rr_sysinfo(struct gen_cell *c)
+{
+	uint8_t si3[23] = { 0x49, 0x06, 0x1b };
+	unsigned n = 3;
+
+	si3[n++] = c->cid >> 8;
+	si3[n++] = c->cid & 0xff;
+	n += put_lai(&si3[n], c);
+	/* Control channel description, cell options, selection parameters, RACH control */
+	memcpy(&si3[n], "\x49\x03\x07\x25\x64\x00\x00\x05\x00", 9);
+
+	gsm_l2(0x81, si3, n + 9);
+}
+
+static void rr_immediate_assignment(struct sub *su)
+{
+	uint8_t ia[23] = { 0x2d, 0x06, 0x3f, 0x03, 0x20, 0xe3 };
+
+	if (su->umts) {
+		umts_rrc(RRC_UMTS_DL_CCCH);
+		return;
+	}
+
+	ia[6] = su->cell->arfcn & 0xff;
+	ia[7] = rnd();
+	ia[8] = rnd();
+	ia[9] = rnd();
+	ia[10] = 0x00;
+	ia[11] = 0x00;
+	gsm_l2(0x83, ia, 12);
+}
+
+static void rr_paging(struct sub *su)
+{
+	uint8_t pag[23] = { 0x15, 0x06, 0x21, 0x00 };
+	unsigned n = 4;
+
+	if (su->umts) {
+		/* PCCH is not logged through 0x412f */
+		return;
+	}
+
+	n += put_mi(&pag[n], su);
+	gsm_l2(0x83, pag, n);
+}
+
+static void rr_cipher_mode(struct sub *su)
+{
+	static const uint8_t cmc[] = { 0x06, 0x35, 0x00 };
+	static const uint8_t cmc_complete[] = { 0x06, 0x32 };
+	uint8_t msg[3];
+
+	if (su->umts) {
+		umts_rrc(RRC_UMTS_DL_DCCH);
+		umts_rrc(RRC_UMTS_UL_DCCH);
+		return;
+	}
+
+	memcpy(msg, cmc, sizeof(msg));
+	/* A5/1 or A5/3 */
+	msg[2] = rnd_range(2) ? 0x01 : 0x05;
+	gsm_rr(su, 0, msg, sizeof(msg));
+	gsm_rr(su, 1, cmc_complete, sizeof(cmc_complete));
+}
+
+static void rr_release(struct sub *su)
+{
+	static const uint8_t release[] = { 0x06, 0x0d, 0x00 };
+
+	if (su->umts) {
+		umts_rrc(RRC_UMTS_DL_DCCH);
+		umts_rrc(RRC_UMTS_UL_DCCH);
+		return;
+	}
+
+	gsm_rr(su, 0, release, sizeof(release));
+}
+
+static void mm_auth(struct sub *su)
+{
+	uint8_t req[19] = { 0x05, 0x12, 0x00 };
+	uint8_t resp[6] = { 0x05, 0x14 };
+
+	rnd_bytes(&req[3], 16);
+	dtap(0, req, sizeof(req));
+
+	rnd_bytes(&resp[2], 4);
+	dtap(1, resp, sizeof(resp));
+}
+
+/* Authentication and ciphering, most networks skip authentication sometimes */
+static void mm_security(struct sub *su)
+{
+	if (rnd_range(4)) {
+		mm_auth(su);
+	}
+	rr_cipher_mode(su);
+}
+
+static void mm_paging_response(struct sub *su)
+{
+	uint8_t resp[32] = { 0x06, 0x27, 0x00, 0x03, 0x33, 0x19, 0xa2 };
+	unsigned n = 7;
+
+	n += put_mi(&resp[n], su);
+
+	if (su->umts) {
+		dtap(1, resp, n);
+	} else {
+		gsm_rr(su, 1, resp, n);
+	}
+}
+
+static void mm_cm_service_request(struct sub *su, uint8_t type)
+{
+	uint8_t req[32] = { 0x05, 0x24 };
+	unsigned n = 3;
+
+	req[2] = type;
+	memcpy(&req[n], "\x03\x33\x19\xa2", 4);
+	n += 4;
+	n += put_mi(&req[n], su);
+
+	dtap(1, req, n);
+}
+
+static void sc_location_update(struct sub *su)
+{
+	uint8_t req[32] = { 0x05, 0x08, 0x72 };
+	uint8_t acc[32] = { 0x05, 0x02 };
+	static const uint8_t realloc_complete[] = { 0x05, 0x5b };
+	unsigned n;
+
+	rr_immediate_assignment(su);
+
+	n = 3;
+	n += put_lai(&req[n], su->cell);
+	req[n++] = 0x33;
+	n += put_mi(&req[n], su);
+	dtap(1, req, n);
+
+	mm_security(su);
+
+	su->tmsi = rnd();
+	n = 2;
+	n += put_lai(&acc[n], su->cell);
+	acc[n++] = 0x17;
+	n += put_mi_tmsi(&acc[n], su->tmsi);
+	dtap(0, acc, n);
+	dtap(1, realloc_complete, sizeof(realloc_complete));
+
+	rr_release(su);
+}
+
+static void cc_clearing(uint8_t mo)
+{
+	static const uint8_t disconnect[] = { 0x03, 0x25, 0x02, 0xe0, 0x90 };
+	static const uint8_t release[] = { 0x83, 0x2d };
+	static const uint8_t release_complete[] = { 0x03, 0x2a };
+	uint8_t msg[8];
+
+	/* The TI flag is set in messages of the side that did not originate */
+	memcpy(msg, disconnect, sizeof(disconnect));
+	if (!mo) {
+		msg[0] ^= 0x80;
+	}
+	dtap(mo, msg, sizeof(disconnect));
+
+	memcpy(msg, release, sizeof(release));
+	if (!mo) {
+		msg[0] ^= 0x80;
+	}
+	dtap(!mo, msg, sizeof(release));
+
+	memcpy(msg, release_complete, sizeof(release_complete));
+	if (!mo) {
+		msg[0] ^= 0x80;
+	}
+	dtap(mo, msg, sizeof(release_complete));
+}
+
+static void sc_mo_call(struct sub *su)
+{
+	static const uint8_t proceeding[] = { 0x83, 0x02 };
+	static const uint8_t alerting[] = { 0x83, 0x01 };
+	static const uint8_t connect[] = { 0x83, 0x07 };
+	static const uint8_t connect_ack[] = { 0x03, 0x0f };
+	uint8_t setup[32] = { 0x03, 0x05, 0x04, 0x01, 0xa0, 0x5e };
+	uint8_t called[11];
+	unsigned i, n;
+
+	rr_immediate_assignment(su);
+	mm_cm_service_request(su, 0x01);
+	mm_security(su);
+
+	for (i = 0; i < sizeof(called); i++) {
+		called[i] = rnd_range(10);
+	}
+	n = 6;
+	n += put_number(&setup[n], called, sizeof(called));
+	dtap(1, setup, n);
+
+	dtap(0, proceeding, sizeof(proceeding));
+	dtap(0, alerting, sizeof(alerting));
+	dtap(0, connect, sizeof(connect));
+	dtap(1, connect_ack, sizeof(connect_ack));
+
+	cc_clearing(1);
+	rr_release(su);
+}
+
+static void sc_mt_call(struct sub *su)
+{
+	static const uint8_t confirmed[] = { 0x83, 0x08 };
+	static const uint8_t alerting[] = { 0x83, 0x01 };
+	static const uint8_t connect[] = { 0x83, 0x07 };
+	static const uint8_t connect_ack[] = { 0x03, 0x0f };
+	uint8_t setup[32] = { 0x03, 0x05, 0x04, 0x01, 0xa0, 0x5c };
+	uint8_t calling[11];
+	unsigned i, n;
+
+	rr_paging(su);
+	rr_immediate_assignment(su);
+	mm_paging_response(su);
+	mm_security(su);
+
+	for (i = 0; i < sizeof(calling); i++) {
+		calling[i] = rnd_range(10);
+	}
+	n = 6;
+	n += put_number(&setup[n], calling, sizeof(calling));
+	dtap(0, setup, n);
+
+	dtap(1, confirmed, sizeof(confirmed));
+	dtap(1, alerting, sizeof(alerting));
+	dtap(1, connect, sizeof(connect));
+	dtap(0, connect_ack, sizeof(connect_ack));
+
+	cc_clearing(0);
+	rr_release(su);
+}
+
+static void sc_mt_sms(struct sub *su)
+{
+	static const uint8_t smsc[] = { 4, 9, 1, 7, 1, 0, 7, 6, 0, 0, 0, 0 };
+	static const uint8_t cp_ack_ul[] = { 0x89, 0x04 };
+	static const uint8_t cp_ack_dl[] = { 0x09, 0x04 };
+	uint8_t cp[200] = { 0x09, 0x01 };
+	uint8_t rp_ack[] = { 0x89, 0x01, 0x02, 0x02, 0x00 };
+	uint8_t ref = rnd();
+	unsigned n, tpdu_len, ud_len;
+
+	rr_paging(su);
+	rr_immediate_assignment(su);
+	mm_paging_response(su);
+	mm_security(su);
+
+	/* CP-DATA with RP-DATA, RP-OA is the SMSC, RP-DA is empty */
+	n = 3;
+	cp[n++] = 0x01;
+	cp[n++] = ref;
+	n += put_number(&cp[n], smsc, sizeof(smsc));
+	cp[n++] = 0;
+
+	/* SMS-DELIVER, GSM 7 bit alphabet */
+	tpdu_len = n++;
+	cp[n++] = 0x04;
+	cp[n++] = sizeof(su->msisdn);
+	cp[n++] = 0x91;
+	n += put_bcd(&cp[n], su->msisdn, sizeof(su->msisdn));
+	cp[n++] = 0x00;
+	cp[n++] = 0x00;
+	memcpy(&cp[n], "\x41\x10\x91\x21\x43\x65\x80", 7);
+	n += 7;
+	ud_len = 10 + rnd_range(100);
+	cp[n++] = ud_len * 8 / 7;
+	rnd_bytes(&cp[n], ud_len);
+	n += ud_len;
+	cp[tpdu_len] = n - tpdu_len - 1;
+	cp[2] = n - 3;
+	dtap(0, cp, n);
+
+	dtap(1, cp_ack_ul, sizeof(cp_ack_ul));
+	rp_ack[4] = ref;
+	dtap(1, rp_ack, sizeof(rp_ack));
+	dtap(0, cp_ack_dl, sizeof(cp_ack_dl));
+
+	rr_release(su);
+}
+
+static void emm_connection(struct sub *su)
+{
+	lte_rrc(su, RRC_LTE_UL_CCCH);
+	lte_rrc(su, RRC_LTE_DL_CCCH);
+	lte_rrc(su, RRC_LTE_UL_DCCH);
+}
+
+static void emm_security(struct sub *su)
+{
+	uint8_t auth_req[36] = { 0x07, 0x52, 0x00 };
+	uint8_t auth_resp[11] = { 0x07, 0x53, 0x08 };
+	uint8_t smc[13] = { 0x37, 0, 0, 0, 0, 0x00, 0x07, 0x5d, 0x02, 0x00, 0x02, 0xe0, 0xe0 };
+	uint8_t smc_complete[9] = { 0x47 };
+
+	rnd_bytes(&auth_req[3], 16);
+	auth_req[19] = 16;
+	rnd_bytes(&auth_req[20], 16);
+	lte_nas(0, 0, auth_req, sizeof(auth_req));
+
+	rnd_bytes(&auth_resp[3], 8);
+	lte_nas(1, 0, auth_resp, sizeof(auth_resp));
+
+	/* EIA2 with EEA0 or EEA2 */
+	rnd_bytes(&smc[1], 4);
+	smc[8] = rnd_range(2) ? 0x22 : 0x02;
+	lte_nas(0, 1, smc, sizeof(smc));
+
+	rnd_bytes(&smc_complete[1], 8);
+	smc_complete[5] = 0;
+	lte_nas(1, 1, smc_complete, sizeof(smc_complete));
+
+	lte_rrc(su, RRC_LTE_DL_DCCH);
+}
+
+static void sc_attach(struct sub *su)
+{
+	uint8_t req[64] = { 0x07, 0x41, 0x71 };
+	uint8_t acc[64] = { 0x07, 0x42, 0x01, 0x21 };
+	static const uint8_t complete[] = { 0x07, 0x43, 0x00, 0x03, 0x52, 0x00, 0xc2 };
+	static const uint8_t esm_req[] = { 0x02, 0x01, 0xd0, 0x11 };
+	static const uint8_t esm_act[] = {
+		0x52, 0x01, 0xc1, 0x01, 0x09, 0x09, 0x08, 0x69, 0x6e, 0x74,
+		0x65, 0x72, 0x6e, 0x65, 0x74, 0x05, 0x01, 0x0a, 0x0a, 0x0a, 0x0a
+	};
+	uint8_t id_req[] = { 0x07, 0x55, 0x01 };
+	uint8_t id_resp[16] = { 0x07, 0x56 };
+	unsigned n;
+
+	emm_connection(su);
+
+	n = 3;
+	if (su->m_tmsi && rnd_range(2)) {
+		n += put_guti(&req[n], su);
+	} else {
+		n += put_mi_imsi(&req[n], su);
+	}
+	memcpy(&req[n], "\x02\xe0\xe0\x00\x04", 5);
+	n += 5;
+	memcpy(&req[n], esm_req, sizeof(esm_req));
+	n += sizeof(esm_req);
+	lte_nas(1, 0, req, n);
+
+	/* Unknown GUTI */
+	if (rnd_range(4) == 0) {
+		lte_nas(0, 0, id_req, sizeof(id_req));
+		n = 2 + put_mi_imsi(&id_resp[2], su);
+		lte_nas(1, 0, id_resp, n);
+	}
+
+	emm_security(su);
+
+	su->m_tmsi = rnd();
+	n = 4;
+	memcpy(&acc[n], "\x06\x00", 2);
+	n += 2;
+	put_lai(&acc[n], su->cell);
+	n += 5;
+	acc[n++] = 0x00;
+	acc[n++] = sizeof(esm_act);
+	memcpy(&acc[n], esm_act, sizeof(esm_act));
+	n += sizeof(esm_act);
+	acc[n++] = 0x50;
+	n += put_guti(&acc[n], su);
+	lte_nas(0, 0, acc, n);
+
+	lte_nas(1, 0, complete, sizeof(complete));
+	lte_rrc(su, RRC_LTE_DL_DCCH);
+}
+
+static void sc_tau(struct sub *su)
+{
+	uint8_t req[32] = { 0x07, 0x48, 0x00 };
+	uint8_t acc[32] = { 0x07, 0x49, 0x00, 0x5a, 0x49 };
+	static const uint8_t complete[] = { 0x07, 0x4a };
+	unsigned n;
+
+	if (!su->m_tmsi) {
+		su->m_tmsi = rnd();
+	}
+
+	emm_connection(su);
+
+	n = 3;
+	n += put_guti(&req[n], su);
+	lte_nas(1, 0, req, n);
+
+	if (rnd_range(2)) {
+		emm_security(su);
+	}
+
+	su->m_tmsi = rnd();
+	n = 5;
+	acc[n++] = 0x50;
+	n += put_guti(&acc[n], su);
+	lte_nas(0, 0, acc, n);
+	lte_nas(1, 0, complete, sizeof(complete));
+
+	lte_rrc(su, RRC_LTE_DL_DCCH);
+}
+
+static void new_subscriber(struct sub *su)
+{
+	unsigned i;
+
+	memset(su, 0, sizeof(*su));
+
+	/* Home network is the network of the cell */
+	su->cell = &cells[rnd_range(N_CELLS)];
+	su->imsi[0] = su->cell->mcc / 100;
+	su->imsi[1] = (su->cell->mcc / 10) % 10;
+	su->imsi[2] = su->cell->mcc % 10;
+	su->imsi[3] = su->cell->mnc / 10;
+	su->imsi[4] = su->cell->mnc % 10;
+	for (i = 5; i < sizeof(su->imsi); i++) {
+		su->imsi[i] = rnd_range(10);
+	}
+
+	su->msisdn[0] = 4;
+	su->msisdn[1] = 9;
+	for (i = 2; i < sizeof(su->msisdn); i++) {
+		su->msisdn[i] = rnd_range(10);
+	}
+
+	if (rnd_range(2)) {
+		su->tmsi = rnd();
+	}
+	su->umts = rnd_range(100) < umts_percent;
+}
+
+static void init_cells()
+{
+	static const uint16_t plmn[][2] = { { 262, 1 }, { 262, 2 }, { 234, 15 }, { 208, 10 }, { 310, 26 } };
+	unsigned i, p;
+
+	for (i = 0; i < N_CELLS; i++) {
+		p = rnd_range(ARRAY_SIZE(plmn));
+		cells[i].mcc = plmn[p][0];
+		cells[i].mnc = plmn[p][1];
+		cells[i].lac = 1000 + rnd_range(20);
+		cells[i].cid = rnd_range(65535);
+		cells[i].arfcn = rnd_range(2) ? 1 + rnd_range(124) : 512 + rnd_range(374);
+		cells[i].bsic = rnd_range(64);
+	}
+}
+
+static void run_session()
+{
+	struct sub su;
+	unsigned total = 0, r, i;
+
+	new_subscriber(&su);
+
+	for (i = 0; i < SC_MAX; i++) {
+		total += scenario_weight[i];
+	}
+	r = rnd_range(total);
+	for (i = 0; i < SC_MAX - 1 && r >= scenario_weight[i]; i++) {
+		r -= scenario_weight[i];
+	}
+
+	switch (i) {
+	case SC_LU:
+	case SC_MOC:
+	case SC_MTC:
+	case SC_SMS:
+		if (su.umts) {
+			umts_rrc(RRC_UMTS_BCCH);
+		} else {
+			rr_sysinfo(su.cell);
+		}
+		break;
+	default:
+		lte_rrc(&su, RRC_LTE_BCCH);
+		break;
+	}
+
+	switch (i) {
+	case SC_LU:
+		sc_location_update(&su);
+		break;
+	case SC_MOC:
+		sc_mo_call(&su);
+		break;
+	case SC_MTC:
+		sc_mt_call(&su);
+		break;
+	case SC_SMS:
+		sc_mt_sms(&su);
+		break;
+	case SC_ATTACH:
+		sc_attach(&su);
+		break;
+	case SC_TAU:
+		sc_tau(&su);
+		break;
+	}
+
+	/* Idle time between sessions */
+	ticks += rnd_range(10 * TICKS_PER_SEC);
+}
+
+/* One "<kind> <hex>" RRC payload per line */
+static void load_templates(const char *filename)
+{
+	char line[1024];
+	char kind[32];
+	char hex[600];
+	struct template *t;
+	unsigned i, j;
+	FILE *f;
+
+	f = fopen(filename, "r");
+	if (!f) {
+		err(1, "Cannot open template file: %s", filename);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%31s %599s", kind, hex) != 2 || kind[0] == '#') {
+			continue;
+		}
+		for (i = 0; i < RRC_MAX; i++) {
+			if (!strcmp(kind, rrc_kinds[i].name)) {
+				break;
+			}
+		}
+		if (i == RRC_MAX) {
+			errx(1, "Unknown template kind: %s", kind);
+		}
+		if (n_templates[i] >= MAX_TEMPLATES) {
+			continue;
+		}
+		if (!templates[i]) {
+			templates[i] = (struct template *) calloc(MAX_TEMPLATES, sizeof(struct template));
+			if (!templates[i]) {
+				err(1, "calloc");
+			}
+		}
+		t = &templates[i][n_templates[i]];
+		for (j = 0; j < sizeof(t->data) && sscanf(&hex[2*j], "%2hhx", &t->data[j]) == 1; j++);
+		if (j) {
+			t->len = j;
+			n_templates[i]++;
+		}
+	}
+
+	fclose(f);
+}
+
+/* Weights are capped so their sum can't wrap */
+static unsigned mix_value(const char *key, const char *val, unsigned max)
+{
+	char *end;
+	long v;
+
+	v = strtol(val, &end, 10);
+	if (end == val || *end || v < 0 || v > (long) max) {
+		errx(1, "Invalid mix value: %s=%s (0..%u)", key, val, max);
+	}
+
+	return v;
+}
+
+static void parse_mix(char *arg)
+{
+	char *tok, *val;
+	unsigned total = 0;
+	unsigned i;
+
+	for (tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+		val = strchr(tok, '=');
+		if (!val) {
+			errx(1, "Invalid mix: %s", tok);
+		}
+		*val++ = 0;
+
+		if (!strcmp(tok, "umts")) {
+			umts_percent = mix_value(tok, val, 100);
+			continue;
+		}
+		if (!strcmp(tok, "meas")) {
+			meas_per_msg = mix_value(tok, val, 1000);
+			continue;
+		}
+		for (i = 0; i < SC_MAX; i++) {
+			if (!strcmp(tok, scenario_names[i])) {
+				scenario_weight[i] = mix_value(tok, val, 1000000);
+				break;
+			}
+		}
+		if (i == SC_MAX) {
+			errx(1, "Unknown mix entry: %s", tok);
+		}
+	}
+
+	for (i = 0; i < SC_MAX; i++) {
+		total += scenario_weight[i];
+	}
+	if (!total) {
+		errx(1, "Invalid mix: all scenario weights are 0");
+	}
+}
+
+static uint64_t parse_size(const char *arg)
+{
+	char *end;
+	uint64_t v = strtoull(arg, &end, 10);
+
+	switch (*end) {
+	case 'k': case 'K': return v << 10;
+	case 'm': case 'M': return v << 20;
+	case 'g': case 'G': return v << 30;
+	}
+
+	return v;
+}
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [-n <sessions>] [-b <bytes>] [-s <seed>] [-T <time>] [-m <mix>] [-t <templates>] [-o <file>]\n", progname);
+	printf("	-n <sessions>  - Number of sessions (default 1000, 0 = until -b)\n");
+	printf("	-b <bytes>     - Stop after <bytes> of output, k/M/G suffixes allowed\n");
+	printf("	-s <seed>      - Random seed (default 1)\n");
+	printf("	-T <time>      - UNIX time of the first record (default 1400000000)\n");
+	printf("	-m <mix>       - Comma separated key=value list, keys:\n");
+	printf("	                 lu, moc, mtc, sms, attach, tau - scenario weights\n");
+	printf("	                 umts - percentage of CS sessions on 3G (default %u)\n", umts_percent);
+	printf("	                 meas - 0x506C/0x5071 records per GSM RR message (default %u)\n", meas_per_msg);
+	printf("	-t <file>      - RRC payloads, \"<kind> <hex>\" per line, kinds:\n");
+	printf("	                 umts_ul_dcch, umts_dl_ccch, umts_dl_dcch, umts_bcch,\n");
+	printf("	                 lte_ul_ccch, lte_dl_ccch, lte_ul_dcch, lte_dl_dcch, lte_bcch\n");
+	printf("	                 (random filler is used for kinds without templates)\n");
+	printf("	-o <file>      - Output file (default stdout)\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t sessions = 1000;
+	uint64_t max_bytes = 0;
+	uint64_t start = 1400000000;
+	uint64_t i;
+	char *out_name = NULL;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "n:b:s:T:m:t:o:h")) != -1) {
+		switch (ch) {
+		case 'n':
+			sessions = strtoull(optarg, NULL, 10);
+			break;
+		case 'b':
+			max_bytes = parse_size(optarg);
+			break;
+		case 's':
+			rnd_state = strtoull(optarg, NULL, 0);
+			if (!rnd_state) {
+				rnd_state = 1;
+			}
+			break;
+		case 'T':
+			start = strtoull(optarg, NULL, 10);
+			break;
+		case 'm':
+			parse_mix(optarg);
+			break;
+		case 't':
+			load_templates(optarg);
+			break;
+		case 'o':
+			out_name = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!sessions && !max_bytes) {
+		usage(argv[0]);
+	}
+
+	if (out_name && strcmp(out_name, "-")) {
+		out = fopen(out_name, "wb");
+		if (!out) {
+			err(1, "Cannot open output file: %s", out_name);
+		}
+	} else {
+		out = stdout;
+	}
+
+	out_buf = (uint8_t *) malloc(OUT_BUF_SIZE);
+	if (!out_buf) {
+		err(1, "malloc");
+	}
+
+	crc_init();
+	ticks = (start - GPS_EPOCH) * TICKS_PER_SEC;
+	init_cells();
+
+	for (i = 0; !sessions || i < sessions; ) {
+		run_session();
+		i++;
+		if (max_bytes && out_bytes >= max_bytes) {
+			break;
+		}
+	}
+
+	out_flush();
+	if (out != stdout) {
+		fclose(out);
+	} else {
+		fflush(out);
+	}
+
+	fprintf(stderr, "%llu sessions, %llu records, %llu bytes\n",
+		(unsigned long long) i, (unsigned long long) out_records, (unsigned long long) out_bytes);
+
+	for (i = 0; i < RRC_MAX; i++) {
+		free(templates[i]);
+	}
+	free(out_buf);
+
+	return 0;
+}
@@ -2,26 +2,81 @@
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <err.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 
 #include "diag_input.h"
 #include "bit_func.h"
 #include "session.h"
+#include "cell_info.h"
+#include "perf.h"
+#include "failure.h"
+#include "trace.h"
+#include "decompress.h"
+#include "prefetch.h"
+#include "manifest.h"
+#include "diag_index.h"
 #include <stdlib.h>
 
+/* Files read ahead in -f mode and their memory budget */
+#define PREFETCH_DEPTH 4
+#define PREFETCH_BUDGET_MB 256
+
+/* Session and cell IDs of chunk n start n * SPLIT_ID_STRIDE above -s/-c */
+#define SPLIT_ID_STRIDE 1000000
+
 void process_file(char *infile_name);
+static void process_list(FILE *filelist, const char *filelist_name, unsigned depth, size_t budget);
+static void run_daemon(const char *socket_path);
+static int process_split(char *infile_name, unsigned workers, unsigned *chunk_base,
+		long sid, long cid, const char *gsmtap_target, uint32_t appid,
+		unsigned *next_sid, unsigned *next_cid);
+static void index_file(char *infile_name, uint32_t appid);
+
+/* Time range of -T */
+static int range_set = 0;
+static uint32_t range_from = 0;
+static uint32_t range_to = UINT32_MAX;
+
+/* Record of ingested files, -M */
+static struct manifest *manifest = NULL;
+
+/* A file could not be read completely, e.g. a damaged compressed stream */
+static int read_failed = 0;
+
+/* -p/-e/-t, every chunk of -j/-T writes its own <file>.<chunk> */
+static const char *perf_name = NULL;
+static const char *failure_name = NULL;
+static const char *trace_name = NULL;
 
 static void usage(const char *progname, const char *reason)
 {
 	printf("%s\n", reason);
-	printf("Usage: %s [-s <id>] [-c <id>] [-f <filelist>] [filenames]\n", progname);
+	printf("Usage: %s [-s <id>] [-c <id>] [-f <filelist>] [-d <socket>] [-M <manifest>] [filenames]\n", progname);
 	printf("	-s <id>       - First session_info ID to be used for SQL\n");
 	printf("	-c <id>       - First cell_info ID to be used for SQL\n");
 	printf("	-g <target>   - Target host for GSMTAP UDP stream\n");
 	printf("	-f <filelist> - Read list of input files from <filelist>\n");
+	printf("	-k <files>    - Open and read ahead <files> files of the list (default %u, 0=off)\n", PREFETCH_DEPTH);
+	printf("	-m <MB>       - Memory for files read ahead (default %u)\n", PREFETCH_BUDGET_MB);
 	printf("	-a <appid>    - Set appid to <appid> (in hex)\n");
+	printf("	-p <file>     - Write performance counters (JSON) to <file>\n");
+	printf("	-e <file>     - Write decode failures and sampled payloads to <file>\n");
+	printf("	-t <file>     - Write binary trace to <file>, see trace_fmt\n");
+	printf("	                (-p, -e and -t files of chunk n are named <file>.<n> with -j/-T)\n");
+	printf("	-d <socket>   - Keep running, read jobs from Unix socket <socket>\n");
+	printf("	-M <manifest> - Skip files listed in <manifest>, add new ones\n");
+	printf("	-i            - Write frame index <file>.idx for [filenames], no decoding\n");
+	printf("	-j <workers>  - Split [filenames] at connection boundaries, decode in parallel\n");
+	printf("	                (IDs of chunk n start n*%u above -s/-c)\n", SPLIT_ID_STRIDE);
+	printf("	-T <from>[:<to>] - Only decode [filenames] between Unix times <from> and <to>\n");
 	printf("	-v            - Verbose messages\n");
-	printf("	[filenames]   - Read DIAG data from [filenames]\n");
+	printf("	[filenames]   - Read DIAG data from [filenames], gzip/zstd/xz if built in\n");
 	exit(1);
 }
 
@@ -41,15 +96,25 @@ int main(int argc, char *argv[])
 	FILE *filelist = NULL;
 	char *filelist_name = NULL;
 	char *gsmtap_target = NULL;
+	char *socket_path = NULL;
 	uint32_t appid = 0;
 	int ch;
 	long sid = 0;
 	long cid = 0;
 	int line = 0;
+	unsigned prefetch_depth = PREFETCH_DEPTH;
+	size_t prefetch_budget = (size_t) PREFETCH_BUDGET_MB << 20;
+	unsigned split_workers = 0;
+	unsigned chunk_base = 0;
+	unsigned next_sid = 0;
+	unsigned next_cid = 0;
+	int index_only = 0;
+	int failed = 0;
+	char *end;
 
 	msg_verbose = 0;
 
-	while ((ch = getopt(argc, argv, "s:c:g:f:a:v")) != -1) {
+	while ((ch = getopt(argc, argv, "s:c:g:f:k:m:a:p:e:t:d:M:ij:T:v")) != -1) {
 		switch (ch) {
 			case 's':
 				sid = atol(optarg);
@@ -63,9 +128,55 @@ int main(int argc, char *argv[])
 			case 'f':
 				filelist_name = strdup(optarg);
 				break;
+			case 'k':
+				prefetch_depth = atoi(optarg);
+				break;
+			case 'm':
+				prefetch_budget = (size_t) atol(optarg) << 20;
+				break;
 			case 'a':
 				appid = strtol(optarg, (char **)NULL, 16);
 				break;
+			case 'p':
+				perf_name = optarg;
+				perf_set_output(optarg);
+				break;
+			case 'e':
+				failure_name = optarg;
+				failure_set_output(optarg);
+				break;
+			case 't':
+				trace_name = optarg;
+				trace_set_output(optarg);
+				break;
+			case 'd':
+				socket_path = strdup(optarg);
+				break;
+			case 'M':
+				manifest = manifest_open(optarg);
+				if (!manifest) {
+					err(1, "Cannot open manifest: %s", optarg);
+				}
+				break;
+			case 'i':
+				index_only = 1;
+				break;
+			case 'j':
+				split_workers = atoi(optarg);
+				if (split_workers < 1) {
+					usage(argv[0], "Invalid number of workers");
+				}
+				break;
+			case 'T':
+				range_set = 1;
+				range_from = strtoul(optarg, &end, 10);
+				if (*end == ':') {
+					range_to = strtoul(end + 1, &end, 10);
+				}
+				if (*end || range_to < range_from) {
+					usage(argv[0], "Invalid time range");
+				}
+				break;
 			case 'v':
 				msg_verbose++;
 				break;
@@ -78,11 +189,47 @@ int main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
-	if (filelist_name == NULL && argc == 0)
+	if (filelist_name == NULL && socket_path == NULL && argc == 0)
 	{
 		errx(1, "Invalid arguments");
 	}
 
+	/* Indexed modes only work on the named files */
+	if (index_only || split_workers || range_set)
+	{
+		if (filelist_name || socket_path || argc == 0)
+		{
+			usage(argv[0], "-i, -j and -T need file names and no -f or -d");
+		}
+
+		if (index_only)
+		{
+			for (; argc > 0; argc--, argv++)
+			{
+				index_file(argv[0], appid);
+			}
+			return 0;
+		}
+
+		printf("PARSER_OK\n");
+		fflush(stdout);
+
+		for (; argc > 0; argc--, argv++)
+		{
+			if (process_split(argv[0], split_workers ? split_workers : 1, &chunk_base,
+					  sid, cid, gsmtap_target, appid, &next_sid, &next_cid) < 0)
+			{
+				failed = 1;
+			}
+		}
+
+		/* Highest IDs of all chunks, like diag_destroy() in one process */
+		sid = next_sid;
+		cid = next_cid;
+
+		return failed;
+	}
+
 	diag_init(sid, cid, gsmtap_target, NULL, appid);
 
 	printf("PARSER_OK\n");
@@ -105,6 +252,11 @@ int main(int argc, char *argv[])
 			err(1, "Cannot open file list: %s", filelist_name);
 		}
 
+		if (prefetch_depth > 0)
+		{
+			process_list(filelist, filelist_name, prefetch_depth, prefetch_budget);
+		}
+
 		while (!feof(filelist))
 		{
 			char *ret = fgets(infile_name, sizeof(infile_name), filelist);
@@ -121,24 +273,94 @@ int main(int argc, char *argv[])
 		fclose(filelist);
 	}
 
+	if (socket_path)
+	{
+		run_daemon(socket_path);
+	}
+
 	diag_destroy(&sid, &cid);
 
-	return 0;
+	manifest_close(manifest);
+
+	return read_failed;
+}
+
+/*
+ * Decode the DIAG messages in infile starting before offset end, -1 for
+ * all of them. Returns -1 on read errors.
+ */
+static int
+read_diag_range(FILE *infile, off_t end, unsigned *packets, unsigned long long *bytes)
+{
+	uint8_t msg[4096];
+	unsigned len = 0;
+
+	for (;;) {
+		if (end >= 0 && ftello(infile) >= end) {
+			break;
+		}
+
+		len = fread_unescape(infile, msg, sizeof(msg));
+
+		if (len < 1) {
+			break;
+		}
+
+		/* Terminate message with standard GSM padding */
+		if (len < sizeof(msg) - 1) {
+			msg[len] = 0x2b;
+		}
+
+		handle_diag(msg, len);
+		(*packets)++;
+		*bytes += len;
+
+		/* SQL output is buffered, keep up with interactive input */
+		if (infile == stdin) {
+			fflush(stdout);
+		}
+	}
+
+	return ferror(infile) ? -1 : 0;
+}
+
+/* Decode all DIAG messages in infile, returns -1 on read errors */
+static int
+read_diag(FILE *infile, unsigned *packets, unsigned long long *bytes)
+{
+	return read_diag_range(infile, -1, packets, bytes);
 }
 
 void
 process_file(char *infile_name)
 {
-	uint8_t msg[4096];
 	FILE *infile = NULL;
-	unsigned len = 0;
+	struct manifest_file mf;
+	int hashed = 0;
+	unsigned packets = 0;
+	unsigned long long bytes = 0;
+	int fd;
 
 	if (strcmp(infile_name, "-") == 0)
 	{
 		infile = stdin;
+	} else if (manifest)
+	{
+		fd = open(infile_name, O_RDONLY);
+		if (fd >= 0 && manifest_file_init(manifest, infile_name, fd, NULL, 0, &mf) == 0)
+		{
+			hashed = 1;
+			if (manifest_seen(manifest, &mf))
+			{
+				fprintf(stderr, "Already ingested: %s\n", infile_name);
+				close(fd);
+				return;
+			}
+		}
+		infile = fd >= 0 ? decompress_fdopen(fd) : NULL;
 	} else
 	{
-		infile = fopen(infile_name, "rb");
+		infile = decompress_open(infile_name);
 	}
 
 	if (!infile)
@@ -148,19 +370,475 @@ process_file(char *infile_name)
 
 	diag_set_filename(infile_name);
 
-	for (;;) {
-		len = fread_unescape(infile, msg, sizeof(msg));
+	mf.first_sid = session_next_id();
+	mf.first_cid = cell_next_id();
 
-		if (len < 1) {
-			break;
+	if (read_diag(infile, &packets, &bytes) < 0)
+	{
+		warnx("Read error in %s after %u packets", infile_name, packets);
+		read_failed = 1;
+	} else if (hashed)
+	{
+		/* Recorded only once all its sessions are stored */
+		diag_flush();
+		manifest_add(manifest, infile_name, &mf, session_next_id(), cell_next_id());
+	}
+
+	fclose(infile);
+}
+
+/* File list mode with the prefetch thread opening the next files */
+static void
+process_list(FILE *filelist, const char *filelist_name, unsigned depth, size_t budget)
+{
+	struct prefetch *p;
+	struct prefetch_file *pf;
+	unsigned packets = 0;
+	unsigned long long bytes = 0;
+	unsigned line = 0;
+	int error;
+
+	p = prefetch_start(filelist, depth, budget, manifest);
+	if (!p) {
+		err(1, "Cannot start prefetch thread");
+	}
+
+	while ((pf = prefetch_next(p)) != NULL) {
+		/* stdin is not read ahead */
+		if (strcmp(pf->name, "-") == 0) {
+			process_file(pf->name);
+			prefetch_release(p, pf);
+			continue;
 		}
 
-		/* Terminate message with standard GSM padding */
-		if (len < sizeof(msg) - 1) {
-			msg[len] = 0x2b;
+		/* Copies within the read-ahead window were not recorded yet */
+		if (pf->seen || (pf->hashed && manifest_seen(manifest, &pf->mf))) {
+			fprintf(stderr, "Already ingested: %s\n", pf->name);
+			prefetch_release(p, pf);
+			continue;
 		}
 
-		handle_diag(msg, len);
+		if (pf->read_error) {
+			errno = pf->error;
+			warn("Read error in %s", pf->name);
+			read_failed = 1;
+			prefetch_release(p, pf);
+			continue;
+		}
+
+		if (!pf->f) {
+			errno = pf->error;
+			err(1, "Cannot open input file: %s", pf->name);
+		}
+
+		diag_set_file_meta(&pf->meta);
+		pf->mf.first_sid = session_next_id();
+		pf->mf.first_cid = cell_next_id();
+		packets = 0;
+		if (read_diag(pf->f, &packets, &bytes) < 0) {
+			warnx("Read error in %s after %u packets", pf->name, packets);
+			read_failed = 1;
+		} else if (pf->hashed) {
+			diag_flush();
+			manifest_add(manifest, pf->name, &pf->mf, session_next_id(), cell_next_id());
+		}
+		prefetch_release(p, pf);
+	}
+
+	error = prefetch_stop(p, &line);
+	if (error) {
+		errno = error;
+		err(1, "Error parsing file list %s:%u", filelist_name, line);
+	}
+}
+
+/* Appid from the file name or -a, recorded in the index */
+static uint32_t
+file_appid(const char *infile_name, uint32_t appid)
+{
+	struct file_meta fm;
+
+	session_meta_from_filename(infile_name, &fm);
+
+	return fm.appid ? fm.appid : appid;
+}
+
+/* Offsets only make sense for the plain byte stream */
+static void
+check_uncompressed(const char *infile_name)
+{
+	uint8_t magic[6];
+	size_t n;
+	FILE *f;
+
+	f = fopen(infile_name, "rb");
+	if (!f)
+	{
+		err(1, "Cannot open input file: %s", infile_name);
+	}
+	n = fread(magic, 1, sizeof(magic), f);
+	fclose(f);
+
+	if (decompress_detect(magic, n) != DECOMPRESS_NONE)
+	{
+		errx(1, "Cannot index compressed file %s, decompress it first", infile_name);
+	}
+}
+
+static void
+index_file(char *infile_name, uint32_t appid)
+{
+	char index_name[FILENAME_MAX];
+
+	check_uncompressed(infile_name);
+	diag_index_name(infile_name, index_name, sizeof(index_name));
+
+	if (diag_index_build(infile_name, index_name, file_appid(infile_name, appid)) < 0)
+	{
+		err(1, "Cannot write index %s", index_name);
 	}
+}
+
+/* Index of infile, written first if missing or outdated */
+static struct diag_index *
+load_index(char *infile_name, uint32_t appid)
+{
+	char index_name[FILENAME_MAX];
+	struct diag_index *idx;
+
+	diag_index_name(infile_name, index_name, sizeof(index_name));
+
+	idx = diag_index_load(infile_name, index_name);
+	if (!idx)
+	{
+		index_file(infile_name, appid);
+		idx = diag_index_load(infile_name, index_name);
+	}
+	if (!idx)
+	{
+		err(1, "Cannot read index %s", index_name);
+	}
+
+	return idx;
+}
+
+/* Side files of a chunk, a shared name would keep only the last chunk */
+static void
+chunk_output(void (*set_output)(const char *), const char *name, unsigned chunk)
+{
+	char chunk_name[FILENAME_MAX];
+
+	if (!name)
+	{
+		return;
+	}
+
+	snprintf(chunk_name, sizeof(chunk_name), "%s.%u", name, chunk);
+	set_output(chunk_name);
+}
+
+/*
+ * Worker for one chunk, its output goes to the parent through stdout and
+ * its next session and cell IDs through ids_fd.
+ */
+static int
+decode_chunk(char *infile_name, off_t start, off_t end, unsigned chunk,
+		long sid, long cid, const char *gsmtap_target, uint32_t appid, int ids_fd)
+{
+	unsigned packets = 0;
+	unsigned long long bytes = 0;
+	unsigned ids[2];
+	FILE *infile;
+	int ret;
+
+	infile = fopen(infile_name, "rb");
+	if (!infile || fseeko(infile, start, SEEK_SET) < 0)
+	{
+		warn("Cannot open input file: %s", infile_name);
+		return -1;
+	}
+
+	chunk_output(perf_set_output, perf_name, chunk);
+	chunk_output(failure_set_output, failure_name, chunk);
+	chunk_output(trace_set_output, trace_name, chunk);
+
+	sid += chunk * SPLIT_ID_STRIDE;
+	cid += chunk * SPLIT_ID_STRIDE;
+
+	diag_init(sid, cid, gsmtap_target, NULL, appid);
+	diag_set_filename(infile_name);
+
+	ret = read_diag_range(infile, end, &packets, &bytes);
+	fclose(infile);
+
+	diag_destroy(&ids[0], &ids[1]);
+	fflush(stdout);
+
+	if (ret < 0)
+	{
+		warnx("Read error in %s after %u packets", infile_name, packets);
+	}
+
+	/* Beyond the stride the IDs of the next chunk are used again */
+	if (ids[0] > sid + SPLIT_ID_STRIDE || ids[1] > cid + SPLIT_ID_STRIDE)
+	{
+		warnx("Chunk %u of %s used more than %u session or cell IDs",
+		      chunk, infile_name, SPLIT_ID_STRIDE);
+		ret = -1;
+	}
+
+	if (write(ids_fd, ids, sizeof(ids)) != sizeof(ids))
+	{
+		ret = -1;
+	}
+
+	return ret;
+}
+
+/*
+ * Decode infile in chunks that start at connection setups with no other
+ * connection open. Every chunk runs in its own process, the parser state
+ * is global. Outputs are collected in temporary files and written in
+ * file order.
+ */
+static int
+process_split(char *infile_name, unsigned workers, unsigned *chunk_base,
+		long sid, long cid, const char *gsmtap_target, uint32_t appid,
+		unsigned *next_sid, unsigned *next_cid)
+{
+	struct diag_index *idx;
+	uint64_t *starts;
+	FILE **out;
+	pid_t *pids;
+	int *ids_fd;
+	unsigned ids[2];
+	int fds[2];
+	uint64_t start, end;
+	char buf[65536];
+	unsigned n, i;
+	size_t len;
+	int failed = 0;
+	int status;
+
+	idx = load_index(infile_name, appid);
+
+	start = 0;
+	end = idx->hdr.size;
+	if (range_set && diag_index_range(idx, range_from, range_to, &start, &end) < 0)
+	{
+		fprintf(stderr, "No frames in time range: %s\n", infile_name);
+		diag_index_free(idx);
+		return 0;
+	}
+
+	starts = (uint64_t *) calloc(workers + 1, sizeof(uint64_t));
+	out = (FILE **) calloc(workers, sizeof(FILE *));
+	pids = (pid_t *) calloc(workers, sizeof(pid_t));
+	ids_fd = (int *) calloc(workers, sizeof(int));
+	if (!starts || !out || !pids || !ids_fd)
+	{
+		err(1, "Cannot allocate chunks");
+	}
+
+	n = diag_index_split(idx, start, end, workers, starts);
+	starts[n] = end;
+	diag_index_free(idx);
+
+	for (i = 0; i < n; i++)
+	{
+		out[i] = tmpfile();
+		if (!out[i] || pipe(fds) < 0)
+		{
+			err(1, "Cannot create chunk output");
+		}
+
+		pids[i] = fork();
+		if (pids[i] < 0)
+		{
+			err(1, "fork");
+		}
+		if (pids[i] == 0)
+		{
+			close(fds[0]);
+			if (dup2(fileno(out[i]), STDOUT_FILENO) < 0)
+			{
+				_exit(1);
+			}
+			_exit(decode_chunk(infile_name, starts[i], starts[i + 1], *chunk_base + i,
+					   sid, cid, gsmtap_target, appid, fds[1]) < 0);
+		}
+
+		/* Closed before the next fork, a dead chunk reads as EOF */
+		close(fds[1]);
+		ids_fd[i] = fds[0];
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+		{
+			warnx("Chunk %u of %s failed", i, infile_name);
+			failed = 1;
+		}
+
+		if (read(ids_fd[i], ids, sizeof(ids)) == sizeof(ids))
+		{
+			if (ids[0] > *next_sid)
+			{
+				*next_sid = ids[0];
+			}
+			if (ids[1] > *next_cid)
+			{
+				*next_cid = ids[1];
+			}
+		}
+		close(ids_fd[i]);
+
+		rewind(out[i]);
+		while ((len = fread(buf, 1, sizeof(buf), out[i])) > 0)
+		{
+			fwrite(buf, 1, len, stdout);
+		}
+		fclose(out[i]);
+	}
+	fflush(stdout);
+
+	*chunk_base += n;
+
+	free(ids_fd);
+	free(pids);
+	free(out);
+	free(starts);
+
+	return failed ? -1 : 0;
+}
+
+/*
+ * Daemon mode: one job per line on the control socket,
+ *
+ *   <path>[\tappid=<hex>][\tname=<original file name>]
+ *
+ * answered with "OK ..." or "ERR <reason>" once all its sessions and
+ * cells are written. "QUIT" stores everything and exits. Jobs run one
+ * after the other, parser state and the SQL output are shared.
+ */
+static void
+run_job(FILE *ctl, char *job)
+{
+	char *path = strsep(&job, "\t");
+	char *name = path;
+	char *field;
+	uint32_t appid = 0;
+	unsigned packets = 0;
+	unsigned long long bytes = 0;
+	uint64_t start;
+	FILE *infile;
+	int ret;
+
+	while ((field = strsep(&job, "\t")) != NULL) {
+		if (!strncmp(field, "appid=", 6)) {
+			appid = strtoul(field + 6, NULL, 16);
+		} else if (!strncmp(field, "name=", 5)) {
+			name = field + 5;
+		} else {
+			fprintf(ctl, "ERR unknown field %s\n", field);
+			return;
+		}
+	}
+
+	infile = decompress_open(path);
+	if (!infile) {
+		fprintf(ctl, "ERR %s: %s\n", path, strerror(errno));
+		return;
+	}
+
+	start = perf_ticks();
+
+	diag_set_appid(appid);
+	diag_set_filename(name);
+	ret = read_diag(infile, &packets, &bytes);
 	fclose(infile);
+
+	/* Results must be complete when the job is answered */
+	diag_flush();
+	fflush(stdout);
+
+	if (ret < 0) {
+		fprintf(ctl, "ERR %s: read error after %u packets\n", path, packets);
+		return;
+	}
+
+	fprintf(ctl, "OK next_sid=%u next_cid=%u packets=%u bytes=%llu handsets=%u ticks=%llu\n",
+		session_next_id(), cell_next_id(), packets, bytes, subscriber_count(),
+		(unsigned long long) (perf_ticks() - start));
+}
+
+static void
+run_daemon(const char *socket_path)
+{
+	struct sockaddr_un addr;
+	char job[FILENAME_MAX + 64];
+	FILE *in, *ctl;
+	int quit = 0;
+	int fd, conn;
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		errx(1, "Socket path too long: %s", socket_path);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		err(1, "socket");
+	}
+
+	unlink(socket_path);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		err(1, "Cannot bind to %s", socket_path);
+	}
+	if (listen(fd, 16) < 0) {
+		err(1, "listen");
+	}
+
+	/* A client going away must not kill the parser */
+	signal(SIGPIPE, SIG_IGN);
+
+	while (!quit) {
+		conn = accept(fd, NULL, NULL);
+		if (conn < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			err(1, "accept");
+		}
+
+		/* Separate streams, a read/write stdio stream cannot be used on sockets */
+		in = fdopen(conn, "r");
+		ctl = fdopen(dup(conn), "w");
+		if (!in || !ctl) {
+			err(1, "fdopen");
+		}
+
+		while (fgets(job, sizeof(job), in)) {
+			chop_newline(job);
+			if (!strcmp(job, "QUIT")) {
+				quit = 1;
+				fprintf(ctl, "OK\n");
+				break;
+			}
+			if (job[0]) {
+				run_job(ctl, job);
+			}
+			fflush(ctl);
+		}
+
+		fclose(ctl);
+		fclose(in);
+	}
+
+	close(fd);
+	unlink(socket_path);
 }
@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "diag_index.h"
+#include "diag_input.h"
+
+/* Enough of a frame to classify it */
+#define DIAG_INDEX_PEEK 64
+
+void diag_index_name(const char *filename, char *name, size_t len)
+{
+	snprintf(name, len, "%s.idx", filename);
+}
+
+/* Unescape the start of a frame, like fread_unescape() */
+static unsigned peek_frame(const uint8_t *p, size_t len, uint8_t *out)
+{
+	unsigned n = 0;
+	size_t i;
+
+	for (i = 0; i < len && n < DIAG_INDEX_PEEK; i++) {
+		if (p[i] == 0x7d) {
+			if (++i == len) {
+				break;
+			}
+			out[n++] = (p[i] & 0x0f) | 0x70;
+		} else {
+			out[n++] = p[i];
+		}
+	}
+
+	return n;
+}
+
+/* Same conversion as get_epoch(), without the wall clock fallback */
+static uint32_t frame_epoch(const uint8_t *qd_time)
+{
+	double qd_ts;
+
+	qd_ts = qd_time[1];
+	qd_ts += ((uint32_t)qd_time[2]) << 8;
+	qd_ts += ((uint32_t)qd_time[3]) << 16;
+	qd_ts += ((uint32_t)qd_time[4]) << 24;
+	qd_ts *= 1.25*256.0/1000.0;
+
+	if (qd_ts < 1000000000) {
+		return 0;
+	}
+
+	return qd_ts + 315964800.0;
+}
+
+/* 3G RRC message type of len bits, skipping integrity check info */
+static int rrc_msg_type(const uint8_t *p, unsigned avail, unsigned bits)
+{
+	unsigned bit = (p[0] & 0x80) ? 37 : 1;
+	unsigned v = 0;
+	unsigned i;
+
+	if ((bit + bits + 7) / 8 > avail) {
+		return -1;
+	}
+
+	for (i = 0; i < bits; i++, bit++) {
+		v = (v << 1) | ((p[bit / 8] >> (7 - bit % 8)) & 1);
+	}
+
+	return v;
+}
+
+/* Connection events of a frame, the header layout follows handle_diag() */
+static unsigned classify(const uint8_t *msg, unsigned len)
+{
+	const struct diag_packet *dp = (const struct diag_packet *) msg;
+	const uint8_t *data = msg + sizeof(struct diag_packet);
+	unsigned avail;
+
+	if (len < sizeof(struct diag_packet) + 2) {
+		return 0;
+	}
+	avail = len - sizeof(struct diag_packet);
+
+	switch (dp->msg_protocol) {
+	case 0x512f: // GSM RR
+		switch (dp->msg_type) {
+		case 0x83: /* CCCH, L2 pseudo length first */
+			if (avail >= 3 && (data[1] & 0x0f) == 0x06 && data[2] == 0x3f) {
+				return DIAG_INDEX_SETUP;
+			}
+			break;
+		case 0x80:
+		case 0x84:
+		case 0x85: /* SDCCH/SACCH DL RR */
+			if ((data[0] & 0x0f) == 0x06 && data[1] == 0x0d) {
+				return DIAG_INDEX_RELEASE;
+			}
+			break;
+		}
+		break;
+
+	case 0x713a: // DTAP (2G, 3G)
+		if (avail >= 4 && (data[2] & 0x0f) == 0x05 && (data[3] & 0x3f) == 0x08) {
+			return DIAG_INDEX_LU;
+		}
+		break;
+
+	case 0x412f: // 3G RRC, payload after one byte
+		switch (dp->msg_type) {
+		case 0: /* UL-CCCH */
+			if (rrc_msg_type(data + 1, avail - 1, 2) == 1) {
+				return DIAG_INDEX_SETUP;
+			}
+			break;
+		case 2: /* DL-CCCH */
+			switch (rrc_msg_type(data + 1, avail - 1, 3)) {
+			case 2:
+				return DIAG_INDEX_RELEASE;
+			case 3:
+				return DIAG_INDEX_SETUP;
+			}
+			break;
+		case 3: /* DL-DCCH */
+			if (rrc_msg_type(data + 1, avail - 1, 5) == 14) {
+				return DIAG_INDEX_RELEASE;
+			}
+			break;
+		}
+		break;
+
+	case 0xb0c0: // LTE RRC, payload after ten bytes
+		if (avail < 11) {
+			break;
+		}
+		switch (data[7]) {
+		case 5: /* DL-CCCH, RRC connection setup */
+			if ((data[10] & 0xe0) == 0x60) {
+				return DIAG_INDEX_SETUP;
+			}
+			break;
+		case 6: /* DL-DCCH, RRC connection release */
+			if ((data[10] & 0xf8) == 0x28) {
+				return DIAG_INDEX_RELEASE;
+			}
+			break;
+		case 7: /* UL-CCCH, RRC connection request */
+			if ((data[10] & 0xc0) == 0x40) {
+				return DIAG_INDEX_SETUP;
+			}
+			break;
+		}
+		break;
+	}
+
+	return 0;
+}
+
+static int write_entry(FILE *f, uint64_t offset, uint32_t timestamp, uint32_t appid, unsigned flags)
+{
+	struct diag_index_entry e;
+
+	e.offset = offset;
+	e.timestamp = timestamp;
+	e.appid = appid;
+	e.flags = flags;
+
+	return fwrite(&e, sizeof(e), 1, f) == 1 ? 0 : -1;
+}
+
+static int index_map(const uint8_t *map, size_t size, FILE *f, uint32_t appid, uint32_t *count)
+{
+	const struct diag_packet *dp;
+	const uint8_t *end;
+	uint8_t msg[DIAG_INDEX_PEEK];
+	uint64_t pos = 0;
+	uint64_t frame_end;
+	uint64_t last = 0;
+	uint32_t timestamp = 0;
+	uint32_t t;
+	unsigned flags;
+	unsigned len;
+	int open = 1;	/* Unknown at the start of the file */
+
+	*count = 0;
+
+	while (pos < size) {
+		end = memchr(map + pos, 0x7e, size - pos);
+		frame_end = end ? (uint64_t) (end - map) : size;
+
+		len = peek_frame(map + pos, frame_end - pos, msg);
+		if (len < 1) {
+			pos = frame_end + 1;
+			continue;
+		}
+
+		dp = (const struct diag_packet *) msg;
+		t = 0;
+		if (dp->msg_class == 0x0010 && len >= 16) {
+			t = frame_epoch((const uint8_t *) &dp->timestamp);
+		} else if (dp->msg_class == 0x001d && len > 9) {
+			t = frame_epoch(&msg[3]);
+		}
+		if (t) {
+			timestamp = t;
+		}
+
+		flags = dp->msg_class == 0x0010 ? classify(msg, len) : 0;
+		if (flags & DIAG_INDEX_SETUP) {
+			if (!open) {
+				flags |= DIAG_INDEX_SAFE;
+			}
+			open = 1;
+		}
+		if (flags & DIAG_INDEX_RELEASE) {
+			open = 0;
+		}
+
+		if (flags || !*count || pos - last >= DIAG_INDEX_BLOCK) {
+			if (write_entry(f, pos, timestamp, appid, flags) < 0) {
+				return -1;
+			}
+			(*count)++;
+			last = pos;
+		}
+
+		pos = frame_end + 1;
+	}
+
+	return 0;
+}
+
+int diag_index_build(const char *filename, const char *index_name, uint32_t appid)
+{
+	struct diag_index_header hdr;
+	char tmp_name[FILENAME_MAX];
+	const uint8_t *map = NULL;
+	uint32_t count = 0;
+	struct stat st;
+	FILE *f;
+	int ret = -1;
+	int saved;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+	if (st.st_size > 0) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			close(fd);
+			return -1;
+		}
+		madvise((void *) map, st.st_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	/* Written aside, a reader never sees a partial index */
+	snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", index_name);
+	f = fopen(tmp_name, "wb");
+	if (!f) {
+		goto out;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, DIAG_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.version = DIAG_INDEX_VERSION;
+	hdr.size = st.st_size;
+	hdr.mtime = st.st_mtime;
+
+	/* The count is filled in at the end */
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    (map && index_map(map, st.st_size, f, appid, &count) < 0)) {
+		goto fail;
+	}
+
+	hdr.count = count;
+	if (fseek(f, 0, SEEK_SET) < 0 || fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+		goto fail;
+	}
+
+	if (fclose(f) != 0 || rename(tmp_name, index_name) < 0) {
+		saved = errno;
+		unlink(tmp_name);
+		errno = saved;
+		goto out;
+	}
+
+	ret = 0;
+	goto out;
+
+fail:
+	saved = errno;
+	fclose(f);
+	unlink(tmp_name);
+	errno = saved;
+out:
+	if (map) {
+		saved = errno;
+		munmap((void *) map, st.st_size);
+		errno = saved;
+	}
+
+	return ret;
+}
+
+struct diag_index *diag_index_load(const char *filename, const char *index_name)
+{
+	struct diag_index *idx;
+	struct stat st;
+	FILE *f;
+
+	if (stat(filename, &st) < 0) {
+		return NULL;
+	}
+
+	f = fopen(index_name, "rb");
+	if (!f) {
+		return NULL;
+	}
+
+	idx = (struct diag_index *) calloc(1, sizeof(struct diag_index));
+	if (!idx) {
+		fclose(f);
+		return NULL;
+	}
+
+	if (fread(&idx->hdr, sizeof(idx->hdr), 1, f) != 1 ||
+	    memcmp(idx->hdr.magic, DIAG_INDEX_MAGIC, sizeof(idx->hdr.magic)) ||
+	    idx->hdr.version != DIAG_INDEX_VERSION) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	if (idx->hdr.size != (uint64_t) st.st_size || idx->hdr.mtime != st.st_mtime) {
+		errno = ESTALE;
+		goto fail;
+	}
+
+	idx->entries = (struct diag_index_entry *) malloc(
+		(size_t) idx->hdr.count * sizeof(struct diag_index_entry) + 1);
+	if (!idx->entries) {
+		goto fail;
+	}
+	if (fread(idx->entries, sizeof(struct diag_index_entry), idx->hdr.count, f) != idx->hdr.count) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	fclose(f);
+
+	return idx;
+
+fail:
+	fclose(f);
+	diag_index_free(idx);
+	return NULL;
+}
+
+void diag_index_free(struct diag_index *idx)
+{
+	if (!idx) {
+		return;
+	}
+
+	free(idx->entries);
+	free(idx);
+}
+
+unsigned diag_index_split(const struct diag_index *idx, uint64_t start, uint64_t end,
+		unsigned n, uint64_t *starts)
+{
+	const struct diag_index_entry *e = idx->entries;
+	uint64_t target;
+	unsigned chunks = 1;
+	unsigned i = 0;
+
+	starts[0] = start;
+
+	while (chunks < n) {
+		target = start + (end - start) * chunks / n;
+
+		for (; i < idx->hdr.count; i++) {
+			if ((e[i].flags & DIAG_INDEX_SAFE) && e[i].offset >= target &&
+			    e[i].offset > starts[chunks - 1]) {
+				break;
+			}
+		}
+		if (i == idx->hdr.count || e[i].offset >= end) {
+			break;
+		}
+
+		starts[chunks++] = e[i].offset;
+	}
+
+	return chunks;
+}
+
+int diag_index_range(const struct diag_index *idx, uint32_t from, uint32_t to,
+		uint64_t *start, uint64_t *end)
+{
+	const struct diag_index_entry *e = idx->entries;
+	unsigned i;
+
+	*start = 0;
+	*end = idx->hdr.size;
+
+	for (i = 0; i < idx->hdr.count; i++) {
+		if (!(e[i].flags & DIAG_INDEX_SAFE) || !e[i].timestamp) {
+			continue;
+		}
+		if (e[i].timestamp <= from) {
+			*start = e[i].offset;
+		} else if (e[i].timestamp > to) {
+			*end = e[i].offset;
+			break;
+		}
+	}
+
+	return *start < *end ? 0 : -1;
+}
@@ -0,0 +1,72 @@
+#ifndef DIAG_INDEX_H
+#define DIAG_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Side index of DIAG frame offsets, written next to the input as
+ * <file>.idx. One entry per block of frames and per frame that opens or
+ * closes a connection, so a file can be cut into chunks that decode
+ * independently or entered at a point in time.
+ */
+
+/* An entry is written at least every DIAG_INDEX_BLOCK input bytes */
+#define DIAG_INDEX_BLOCK (64 * 1024)
+
+enum diag_index_flags {
+	DIAG_INDEX_SETUP = 1,	/* Immediate assignment, RRC connection request/setup */
+	DIAG_INDEX_RELEASE = 2,	/* Channel release, RRC connection release */
+	DIAG_INDEX_LU = 4,	/* Location updating request */
+	DIAG_INDEX_SAFE = 8,	/* Setup with no connection open, chunks may start here */
+};
+
+/* File layout: header, then entries in file order, host byte order */
+#define DIAG_INDEX_MAGIC "DIAGIDX1"
+#define DIAG_INDEX_VERSION 1
+
+struct diag_index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t count;		/* Entries following */
+	uint64_t size;		/* Indexed file, a changed file needs a new index */
+	int64_t mtime;
+} __attribute__((packed));
+
+struct diag_index_entry {
+	uint64_t offset;	/* First byte of the frame, after the 0x7e flag */
+	uint32_t timestamp;	/* Unix time of the frame or the last one before, 0 if unknown */
+	uint32_t appid;
+	uint16_t flags;
+} __attribute__((packed));
+
+struct diag_index {
+	struct diag_index_header hdr;
+	struct diag_index_entry *entries;
+};
+
+/* <filename>.idx */
+void diag_index_name(const char *filename, char *name, size_t len);
+
+/* Scan an uncompressed DIAG file, 0 or -1 with errno set */
+int diag_index_build(const char *filename, const char *index_name, uint32_t appid);
+
+/* NULL with errno ESTALE if the file changed after indexing */
+struct diag_index *diag_index_load(const char *filename, const char *index_name);
+void diag_index_free(struct diag_index *idx);
+
+/*
+ * Cut [start, end) into at most n chunks at safe entries, starts gets
+ * the chunk offsets (starts[0] = start). Returns the number of chunks.
+ */
+unsigned diag_index_split(const struct diag_index *idx, uint64_t start, uint64_t end,
+		unsigned n, uint64_t *starts);
+
+/*
+ * Byte range covering the frames from time from to to, widened to safe
+ * entries so the connections at both ends are complete. -1 if empty.
+ */
+int diag_index_range(const struct diag_index *idx, uint32_t from, uint32_t to,
+		uint64_t *start, uint64_t *end);
+
+#endif
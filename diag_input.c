@@ -15,25 +15,11 @@
 #include "session.h"
 #include "diag_structs.h"
 #include "l3_handler.h"
-
-struct diag_packet {
-	uint16_t msg_class;
-	uint16_t len;
-	uint16_t inner_len;
-	uint16_t msg_protocol;
-	uint64_t timestamp;
-	uint8_t msg_type;
-	uint8_t msg_subtype;
-	uint8_t data_len;
-	uint8_t data[0];
-} __attribute__ ((packed));
-
-struct burst_info {
-	uint32_t fn;
-	uint16_t arfcn[4];
-} last_burst;
-
-struct radio_message *last_m = NULL;
+#include "umts_rrc.h"
+#include "lte_nas_eps_sec.h"
+#include "perf.h"
+#include "failure.h"
+#include "trace.h"
 
 void diag_init(unsigned start_sid, unsigned start_cid, const char *gsmtap_target, char *filename, uint32_t appid)
 {
@@ -56,8 +42,6 @@ void diag_init(unsigned start_sid, unsigned start_cid, const char *gsmtap_target
 	auto_timestamp = 0;
 #endif
 
-	memset(&last_burst, 0, sizeof(last_burst));
-
 	session_init(start_sid, 0, gsmtap_target, callback_type);
 
 	diag_set_filename(filename);
@@ -66,20 +50,31 @@ void diag_init(unsigned start_sid, unsigned start_cid, const char *gsmtap_target
 	cell_init(start_cid, _s[0].timestamp.tv_sec, callback_type);
 }
 
+/* Files named after an app ID select that handset */
 void diag_set_filename(char *filename)
 {
+	struct file_meta fm;
+
 	if (filename && (filename[0] != '-')) {
-		session_from_filename(filename, &_s[0]);
-		session_from_filename(filename, &_s[1]);
+		session_meta_from_filename(filename, &fm);
+		diag_set_file_meta(&fm);
 	}
 }
 
+/* Same with the file name already parsed, e.g. by the prefetch thread */
+void diag_set_file_meta(const struct file_meta *fm)
+{
+	diag_set_appid(fm->appid);
+	session_apply_meta(fm, &_s[0]);
+	session_apply_meta(fm, &_s[1]);
+}
+
+/* Following messages belong to the handset with appid, 0 keeps the current one */
 void diag_set_appid(uint32_t appid)
 {
 	if (appid)
 	{
-		_s[0].appid = appid;
-		_s[1].appid = appid;
+		subscriber_select(appid);
 	}
 }
 
@@ -88,6 +83,28 @@ void diag_destroy(unsigned *last_sid, unsigned *last_cid)
 	session_destroy(last_sid, last_cid);
 }
 
+/* End of input for the current handset, everything pending is stored */
+void diag_flush()
+{
+	struct radio_message *m = cur_sub->last_m;
+
+	if (m) {
+		cur_sub->last_m = NULL;
+		handle_radio_msg(_s, m);
+	}
+
+	session_flush();
+	cell_dump(now, 1, 0);
+}
+
+/* Drop all parser state, the next message is handled like the first one */
+void diag_reset()
+{
+	session_reset_all();
+	cell_reset();
+	rrc_bcch_reset();
+}
+
 inline
 uint32_t get_fn(struct diag_packet *dp)
 {
@@ -138,20 +155,23 @@ struct radio_message * handle_3G(struct diag_packet *dp, unsigned len)
 	struct radio_message *m;
 
 	if (len < 16) {
+		failure_record(FAIL_DIAG_LEN, (uint8_t *) dp, len);
 		return 0;
 	}
 
 	payload_len = dp->len - 16;
 
 	if (payload_len > len - 16) {
+		failure_record(FAIL_DIAG_LEN, (uint8_t *) dp, len);
 		return 0;
 	}
 
 	if (payload_len > sizeof(m->bb.data)) {
+		failure_record(FAIL_DIAG_LEN, (uint8_t *) dp, len);
 		return 0;
 	}
 
-	m = (struct radio_message *) malloc(sizeof(struct radio_message));
+	m = radio_msg_alloc();
 
 	memset(m, 0, sizeof(struct radio_message));
 
@@ -187,7 +207,8 @@ struct radio_message * handle_3G(struct diag_packet *dp, unsigned len)
 		if (msg_verbose > 1) {
 			printf("Discarding 3G message type=%d data=%s\n", dp->msg_type, osmo_hexdump_nospc(dp->data, payload_len));
 		}
-		free(m);
+		/* Other channels are not decoded, this is no failure */
+		radio_msg_free(m);
 		return 0;
 	}
 
@@ -205,22 +226,25 @@ struct radio_message * handle_4G(struct diag_packet *dp, unsigned len)
 	uint8_t *data = NULL;
 
 	if (len < 16) {
+		failure_record(FAIL_DIAG_LEN, (uint8_t *) dp, len);
 		return 0;
 	}
 
 	payload_len = dp->len - 16;
 
 	if (payload_len > len - 16) {
+		failure_record(FAIL_DIAG_LEN, (uint8_t *) dp, len);
 		return 0;
 	}
 
 	if (payload_len > sizeof(m->bb.data)) {
+		failure_record(FAIL_DIAG_LEN, (uint8_t *) dp, len);
 		return 0;
 	}
 
 	data = &dp->data[1];
 
-	m = (struct radio_message *) malloc(sizeof(struct radio_message));
+	m = radio_msg_alloc();
 
 	memset(m, 0, sizeof(struct radio_message));
 
@@ -263,15 +287,15 @@ struct radio_message * handle_4G(struct diag_packet *dp, unsigned len)
 			m->chan_nr = 3;
 			break;
 		default:
-			// Unhandled
+			// Unhandled, e.g. BCCH-BCH, not a failure
+			radio_msg_free(m);
 			return NULL;
 		}
 		// verify len
 		payload_len = ((uint16_t)dp->data[9]) << 8 | dp->data[8];
-		if (payload_len > len - 15) {
-			return 0;
-		}
-		if (payload_len > sizeof(m->bb.data)) {
+		if (payload_len > len - 15 || payload_len > sizeof(m->bb.data)) {
+			failure_record(FAIL_DIAG_LEN, (uint8_t *) dp, len);
+			radio_msg_free(m);
 			return 0;
 		}
 		data = &dp->data[10];
@@ -301,7 +325,9 @@ struct radio_message * handle_4G(struct diag_packet *dp, unsigned len)
 		if (msg_verbose > 1) {
 			printf("Discarding 4G message type=%d data=%s\n", dp->msg_type, osmo_hexdump_nospc(dp->data, payload_len));
 		}
-		free(m);
+		/* handle_diag() only passes protocols listed above */
+		failure_record(FAIL_DIAG_DISCARD, (uint8_t *) dp, len);
+		radio_msg_free(m);
 		return NULL;
 	}
 
@@ -312,6 +338,31 @@ struct radio_message * handle_4G(struct diag_packet *dp, unsigned len)
 	return m;
 }
 
+void handle_lte_nas_keys(struct diag_packet *dp, unsigned len)
+{
+	struct lte_nas_keys *k;
+	unsigned payload_len;
+
+	if (len < 16) {
+		return;
+	}
+
+	payload_len = dp->len - 16;
+
+	if (payload_len > len - 16) {
+		return;
+	}
+
+	if (payload_len < sizeof(struct lte_nas_keys)) {
+		return;
+	}
+
+	k = (struct lte_nas_keys *) &dp->data[1];
+
+	/* LTE signalling is always handled in the first session */
+	naseps_set_keys(&_s[0], k->eea, k->eia, &k->k_nas_enc[16], &k->k_nas_int[16], k->ul_nas_count, k->dl_nas_count);
+}
+
 struct radio_message * handle_nas(struct diag_packet *dp, unsigned len)
 {
 	/* sanity checks */
@@ -421,16 +472,16 @@ void handle_gsm_l1_burst_metrics(struct diag_packet *dp, unsigned len)
 		return;
 	}
 
-	last_burst.fn = get_fn(dp);
+	cur_sub->last_burst.fn = get_fn(dp);
 
 	/* log burst information */
 	for (i = 0; i < 4; i++) {
 		uint8_t band = get_band_from_arfcn_and_band(ntohs(dat->metrics[i].arfcn_and_band));
 		uint16_t n_arfcn = get_arfcn_from_arfcn_and_band(ntohs(dat->metrics[i].arfcn_and_band));
 		if (band == 8 || band == 9) {
-			last_burst.arfcn[i] = n_arfcn;
+			cur_sub->last_burst.arfcn[i] = n_arfcn;
 		} else {
-			last_burst.arfcn[i] = last_burst.arfcn[0];
+			cur_sub->last_burst.arfcn[i] = cur_sub->last_burst.arfcn[0];
 		}
 	}
 
@@ -546,7 +597,7 @@ void handle_sacch_report(struct diag_packet *dp, unsigned len)
 	_s[1].arfcn = _s[0].arfcn = get_arfcn_from_arfcn_and_band(b_arfcn);
 
 	if (old_arfcn != _s[0].arfcn) {
-		printf("SACCH report old=%d new=%d\n", old_arfcn, _s[0].arfcn);
+		TRACE2(TRACE_INFO, TRACE_SACCH_REPORT, old_arfcn, _s[0].arfcn);
 	}
 }
 
@@ -560,6 +611,8 @@ void handle_diag(uint8_t *msg, unsigned len)
 		if (dp->msg_class == 0x001d && len > 9) {
 			_s[0].timestamp.tv_sec = get_epoch(&msg[3]);
 			_s[1].timestamp = _s[0].timestamp;
+		} else {
+			failure_record(FAIL_DIAG_CLASS, msg, len);
 		}
 		if (msg_verbose > 1) {
 			fprintf(stderr, "Class %04x is not supported\n", dp->msg_class);
@@ -574,8 +627,12 @@ void handle_diag(uint8_t *msg, unsigned len)
 	}
 
 	/* Avoid short messages */
-	if (len < 16)
+	if (len < 16) {
+		failure_record(FAIL_DIAG_LEN, msg, len);
 		return;
+	}
+
+	perf_count_diag(dp->msg_protocol, len);
 
 	now = get_epoch(&dp->timestamp);
 	cell_dump(now, 0, 0);
@@ -639,14 +696,14 @@ void handle_diag(uint8_t *msg, unsigned len)
 		if (msg_verbose > 1) {
 			fprintf(stderr, "-> Handling 3G\n");
 		}
-		m = handle_3G(dp, len);
+		PERF_TIME(PERF_HANDLE_3G, m = handle_3G(dp, len));
 		break;
 
 	case 0x512f: // GSM RR
 		if (msg_verbose > 1) {
 			fprintf(stderr, "Handling GSM RR\n");
 		}
-		m = handle_bcch_and_rr(dp, len);
+		PERF_TIME(PERF_HANDLE_BCCH_RR, m = handle_bcch_and_rr(dp, len));
 		break;
 
 	case 0x5230: // GPRS GMM (doubled msg)
@@ -659,7 +716,7 @@ void handle_diag(uint8_t *msg, unsigned len)
 		if (msg_verbose > 1) {
 			fprintf(stderr, "-> Handling NAS\n");
 		}
-		m = handle_nas(dp, len);
+		PERF_TIME(PERF_HANDLE_NAS, m = handle_nas(dp, len));
 		break;
 
 	case 0xb0c0: // LTE RRC
@@ -674,10 +731,14 @@ void handle_diag(uint8_t *msg, unsigned len)
 		if (msg_verbose > 1) {
 			fprintf(stderr, "-> Handling 4G\n");
 		}
-		m = handle_4G(dp, len);
+		PERF_TIME(PERF_HANDLE_4G, m = handle_4G(dp, len));
 		break;
 
-	case 0xb0f3: // unknown LTE
+	case 0xb0f3: // EMM ciphering and integrity keys
+		if (msg_verbose > 1) {
+			fprintf(stderr, "-> Handling LTE NAS keys\n");
+		}
+		handle_lte_nas_keys(dp, len);
 		break;
 
 	default:
@@ -691,25 +752,25 @@ void handle_diag(uint8_t *msg, unsigned len)
 	if (m) {
 		/* Attach timestamp */
 		m->timestamp.tv_sec = now;
-		if (m->bb.fn[0] > last_burst.fn) {
+		if (m->bb.fn[0] > cur_sub->last_burst.fn) {
 			struct radio_message *z;
 			/* Swap m */
 			z = m;
-			m = last_m;
-			last_m = z;
+			m = cur_sub->last_m;
+			cur_sub->last_m = z;
 		}
 	} else {
 		/* Deliver delayed message */
-		m = last_m;
-		last_m = NULL;
+		m = cur_sub->last_m;
+		cur_sub->last_m = NULL;
 	}
 
 	if (m) {
 		/* Attach ARFCN */
-		if (m->bb.fn[0] == last_burst.fn) {
+		if (m->bb.fn[0] == cur_sub->last_burst.fn) {
 			int i;
 			for (i = 0; i < 4; i++) {
-				m->bb.arfcn[i] = last_burst.arfcn[i];
+				m->bb.arfcn[i] = cur_sub->last_burst.arfcn[i];
 			}
 		}
 
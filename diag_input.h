@@ -3,10 +3,28 @@
 
 #include <stdint.h>
 
+/* DIAG log record, as found between HDLC flags (CRC not included) */
+struct diag_packet {
+	uint16_t msg_class;
+	uint16_t len;
+	uint16_t inner_len;
+	uint16_t msg_protocol;
+	uint64_t timestamp;
+	uint8_t msg_type;
+	uint8_t msg_subtype;
+	uint8_t data_len;
+	uint8_t data[0];
+} __attribute__ ((packed));
+
+struct file_meta;
+
 void diag_init(unsigned start_sid, unsigned start_cid, const char *gsmtap_target, char *filename, uint32_t appid);
 void diag_set_filename(char *filename);
+void diag_set_file_meta(const struct file_meta *fm);
 void diag_set_appid(uint32_t appid);
 void handle_diag(uint8_t *msg, unsigned len);
 void diag_destroy();
+void diag_flush();
+void diag_reset();
 
 #endif
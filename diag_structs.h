@@ -140,4 +140,16 @@ struct  gprs_grr_cell_reselection_measurements  {
 	struct neighbor neigbors[6];
 } __attribute__((packed));
 
+/*********************************************************/
+
+//cmd: 0xB0F3 (EMM ciphering and integrity keys)
+struct  lte_nas_keys  {
+	uint8_t   eea;
+	uint8_t   eia;
+	uint8_t   k_nas_enc[32];	// 256 bit KDF output, the key is the low 128 bit
+	uint8_t   k_nas_int[32];
+	uint32_t  ul_nas_count;
+	uint32_t  dl_nas_count;
+} __attribute__((packed));
+
 #endif //__DIAG_STRUCTS_H__
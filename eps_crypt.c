@@ -0,0 +1,503 @@
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "eps_crypt.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_AESNI 1
+#include <cpuid.h>
+#include <wmmintrin.h>
+#endif
+
+static const uint8_t aes_sbox[256] = {
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+/* SNOW 3G S-box S_Q */
+static const uint8_t snow_sq[256] = {
+	0x25, 0x24, 0x73, 0x67, 0xd7, 0xae, 0x5c, 0x30, 0xa4, 0xee, 0x6e, 0xcb, 0x7d, 0xb5, 0x82, 0xdb,
+	0xe4, 0x8e, 0x48, 0x49, 0x4f, 0x5d, 0x6a, 0x78, 0x70, 0x88, 0xe8, 0x5f, 0x5e, 0x84, 0x65, 0xe2,
+	0xd8, 0xe9, 0xcc, 0xed, 0x40, 0x2f, 0x11, 0x28, 0x57, 0xd2, 0xac, 0xe3, 0x4a, 0x15, 0x1b, 0xb9,
+	0xb2, 0x80, 0x85, 0xa6, 0x2e, 0x02, 0x47, 0x29, 0x07, 0x4b, 0x0e, 0xc1, 0x51, 0xaa, 0x89, 0xd4,
+	0xca, 0x01, 0x46, 0xb3, 0xef, 0xdd, 0x44, 0x7b, 0xc2, 0x7f, 0xbe, 0xc3, 0x9f, 0x20, 0x4c, 0x64,
+	0x83, 0xa2, 0x68, 0x42, 0x13, 0xb4, 0x41, 0xcd, 0xba, 0xc6, 0xbb, 0x6d, 0x4d, 0x71, 0x21, 0xf4,
+	0x8d, 0xb0, 0xe5, 0x93, 0xfe, 0x8f, 0xe6, 0xcf, 0x43, 0x45, 0x31, 0x22, 0x37, 0x36, 0x96, 0xfa,
+	0xbc, 0x0f, 0x08, 0x52, 0x1d, 0x55, 0x1a, 0xc5, 0x4e, 0x23, 0x69, 0x7a, 0x92, 0xff, 0x5b, 0x5a,
+	0xeb, 0x9a, 0x1c, 0xa9, 0xd1, 0x7e, 0x0d, 0xfc, 0x50, 0x8a, 0xb6, 0x62, 0xf5, 0x0a, 0xf8, 0xdc,
+	0x03, 0x3c, 0x0c, 0x39, 0xf1, 0xb8, 0xf3, 0x3d, 0xf2, 0xd5, 0x97, 0x66, 0x81, 0x32, 0xa0, 0x00,
+	0x06, 0xce, 0xf6, 0xea, 0xb7, 0x17, 0xf7, 0x8c, 0x79, 0xd6, 0xa7, 0xbf, 0x8b, 0x3f, 0x1f, 0x53,
+	0x63, 0x75, 0x35, 0x2c, 0x60, 0xfd, 0x27, 0xd3, 0x94, 0xa5, 0x7c, 0xa1, 0x05, 0x58, 0x2d, 0xbd,
+	0xd9, 0xc7, 0xaf, 0x6b, 0x54, 0x0b, 0xe0, 0x38, 0x04, 0xc8, 0x9d, 0xe7, 0x14, 0xb1, 0x87, 0x9c,
+	0xdf, 0x6f, 0xf9, 0xda, 0x2a, 0xc4, 0x59, 0x16, 0x74, 0x91, 0xab, 0x26, 0x61, 0x76, 0x34, 0x2b,
+	0xad, 0x99, 0xfb, 0x72, 0xec, 0x33, 0x12, 0xde, 0x98, 0x3b, 0xc0, 0x9b, 0x3e, 0x18, 0x10, 0x3a,
+	0x56, 0xe1, 0x77, 0xc9, 0x1e, 0x9e, 0x95, 0xa3, 0x90, 0x19, 0xa8, 0x6c, 0x09, 0xd0, 0xf0, 0x86,
+};
+
+static inline uint8_t mulx(uint8_t v, uint8_t c)
+{
+	return (v & 0x80) ? (v << 1) ^ c : (v << 1);
+}
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+/*
+	AES-128
+*/
+
+void aes128_set_key(struct aes128_ctx *ctx, const uint8_t *key)
+{
+	uint8_t *w = ctx->rk;
+	uint8_t rcon = 0x01;
+	uint8_t t[4];
+	int i;
+
+	memcpy(w, key, 16);
+
+	for (i = 16; i < 176; i += 4) {
+		memcpy(t, &w[i-4], 4);
+		if (i % 16 == 0) {
+			uint8_t u = t[0];
+			t[0] = aes_sbox[t[1]] ^ rcon;
+			t[1] = aes_sbox[t[2]];
+			t[2] = aes_sbox[t[3]];
+			t[3] = aes_sbox[u];
+			rcon = mulx(rcon, 0x1b);
+		}
+		w[i+0] = w[i-16] ^ t[0];
+		w[i+1] = w[i-15] ^ t[1];
+		w[i+2] = w[i-14] ^ t[2];
+		w[i+3] = w[i-13] ^ t[3];
+	}
+}
+
+static void aes128_encrypt_sw(const struct aes128_ctx *ctx, const uint8_t *in, uint8_t *out)
+{
+	uint8_t s[16], t[16];
+	int i, r, c;
+
+	for (i = 0; i < 16; i++) {
+		s[i] = in[i] ^ ctx->rk[i];
+	}
+
+	for (r = 1; r <= 10; r++) {
+		/* SubBytes and ShiftRows */
+		for (c = 0; c < 4; c++) {
+			for (i = 0; i < 4; i++) {
+				t[4*c+i] = aes_sbox[s[4*((c+i)%4)+i]];
+			}
+		}
+
+		/* MixColumns, skipped in the last round */
+		if (r < 10) {
+			for (c = 0; c < 4; c++) {
+				uint8_t *a = &t[4*c];
+				uint8_t x = a[0] ^ a[1] ^ a[2] ^ a[3];
+				uint8_t a0 = a[0];
+
+				a[0] ^= x ^ mulx(a[0] ^ a[1], 0x1b);
+				a[1] ^= x ^ mulx(a[1] ^ a[2], 0x1b);
+				a[2] ^= x ^ mulx(a[2] ^ a[3], 0x1b);
+				a[3] ^= x ^ mulx(a[3] ^ a0, 0x1b);
+			}
+		}
+
+		for (i = 0; i < 16; i++) {
+			s[i] = t[i] ^ ctx->rk[16*r+i];
+		}
+	}
+
+	memcpy(out, s, 16);
+}
+
+#ifdef HAVE_AESNI
+__attribute__((target("aes,sse2")))
+static void aes128_encrypt_aesni(const struct aes128_ctx *ctx, const uint8_t *in, uint8_t *out)
+{
+	const __m128i *rk = (const __m128i *) ctx->rk;
+	__m128i b;
+	int i;
+
+	b = _mm_loadu_si128((const __m128i *) in);
+	b = _mm_xor_si128(b, _mm_loadu_si128(&rk[0]));
+	for (i = 1; i < 10; i++) {
+		b = _mm_aesenc_si128(b, _mm_loadu_si128(&rk[i]));
+	}
+	b = _mm_aesenclast_si128(b, _mm_loadu_si128(&rk[10]));
+	_mm_storeu_si128((__m128i *) out, b);
+}
+#endif
+
+int aes128_have_aesni()
+{
+#ifdef HAVE_AESNI
+	unsigned a, b, c, d;
+
+	if (__get_cpuid(1, &a, &b, &c, &d)) {
+		return !!(c & bit_AES);
+	}
+#endif
+	return 0;
+}
+
+/* Selected on first use, the round keys are the same for both */
+static void (*aes128_encrypt_fn)(const struct aes128_ctx *, const uint8_t *, uint8_t *) = NULL;
+
+void aes128_encrypt(const struct aes128_ctx *ctx, const uint8_t *in, uint8_t *out)
+{
+	if (!aes128_encrypt_fn) {
+#ifdef HAVE_AESNI
+		if (aes128_have_aesni()) {
+			aes128_encrypt_fn = aes128_encrypt_aesni;
+		} else
+#endif
+		aes128_encrypt_fn = aes128_encrypt_sw;
+	}
+
+	aes128_encrypt_fn(ctx, in, out);
+}
+
+/*
+	128-EEA2 and 128-EIA2 (3GPP TS 33.401, Annex B)
+*/
+
+void eps_eea2(const uint8_t *key, uint32_t count, uint8_t bearer, uint8_t dir, uint8_t *data, unsigned len)
+{
+	struct aes128_ctx ctx;
+	uint8_t ctr[16];
+	uint8_t ks[16];
+	unsigned i, n;
+
+	aes128_set_key(&ctx, key);
+
+	memset(ctr, 0, sizeof(ctr));
+	ctr[0] = count >> 24;
+	ctr[1] = count >> 16;
+	ctr[2] = count >> 8;
+	ctr[3] = count;
+	ctr[4] = ((bearer & 0x1f) << 3) | ((dir & 1) << 2);
+
+	while (len) {
+		aes128_encrypt(&ctx, ctr, ks);
+
+		n = (len < 16) ? len : 16;
+		for (i = 0; i < n; i++) {
+			data[i] ^= ks[i];
+		}
+		data += n;
+		len -= n;
+
+		/* Increment the 128 bit counter block */
+		for (i = 16; i-- > 0; ) {
+			if (++ctr[i]) {
+				break;
+			}
+		}
+	}
+}
+
+/* Derive a CMAC subkey (RFC 4493) */
+static void cmac_subkey(uint8_t *k)
+{
+	uint8_t carry = k[0] & 0x80;
+	int i;
+
+	for (i = 0; i < 15; i++) {
+		k[i] = (k[i] << 1) | (k[i+1] >> 7);
+	}
+	k[15] <<= 1;
+	if (carry) {
+		k[15] ^= 0x87;
+	}
+}
+
+static void aes128_cmac(const struct aes128_ctx *ctx, const uint8_t *msg, unsigned len, uint8_t *mac)
+{
+	uint8_t k[16];
+	uint8_t x[16];
+	unsigned i, n;
+
+	memset(k, 0, sizeof(k));
+	aes128_encrypt(ctx, k, k);
+	cmac_subkey(k);
+
+	memset(x, 0, sizeof(x));
+	while (len > 16) {
+		for (i = 0; i < 16; i++) {
+			x[i] ^= msg[i];
+		}
+		aes128_encrypt(ctx, x, x);
+		msg += 16;
+		len -= 16;
+	}
+
+	/* Last block, padded and masked with K2 when incomplete */
+	n = len;
+	if (n < 16) {
+		cmac_subkey(k);
+	}
+	for (i = 0; i < n; i++) {
+		x[i] ^= msg[i];
+	}
+	if (n < 16) {
+		x[n] ^= 0x80;
+	}
+	for (i = 0; i < 16; i++) {
+		x[i] ^= k[i];
+	}
+	aes128_encrypt(ctx, x, mac);
+}
+
+uint32_t eps_eia2(const uint8_t *key, uint32_t count, uint8_t bearer, uint8_t dir, const uint8_t *data, unsigned len)
+{
+	struct aes128_ctx ctx;
+	uint8_t buf[8 + EPS_CRYPT_MAX_LEN];
+	uint8_t mac[16];
+
+	assert(len <= EPS_CRYPT_MAX_LEN);
+
+	memset(buf, 0, 8);
+	buf[0] = count >> 24;
+	buf[1] = count >> 16;
+	buf[2] = count >> 8;
+	buf[3] = count;
+	buf[4] = ((bearer & 0x1f) << 3) | ((dir & 1) << 2);
+	memcpy(&buf[8], data, len);
+
+	aes128_set_key(&ctx, key);
+	aes128_cmac(&ctx, buf, 8 + len, mac);
+
+	return load_be32(mac);
+}
+
+/*
+	SNOW 3G (ETSI/SAGE UEA2 & UIA2 Document 2)
+*/
+
+struct snow3g_state {
+	uint32_t s[16];
+	uint32_t r1, r2, r3;
+};
+
+static uint32_t snow_mul_alpha[256];
+static uint32_t snow_div_alpha[256];
+
+static uint8_t mulxpow(uint8_t v, int i, uint8_t c)
+{
+	while (i--) {
+		v = mulx(v, c);
+	}
+	return v;
+}
+
+static void snow3g_init_tables()
+{
+	static int initialized = 0;
+	int c;
+
+	if (initialized) {
+		return;
+	}
+
+	for (c = 0; c < 256; c++) {
+		snow_mul_alpha[c] = ((uint32_t) mulxpow(c, 23, 0xa9) << 24) |
+				    ((uint32_t) mulxpow(c, 245, 0xa9) << 16) |
+				    ((uint32_t) mulxpow(c, 48, 0xa9) << 8) |
+				    mulxpow(c, 239, 0xa9);
+		snow_div_alpha[c] = ((uint32_t) mulxpow(c, 16, 0xa9) << 24) |
+				    ((uint32_t) mulxpow(c, 39, 0xa9) << 16) |
+				    ((uint32_t) mulxpow(c, 6, 0xa9) << 8) |
+				    mulxpow(c, 64, 0xa9);
+	}
+	initialized = 1;
+}
+
+/* S-box S1 (poly 0x1b, S_R) and S2 (poly 0x69, S_Q) */
+static uint32_t snow3g_sbox(uint32_t w, const uint8_t *sb, uint8_t poly)
+{
+	uint8_t w0 = sb[w >> 24];
+	uint8_t w1 = sb[(w >> 16) & 0xff];
+	uint8_t w2 = sb[(w >> 8) & 0xff];
+	uint8_t w3 = sb[w & 0xff];
+	uint8_t r0, r1, r2, r3;
+
+	r0 = mulx(w0, poly) ^ w1 ^ w2 ^ mulx(w3, poly) ^ w3;
+	r1 = mulx(w0, poly) ^ w0 ^ mulx(w1, poly) ^ w2 ^ w3;
+	r2 = w0 ^ mulx(w1, poly) ^ w1 ^ mulx(w2, poly) ^ w3;
+	r3 = w0 ^ w1 ^ mulx(w2, poly) ^ w2 ^ mulx(w3, poly);
+
+	return ((uint32_t) r0 << 24) | ((uint32_t) r1 << 16) | ((uint32_t) r2 << 8) | r3;
+}
+
+static uint32_t snow3g_clock_fsm(struct snow3g_state *st)
+{
+	uint32_t f = (st->s[15] + st->r1) ^ st->r2;
+	uint32_t r = st->r2 + (st->r3 ^ st->s[5]);
+
+	st->r3 = snow3g_sbox(st->r2, snow_sq, 0x69);
+	st->r2 = snow3g_sbox(st->r1, aes_sbox, 0x1b);
+	st->r1 = r;
+
+	return f;
+}
+
+static void snow3g_clock_lfsr(struct snow3g_state *st, uint32_t f)
+{
+	uint32_t v;
+
+	v = (st->s[0] << 8) ^ snow_mul_alpha[st->s[0] >> 24] ^
+	    st->s[2] ^ (st->s[11] >> 8) ^ snow_div_alpha[st->s[11] & 0xff] ^ f;
+
+	memmove(&st->s[0], &st->s[1], 15 * sizeof(uint32_t));
+	st->s[15] = v;
+}
+
+static void snow3g_init(struct snow3g_state *st, const uint32_t *k, const uint32_t *iv)
+{
+	int i;
+
+	snow3g_init_tables();
+
+	st->s[15] = k[3] ^ iv[0];
+	st->s[14] = k[2];
+	st->s[13] = k[1];
+	st->s[12] = k[0] ^ iv[1];
+	st->s[11] = k[3] ^ 0xffffffff;
+	st->s[10] = k[2] ^ 0xffffffff ^ iv[2];
+	st->s[9] = k[1] ^ 0xffffffff ^ iv[3];
+	st->s[8] = k[0] ^ 0xffffffff;
+	st->s[7] = k[3];
+	st->s[6] = k[2];
+	st->s[5] = k[1];
+	st->s[4] = k[0];
+	st->s[3] = k[3] ^ 0xffffffff;
+	st->s[2] = k[2] ^ 0xffffffff;
+	st->s[1] = k[1] ^ 0xffffffff;
+	st->s[0] = k[0] ^ 0xffffffff;
+	st->r1 = st->r2 = st->r3 = 0;
+
+	for (i = 0; i < 32; i++) {
+		snow3g_clock_lfsr(st, snow3g_clock_fsm(st));
+	}
+
+	/* The first keystream word is discarded */
+	snow3g_clock_fsm(st);
+	snow3g_clock_lfsr(st, 0);
+}
+
+static uint32_t snow3g_keystream(struct snow3g_state *st)
+{
+	uint32_t z = snow3g_clock_fsm(st) ^ st->s[0];
+
+	snow3g_clock_lfsr(st, 0);
+
+	return z;
+}
+
+static void snow3g_load_key(const uint8_t *key, uint32_t *k)
+{
+	k[3] = load_be32(&key[0]);
+	k[2] = load_be32(&key[4]);
+	k[1] = load_be32(&key[8]);
+	k[0] = load_be32(&key[12]);
+}
+
+/*
+	128-EEA1 and 128-EIA1 (3GPP TS 33.401, Annex B)
+*/
+
+void eps_eea1(const uint8_t *key, uint32_t count, uint8_t bearer, uint8_t dir, uint8_t *data, unsigned len)
+{
+	struct snow3g_state st;
+	uint32_t k[4], iv[4];
+	uint32_t z;
+	unsigned i;
+
+	snow3g_load_key(key, k);
+	iv[3] = count;
+	iv[2] = ((uint32_t) (bearer & 0x1f) << 27) | ((uint32_t) (dir & 1) << 26);
+	iv[1] = count;
+	iv[0] = iv[2];
+
+	snow3g_init(&st, k, iv);
+
+	for (i = 0; i < len; i += 4) {
+		z = snow3g_keystream(&st);
+		data[i] ^= z >> 24;
+		if (i + 1 < len) data[i+1] ^= z >> 16;
+		if (i + 2 < len) data[i+2] ^= z >> 8;
+		if (i + 3 < len) data[i+3] ^= z;
+	}
+}
+
+/* Multiplication in GF(2^64) as used by UIA2 */
+static uint64_t snow3g_mul64(uint64_t v, uint64_t p)
+{
+	uint64_t r = 0;
+	int i;
+
+	for (i = 0; i < 64; i++) {
+		if ((p >> i) & 1) {
+			r ^= v;
+		}
+		v = (v & 0x8000000000000000ULL) ? (v << 1) ^ 0x1b : (v << 1);
+	}
+
+	return r;
+}
+
+uint32_t eps_eia1(const uint8_t *key, uint32_t count, uint8_t bearer, uint8_t dir, const uint8_t *data, unsigned len)
+{
+	struct snow3g_state st;
+	uint32_t k[4], iv[4], z[5];
+	uint32_t fresh = (uint32_t) (bearer & 0x1f) << 27;
+	uint64_t p, q, m, eval = 0;
+	unsigned i, j, n;
+
+	snow3g_load_key(key, k);
+	iv[3] = count;
+	iv[2] = fresh;
+	iv[1] = count ^ ((uint32_t) (dir & 1) << 31);
+	iv[0] = fresh ^ ((uint32_t) (dir & 1) << 15);
+
+	snow3g_init(&st, k, iv);
+	for (i = 0; i < 5; i++) {
+		z[i] = snow3g_keystream(&st);
+	}
+
+	p = ((uint64_t) z[0] << 32) | z[1];
+	q = ((uint64_t) z[2] << 32) | z[3];
+
+	/* Message in 64 bit blocks, the last one zero padded */
+	for (i = 0; i < len || i == 0; i += 8) {
+		n = (len - i < 8) ? len - i : 8;
+		m = 0;
+		for (j = 0; j < n; j++) {
+			m |= (uint64_t) data[i+j] << (56 - 8 * j);
+		}
+		eval = snow3g_mul64(eval ^ m, p);
+	}
+
+	eval ^= (uint64_t) len * 8;
+	eval = snow3g_mul64(eval, q);
+
+	return (uint32_t) (eval >> 32) ^ z[4];
+}
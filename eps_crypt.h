@@ -0,0 +1,34 @@
+#ifndef EPS_CRYPT_H
+#define EPS_CRYPT_H
+
+#include <stdint.h>
+
+/* EPS encryption and integrity algorithm identifiers (3GPP TS 33.401) */
+#define EPS_EEA0 0
+#define EPS_EEA1 1	/* SNOW 3G */
+#define EPS_EEA2 2	/* AES */
+#define EPS_EIA0 0
+#define EPS_EIA1 1	/* SNOW 3G */
+#define EPS_EIA2 2	/* AES */
+
+/* Largest message that can be integrity protected by eps_eia2() */
+#define EPS_CRYPT_MAX_LEN 1024
+
+/* AES-128 expanded encryption key */
+struct aes128_ctx {
+	uint8_t rk[11*16];
+};
+
+void aes128_set_key(struct aes128_ctx *ctx, const uint8_t *key);
+void aes128_encrypt(const struct aes128_ctx *ctx, const uint8_t *in, uint8_t *out);
+int aes128_have_aesni();
+
+/* Encrypt or decrypt len bytes in place */
+void eps_eea1(const uint8_t *key, uint32_t count, uint8_t bearer, uint8_t dir, uint8_t *data, unsigned len);
+void eps_eea2(const uint8_t *key, uint32_t count, uint8_t bearer, uint8_t dir, uint8_t *data, unsigned len);
+
+/* Compute the 32 bit MAC over len bytes */
+uint32_t eps_eia1(const uint8_t *key, uint32_t count, uint8_t bearer, uint8_t dir, const uint8_t *data, unsigned len);
+uint32_t eps_eia2(const uint8_t *key, uint32_t count, uint8_t bearer, uint8_t dir, const uint8_t *data, unsigned len);
+
+#endif
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "failure.h"
+
+/* Payloads kept per cause */
+#define FAILURE_SAMPLES 8
+#define FAILURE_SAMPLE_LEN 256
+
+struct failure_sample {
+	unsigned len;
+	uint8_t data[FAILURE_SAMPLE_LEN];
+};
+
+struct failure_stats {
+	uint64_t count;
+	unsigned n_samples;
+	struct failure_sample sample[FAILURE_SAMPLES];
+};
+
+static const char *failure_names[FAIL_CAUSE_MAX] = {
+	"diag_len",
+	"diag_class",
+	"diag_discard",
+	"msg_flags",
+	"lapdm_sanity",
+	"lapdm_pad",
+	"lapdm_sequence",
+	"mi_sanity",
+	"mm_sanity",
+	"gmm_sanity",
+	"sm_sanity",
+	"rrc_hmac_len",
+	"rrc_asn1",
+	"nas_eps_parse",
+	"nas_eps_integrity",
+};
+
+static struct failure_stats failures[FAIL_CAUSE_MAX];
+static char *failure_filename = NULL;
+static uint32_t failure_rnd = 0x2545f491;
+
+/* xorshift32, good enough for sampling */
+static uint32_t failure_random()
+{
+	failure_rnd ^= failure_rnd << 13;
+	failure_rnd ^= failure_rnd >> 17;
+	failure_rnd ^= failure_rnd << 5;
+
+	return failure_rnd;
+}
+
+/* Count a failure and sample its payload */
+void failure_record(enum failure_cause cause, const uint8_t *data, unsigned len)
+{
+	struct failure_stats *fs;
+	struct failure_sample *sample;
+	uint64_t slot;
+
+	assert(cause < FAIL_CAUSE_MAX);
+
+	fs = &failures[cause];
+	fs->count++;
+
+	/* Reservoir sampling, every failure has the same chance to be kept */
+	if (fs->n_samples < FAILURE_SAMPLES) {
+		sample = &fs->sample[fs->n_samples++];
+	} else {
+		slot = failure_random() % fs->count;
+		if (slot >= FAILURE_SAMPLES) {
+			return;
+		}
+		sample = &fs->sample[slot];
+	}
+
+	if (!data) {
+		len = 0;
+	}
+	if (len > FAILURE_SAMPLE_LEN) {
+		len = FAILURE_SAMPLE_LEN;
+	}
+	sample->len = len;
+	if (len) {
+		memcpy(sample->data, data, len);
+	}
+}
+
+void failure_record_msg(enum failure_cause cause, struct radio_message *m)
+{
+	if (!m) {
+		failure_record(cause, NULL, 0);
+		return;
+	}
+
+	if (m->rat == RAT_GSM) {
+		failure_record(cause, m->msg, m->msg_len);
+	} else {
+		failure_record(cause, m->bb.data, m->msg_len);
+	}
+}
+
+void failure_set_output(const char *filename)
+{
+	free(failure_filename);
+	failure_filename = filename ? strdup(filename) : NULL;
+}
+
+/* Write counters and sampled payloads (hex, one per line) to the side file */
+void failure_dump()
+{
+	FILE *f;
+	unsigned i, j, k;
+
+	if (!failure_filename) {
+		return;
+	}
+
+	f = fopen(failure_filename, "w");
+	if (!f) {
+		perror("failure_dump");
+		return;
+	}
+
+	for (i = 0; i < FAIL_CAUSE_MAX; i++) {
+		if (failures[i].count) {
+			fprintf(f, "count %s %llu\n", failure_names[i], (unsigned long long) failures[i].count);
+		}
+	}
+
+	for (i = 0; i < FAIL_CAUSE_MAX; i++) {
+		for (j = 0; j < failures[i].n_samples; j++) {
+			struct failure_sample *sample = &failures[i].sample[j];
+
+			fprintf(f, "sample %s ", failure_names[i]);
+			for (k = 0; k < sample->len; k++) {
+				fprintf(f, "%02x", sample->data[k]);
+			}
+			fprintf(f, "\n");
+		}
+	}
+
+	fclose(f);
+}
+
+/* Append the failure counters as a JSON object */
+void failure_dump_json(FILE *f)
+{
+	unsigned i;
+
+	fprintf(f, "{");
+	for (i = 0; i < FAIL_CAUSE_MAX; i++) {
+		fprintf(f, "%s\"%s\": %llu", i ? ", " : "", failure_names[i],
+			(unsigned long long) failures[i].count);
+	}
+	fprintf(f, "}");
+}
@@ -0,0 +1,40 @@
+#ifndef FAILURE_H
+#define FAILURE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "process.h"
+
+/* Decode failure causes */
+enum failure_cause {
+	FAIL_DIAG_LEN,		/* DIAG packet shorter than announced */
+	FAIL_DIAG_CLASS,	/* Unsupported DIAG class */
+	FAIL_DIAG_DISCARD,	/* DIAG protocol passed to a handler that lacks it */
+	FAIL_MSG_FLAGS,		/* Wrong radio message flags */
+	FAIL_LAPDM_SANITY,	/* LAPDm header checks failed */
+	FAIL_LAPDM_PAD,		/* LAPDm padding too long */
+	FAIL_LAPDM_SEQUENCE,	/* LAPDm frame out of sequence */
+	FAIL_MI_SANITY,		/* Mobile identity length or type */
+	FAIL_MM_SANITY,		/* MM message checks failed */
+	FAIL_GMM_SANITY,	/* GMM message checks failed */
+	FAIL_SM_SANITY,		/* SM message checks failed */
+	FAIL_RRC_HMAC_LEN,	/* RRC message too short for integrity header */
+	FAIL_RRC_ASN1,		/* RRC ASN.1 decoding error */
+	FAIL_NAS_EPS_PARSE,	/* NAS/EPS message could not be parsed */
+	FAIL_NAS_EPS_INTEGRITY,	/* NAS/EPS integrity check failed */
+	FAIL_CAUSE_MAX
+};
+
+/* Count a failure and sample its payload */
+void failure_record(enum failure_cause cause, const uint8_t *data, unsigned len);
+void failure_record_msg(enum failure_cause cause, struct radio_message *m);
+
+/* Side file for sampled payloads, written by failure_dump() */
+void failure_set_output(const char *filename);
+void failure_dump();
+
+/* Append the failure counters as a JSON object */
+void failure_dump_json(FILE *f);
+
+#endif
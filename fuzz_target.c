@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "session.h"
+#include "process.h"
+#include "diag_input.h"
+#include "l3_handler.h"
+#include "lte_nas_eps.h"
+#include "umts_rrc.h"
+#include "sms.h"
+
+/*
+ * In-process fuzz targets for libFuzzer. Every input is decoded from a clean
+ * parser state, diag_reset() drops sessions, cells and SIB reassembly.
+ *
+ * The target is chosen at build time with -DFUZZ_TARGET=\"name\" or with
+ * the FUZZ_TARGET environment variable. With -DFUZZ_STANDALONE a main() is
+ * included which runs files given on the command line, e.g. to replay
+ * crashes without libFuzzer.
+ */
+
+#ifndef FUZZ_TARGET
+#define FUZZ_TARGET "diag"
+#endif
+
+#define LAPDM_FRAME_LEN 23
+
+typedef void (*fuzz_func)(const uint8_t *data, size_t size);
+
+static fuzz_func fuzz_selected = NULL;
+static uint8_t fuzz_buf[4096];
+
+/* Attach a fresh message to both domains, like handle_radio_msg() does */
+static struct radio_message *fuzz_begin(uint8_t rat, uint8_t flags, uint8_t ul)
+{
+	struct radio_message *m;
+
+	m = radio_msg_alloc();
+	memset(m, 0, sizeof(struct radio_message));
+
+	m->rat = rat;
+	m->flags = flags | MSG_DECODED;
+	if (ul) {
+		m->bb.arfcn[0] = ARFCN_UPLINK;
+	}
+
+	_s[0].new_msg = m;
+	_s[1].new_msg = m;
+
+	return m;
+}
+
+/* Hand the message over to the session or free it */
+static void fuzz_release(struct radio_message *m)
+{
+	if (_s[0].new_msg == m) {
+		if (m->flags & MSG_DECODED) {
+			link_to_msg_list(&_s[m->domain & 1], m);
+		} else {
+			radio_msg_free(m);
+		}
+	}
+	_s[0].new_msg = NULL;
+	_s[1].new_msg = NULL;
+}
+
+static void fuzz_end(struct radio_message *m)
+{
+	fuzz_release(m);
+	diag_reset();
+}
+
+/* Input is a stream of DIAG frames, separated by HDLC flags */
+static void fuzz_diag(const uint8_t *data, size_t size)
+{
+	size_t start = 0;
+	size_t i, len;
+
+	for (i = 0; i <= size; i++) {
+		if ((i < size) && (data[i] != 0x7e)) {
+			continue;
+		}
+
+		len = i - start;
+		if (len > sizeof(fuzz_buf) - 1) {
+			len = sizeof(fuzz_buf) - 1;
+		}
+		if (len) {
+			/* Same padding as diag_import */
+			memcpy(fuzz_buf, &data[start], len);
+			fuzz_buf[len] = 0x2b;
+			handle_diag(fuzz_buf, len);
+		}
+		start = i + 1;
+	}
+
+	diag_reset();
+}
+
+/* First byte: direction, rest: GSM L3 message */
+static void fuzz_dtap(const uint8_t *data, size_t size)
+{
+	struct radio_message *m;
+	uint8_t ul;
+
+	if (size < 2 || size > sizeof(fuzz_buf)) {
+		return;
+	}
+
+	ul = data[0] & 1;
+	memcpy(fuzz_buf, &data[1], size - 1);
+
+	m = fuzz_begin(RAT_GSM, MSG_SDCCH, ul);
+	_s[0].rat = RAT_GSM;
+	_s[1].rat = RAT_GSM;
+	handle_dtap(_s, fuzz_buf, size - 1, 0, ul);
+	fuzz_end(m);
+}
+
+/* First byte: direction and channel, rest: consecutive LAPDm frames */
+static void fuzz_lapdm(const uint8_t *data, size_t size)
+{
+	struct radio_message *m;
+	struct lapdm_buf *mb;
+	uint8_t ul, flags;
+	size_t off, len;
+	uint32_t fn = 0;
+
+	if (size < 2) {
+		return;
+	}
+
+	ul = data[0] & 1;
+	switch ((data[0] >> 1) & 3) {
+	case 0:
+		flags = MSG_SDCCH;
+		mb = &_s[0].chan_sdcch[ul];
+		break;
+	case 1:
+		flags = MSG_SACCH;
+		mb = &_s[0].chan_sacch[ul];
+		break;
+	default:
+		flags = MSG_FACCH;
+		mb = &_s[0].chan_facch[ul];
+		break;
+	}
+
+	_s[0].rat = RAT_GSM;
+	_s[1].rat = RAT_GSM;
+
+	for (off = 1; off < size; off += LAPDM_FRAME_LEN) {
+		len = size - off;
+		if (len > LAPDM_FRAME_LEN) {
+			len = LAPDM_FRAME_LEN;
+		}
+		memset(fuzz_buf, 0x2b, LAPDM_FRAME_LEN);
+		memcpy(fuzz_buf, &data[off], len);
+
+		m = fuzz_begin(RAT_GSM, flags, ul);
+		m->bb.fn[0] = fn;
+		handle_lapdm(_s, mb, fuzz_buf, len, fn, ul);
+		fuzz_release(m);
+		fn += 51;
+	}
+
+	diag_reset();
+}
+
+/* First byte: direction, rest: plain LTE NAS message */
+static void fuzz_naseps(const uint8_t *data, size_t size)
+{
+	struct radio_message *m;
+
+	if (size < 2 || size > sizeof(fuzz_buf)) {
+		return;
+	}
+
+	memcpy(fuzz_buf, &data[1], size - 1);
+
+	m = fuzz_begin(RAT_LTE, MSG_SDCCH, data[0] & 1);
+	_s[0].rat = RAT_LTE;
+	_s[1].rat = RAT_LTE;
+	handle_naseps(_s, fuzz_buf, size - 1);
+	fuzz_end(m);
+}
+
+static void fuzz_rrc(const uint8_t *data, size_t size, uint8_t ul)
+{
+	struct radio_message *m;
+
+	if (size < 1 || size > sizeof(fuzz_buf)) {
+		return;
+	}
+
+	memcpy(fuzz_buf, data, size);
+
+	m = fuzz_begin(RAT_UMTS, MSG_SDCCH, ul);
+	_s[0].rat = RAT_UMTS;
+	_s[1].rat = RAT_UMTS;
+	if (ul) {
+		handle_dcch_ul(_s, fuzz_buf, size);
+	} else {
+		handle_dcch_dl(_s, fuzz_buf, size);
+	}
+	fuzz_end(m);
+}
+
+/* UL-DCCH message */
+static void fuzz_rrc_ul(const uint8_t *data, size_t size)
+{
+	fuzz_rrc(data, size, 1);
+}
+
+/* DL-DCCH message */
+static void fuzz_rrc_dl(const uint8_t *data, size_t size)
+{
+	fuzz_rrc(data, size, 0);
+}
+
+/* First byte: from network flag, rest: SMS TPDU */
+static void fuzz_tpdu(const uint8_t *data, size_t size)
+{
+	struct radio_message *m;
+	char smsc[] = "+491710760000";
+
+	if (size < 2 || size > sizeof(fuzz_buf)) {
+		return;
+	}
+
+	memcpy(fuzz_buf, &data[1], size - 1);
+
+	m = fuzz_begin(RAT_GSM, MSG_SDCCH, !(data[0] & 1));
+	_s[0].rat = RAT_GSM;
+	handle_tpdu(_s, fuzz_buf, size - 1, data[0] & 1, smsc);
+	fuzz_end(m);
+}
+
+static const struct {
+	const char *name;
+	fuzz_func func;
+} fuzz_targets[] = {
+	{ "diag", fuzz_diag },
+	{ "dtap", fuzz_dtap },
+	{ "lapdm", fuzz_lapdm },
+	{ "naseps", fuzz_naseps },
+	{ "rrc_ul", fuzz_rrc_ul },
+	{ "rrc_dl", fuzz_rrc_dl },
+	{ "tpdu", fuzz_tpdu },
+};
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+	const char *name = getenv("FUZZ_TARGET");
+	unsigned i;
+
+	if (!name) {
+		name = FUZZ_TARGET;
+	}
+
+	for (i = 0; i < sizeof(fuzz_targets) / sizeof(fuzz_targets[0]); i++) {
+		if (!strcmp(fuzz_targets[i].name, name)) {
+			fuzz_selected = fuzz_targets[i].func;
+		}
+	}
+	if (!fuzz_selected) {
+		fprintf(stderr, "Unknown fuzz target: %s\n", name);
+		exit(1);
+	}
+
+	/* No console, SQL or GSMTAP output */
+	msg_verbose = 0;
+	auto_reset = 1;
+	auto_timestamp = 0;
+
+	process_init();
+	session_init(1, 0, NULL, CALLBACK_NONE);
+	cell_init(1, 1, CALLBACK_NONE);
+
+	return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	fuzz_selected(data, size);
+
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+int main(int argc, char **argv)
+{
+	static uint8_t input[1 << 20];
+	FILE *f;
+	size_t len;
+	int i;
+
+	LLVMFuzzerInitialize(&argc, &argv);
+
+	for (i = 1; i < argc; i++) {
+		f = fopen(argv[i], "rb");
+		if (!f) {
+			perror(argv[i]);
+			return 1;
+		}
+		len = fread(input, 1, sizeof(input), f);
+		fclose(f);
+
+		printf("Running %s (%zu bytes)\n", argv[i], len);
+		fflush(stdout);
+		LLVMFuzzerTestOneInput(input, len);
+	}
+
+	return 0;
+}
+#endif
@@ -1,12 +1,19 @@
+/* recvmmsg() */
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <err.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <pcap/pcap.h>
 #include <osmocom/gsm/rsl.h>
 #include <osmocom/core/gsmtap.h>
 #include <osmocom/core/utils.h>
@@ -15,201 +22,504 @@
 #include "process.h"
 #include "cell_info.h"
 #include "l3_handler.h"
+#include "pcap_file.h"
+#include "manifest.h"
 
-void chantype_from_gsmtap(struct radio_message *m, uint8_t gsmtap_chantype, uint8_t timeslot)
+/* Flags and RSL channel number, flags are 0 for channels not handled */
+static void chantype_from_gsmtap(uint8_t *flags, uint8_t *chan_nr, uint8_t gsmtap_chantype, uint8_t timeslot)
 {
 	uint8_t rsl_type = 0;
 
 	switch (gsmtap_chantype & ~GSMTAP_CHANNEL_ACCH) {
 	case GSMTAP_CHANNEL_TCH_F:
 		rsl_type = RSL_CHAN_Bm_ACCHs;
-		m->flags = MSG_FACCH;
+		*flags = MSG_FACCH;
 		break;
 	case GSMTAP_CHANNEL_TCH_H:
 		rsl_type = RSL_CHAN_Lm_ACCHs;
-		m->flags = MSG_FACCH;
+		*flags = MSG_FACCH;
 		break;
 	case GSMTAP_CHANNEL_SDCCH4:
 		rsl_type = RSL_CHAN_SDCCH4_ACCH;
 		if (gsmtap_chantype & GSMTAP_CHANNEL_ACCH) {
-			m->flags = MSG_SACCH;
+			*flags = MSG_SACCH;
 		} else {
-			m->flags = MSG_SDCCH;
+			*flags = MSG_SDCCH;
 		}
 		break;
 	case GSMTAP_CHANNEL_SDCCH8:
 		rsl_type = RSL_CHAN_SDCCH8_ACCH;
 		if (gsmtap_chantype & GSMTAP_CHANNEL_ACCH) {
-			m->flags = MSG_SACCH;
+			*flags = MSG_SACCH;
 		} else {
-			m->flags = MSG_SDCCH;
+			*flags = MSG_SDCCH;
 		}
 		break;
 	case GSMTAP_CHANNEL_BCCH:
 		rsl_type = RSL_CHAN_BCCH;
-		m->flags = MSG_BCCH;
+		*flags = MSG_BCCH;
 		break;
 	case GSMTAP_CHANNEL_RACH:
 		rsl_type = RSL_CHAN_RACH;
-		m->flags = MSG_BCCH;
+		*flags = MSG_BCCH;
 		break;
 	case GSMTAP_CHANNEL_PCH:
 		rsl_type = RSL_CHAN_PCH_AGCH;
-		m->flags = MSG_BCCH;
+		*flags = MSG_BCCH;
 		break;
 	default:
-		m->flags = 0;
+		*flags = 0;
 		return;
 	}
 
-	m->chan_nr = rsl_type | timeslot;
+	*chan_nr = rsl_type | timeslot;
 }
 
-void process_gsmtap(const struct pcap_pkthdr* pkt_hdr, const u_char* pkt_data, uint32_t offset)
+/* Header and payload fit, checked before anything is copied */
+static int gsmtap_valid(const uint8_t *data, unsigned len)
 {
-	struct gsmtap_hdr *gh;
+	const struct gsmtap_hdr *gh = (const struct gsmtap_hdr *) data;
 	struct radio_message *m;
+	unsigned payload;
 
-	assert(pkt_hdr->len - offset > 4);
+	if (len < sizeof(struct gsmtap_hdr) || gh->version != 2) {
+		return 0;
+	}
+	if (gh->hdr_len * 4 < sizeof(struct gsmtap_hdr) || len <= gh->hdr_len * 4) {
+		return 0;
+	}
 
-	gh = (struct gsmtap_hdr *) (pkt_data + offset);
+	payload = len - gh->hdr_len * 4;
+	if (gh->type == GSMTAP_TYPE_UM) {
+		return payload <= sizeof(m->msg);
+	}
 
-	assert(gh->version == 2);
-	assert(pkt_hdr->len - offset > gh->hdr_len*4);
+	return payload <= sizeof(m->bb.data);
+}
 
-	offset += gh->hdr_len*4;
+/* A radio message is only taken from the pool for channels that are handled */
+void process_gsmtap(const struct timeval *ts, const uint8_t *data, uint32_t len)
+{
+	const struct gsmtap_hdr *gh = (const struct gsmtap_hdr *) data;
+	struct radio_message *m;
+	uint8_t flags = 0;
+	uint8_t chan_nr = 0;
+	uint32_t offset;
 
-	m = (struct radio_message *) malloc(sizeof(struct radio_message));
-	if (!m) {
-		printf("Cannot allocate memory for radio message\n");
-		exit(1);
+	if (!gsmtap_valid(data, len)) {
+		return;
 	}
 
-	memset(m, 0, sizeof(*m));
-
-	m->msg_len = pkt_hdr->len - offset;
+	offset = gh->hdr_len * 4;
 
-	switch (gh->type) {
-	case GSMTAP_TYPE_UM:
-		m->rat = RAT_GSM;
-		chantype_from_gsmtap(m, gh->sub_type, gh->timeslot);
-		memcpy(m->msg, &pkt_data[offset], m->msg_len);
-		break;
-	case GSMTAP_TYPE_UMTS_RRC:
-		m->rat = RAT_UMTS;
-		memcpy(m->bb.data, &pkt_data[offset], m->msg_len);
-		break;
-	case GSMTAP_TYPE_LTE_RRC:
-		m->rat = RAT_LTE;
-		memcpy(m->bb.data, &pkt_data[offset], m->msg_len);
-		break;
-	default:
-		free(m);
-		return;
+	/* UMTS and LTE RRC carry no channel flags and are not decoded */
+	if (gh->type == GSMTAP_TYPE_UM) {
+		chantype_from_gsmtap(&flags, &chan_nr, gh->sub_type, gh->timeslot);
 	}
 
-	m->bb.fn[0] = ntohl(gh->frame_number);
-	m->bb.arfcn[0] = ntohs(gh->arfcn);
-	if (m->flags & MSG_BCCH) {
-		_s[0].arfcn = m->bb.arfcn[0];
-		_s[1].arfcn = m->bb.arfcn[0];
+	if (flags & MSG_BCCH) {
+		_s[0].arfcn = ntohs(gh->arfcn);
+		_s[1].arfcn = ntohs(gh->arfcn);
 	}
 
-	if (m->flags) {
-		_s->timestamp = pkt_hdr->ts;
-		m->timestamp = pkt_hdr->ts;
+	if (flags) {
+		m = radio_msg_alloc();
+		memset(m, 0, sizeof(*m));
+
+		m->rat = RAT_GSM;
+		m->flags = flags;
+		m->chan_nr = chan_nr;
+		m->msg_len = len - offset;
+		memcpy(m->msg, &data[offset], m->msg_len);
+		m->bb.fn[0] = ntohl(gh->frame_number);
+		m->bb.arfcn[0] = ntohs(gh->arfcn);
+
+		_s->timestamp = *ts;
+		m->timestamp = *ts;
 		handle_radio_msg(_s, m);
 	}
 
-	cell_dump(pkt_hdr->ts.tv_sec, 0, 0);
+	cell_dump(ts->tv_sec, 0, 0);
+}
+
+/* Live mode, datagrams per recvmmsg() call and largest datagram kept */
+#define GSMTAP_BATCH 64
+#define GSMTAP_SLOT_SIZE 2048
+#define GSMTAP_STATS_INTERVAL 60
+#define GSMTAP_RCVBUF (4 * 1024 * 1024)
+
+struct gsmtap_stats {
+	unsigned long long datagrams;
+	unsigned long long bytes;
+	unsigned long long batches;
+	unsigned long long invalid;	/* Too short, truncated or not GSMTAP v2 */
+	uint32_t kernel_drops;		/* SO_RXQ_OVFL, socket buffer overruns */
+	unsigned max_batch;
+	int queued;			/* Bytes left in the socket after a batch */
+	int max_queued;
+};
+
+/* Receive buffers, allocated once and reused for every batch */
+struct gsmtap_ring {
+	struct mmsghdr hdr[GSMTAP_BATCH];
+	struct iovec iov[GSMTAP_BATCH];
+	uint8_t cmsg[GSMTAP_BATCH][CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(uint32_t))];
+	uint8_t data[GSMTAP_BATCH][GSMTAP_SLOT_SIZE];
+};
+
+static volatile sig_atomic_t live_stop = 0;
+
+static void live_signal(int sig)
+{
+	live_stop = 1;
+}
+
+static void live_print_stats(const struct gsmtap_stats *st)
+{
+	fprintf(stderr, "gsmtap: datagrams=%llu bytes=%llu batches=%llu max_batch=%u "
+		"invalid=%llu kernel_drops=%u queued=%d max_queued=%d\n",
+		st->datagrams, st->bytes, st->batches, st->max_batch,
+		st->invalid, st->kernel_drops, st->queued, st->max_queued);
 }
 
-void process_udp(const struct pcap_pkthdr* pkt_hdr, const u_char* pkt_data, uint32_t offset)
+static void live_handle(struct gsmtap_stats *st, struct msghdr *mh, unsigned len)
 {
-	uint16_t *dport;
+	struct timeval ts;
+	struct cmsghdr *cm;
+	int have_ts = 0;
 
-	assert(pkt_hdr->len - offset > 8);
+	for (cm = CMSG_FIRSTHDR(mh); cm; cm = CMSG_NXTHDR(mh, cm)) {
+		if (cm->cmsg_level != SOL_SOCKET) {
+			continue;
+		}
+		if (cm->cmsg_type == SO_TIMESTAMP) {
+			memcpy(&ts, CMSG_DATA(cm), sizeof(struct timeval));
+			have_ts = 1;
+		} else if (cm->cmsg_type == SO_RXQ_OVFL) {
+			memcpy(&st->kernel_drops, CMSG_DATA(cm), sizeof(uint32_t));
+		}
+	}
+	if (!have_ts) {
+		gettimeofday(&ts, NULL);
+	}
 
-	dport = (uint16_t *) &pkt_data[offset+2];
+	st->datagrams++;
+	st->bytes += len;
 
-	/* check UDP port */
-	if (ntohs(*dport) == GSMTAP_UDP_PORT) {
-		process_gsmtap(pkt_hdr, (u_char *) pkt_data, offset+8);
+	if ((mh->msg_flags & MSG_TRUNC) || !gsmtap_valid((uint8_t *) mh->msg_iov->iov_base, len)) {
+		st->invalid++;
+		return;
 	}
+
+	process_gsmtap(&ts, (uint8_t *) mh->msg_iov->iov_base, len);
 }
 
-void process_ip(const struct pcap_pkthdr* pkt_hdr, const u_char* pkt_data, uint32_t offset)
+/* Decode GSMTAP datagrams sent to port until SIGINT or SIGTERM */
+static void live_loop(uint16_t port)
 {
-	assert(pkt_hdr->len - offset > 20);
+	static struct gsmtap_ring ring;
+	struct gsmtap_stats st;
+	struct sockaddr_in addr;
+	struct sigaction sa;
+	time_t last_stats;
+	int rcvbuf = GSMTAP_RCVBUF;
+	int one = 1;
+	int fd, n, i;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		err(1, "socket");
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0) {
+		warn("SO_RCVBUF");
+	}
+	if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one)) < 0) {
+		warn("SO_TIMESTAMP");
+	}
+	if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)) < 0) {
+		warn("SO_RXQ_OVFL, kernel drops are not counted");
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		err(1, "Cannot bind to UDP port %u", port);
+	}
+
+	/* No SA_RESTART, recvmmsg() has to return on signals */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = live_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	memset(&st, 0, sizeof(st));
+	last_stats = time(NULL);
+
+	while (!live_stop) {
+		for (i = 0; i < GSMTAP_BATCH; i++) {
+			ring.iov[i].iov_base = ring.data[i];
+			ring.iov[i].iov_len = GSMTAP_SLOT_SIZE;
+			memset(&ring.hdr[i].msg_hdr, 0, sizeof(struct msghdr));
+			ring.hdr[i].msg_hdr.msg_iov = &ring.iov[i];
+			ring.hdr[i].msg_hdr.msg_iovlen = 1;
+			ring.hdr[i].msg_hdr.msg_control = ring.cmsg[i];
+			ring.hdr[i].msg_hdr.msg_controllen = sizeof(ring.cmsg[i]);
+		}
+
+		n = recvmmsg(fd, ring.hdr, GSMTAP_BATCH, MSG_WAITFORONE, NULL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			err(1, "recvmmsg");
+		}
+
+		st.batches++;
+		if ((unsigned) n > st.max_batch) {
+			st.max_batch = n;
+		}
+
+		for (i = 0; i < n; i++) {
+			live_handle(&st, &ring.hdr[i].msg_hdr, ring.hdr[i].msg_len);
+		}
+
+		/* SQL output is buffered, keep up with the feed */
+		fflush(stdout);
+
+		if (ioctl(fd, FIONREAD, &st.queued) == 0 && st.queued > st.max_queued) {
+			st.max_queued = st.queued;
+		}
+
+		if (time(NULL) - last_stats >= GSMTAP_STATS_INTERVAL) {
+			live_print_stats(&st);
+			last_stats = time(NULL);
+		}
+	}
+
+	live_print_stats(&st);
+	close(fd);
+}
 
-	/* check protocol */
-	if (pkt_data[offset+9] == 0x11) {
-		process_udp(pkt_hdr, pkt_data, offset+20);
+static int callback_from_name(const char *name)
+{
+	if (!strcmp(name, "mysql")) {
+		return CALLBACK_MYSQL;
+	} else if (!strcmp(name, "sqlite")) {
+		return CALLBACK_SQLITE;
+	} else if (!strcmp(name, "console")) {
+		return CALLBACK_CONSOLE;
+	} else if (!strcmp(name, "none")) {
+		return CALLBACK_NONE;
 	}
+
+	return -1;
 }
 
-void process_vlan(const struct pcap_pkthdr* pkt_hdr, const u_char* pkt_data, uint32_t offset)
+/* Decode all GSMTAP packets of a pcap or pcapng file */
+static int import_file(const char *filename, unsigned start_cid, int callback, int *started)
 {
-	uint16_t *etype;
+	struct pcap_file *pf;
+	struct pcap_packet pkt;
+	const uint8_t *payload;
+	uint32_t payload_len;
+	uint16_t dport;
+	int ret;
+
+	pf = pcap_file_open(filename);
+	if (!pf) {
+		warn("Cannot open capture %s", filename);
+		return -1;
+	}
+
+	while ((ret = pcap_file_next(pf, &pkt)) > 0) {
+		if (!pcap_udp_payload(&pkt, &dport, &payload, &payload_len) ||
+		    dport != GSMTAP_UDP_PORT) {
+			continue;
+		}
+
+		/* Cell timestamps start with the first packet */
+		if (!*started) {
+			cell_init(start_cid, pkt.ts.tv_sec, callback);
+			*started = 1;
+		}
+
+		process_gsmtap(&pkt.ts, payload, payload_len);
+	}
 
-	/* check inner ethertype */
-	etype = (uint16_t *) &pkt_data[offset+2];
-	if (ntohs(*etype) == 0x0800) {
-		process_ip(pkt_hdr, pkt_data, offset+4);
+	if (ret < 0) {
+		warnx("Damaged capture %s, stopped at the last good block", filename);
 	}
+
+	pcap_file_close(pf);
+
+	return ret;
 }
 
-void process_ethernet(u_char *arg, const struct pcap_pkthdr* pkt_hdr, const u_char* pkt_data)
+/* Import unless the manifest lists the capture's content already */
+static int import_new_file(struct manifest *m, const char *filename, unsigned start_cid,
+		int callback, int *started)
 {
-	uint16_t *etype;
+	struct manifest_file mf;
+	int hashed = 0;
+	int ret;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd >= 0) {
+		if (manifest_file_init(m, filename, fd, NULL, 0, &mf) == 0) {
+			hashed = 1;
+		}
+		close(fd);
+	}
 
-	/* check ethertype */
-	etype = (uint16_t *) &pkt_data[12];
-	switch (ntohs(*etype)) {
-	case 0x0800: // IP
-		process_ip(pkt_hdr, pkt_data, 14);
-		break;
-	case 0x8100: // VLAN
-		process_vlan(pkt_hdr, pkt_data, 14);
-		break;
+	if (hashed && manifest_seen(m, &mf)) {
+		fprintf(stderr, "Already ingested: %s\n", filename);
+		return 0;
+	}
+
+	mf.first_sid = session_next_id();
+	mf.first_cid = *started ? cell_next_id() : start_cid;
+
+	ret = import_file(filename, start_cid, callback, started);
+	if (ret == 0 && hashed) {
+		/* Recorded only once all its sessions and cells are stored */
+		session_flush();
+		if (*started) {
+			cell_dump(_s->timestamp.tv_sec, 1, 0);
+		}
+		manifest_add(m, filename, &mf, session_next_id(),
+			     *started ? cell_next_id() : start_cid);
 	}
+
+	return ret;
+}
+
+static int is_number(const char *s)
+{
+	return s[0] && strspn(s, "0123456789") == strlen(s);
+}
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [-o <output>] [-s <id>] [-c <id>] [-M <manifest>] <capture>...\n", progname);
+	printf("       %s [-o <output>] [-s <id>] [-c <id>] -u <port>\n", progname);
+	printf("	-o <output>   - SQL output: mysql (default), sqlite, console or none\n");
+	printf("	-s <id>       - First session_info ID to be used for SQL\n");
+	printf("	-c <id>       - First cell_info ID to be used for SQL\n");
+	printf("	-u <port>     - Decode live GSMTAP from UDP <port> (usually %u) until SIGINT\n", GSMTAP_UDP_PORT);
+	printf("	-M <manifest> - Skip captures listed in <manifest>, add new ones\n");
+	printf("	<capture>     - pcap or pcapng files (Ethernet, Linux SLL/SLL2, raw IP), gzip/zstd/xz if built in\n");
+	printf("The old form <capture> <start session id> <start cell id> is still accepted\n");
+	exit(1);
 }
 
 int main(int argc, char *argv[]) {
-	char errbuf[PCAP_ERRBUF_SIZE];
 	unsigned unused1, unused2;
-	pcap_t *read_fp;
-	struct pcap_pkthdr pkt_hdr;
-	const u_char* pkt_data;
+	struct manifest *manifest = NULL;
+	int callback = CALLBACK_MYSQL;
+	const char *progname = argv[0];
+	long sid = -1;
+	long cid = -1;
+	int port = -1;
+	int started = 0;
+	int failed = 0;
+	int ret;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "o:s:c:u:M:")) != -1) {
+		switch (ch) {
+			case 'o':
+				callback = callback_from_name(optarg);
+				if (callback < 0) {
+					usage(progname);
+				}
+				break;
+			case 's':
+				sid = atol(optarg);
+				break;
+			case 'c':
+				cid = atol(optarg);
+				break;
+			case 'u':
+				port = atoi(optarg);
+				if (port <= 0 || port > 65535) {
+					usage(progname);
+				}
+				break;
+			case 'M':
+				manifest = manifest_open(optarg);
+				if (!manifest) {
+					err(1, "Cannot open manifest: %s", optarg);
+				}
+				break;
+			default:
+				usage(progname);
+		}
+	}
 
-	if (argc < 4) {
-		printf("Not enough arguments\n");
-		printf("Usage: %s <file.pcap> <start session id> <start cell id>\n", argv[0]);
-		return -1;
+	argc -= optind;
+	argv += optind;
+
+	/* Session and cell IDs as the last two arguments */
+	if (sid < 0 && cid < 0 && argc >= 2 && is_number(argv[argc - 2]) && is_number(argv[argc - 1])) {
+		sid = atol(argv[argc - 2]);
+		cid = atol(argv[argc - 1]);
+		argc -= 2;
+	}
+	if (sid < 0) {
+		sid = 0;
 	}
+	if (cid < 0) {
+		cid = 0;
+	}
+
+	if (port > 0) {
+		if (argc > 0) {
+			usage(progname);
+		}
 
-	read_fp = pcap_open_offline(argv[1], errbuf);
+		/* No GSMTAP output, it would be received again */
+		session_init(sid, 1, NULL, callback);
+		cell_init(cid, time(NULL), callback);
+		msg_verbose = 0;
 
-	if (pcap_datalink(read_fp) != DLT_EN10MB) {
-		printf("Wrong datalink type\n");
-		return 1;
+		live_loop(port);
+
+		session_destroy(&unused1, &unused2);
+
+		return 0;
 	}
 
-	pkt_data = pcap_next(read_fp, &pkt_hdr);
-	if (!pkt_data) {
-		printf("Cannot read first packet\n");
-		return 1;
+	if (argc < 1) {
+		printf("Not enough arguments\n");
+		usage(progname);
 	}
 
-	session_init(atoi(argv[2]), 1, "127.0.0.1", CALLBACK_MYSQL);
-	cell_init(atoi(argv[3]), pkt_hdr.ts.tv_sec, CALLBACK_MYSQL);
+	session_init(sid, 1, "127.0.0.1", callback);
 	msg_verbose = 0;
 
-	process_ethernet(0, &pkt_hdr, pkt_data);
+	for (; argc > 0; argc--, argv++) {
+		if (manifest) {
+			ret = import_new_file(manifest, argv[0], cid, callback, &started);
+		} else {
+			ret = import_file(argv[0], cid, callback, &started);
+		}
+		if (ret < 0) {
+			failed = 1;
+		}
+	}
 
-	pcap_loop(read_fp, -1, process_ethernet, NULL);
+	if (!started) {
+		cell_init(cid, time(NULL), callback);
+	}
 
 	session_destroy(&unused1, &unused2);
 
-	return 0;
+	manifest_close(manifest);
+
+	return failed;
 }
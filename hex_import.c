@@ -1,31 +1,47 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <endian.h>
 
 #include "diag_input.h"
 #include "bit_func.h"
 #include "assert.h"
-#include <osmocom/core/utils.h>
 
-int main(int argc, char *argv[])
-{
-	uint8_t msg[4096]; 
-	int len = 0;
-	char diag_hex[4096];
-	char *ptr = NULL;
-	unsigned unused1, unused2;
+/*
+ * Binary framing on stdin (-b): per message a little endian header, then
+ * len bytes of DIAG payload as found between HDLC flags. An appid of 0
+ * keeps the current handset.
+ */
+struct bin_header {
+	uint32_t len;
+	uint32_t appid;
+} __attribute__((packed));
 
-	if (argc < 3) {
-		printf("Not enough arguments\n");
-		printf("Usage: %s <session_info id> <cell_info id>\n", argv[0]);
-		fflush(stdout);
-		return -1;
-	}
+#define BIN_BUF_SIZE (1024 * 1024)
+#define BIN_MAX_MSG 65535
 
-	diag_init(atoi(argv[1]), atoi(argv[2]), NULL, NULL, 0);
+/* Handlers may read a few bytes past a message, as in diag_import's buffer */
+#define BIN_PAD 64
 
-	printf("PARSER_OK\n");
+static void usage(const char *progname, const char *reason)
+{
+	printf("%s\n", reason);
+	printf("Usage: %s [-b] <session_info id> <cell_info id>\n", progname);
+	printf("	-b            - Read length prefixed binary messages instead of hex lines\n");
 	fflush(stdout);
+	exit(-1);
+}
+
+/* One hex encoded message per line */
+static void read_hex(void)
+{
+	uint8_t msg[4096];
+	int len = 0;
+	char diag_hex[4096];
+	char *ptr = NULL;
 
 	for (;;) {
 		/* Get one line from stdin */
@@ -47,22 +63,134 @@ int main(int argc, char *argv[])
 		if (diag_hex[len-1] == '\n') {
 			len--;
 		}
-		diag_hex[len] = 0;
-
-		/* Prepare data buffer */
-		memset(msg, 0x2b, sizeof(msg));
 
 		/* Parse hex into binary */
-		len = osmo_hexparse(diag_hex, msg, sizeof(msg));
+		len = hex_parse(diag_hex, len, msg, sizeof(msg) - 1);
 		assert(len >= 0);
 
 		if (len > 0) {
+			/* Terminate message with standard GSM padding */
+			msg[len] = 0x2b;
 			handle_diag(msg, len);
 		}
+
+		/* SQL output is buffered, answer every line */
+		fflush(stdout);
 	}
+}
 
-	diag_destroy(&unused1, &unused2);
+/*
+ * Messages are handled in place in large reads, only a partial message
+ * at the end of the buffer is moved to its start.
+ */
+static int read_binary(int fd)
+{
+	struct bin_header hdr;
+	uint8_t *buf;
+	uint8_t *msg;
+	uint8_t saved;
+	size_t start = 0;
+	size_t end = 0;
+	uint32_t len;
+	ssize_t n = 0;
+
+	/* Spare bytes after a message ending at the buffer end */
+	buf = (uint8_t *) calloc(1, BIN_BUF_SIZE + BIN_PAD);
+	if (!buf) {
+		return -1;
+	}
+
+	for (;;) {
+		while (end - start >= sizeof(hdr)) {
+			memcpy(&hdr, buf + start, sizeof(hdr));
+			len = le32toh(hdr.len);
+			if (len > BIN_MAX_MSG) {
+				fprintf(stderr, "Bad message length %u\n", len);
+				free(buf);
+				return -1;
+			}
+			if (end - start < sizeof(hdr) + len) {
+				break;
+			}
+
+			msg = buf + start + sizeof(hdr);
+			diag_set_appid(le32toh(hdr.appid));
+
+			/* Terminate message with standard GSM padding */
+			saved = msg[len];
+			msg[len] = 0x2b;
+			if (len > 0) {
+				handle_diag(msg, len);
+			}
+			msg[len] = saved;
+
+			start += sizeof(hdr) + len;
+		}
 
-	return 0;
+		/* SQL output is buffered, keep up with the producer */
+		fflush(stdout);
+
+		if (start > 0) {
+			memmove(buf, buf + start, end - start);
+			end -= start;
+			start = 0;
+		}
+
+		n = read(fd, buf + end, BIN_BUF_SIZE - end);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			perror("Reading stdin");
+		}
+		if (n <= 0) {
+			break;
+		}
+		end += n;
+	}
+
+	if (end > 0) {
+		fprintf(stderr, "Truncated message at end of input\n");
+	}
+
+	free(buf);
+
+	return n < 0 ? -1 : 0;
 }
 
+int main(int argc, char *argv[])
+{
+	unsigned unused1, unused2;
+	int binary = 0;
+	int ret = 0;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "b")) != -1) {
+		switch (ch) {
+			case 'b':
+				binary = 1;
+				break;
+			default:
+				usage(argv[0], "Invalid arguments");
+		}
+	}
+
+	if (argc - optind < 2) {
+		usage(argv[0], "Not enough arguments");
+	}
+
+	diag_init(atoi(argv[optind]), atoi(argv[optind + 1]), NULL, NULL, 0);
+
+	printf("PARSER_OK\n");
+	fflush(stdout);
+
+	if (binary) {
+		ret = read_binary(STDIN_FILENO);
+	} else {
+		read_hex();
+	}
+
+	diag_destroy(&unused1, &unused2);
+
+	return ret < 0;
+}
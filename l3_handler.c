@@ -19,6 +19,9 @@
 #include "cell_info.h"
 #include "output.h"
 #include "umts_rrc.h"
+#include "lte_nas_eps_sec.h"
+#include "perf.h"
+#include "failure.h"
 #include "lte_nas_eps.h"
 
 void handle_classmark(struct session_info *s, uint8_t *data, uint8_t type)
@@ -54,6 +57,7 @@ void handle_mi(struct session_info *s, uint8_t *data, uint8_t len, uint8_t new_t
 
 	if (len > GSM48_MI_SIZE) {
 		SET_MSG_INFO(s, "FAILED SANITY CHECKS (MI_LEN)");
+		failure_record_msg(FAIL_MI_SANITY, s->new_msg);
 		return;
 	}
 
@@ -94,6 +98,7 @@ void handle_mi(struct session_info *s, uint8_t *data, uint8_t len, uint8_t new_t
 
 	default:
 		SET_MSG_INFO(s, "FAILED SANITY CHECKS (MI_TYPE)");
+		failure_record_msg(FAIL_MI_SANITY, s->new_msg);
 		return;
 	}
 }
@@ -352,6 +357,7 @@ void handle_mm(struct session_info *s, struct gsm48_hdr *dtap, unsigned dtap_len
 {
 	if (dtap_len < sizeof(struct gsm48_hdr)) {
 		SET_MSG_INFO(s, "FAILED SANITY CHECKS (MM_LEN)");
+		failure_record_msg(FAIL_MM_SANITY, s->new_msg);
 		return;
 	}
 
@@ -379,6 +385,7 @@ void handle_mm(struct session_info *s, struct gsm48_hdr *dtap, unsigned dtap_len
 		session_reset(s, 1);
 		if (dtap_len < sizeof(struct gsm48_loc_upd_req)) {
 			SET_MSG_INFO(s, "FAILED SANITY CHECKS (LUR_DTAP_SIZE)");
+			failure_record_msg(FAIL_MM_SANITY, s->new_msg);
 			break;
 		}
 		SET_MSG_INFO(s, "LOC UPD REQUEST");
@@ -758,11 +765,13 @@ void handle_attach_req(struct session_info *s, uint8_t *data, unsigned len)
 	offset = 1 + data[0];
 	if (offset >= len) {
 		SET_MSG_INFO(s, "FAILED SANITY CHECKS (MS_CAP_LEN)");
+		failure_record_msg(FAIL_GMM_SANITY, s->new_msg);
 		return;
 	}
 
 	if (offset + 4 >= len) {
 		SET_MSG_INFO(s, "FAILED SANITY CHECKS (NO_DATA_ATT)");
+		failure_record_msg(FAIL_GMM_SANITY, s->new_msg);
 		return;
 	}
 	s->lu_type = data[offset] & 7;
@@ -774,6 +783,7 @@ void handle_attach_req(struct session_info *s, uint8_t *data, unsigned len)
 
 	if (offset + data[offset] + 1 >= len) {
 		SET_MSG_INFO(s, "FAILED SANITY CHECKS (NO_DATA_MI)");
+		failure_record_msg(FAIL_GMM_SANITY, s->new_msg);
 		return;
 	}
 	/* Get current mobile identity */
@@ -782,6 +792,7 @@ void handle_attach_req(struct session_info *s, uint8_t *data, unsigned len)
 
 	if (offset + 3 >= len) {
 		SET_MSG_INFO(s, "FAILED SANITY CHECKS (NO_DATA_LAI)");
+		failure_record_msg(FAIL_GMM_SANITY, s->new_msg);
 		return;
 	}
 	/* Get old LAI */
@@ -802,6 +813,7 @@ void handle_gmm(struct session_info *s, struct gsm48_hdr *dtap, unsigned len)
 
 	if (s->domain != DOMAIN_PS) {
 		SET_MSG_INFO(s, "FAILED SANITY CHECKS (GMM_IN_CS)");
+		failure_record_msg(FAIL_GMM_SANITY, s->new_msg);
 		return;
 	}
 
@@ -932,11 +944,13 @@ void handle_pdp_accept(struct session_info *s, uint8_t *data, unsigned len)
 	offset += 1 + data[offset] + 1;
 	if (offset >= len) {
 		SET_MSG_INFO(s, "FAILED SANITY CHECKS (QOS_LEN_OVER)");
+		failure_record_msg(FAIL_SM_SANITY, s->new_msg);
 		return;
 	}
 	/* Check if there is a PDP address */
 	if (data[offset++] != 0x2b) {
 		SET_MSG_INFO(s, "FAILED SANITY CHECKS (NO_PDP_ADDR)");
+		failure_record_msg(FAIL_SM_SANITY, s->new_msg);
 		return;
 	}
 	/* Check if compatible with IPv4 */
@@ -958,6 +972,7 @@ void handle_sm(struct session_info *s, struct gsm48_hdr *dtap, unsigned len)
 
 	if (s->domain != DOMAIN_PS) {
 		SET_MSG_INFO(s, "FAILED SANITY CHECKS (SM_IN_CS)");
+		failure_record_msg(FAIL_SM_SANITY, s->new_msg);
 		return;
 	}
 
@@ -1041,6 +1056,7 @@ void update_counters(struct session_info *s, uint8_t *data, unsigned len, unsign
 
 	if (pad_len > 20) {
 		fprintf(stderr, "s = %d: error in pad_len %d\n", s->id, pad_len);
+		failure_record(FAIL_LAPDM_PAD, data, len);
 		return;
 	}
 
@@ -1142,7 +1158,7 @@ void handle_dtap(struct session_info *s, uint8_t *msg, size_t len, uint32_t fn,
 	assert(msg != NULL);
 
 	dtap = (struct gsm48_hdr *) msg;
-	s->new_msg->info[0] = 0;
+	msg_info_clear(&s->new_msg->info);
 
 	if (len == 0) {
 		SET_MSG_INFO(s, "<ZERO LENGTH>");
@@ -1229,7 +1245,7 @@ void handle_lapdm(struct session_info *s, struct lapdm_buf *mb_sapi, uint8_t *ms
 	more_frag = (msg[2] >> 1) & 0x1;
 	fo = msg[2] & 0x1;
 
-	s->new_msg->info[0] = 0;
+	msg_info_clear(&s->new_msg->info);
 
 	/* discard non-GSM */
 	if (lpd_type) {
@@ -1240,6 +1256,7 @@ void handle_lapdm(struct session_info *s, struct lapdm_buf *mb_sapi, uint8_t *ms
 	/* other sanity checks */
 	if (!ea || !fo || ((data_len + 3) > len)) {
 		SET_MSG_INFO(s, "FAILED SANITY CHECKS (LAPDm)");
+		failure_record(FAIL_LAPDM_SANITY, msg, len);
 		return;
 	}
 
@@ -1276,6 +1293,7 @@ void handle_lapdm(struct session_info *s, struct lapdm_buf *mb_sapi, uint8_t *ms
 				, "<OUT OF SEQUENCE> recv %d want %d no out-of-seq %u", ns
 				, (mb->ns + 1)%8, mb->no_out_of_seq_sender_msgs
 			);
+			failure_record(FAIL_LAPDM_SEQUENCE, msg, len);
 			update_counters(s, &msg[3], len - 3, data_len, fn, ul);
 
 			//Fragments end, reset everything
@@ -1412,7 +1430,9 @@ void handle_radio_msg(struct session_info *s, struct radio_message *m)
 
 	uint8_t ul = !!(m->bb.arfcn[0] & ARFCN_UPLINK);
 
-	m->info[0] = 0;
+	perf_count_radio(m->rat, m->flags, m->msg_len);
+
+	msg_info_clear(&m->info);
 	m->flags |= MSG_DECODED;
 
 	//s0 = CS (circuit switched) related transation
@@ -1461,13 +1481,15 @@ void handle_radio_msg(struct session_info *s, struct radio_message *m)
 				fprintf(stderr, "Wrong MSG flags %02x\n", m->flags);
 			}
 			printf("Wrong MSG flags %02x\n", m->flags);
+			failure_record_msg(FAIL_MSG_FLAGS, m);
+			failure_dump();
 			abort();
 		}
 
 		//if s->new_msg is not m, then we have freed it.
 		if (msg_verbose && s->new_msg == m && m->flags & MSG_DECODED) {
 			printf("GSM %s %s %u : %s\n", m->domain ? "PS" : "CS", ul ? "UL" : "DL",
-				m->bb.fn[0], m->info[0] ? m->info : osmo_hexdump_nospc(m->msg, m->msg_len));
+				m->bb.fn[0], !msg_info_empty(&m->info) ? msg_info_str(&m->info) : osmo_hexdump_nospc(m->msg, m->msg_len));
 		}
 		break;
 
@@ -1502,7 +1524,7 @@ void handle_radio_msg(struct session_info *s, struct radio_message *m)
 		}
 		if (msg_verbose && s->new_msg == m && m->flags & MSG_DECODED) {
 			printf("RRC %s %s %u : %s\n", m->domain ? "PS" : "CS", ul ? "UL" : "DL",
-				m->bb.fn[0], m->info[0] ? m->info : osmo_hexdump_nospc(m->bb.data, m->msg_len));
+				m->bb.fn[0], !msg_info_empty(&m->info) ? msg_info_str(&m->info) : osmo_hexdump_nospc(m->bb.data, m->msg_len));
 		}
 		break;
 
@@ -1517,11 +1539,15 @@ void handle_radio_msg(struct session_info *s, struct radio_message *m)
 					m->msg_len -= 6;
 				}
 			}
-			handle_naseps(s, m->bb.data, m->msg_len);
+			if (m->flags & MSG_CIPHERED) {
+				handle_naseps_protected(s, m->bb.data, m->msg_len, ul);
+			} else {
+				handle_naseps(s, m->bb.data, m->msg_len);
+			}
 		}
 		if (msg_verbose && s->new_msg == m && m->flags & MSG_DECODED) {
 			printf("LTE %s %u : %s\n", ul ? "UL" : "DL",
-				m->bb.fn[0], m->info[0] ? m->info : osmo_hexdump_nospc(m->bb.data, m->msg_len));
+				m->bb.fn[0], !msg_info_empty(&m->info) ? msg_info_str(&m->info) : osmo_hexdump_nospc(m->bb.data, m->msg_len));
 		}
 		break;
 
@@ -1538,9 +1564,9 @@ void handle_radio_msg(struct session_info *s, struct radio_message *m)
 			assert(s->new_msg == m);
 			link_to_msg_list(&s[m->domain], m);
 			s->new_msg = NULL;
-			net_send_msg(m);
+			PERF_TIME(PERF_NET_SEND, net_send_msg(m));
 		} else {
-			free(m);
+			radio_msg_free(m);
 			s->new_msg = NULL;
 		}
 	}
@@ -1604,10 +1630,7 @@ struct radio_message * new_l2(uint8_t *data, uint8_t len, uint8_t rat, uint8_t d
 
 	assert(data != 0);
 
-	m = (struct radio_message *) malloc(sizeof(struct radio_message));
-
-	if (m == 0)
-		return 0;
+	m = radio_msg_alloc();
 
 	memset(m, 0, sizeof(struct radio_message));
 
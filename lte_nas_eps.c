@@ -5,23 +5,33 @@
 #include "lte_nas_eps_mm.h"
 #include "lte_nas_eps_sm.h"
 #include "lte_nas_eps_info.h"
+#include "failure.h"
 #include <assert.h>
 
+/* Scratch area for parsed messages, used like a stack */
+static naseps_msg_t naseps_scratch[NASEPS_SCRATCH_MSGS];
+static unsigned naseps_scratch_used = 0;
+
 /* 
 	PARSER FUNCTIONS FOR SINGLE ELEMENTS 
 */
 
+/* Reset an element to the empty state */
+static void init_naseps_element(naseps_msg_string_t *element, int type, int iei)
+{
+	element->iei = iei;
+	element->type = type;
+	element->value = 0;
+	element->off = 0;
+	element->len = 0;
+	element->valid = 0;
+}
+
 /* Parse a type 1 vector element (Two nibbles sized vectors in one byte) */
-static int parse_naseps_type1v(uint8_t *msg, int msg_len, naseps_msg_string_t *element1, naseps_msg_string_t *element2)
+static int parse_naseps_type1v(uint8_t *msg, int msg_len, unsigned off, naseps_msg_string_t *element1, naseps_msg_string_t *element2)
 {
-	element1->iei = -1;
-	element1->len = 0;
-	element1->data = NULL;
-	element1->valid = 0;
-	element2->iei = -1;
-	element2->len = 0;
-	element2->data = NULL;
-	element2->valid = 0;
+	init_naseps_element(element1, ELEMENT_TYPE_1V, -1);
+	init_naseps_element(element2, ELEMENT_TYPE_1V, -1);
 
 	/* Length check */
 	if(msg_len < 1)
@@ -29,14 +39,10 @@ static int parse_naseps_type1v(uint8_t *msg, int msg_len, naseps_msg_string_t *e
 
 	element1->len = 1;
 	element2->len = 1;
-	element1->iei = -1;
-	element2->iei = -1;
-	element1->data = (uint8_t*) malloc(1);
-	assert(element1->data);
-	element2->data = (uint8_t*) malloc(1);
-	assert(element2->data);
-	element1->data[0] = msg[0] & 0x0F;
-	element2->data[0] = (msg[0]>>4) & 0x0F;
+	element1->off = off;
+	element2->off = off;
+	element1->value = msg[0] & 0x0F;
+	element2->value = (msg[0]>>4) & 0x0F;
 	element1->valid = 1;
 	element2->valid = 1;
 
@@ -44,124 +50,92 @@ static int parse_naseps_type1v(uint8_t *msg, int msg_len, naseps_msg_string_t *e
 }
 
 /* Parse a type 1 tag/vector element (Two nibbles first is the tag, second the vector) */
-static int parse_naseps_type1tv(uint8_t *msg, int msg_len, naseps_msg_string_t *element, int expected_tag)
+static int parse_naseps_type1tv(uint8_t *msg, int msg_len, unsigned off, naseps_msg_string_t *element, int expected_tag)
 {
-	int tag;
-	tag = (msg[0]>>4) & 0x0F;
-
-	element->iei = expected_tag;
-	element->len = 0;
-	element->data = NULL;
-	element->valid = 0;
+	init_naseps_element(element, ELEMENT_TYPE_1TV, expected_tag);
 
 	/* Length check */
 	if(msg_len < 1)
 		return 0;
 
 	/* Tag check */
-	if(tag != expected_tag)
+	if(((msg[0]>>4) & 0x0F) != expected_tag)
 		return 0;
 
 	element->len = 1;
-	element->iei = tag;
-	element->data = (uint8_t*) malloc(1);
-	assert(element->data);
-	element->data[0] = msg[0] & 0x0F;
+	element->off = off;
+	element->value = msg[0] & 0x0F;
 	element->valid = 1;
 
 	return 1;
 }
 
 /* Parse a type 2 tag element (entire filed consits of one byte tag only) */
-static int parse_naseps_type2t(uint8_t *msg, int msg_len, naseps_msg_string_t *element, int expected_tag)
+static int parse_naseps_type2t(uint8_t *msg, int msg_len, unsigned off, naseps_msg_string_t *element, int expected_tag)
 {
-	int tag;
-	tag = msg[0];
-
-	element->iei = expected_tag;
-	element->len = 0;
-	element->data = NULL;
-	element->valid = 0;
+	init_naseps_element(element, ELEMENT_TYPE_2T, expected_tag);
 
 	/* Length check */
 	if(msg_len < 1)
 		return 0;
 
 	/* Tag check */
-	if(tag != expected_tag)
+	if(msg[0] != expected_tag)
 		return 0;
 
-	element->len = 0;
-	element->iei = tag;
-	element->data = NULL;
+	element->off = off;
 	element->valid = 1;
 
 	return 1;
 }
 
 /* Parse a type 3 vector element (vector only, length known by spec) */
-static int parse_naseps_type3v(uint8_t *msg, int msg_len, int len, naseps_msg_string_t *element)
+static int parse_naseps_type3v(uint8_t *msg, int msg_len, unsigned off, int len, naseps_msg_string_t *element)
 {
-	element->iei = -1;
-	element->len = 0;
-	element->data = NULL;
-	element->valid = 0;
+	init_naseps_element(element, ELEMENT_TYPE_3V, -1);
 
 	/* Length check */
 	if(msg_len < len)
 		return 0;
 
 	element->len = len;
-	element->iei = -1;
-	element->data = (uint8_t*) malloc(element->len);
-	assert(element->data);
-	memcpy(element->data, msg, len);
+	element->off = off;
 	element->valid = 1;
 
 	return element->len;
 }
 
 /* Parse a type 3 tag/vector element (one byte tag only) */
-static int parse_naseps_type3tv(uint8_t *msg, int msg_len, int len, naseps_msg_string_t *element, int expected_tag)
+static int parse_naseps_type3tv(uint8_t *msg, int msg_len, unsigned off, int len, naseps_msg_string_t *element, int expected_tag)
 {
-	int tag;
-	tag = msg[0];
-
-	element->iei = expected_tag;
-	element->len = 0;
-	element->data = NULL;
-	element->valid = 0;
+	init_naseps_element(element, ELEMENT_TYPE_3TV, expected_tag);
 
-	/* Tag check */
-	if(tag != expected_tag)
+	/* Length check */
+	if(msg_len < len || msg_len < 1)
 		return 0;
 
-	/* Length check */
-	if(msg_len < len)
+	/* Tag check */
+	if(msg[0] != expected_tag)
 		return 0;
 
 	element->len = len-1;
-	element->iei = tag;
-	element->data = (uint8_t*) malloc(element->len);
-	assert(element->data);
-	memcpy(element->data, msg+1, len);
+	element->off = off+1;
 	element->valid = 1;
 
 	return element->len + 1;
 }
 
 /* Parse a type 4 length/vector element */
-static int parse_naseps_type4lv(uint8_t *msg, int msg_len, naseps_msg_string_t *element, int expected_len)
+static int parse_naseps_type4lv(uint8_t *msg, int msg_len, unsigned off, naseps_msg_string_t *element, int expected_len)
 {
 	int len;
-	len = msg[0];
 
-	element->iei = -1;
-	element->len = 0;
-	element->data = NULL;
-	element->valid = 0;
+	init_naseps_element(element, ELEMENT_TYPE_4LV, -1);
 
 	/* Length check */
+	if(msg_len < 1)
+		return 0;
+	len = msg[0];
 	if(msg_len < len+1)
 		return 0;
 	if((len > expected_len)&&(expected_len != -1))
@@ -170,29 +144,23 @@ static int parse_naseps_type4lv(uint8_t *msg, int msg_len, naseps_msg_string_t *
 		return 0;
 
 	element->len = len;
-	element->iei = -1;
-	element->data = (uint8_t*) malloc(element->len);
-	assert(element->data);
-	memcpy(element->data, msg+1, element->len);
+	element->off = off+1;
 	element->valid = 1;
 
 	return element->len + 1;
 }
 
 /* Parse a type 4 tag/length/vector element */
-static int parse_naseps_type4tlv(uint8_t *msg, int msg_len, naseps_msg_string_t *element, int expected_tag, int expected_len)
+static int parse_naseps_type4tlv(uint8_t *msg, int msg_len, unsigned off, naseps_msg_string_t *element, int expected_tag, int expected_len)
 {
-	int tag;
 	int len;
-	tag = msg[0];
-	len = msg[1];
 
-	element->iei = expected_tag;
-	element->len = 0;
-	element->data = NULL;
-	element->valid = 0;
+	init_naseps_element(element, ELEMENT_TYPE_4TLV, expected_tag);
 
 	/* Length check */
+	if(msg_len < 2)
+		return 0;
+	len = msg[1];
 	if(msg_len < len+2)
 		return 0;
 	if((len > expected_len)&&(expected_len != -1))
@@ -201,32 +169,28 @@ static int parse_naseps_type4tlv(uint8_t *msg, int msg_len, naseps_msg_string_t
 		return 0;
 
 	/* Tag check */
-	if(tag != expected_tag)
+	if(msg[0] != expected_tag)
 		return 0;
 
 	element->len = len;
-	element->iei = tag;
-	element->data = (uint8_t*) malloc(element->len);
-	assert(element->data);
-	memcpy(element->data, msg+2, element->len);
+	element->off = off+2;
 	element->valid = 1;
 
 	return element->len + 2;
 }
 
 /* Parse a type 6 length/vector element */
-static int parse_naseps_type6lve(uint8_t *msg, int msg_len, naseps_msg_string_t *element, int expected_len)
+static int parse_naseps_type6lve(uint8_t *msg, int msg_len, unsigned off, naseps_msg_string_t *element, int expected_len)
 {
 	int len;
-	len = msg[1];
-	len |= (msg[0] << 8);
 
-	element->iei = -1;
-	element->len = 0;
-	element->data = NULL;
-	element->valid = 0;
+	init_naseps_element(element, ELEMENT_TYPE_6LVE, -1);
 
 	/* Length check */
+	if(msg_len < 2)
+		return 0;
+	len = msg[1];
+	len |= (msg[0] << 8);
 	if(msg_len < len+2)
 		return 0;
 	if((len > expected_len)&&(expected_len != -1))
@@ -235,30 +199,24 @@ static int parse_naseps_type6lve(uint8_t *msg, int msg_len, naseps_msg_string_t
 		return 0;
 
 	element->len = len;
-	element->iei = -1;
-	element->data = (uint8_t*) malloc(element->len);
-	assert(element->data);
-	memcpy(element->data, msg+2, element->len);
+	element->off = off+2;
 	element->valid = 1;
 
 	return element->len + 2;
 }
 
 /* Parse a type 6 tag/length/vector element */
-static int parse_naseps_type6tlve(uint8_t *msg, int msg_len, naseps_msg_string_t *element, int expected_tag, int expected_len)
+static int parse_naseps_type6tlve(uint8_t *msg, int msg_len, unsigned off, naseps_msg_string_t *element, int expected_tag, int expected_len)
 {
-	int tag;
 	int len;
-	tag = msg[0];
-	len = msg[2];
-	len |= (msg[1] << 8);
 
-	element->iei = expected_tag;
-	element->len = 0;
-	element->data = NULL;
-	element->valid = 0;
+	init_naseps_element(element, ELEMENT_TYPE_6TLVE, expected_tag);
 
 	/* Length check */
+	if(msg_len < 3)
+		return 0;
+	len = msg[2];
+	len |= (msg[1] << 8);
 	if(msg_len < len+3)
 		return 0;
 	if((len > expected_len)&&(expected_len != -1))
@@ -267,14 +225,11 @@ static int parse_naseps_type6tlve(uint8_t *msg, int msg_len, naseps_msg_string_t
 		return 0;
 
 	/* Tag check */
-	if(tag != expected_tag)
+	if(msg[0] != expected_tag)
 		return 0;
 
 	element->len = len;
-	element->iei = tag;
-	element->data = (uint8_t*) malloc(element->len);
-	assert(element->data);
-	memcpy(element->data, msg+3, element->len);
+	element->off = off+3;
 	element->valid = 1;
 
 	return element->len + 3;
@@ -288,8 +243,10 @@ static int parse_naseps_type6tlve(uint8_t *msg, int msg_len, naseps_msg_string_t
 */
 
 /* Print a NAS/EPS variable length epement */
-void print_naseps_msg_string(char *identifier, naseps_msg_string_t *element)
+void print_naseps_msg_string(char *identifier, naseps_msg_t *msg, naseps_msg_string_t *element)
 {
+	uint8_t *data;
+
 	if(identifier)
 		printf(" %s=",identifier);
 	else
@@ -297,11 +254,12 @@ void print_naseps_msg_string(char *identifier, naseps_msg_string_t *element)
 	
 	printf("naseps_msg_string_t{");
 
-	if(element->iei != -1)
+	if(element->iei != 0xFF)
 		printf("iei=%i (0x%02x), ",element->iei,element->iei & 0xFF);
 
-	if(element->data != NULL)
-		printf("len=%i, data=%s ",element->len, osmo_hexdump_nospc((uint8_t*)element->data, element->len));
+	data = get_naseps_msg_field_data(msg, element);
+	if(data != NULL)
+		printf("len=%i, data=%s ",element->len, osmo_hexdump_nospc(data, element->len));
 	else
 		printf("len=%i, data=NULL ",element->len);
 
@@ -331,13 +289,14 @@ void print_naseps_msg(naseps_msg_t *msg)
 
 	/* Dump message content */
 	for(i=0;i<msg->n;i++)
-		print_naseps_msg_string(0,&msg->elm[i]);
+		print_naseps_msg_string(0,msg,&msg->elm[i]);
 
 	printf(" }\n");
 }
 
 
 
+
 /* 
 	DATA ACCESS TOOLS
 */
@@ -374,94 +333,123 @@ naseps_msg_string_t *get_naseps_msg_field_by_pos(naseps_msg_t *msg, uint8_t pos)
 	return NULL;
 }
 
+/* Get a pointer to the data of a field (NULL if empty) */
+uint8_t *get_naseps_msg_field_data(naseps_msg_t *msg, naseps_msg_string_t *element)
+{
+	if(!element->valid || !element->len)
+		return NULL;
+
+	/* Half octet values are not addressable in the raw message */
+	if((element->type == ELEMENT_TYPE_1V) || (element->type == ELEMENT_TYPE_1TV))
+		return &element->value;
+
+	return msg->raw + element->off;
+}
+
 
 
 /* 
 	RAW MESSAGE PARSER
 */
 
+/* Get an empty message from the scratch area */
+naseps_msg_t *alloc_naseps_msg()
+{
+	naseps_msg_t *msg;
+
+	if(naseps_scratch_used >= NASEPS_SCRATCH_MSGS)
+		return NULL;
+
+	msg = &naseps_scratch[naseps_scratch_used++];
+	msg->flags = 0;
+	msg->type = 0;
+	msg->subtype = 0;
+	msg->n = 0;
+	msg->raw = NULL;
+	msg->raw_len = 0;
+	msg->uplink = 0;
+
+	return msg;
+}
+
 
 /* Generate a dummy message */
 naseps_msg_t *parse_naseps_msg_dummy(uint8_t *raw_message, int len, int type, int subtype, uint8_t uplink)
 {
-	nas_eps_message_spec spec;
+	nas_eps_message_spec spec = { type, subtype, NULL, 0 };
 
-	/* Setup specification */
-	spec.n=0;
-	spec.msg_type=type;
-	spec.msg_subtype=subtype;
-	spec.msg_uplink=uplink;
-	
 	/* Parse message */
-	return parse_naseps_msg_generic(raw_message,len,&spec);
+	return parse_naseps_msg_generic(raw_message,len,&spec,uplink);
 }
 
 /* Parse a NAS/EPS message by submitting a message speficication */
-naseps_msg_t *parse_naseps_msg_generic(uint8_t *raw_message, int raw_len, nas_eps_message_spec *spec)
+naseps_msg_t *parse_naseps_msg_generic(uint8_t *raw_message, int raw_len, const nas_eps_message_spec *spec, uint8_t uplink)
 {
+	const nas_eps_element_spec *elm;
 	int i;
 	int e=0;
 	int len;
+	unsigned off=0;
 	naseps_msg_t *msg;
 
-	/* Create an empty message body */
-	msg = (naseps_msg_t*) malloc(sizeof(naseps_msg_t));
-	assert(msg);
-	memset(msg,0,sizeof(naseps_msg_t));
+	/* Get an empty message body */
+	msg = alloc_naseps_msg();
+	if(!msg)
+		return NULL;
 
-	/* Create a copy of the message data (allows for re use of the input buffers) */
-	msg->raw=(uint8_t *) malloc(raw_len);
-	assert(msg->raw);
-	memcpy(msg->raw, raw_message, raw_len);
+	/* Elements refer to the caller's buffer, which must outlive the message */
+	msg->raw=raw_message;
 	msg->raw_len=raw_len;	
 
 	for(i=0;i<spec->n;i++)
 	{
-		switch(spec->type[i])
+		elm = &spec->elm[i];
+
+		switch(elm->type)
 		{
 			/* type 1 vector element (Two nibbles sized vectors in one byte) */
 			case ELEMENT_TYPE_1V:
-				len = parse_naseps_type1v(raw_message, raw_len, &msg->elm[e],&msg->elm[e+1]);
+				len = parse_naseps_type1v(raw_message, raw_len, off, &msg->elm[e],&msg->elm[e+1]);
 				e+=2;
 			break;
 			/* type 1 tag/vector element (Two nibbles first is the tag, second the vector) */
 			case ELEMENT_TYPE_1TV:
-				len = parse_naseps_type1tv(raw_message, raw_len, &msg->elm[e], spec->tag[i]);
+				len = parse_naseps_type1tv(raw_message, raw_len, off, &msg->elm[e], elm->tag);
 				e++;
 			break;
 			/* type 2 tag element (one byte tag only) */
 			case ELEMENT_TYPE_2T:
-				len = parse_naseps_type2t(raw_message, raw_len, &msg->elm[e], spec->tag[i]);
+				len = parse_naseps_type2t(raw_message, raw_len, off, &msg->elm[e], elm->tag);
 				e++;
 			break;
 			/* type 3 vector element (vector only, length known by spec) */	
 			case ELEMENT_TYPE_3V:
-				len = parse_naseps_type3v(raw_message, raw_len, spec->len[i], &msg->elm[e]);
+				len = parse_naseps_type3v(raw_message, raw_len, off, elm->len, &msg->elm[e]);
 				e++;
 			break;
 			/* type 3 tag/vector element (one byte tag only) */	
 			case ELEMENT_TYPE_3TV:
-				len = parse_naseps_type3tv(raw_message, raw_len, spec->len[i], &msg->elm[e], spec->tag[i]);
+				len = parse_naseps_type3tv(raw_message, raw_len, off, elm->len, &msg->elm[e], elm->tag);
 				e++;
 			break;
 			/* type 4 length/vector element */	
 			case ELEMENT_TYPE_4LV:
-				len = parse_naseps_type4lv(raw_message, raw_len, &msg->elm[e], spec->len[i]);
+				len = parse_naseps_type4lv(raw_message, raw_len, off, &msg->elm[e], elm->len);
 				e++;
 			break;
 			/* type 4 tag/length/vector element */	
 			case ELEMENT_TYPE_4TLV:
-				len = parse_naseps_type4tlv(raw_message, raw_len, &msg->elm[e], spec->tag[i], spec->len[i]);
+				len = parse_naseps_type4tlv(raw_message, raw_len, off, &msg->elm[e], elm->tag, elm->len);
 				e++;
 			break;
 			/* type 6: (LV-E) length/vector element */
 			case ELEMENT_TYPE_6LVE:
-				len = parse_naseps_type6lve(raw_message, raw_len, &msg->elm[e], spec->len[i]);
+				len = parse_naseps_type6lve(raw_message, raw_len, off, &msg->elm[e], elm->len);
 				e++;
 			break;
 			/* type 6 tag/length/vector element */	
 			case ELEMENT_TYPE_6TLVE:
-				len = parse_naseps_type6tlve(raw_message, raw_len, &msg->elm[e], spec->tag[i], spec->len[i]);
+				len = parse_naseps_type6tlve(raw_message, raw_len, off, &msg->elm[e], elm->tag, elm->len);
 				e++;
 			break;
 			default:
@@ -473,12 +461,13 @@ naseps_msg_t *parse_naseps_msg_generic(uint8_t *raw_message, int raw_len, nas_ep
 		/* Move forward to the next element */
 		raw_message += len;
 		raw_len -= len; 
+		off += len;
 	}
 	
 	msg->type=spec->msg_type;	/* Set the desired message type */
 	msg->subtype=spec->msg_subtype;	/* Set the desired message subtype */
 	msg->n=e;			/* Set the number of elements we were able to detect */
-	msg->uplink=spec->msg_uplink;	/* Set uplink flag as specified in the specification */
+	msg->uplink=uplink;		/* Set uplink flag */
 
 	return msg;
 }
@@ -487,30 +476,16 @@ naseps_msg_t *parse_naseps_msg_generic(uint8_t *raw_message, int raw_len, nas_ep
 /* Cleanup a NAS/EPS variable length epement */
 void cleanup_naseps_msg_string(naseps_msg_string_t *element)
 {
-	/* Free allocated memory */
-	if(element->data != NULL)
-		free(element->data);
-
-	/* Zero out the memory occupied by the data structure */
-	memset(element,0,sizeof(naseps_msg_string_t));
+	init_naseps_element(element, 0, -1);
 }
 
 
-/* Cleanup contents of a NAS/EPS message */
+/* Release a NAS/EPS message and all messages parsed after it */
 void cleanup_naseps_msg(naseps_msg_t *msg)
 {
-	int i;
+	assert(msg >= naseps_scratch && msg < &naseps_scratch[naseps_scratch_used]);
 
-	/* cleanup allocated elements */
-	for(i = 0; i < msg->n; i++)
-		cleanup_naseps_msg_string(&msg->elm[i]);
-
-	/* Free raw data */
-	if(msg->raw != NULL)
-		free(msg->raw);
-
-	/* Zero out the memory occupied by the data structure */
-	memset(msg,0,sizeof(naseps_msg_t));
+	naseps_scratch_used = msg - naseps_scratch;
 }
 
 
@@ -529,6 +504,8 @@ void handle_naseps(struct session_info *s, uint8_t *message, int len)
 		 the caller should take care himself! */
 	uplink_flag = !!(s->new_msg->bb.arfcn[0] & ARFCN_UPLINK);
 
+	/* Start with an empty scratch area */
+	naseps_scratch_used = 0;
 
 	/* Parse accordingly */
 	switch(protocol_discriminator)
@@ -549,6 +526,10 @@ void handle_naseps(struct session_info *s, uint8_t *message, int len)
 		naseps_set_msg_info(s, msg);
 #endif
 		cleanup_naseps_msg(msg);
+	} else {
+#ifndef TESTBENCH
+		failure_record(FAIL_NAS_EPS_PARSE, message, len);
+#endif
 	}
 }
 
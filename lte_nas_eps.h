@@ -9,18 +9,23 @@
 /* Maximum number of elements per message */
 #define NASEPS_MSG_MAXELM 255
 
+/* Number of messages that may be parsed at the same time */
+#define NASEPS_SCRATCH_MSGS 4
+
 
 
 /* 
 	GENERIC MESSAGE CONTAINER STRUCTURES
 */
 
-/* Variable length field */
+/* Variable length field, a view into the raw message */
 typedef struct 
 {
 	uint8_t iei;	/* Identifier of the data element (-1 if non existant) */
+	uint8_t type;	/* Element type (ELEMENT_TYPE_*) */
+	uint8_t value;	/* Value of half octet elements (type 1) */
+	unsigned off;	/* Offset of the data in the raw message */
 	unsigned len;	/* Length of the data string */
-	uint8_t *data;	/* Pointer to the data of the parsed message  */
 	int valid;	/* If set to 1 the field is valid, 0 means valid */
 } naseps_msg_string_t;
 
@@ -32,7 +37,7 @@ typedef struct
 	uint8_t subtype;	/* Message subtype */
 	naseps_msg_string_t elm[NASEPS_MSG_MAXELM];	/* Message elements */
 	unsigned n;		/* Number of elements */
-	uint8_t *raw;		/* Pointer to the raw message data (wire) */
+	uint8_t *raw;		/* Pointer to the raw message data (wire), not copied */
 	unsigned raw_len;	/* Length of the raw message data (wire) */
 	uint8_t uplink;		/* Message direction flag 1=Uplink, 0=Downlink */
 } naseps_msg_t;
@@ -52,15 +57,20 @@ typedef struct
 #define ELEMENT_TYPE_6LVE 8	/* type 6: (LV-E) length/vector element */
 #define ELEMENT_TYPE_6TLVE 9	/* type 6: (TLV-E) length/vector element */
 
-/* A structure to define a cartain message type */
+/* A structure to define a single message element */
+typedef struct
+{
+	int type;		/* Expected field type */
+	int len;		/* (Max)length of the data field (ignored for Type 1V, Type 1TV and Type 2T) */
+	int tag;		/* Expected tag (-1 when the message has no tag) */
+} nas_eps_element_spec;
+
+/* A structure to define a cartain message type, kept in read-only tables */
 typedef struct
 {
 	int msg_type;		/* Message type identifier (protocol discriminator) */
 	int msg_subtype;	/* Message subtype identifier */
-	int msg_uplink;		/* Uplink flag, 1=UPLINK, 0=Downlink */
-	int type[255];		/* Expected field type */
-	int len[255];		/* (Max)length of the data field (ignored for Type 1V, Type 1TV and Type 2T) */
-	int tag[255];		/* Expected tag (-1 when the message has no tag) */
+	const nas_eps_element_spec *elm;	/* Expected elements */
 	int n;			/* Number of elements */
 } nas_eps_message_spec;
 
@@ -87,7 +97,7 @@ typedef struct
 */
 
 /* Print a NAS/EPS variable length epement */
-void print_naseps_msg_string(char *identifier, naseps_msg_string_t *element);
+void print_naseps_msg_string(char *identifier, naseps_msg_t *msg, naseps_msg_string_t *element);
 
 /* Print contents of a NAS/EPS message */
 void print_naseps_msg(naseps_msg_t *msg);
@@ -105,6 +115,9 @@ naseps_msg_string_t *get_naseps_msg_field_by_iei(naseps_msg_t *msg, uint8_t iei)
 /* Get a field by its position */
 naseps_msg_string_t *get_naseps_msg_field_by_pos(naseps_msg_t *msg, uint8_t pos);
 
+/* Get a pointer to the data of a field (NULL if empty) */
+uint8_t *get_naseps_msg_field_data(naseps_msg_t *msg, naseps_msg_string_t *element);
+
 
 
 
@@ -112,11 +125,14 @@ naseps_msg_string_t *get_naseps_msg_field_by_pos(naseps_msg_t *msg, uint8_t pos)
 	RAW MESSAGE PARSER
 */
 
+/* Get an empty message from the scratch area */
+naseps_msg_t *alloc_naseps_msg();
+
 /* Generate a dummy message */
 naseps_msg_t *parse_naseps_msg_dummy(uint8_t *raw_message, int len, int type, int subtype, uint8_t uplink);
 
 /* Parse a NAS/EPS message by submitting a message speficication */
-naseps_msg_t *parse_naseps_msg_generic(uint8_t *raw_message, int raw_len, nas_eps_message_spec *spec);
+naseps_msg_t *parse_naseps_msg_generic(uint8_t *raw_message, int raw_len, const nas_eps_message_spec *spec, uint8_t uplink);
 
 /* Dispatch and parse message */
 void handle_naseps(struct session_info *s, uint8_t *message, int len);
@@ -131,7 +147,7 @@ void handle_naseps(struct session_info *s, uint8_t *message, int len);
 /* Cleanup a NAS/EPS variable length epement */
 void cleanup_naseps_msg_string(naseps_msg_string_t *element);
 
-/* Cleanup contents of a NAS/EPS message */
+/* Release a NAS/EPS message and all messages parsed after it */
 void cleanup_naseps_msg(naseps_msg_t *msg);
 
 
@@ -3,6 +3,7 @@
 #include "l3_handler.h"
 #include <arpa/inet.h>
 #include "bit_func.h"
+#include "failure.h"
 
 /* Structure to hold an EPS Mobile identity */
 typedef struct
@@ -23,20 +24,22 @@ typedef struct
 #define EPS_MI_TYPE_IMEI 3
 
 /* Parse a NAS mobile identity field */
-int parse_naseps_mi(naseps_msg_string_t *elm, eps_mobile_identity_t *mi)
+int parse_naseps_mi(naseps_msg_t *msg, naseps_msg_string_t *elm, eps_mobile_identity_t *mi)
 {
 	struct gsm48_loc_area_id *lai;
+	uint8_t *data;
 
 	/* Only continue if the element is there */
 	if(elm == NULL)
 		return -1;
 
 	/* Check if the element is really valid */
-	if (!(elm->valid))
+	data = get_naseps_msg_field_data(msg, elm);
+	if (!data)
 		return -1;
 
-	mi->odd_even_ind = (elm->data[0] >> 3) & 0x1; /* Get Odd/Even indicator */
-	mi->type_of_identity = (elm->data[0]) & 0x07; /* Get type of identity */
+	mi->odd_even_ind = (data[0] >> 3) & 0x1; /* Get Odd/Even indicator */
+	mi->type_of_identity = (data[0]) & 0x07; /* Get type of identity */
 
 	/* EPS mobile identity information element for type of identity "GUTI" */
 	if(mi->type_of_identity == EPS_MI_TYPE_GUTI)
@@ -44,20 +47,24 @@ int parse_naseps_mi(naseps_msg_string_t *elm, eps_mobile_identity_t *mi)
 		/* See also: 3GPP TS 24.301 version 12.7.0 Release 12, ETSI TS 124 301 V12.7.0 (2015-01), page 278
 		             Figure 9.9.3.12.1: EPS mobile identity information element for type of identity "GUTI" */
 
+		/* GUTI is 11 octets long */
+		if(elm->len < 11)
+			return -1;
+
 		/* Extract MCC/MNC fields */
-		lai = (struct gsm48_loc_area_id *) &(elm->data[1]);
+		lai = (struct gsm48_loc_area_id *) &(data[1]);
 		mi->mcc = get_mcc(lai->digits);
 		mi->mnc = get_mnc(lai->digits);
 
 		/* Extract MME Group ID */
-		mi->mme_group_id = (elm->data[5] |  elm->data[4] << 8);
+		mi->mme_group_id = (data[5] |  data[4] << 8);
 
 		/* Extract MME code */
-		mi->mme_code = elm->data[6];
+		mi->mme_code = data[6];
 
 		/* Extract identity (GUTI) */
 		mi->identity_len = 4;
-		memcpy(mi->identity,&(elm->data[7]),mi->identity_len);
+		memcpy(mi->identity,&(data[7]),mi->identity_len);
 		return 0;
 	}
 
@@ -76,7 +83,7 @@ int parse_naseps_mi(naseps_msg_string_t *elm, eps_mobile_identity_t *mi)
 }
 
 /* Handle EPS Mobile identity */
-void handle_eps_mi(struct session_info *s, naseps_msg_string_t *elm, uint8_t new_tmsi)
+void handle_eps_mi(struct session_info *s, naseps_msg_t *msg, naseps_msg_string_t *elm, uint8_t new_tmsi)
 {
 	/* Note: The new_tmsi flag is usually only set on an accept transaction,
 		 on all other transactions the flag is not set. */
@@ -86,7 +93,7 @@ void handle_eps_mi(struct session_info *s, naseps_msg_string_t *elm, uint8_t new
 	char tmsi_str[9];
 
 	/* Parse EPS Mobile identity field */
-	rc = parse_naseps_mi(elm, &mi);
+	rc = parse_naseps_mi(msg, elm, &mi);
 
 	/* Only continue if parsing was successful */
 	if (rc == 0)
@@ -120,6 +127,7 @@ void handle_eps_mi(struct session_info *s, naseps_msg_string_t *elm, uint8_t new
 			break;
 			default:
 				SET_MSG_INFO(s, "FAILED SANITY CHECKS (MI_TYPE)");
+				failure_record_msg(FAIL_MI_SANITY, s->new_msg);
 			return;
 		}
 	}
@@ -144,7 +152,7 @@ void parse_naseps_lai(struct session_info *s, naseps_msg_t *msg, uint8_t new_lai
 		return;
 
 	/* Extract LAI fields */
-	lai = (struct gsm48_loc_area_id *) elm->data;
+	lai = (struct gsm48_loc_area_id *) get_naseps_msg_field_data(msg, elm);
 
 	if (new_lai) {
 		s->mcc = get_mcc(lai->digits);
@@ -176,7 +184,7 @@ void parse_naseps_nfs(struct session_info *s, naseps_msg_t *msg)
 		return;
 
 	/* Mask the IMS flag (last bit in the first octet) */
-	s->have_ims = elm->data[0] & 1;
+	s->have_ims = get_naseps_msg_field_data(msg, elm)[0] & 1;
 }
 
 
@@ -194,7 +202,7 @@ void handle_taur(struct session_info *s, naseps_msg_t *msg)
 
 	parse_naseps_lai(s, msg, 0);
 	mobile_identity = get_naseps_msg_field_by_pos(msg, 5);
-	handle_eps_mi(s, mobile_identity, 0);
+	handle_eps_mi(s, msg, mobile_identity, 0);
 }
 
 /* Handle attach request */
@@ -211,7 +219,7 @@ void handle_arq(struct session_info *s, naseps_msg_t *msg)
 
 	parse_naseps_lai(s, msg, 0);
 	mobile_identity = get_naseps_msg_field_by_pos(msg, 5);
-	handle_eps_mi(s, mobile_identity, 0);
+	handle_eps_mi(s, msg, mobile_identity, 0);
 }
 
 /* Handle attach accept */
@@ -225,7 +233,7 @@ void handle_aac(struct session_info *s, naseps_msg_t *msg)
 	parse_naseps_nfs(s, msg);
 
 	mobile_identity = get_naseps_msg_field_by_iei(msg, 0x50);
-	handle_eps_mi(s, mobile_identity, 1);
+	handle_eps_mi(s, msg, mobile_identity, 1);
 }
 
 /* Handle Tracking area update accept */
@@ -240,7 +248,7 @@ void handle_taua(struct session_info *s, naseps_msg_t *msg)
 	parse_naseps_nfs(s, msg);
 
 	mobile_identity = get_naseps_msg_field_by_iei(msg, 0x50);
-	handle_eps_mi(s, mobile_identity, 1);
+	handle_eps_mi(s, msg, mobile_identity, 1);
 }
 
 /* Handle Tracking area update reject */
@@ -254,8 +262,8 @@ void handle_tauj(struct session_info *s, naseps_msg_t *msg)
 	s->lu_reject = 1;
 
 	reject_cause = get_naseps_msg_field_by_pos(msg, 3);
-	if(reject_cause && reject_cause->data)
-		s->lu_rej_cause = reject_cause->data[0];
+	if(reject_cause && reject_cause->len)
+		s->lu_rej_cause = get_naseps_msg_field_data(msg, reject_cause)[0];
 }
 
 /* Handle Authentication request */
@@ -274,13 +282,16 @@ void handle_ares(struct session_info *s, naseps_msg_t *msg)
 void handle_scmd(struct session_info *s, naseps_msg_t *msg)
 {
 	naseps_msg_string_t* selected_nas_security_alogirthms;
+	uint8_t *data = NULL;
 
 	/* Find out which ciphering algorithms where selected */
 	selected_nas_security_alogirthms = get_naseps_msg_field_by_pos(msg, 3);
-	if(selected_nas_security_alogirthms && selected_nas_security_alogirthms->data)
+	if(selected_nas_security_alogirthms)
+		data = get_naseps_msg_field_data(msg, selected_nas_security_alogirthms);
+	if(data)
 	{
-		s->cipher = ((selected_nas_security_alogirthms->data[0]) >> 4) & 0x7;
-		s->integrity = (selected_nas_security_alogirthms->data[0]) & 0x7;
+		s->cipher = ((data[0]) >> 4) & 0x7;
+		s->integrity = (data[0]) & 0x7;
 	}
 }
 
@@ -296,7 +307,7 @@ void handle_drq(struct session_info *s, naseps_msg_t *msg)
 	if(msg->uplink)
 	{
 		mobile_identity = get_naseps_msg_field_by_pos(msg, 5);
-		handle_eps_mi(s, mobile_identity, 0);
+		handle_eps_mi(s, msg, mobile_identity, 0);
 	}
 }
 
@@ -306,8 +317,8 @@ void handle_unt(struct session_info *s, naseps_msg_t *msg)
 	naseps_msg_string_t* nas_mc;
 
 	nas_mc = get_naseps_msg_field_by_pos(msg, 3);
-	if(nas_mc && nas_mc->data)
-		handle_dtap(s, nas_mc->data, nas_mc->len, 0, 1);
+	if(nas_mc && nas_mc->len)
+		handle_dtap(s, get_naseps_msg_field_data(msg, nas_mc), nas_mc->len, 0, 1);
 }
 
 /* Handle downlink NAS transport message */
@@ -316,8 +327,8 @@ void handle_dnt(struct session_info *s, naseps_msg_t *msg)
 	naseps_msg_string_t* nas_mc;
 
 	nas_mc = get_naseps_msg_field_by_pos(msg, 3);
-	if(nas_mc && nas_mc->data)
-		handle_dtap(s, nas_mc->data, nas_mc->len, 0, 0);
+	if(nas_mc && nas_mc->len)
+		handle_dtap(s, get_naseps_msg_field_data(msg, nas_mc), nas_mc->len, 0, 0);
 }
 
 /* Session management types */
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "session.h"
+#include "eps_crypt.h"
+#include "failure.h"
+#include "lte_nas_eps.h"
+#include "lte_nas_eps_mm.h"
+#include "lte_nas_eps_sec.h"
+
+/* NAS signalling always uses bearer 0 */
+#define NASEPS_SEC_BEARER 0
+
+static struct naseps_sec_stats naseps_sec_stats;
+
+/* Store the NAS keys (128 bit) and algorithms for a session */
+void naseps_set_keys(struct session_info *s, uint8_t eea, uint8_t eia, const uint8_t *k_enc, const uint8_t *k_int, uint32_t ul_count, uint32_t dl_count)
+{
+	struct nas_sec_ctx *ctx = &s->nas_sec;
+
+	ctx->eea = eea;
+	ctx->eia = eia;
+	memcpy(ctx->k_enc, k_enc, sizeof(ctx->k_enc));
+	memcpy(ctx->k_int, k_int, sizeof(ctx->k_int));
+	ctx->count[0] = ul_count;
+	ctx->count[1] = dl_count;
+	ctx->valid = 1;
+
+	if (msg_verbose > 1) {
+		printf("NAS keys: EEA%u EIA%u UL %u DL %u\n", eea, eia, ul_count, dl_count);
+	}
+}
+
+/* Reconstruct the NAS COUNT from the 8 bit sequence number */
+static uint32_t naseps_estimate_count(uint32_t next, uint8_t sqn)
+{
+	uint32_t count = (next & 0xffff00) | sqn;
+
+	if (count < next) {
+		count = (count + 0x100) & 0xffffff;
+	}
+
+	return count;
+}
+
+/* Verify and decipher a security protected message in place, returns 0 on success */
+int naseps_decrypt(struct session_info *s, uint8_t *message, int len, uint8_t uplink)
+{
+	struct nas_sec_ctx *ctx = &s->nas_sec;
+	uint8_t dir = uplink ? 0 : 1;
+	uint8_t header_type;
+	uint32_t count;
+	uint32_t mac;
+	uint32_t xmac;
+	int ciphered;
+
+	if (len <= NASEPS_SEC_HDR_LEN || (message[0] & 0x0f) != PROTOCOL_EPS_MM) {
+		return -1;
+	}
+
+	header_type = message[0] >> 4;
+	switch (header_type) {
+	case EPS_MM_SECHDR_TYPE_INTEGRITY:
+	case EPS_MM_SECHDR_TYPE_INTEGRITY_NEW:
+		ciphered = 0;
+		break;
+	case EPS_MM_SECHDR_TYPE_INTEGRITY_CIPHERED:
+	case EPS_MM_SECHDR_TYPE_INTEGRITY_CIPHERED_NEW:
+		ciphered = 1;
+		break;
+	default:
+		return -1;
+	}
+
+	naseps_sec_stats.protected++;
+
+	if (!ctx->valid) {
+		naseps_sec_stats.no_key++;
+		return -1;
+	}
+
+	if (len - 5 > EPS_CRYPT_MAX_LEN) {
+		naseps_sec_stats.unsupported++;
+		return -1;
+	}
+
+	count = naseps_estimate_count(ctx->count[dir], message[5]);
+
+	/* The MAC covers the sequence number and the (ciphered) message */
+	mac = ((uint32_t) message[1] << 24) | (message[2] << 16) | (message[3] << 8) | message[4];
+	switch (ctx->eia) {
+	case EPS_EIA0:
+		xmac = mac;
+		break;
+	case EPS_EIA1:
+		xmac = eps_eia1(ctx->k_int, count, NASEPS_SEC_BEARER, dir, &message[5], len - 5);
+		break;
+	case EPS_EIA2:
+		xmac = eps_eia2(ctx->k_int, count, NASEPS_SEC_BEARER, dir, &message[5], len - 5);
+		break;
+	default:
+		naseps_sec_stats.unsupported++;
+		return -1;
+	}
+
+	if (xmac != mac) {
+		naseps_sec_stats.mac_failed++;
+		failure_record(FAIL_NAS_EPS_INTEGRITY, message, len);
+		if (msg_verbose > 1) {
+			printf("NAS integrity check failed: COUNT %u MAC %08x expected %08x\n", count, mac, xmac);
+		}
+		return -1;
+	}
+
+	if (ciphered) {
+		switch (ctx->eea) {
+		case EPS_EEA0:
+			break;
+		case EPS_EEA1:
+			eps_eea1(ctx->k_enc, count, NASEPS_SEC_BEARER, dir, &message[6], len - 6);
+			break;
+		case EPS_EEA2:
+			eps_eea2(ctx->k_enc, count, NASEPS_SEC_BEARER, dir, &message[6], len - 6);
+			break;
+		default:
+			naseps_sec_stats.unsupported++;
+			return -1;
+		}
+	}
+
+	ctx->count[dir] = (count + 1) & 0xffffff;
+	naseps_sec_stats.decrypted++;
+
+	return 0;
+}
+
+/* Decrypt if possible and dispatch a security protected message */
+void handle_naseps_protected(struct session_info *s, uint8_t *message, int len, uint8_t uplink)
+{
+	if (naseps_decrypt(s, message, len, uplink) == 0) {
+		/* The plain message follows the security header */
+		handle_naseps(s, &message[NASEPS_SEC_HDR_LEN], len - NASEPS_SEC_HDR_LEN);
+	} else {
+		handle_naseps(s, message, len);
+	}
+}
+
+/* Print the security counters */
+void naseps_sec_print_stats()
+{
+	struct naseps_sec_stats *st = &naseps_sec_stats;
+
+	if (!st->protected) {
+		return;
+	}
+
+	printf("NAS protected: %u decrypted: %u no key: %u unsupported: %u integrity failed: %u\n",
+		st->protected, st->decrypted, st->no_key, st->unsupported, st->mac_failed);
+}
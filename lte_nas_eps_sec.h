@@ -0,0 +1,30 @@
+#ifndef LTE_NAS_EPS_SEC_H
+#define LTE_NAS_EPS_SEC_H
+
+#include "session.h"
+
+/* Length of the security protected NAS message header */
+#define NASEPS_SEC_HDR_LEN 6
+
+/* Counters for security protected messages */
+struct naseps_sec_stats {
+	unsigned protected;	/* Security protected messages seen */
+	unsigned decrypted;	/* Messages verified (and deciphered) */
+	unsigned no_key;	/* No NAS keys available */
+	unsigned unsupported;	/* Unsupported header type or algorithm */
+	unsigned mac_failed;	/* Integrity check failed */
+};
+
+/* Store the NAS keys (128 bit) and algorithms for a session */
+void naseps_set_keys(struct session_info *s, uint8_t eea, uint8_t eia, const uint8_t *k_enc, const uint8_t *k_int, uint32_t ul_count, uint32_t dl_count);
+
+/* Verify and decipher a security protected message in place, returns 0 on success */
+int naseps_decrypt(struct session_info *s, uint8_t *message, int len, uint8_t uplink);
+
+/* Decrypt if possible and dispatch a security protected message */
+void handle_naseps_protected(struct session_info *s, uint8_t *message, int len, uint8_t uplink);
+
+/* Print the security counters */
+void naseps_sec_print_stats();
+
+#endif
@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "manifest.h"
+
+#define MANIFEST_HASH_BITS 16
+#define MANIFEST_HASH_SIZE (1 << MANIFEST_HASH_BITS)
+#define MANIFEST_READ_SIZE (1024 * 1024)
+
+struct manifest_entry {
+	uint64_t hash;
+	uint64_t size;
+	int64_t mtime;
+	unsigned version;
+	char *path;
+	struct manifest_entry *next_hash;	/* Same content hash bucket */
+	struct manifest_entry *next_path;	/* Same path bucket, newest first */
+};
+
+/* Lookups come from the prefetch thread as well */
+struct manifest {
+	FILE *f;
+	pthread_mutex_t mutex;
+	struct manifest_entry *by_hash[MANIFEST_HASH_SIZE];
+	struct manifest_entry *by_path[MANIFEST_HASH_SIZE];
+};
+
+/* XXH64, https://github.com/Cyan4973/xxHash */
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+
+struct xxh64_state {
+	uint64_t v[4];
+	uint64_t total;
+	uint64_t seed;
+	uint8_t mem[32];
+	unsigned memsize;
+};
+
+static inline uint64_t rotl64(uint64_t x, unsigned r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_P2;
+	acc = rotl64(acc, 31);
+
+	return acc * XXH_P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh_round(0, val);
+
+	return acc * XXH_P1 + XXH_P4;
+}
+
+static void xxh64_init(struct xxh64_state *st, uint64_t seed)
+{
+	memset(st, 0, sizeof(*st));
+	st->seed = seed;
+	st->v[0] = seed + XXH_P1 + XXH_P2;
+	st->v[1] = seed + XXH_P2;
+	st->v[2] = seed;
+	st->v[3] = seed - XXH_P1;
+}
+
+static void xxh64_update(struct xxh64_state *st, const uint8_t *p, size_t len)
+{
+	const uint8_t *end = p + len;
+	unsigned fill;
+
+	st->total += len;
+
+	if (st->memsize + len < 32) {
+		memcpy(st->mem + st->memsize, p, len);
+		st->memsize += len;
+		return;
+	}
+
+	if (st->memsize) {
+		fill = 32 - st->memsize;
+		memcpy(st->mem + st->memsize, p, fill);
+		st->v[0] = xxh_round(st->v[0], read64(st->mem));
+		st->v[1] = xxh_round(st->v[1], read64(st->mem + 8));
+		st->v[2] = xxh_round(st->v[2], read64(st->mem + 16));
+		st->v[3] = xxh_round(st->v[3], read64(st->mem + 24));
+		p += fill;
+		st->memsize = 0;
+	}
+
+	while (p + 32 <= end) {
+		st->v[0] = xxh_round(st->v[0], read64(p));
+		st->v[1] = xxh_round(st->v[1], read64(p + 8));
+		st->v[2] = xxh_round(st->v[2], read64(p + 16));
+		st->v[3] = xxh_round(st->v[3], read64(p + 24));
+		p += 32;
+	}
+
+	if (p < end) {
+		memcpy(st->mem, p, end - p);
+		st->memsize = end - p;
+	}
+}
+
+static uint64_t xxh64_digest(const struct xxh64_state *st)
+{
+	const uint8_t *p = st->mem;
+	const uint8_t *end = st->mem + st->memsize;
+	uint64_t h;
+
+	if (st->total >= 32) {
+		h = rotl64(st->v[0], 1) + rotl64(st->v[1], 7) +
+		    rotl64(st->v[2], 12) + rotl64(st->v[3], 18);
+		h = xxh_merge(h, st->v[0]);
+		h = xxh_merge(h, st->v[1]);
+		h = xxh_merge(h, st->v[2]);
+		h = xxh_merge(h, st->v[3]);
+	} else {
+		h = st->seed + XXH_P5;
+	}
+
+	h += st->total;
+
+	while (p + 8 <= end) {
+		h ^= xxh_round(0, read64(p));
+		h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t) read32(p) * XXH_P1;
+		h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * XXH_P5;
+		h = rotl64(h, 11) * XXH_P1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_P2;
+	h ^= h >> 29;
+	h *= XXH_P3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+uint64_t manifest_hash(const void *data, size_t len, uint64_t seed)
+{
+	struct xxh64_state st;
+
+	xxh64_init(&st, seed);
+	xxh64_update(&st, (const uint8_t *) data, len);
+
+	return xxh64_digest(&st);
+}
+
+static unsigned bucket(uint64_t hash)
+{
+	return hash >> (64 - MANIFEST_HASH_BITS);
+}
+
+static unsigned path_bucket(const char *path)
+{
+	return bucket(manifest_hash(path, strlen(path), 0));
+}
+
+/* Called with the mutex held or before the manifest is shared */
+static void manifest_insert(struct manifest *m, struct manifest_entry *e)
+{
+	unsigned b = bucket(e->hash);
+	unsigned pb = path_bucket(e->path);
+
+	e->next_hash = m->by_hash[b];
+	m->by_hash[b] = e;
+	e->next_path = m->by_path[pb];
+	m->by_path[pb] = e;
+}
+
+static void manifest_load(struct manifest *m)
+{
+	struct manifest_entry *e;
+	unsigned long long hash, size;
+	long long mtime;
+	unsigned version;
+	char line[FILENAME_MAX + 128];
+	int len, pos;
+
+	while (fgets(line, sizeof(line), m->f)) {
+		len = strlen(line);
+		if (len && line[len - 1] == '\n') {
+			line[--len] = '\0';
+		}
+
+		/* ID ranges are only kept for the reader */
+		pos = 0;
+		if (line[0] == '#' ||
+		    sscanf(line, "%16llx\t%llu\t%lld\t%u\t%*u\t%*u\t%*u\t%*u\t%n",
+			   &hash, &size, &mtime, &version, &pos) != 4 || !pos) {
+			continue;
+		}
+
+		e = (struct manifest_entry *) calloc(1, sizeof(struct manifest_entry));
+		if (!e) {
+			break;
+		}
+		e->hash = hash;
+		e->size = size;
+		e->mtime = mtime;
+		e->version = version;
+		e->path = strdup(line + pos);
+		manifest_insert(m, e);
+	}
+}
+
+struct manifest *manifest_open(const char *filename)
+{
+	struct manifest *m;
+
+	m = (struct manifest *) calloc(1, sizeof(struct manifest));
+	if (!m) {
+		return NULL;
+	}
+
+	m->f = fopen(filename, "a+");
+	if (!m->f) {
+		free(m);
+		return NULL;
+	}
+	pthread_mutex_init(&m->mutex, NULL);
+
+	fseek(m->f, 0, SEEK_SET);
+	manifest_load(m);
+
+	return m;
+}
+
+void manifest_close(struct manifest *m)
+{
+	struct manifest_entry *e, *next;
+	unsigned i;
+
+	if (!m) {
+		return;
+	}
+
+	for (i = 0; i < MANIFEST_HASH_SIZE; i++) {
+		for (e = m->by_hash[i]; e; e = next) {
+			next = e->next_hash;
+			free(e->path);
+			free(e);
+		}
+	}
+
+	fclose(m->f);
+	pthread_mutex_destroy(&m->mutex);
+	free(m);
+}
+
+static int hash_fd(int fd, uint64_t *hash)
+{
+	struct xxh64_state st;
+	uint8_t *buf;
+	off_t off = 0;
+	ssize_t n;
+
+	buf = (uint8_t *) malloc(MANIFEST_READ_SIZE);
+	if (!buf) {
+		return -1;
+	}
+
+	xxh64_init(&st, 0);
+	for (;;) {
+		n = pread(fd, buf, MANIFEST_READ_SIZE, off);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		xxh64_update(&st, buf, n);
+		off += n;
+	}
+	free(buf);
+
+	if (n < 0) {
+		return -1;
+	}
+
+	*hash = xxh64_digest(&st);
+
+	return 0;
+}
+
+int manifest_file_init(struct manifest *m, const char *path, int fd,
+		const uint8_t *data, size_t len, struct manifest_file *mf)
+{
+	struct manifest_entry *e;
+	struct stat st;
+
+	memset(mf, 0, sizeof(*mf));
+
+	if (fstat(fd, &st) < 0) {
+		return -1;
+	}
+	mf->size = st.st_size;
+	mf->mtime = st.st_mtime;
+
+	pthread_mutex_lock(&m->mutex);
+	for (e = m->by_path[path_bucket(path)]; e; e = e->next_path) {
+		if (e->size == mf->size && e->mtime == mf->mtime && !strcmp(e->path, path)) {
+			break;
+		}
+	}
+	if (e) {
+		mf->hash = e->hash;
+	}
+	pthread_mutex_unlock(&m->mutex);
+
+	if (e) {
+		return 0;
+	}
+
+	if (data && len == mf->size) {
+		mf->hash = manifest_hash(data, len, 0);
+		return 0;
+	}
+
+	return hash_fd(fd, &mf->hash);
+}
+
+int manifest_seen(struct manifest *m, const struct manifest_file *mf)
+{
+	struct manifest_entry *e;
+
+	pthread_mutex_lock(&m->mutex);
+	for (e = m->by_hash[bucket(mf->hash)]; e; e = e->next_hash) {
+		if (e->hash == mf->hash && e->size == mf->size && e->version >= PARSER_VERSION) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&m->mutex);
+
+	return e != NULL;
+}
+
+void manifest_add(struct manifest *m, const char *path, const struct manifest_file *mf,
+		unsigned next_sid, unsigned next_cid)
+{
+	struct manifest_entry *e;
+
+	e = (struct manifest_entry *) calloc(1, sizeof(struct manifest_entry));
+	if (!e) {
+		return;
+	}
+	e->hash = mf->hash;
+	e->size = mf->size;
+	e->mtime = mf->mtime;
+	e->version = PARSER_VERSION;
+	e->path = strdup(path);
+
+	pthread_mutex_lock(&m->mutex);
+	fprintf(m->f, "%016llx\t%llu\t%lld\t%u\t%u\t%u\t%u\t%u\t%s\n",
+		(unsigned long long) mf->hash, (unsigned long long) mf->size,
+		(long long) mf->mtime, PARSER_VERSION,
+		mf->first_sid, next_sid, mf->first_cid, next_cid, path);
+	fflush(m->f);
+	manifest_insert(m, e);
+	pthread_mutex_unlock(&m->mutex);
+}
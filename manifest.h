@@ -0,0 +1,49 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Record of ingested input files, a tab separated text file with one line
+ * per file: content hash (XXH64), size, mtime, parser version, the
+ * session and cell ID ranges used and the path. Files whose content was
+ * already ingested by the current parser version are skipped.
+ */
+
+/* Bump when decoding changes, older imports are then ingested again */
+#define PARSER_VERSION 1
+
+struct manifest_file {
+	uint64_t hash;
+	uint64_t size;
+	int64_t mtime;
+	unsigned first_sid;	/* IDs before the file was read */
+	unsigned first_cid;
+};
+
+struct manifest;
+
+/* Entries are loaded, new ones appended. NULL with errno set on errors */
+struct manifest *manifest_open(const char *filename);
+void manifest_close(struct manifest *m);
+
+/*
+ * Hash and size of an open file. data/len are the contents if already in
+ * memory. Unchanged paths (same size and mtime) reuse the recorded hash.
+ */
+int manifest_file_init(struct manifest *m, const char *path, int fd,
+		const uint8_t *data, size_t len, struct manifest_file *mf);
+
+/* 1 if the content was ingested by this parser version */
+int manifest_seen(struct manifest *m, const struct manifest_file *mf);
+
+/* Record a file, next_sid/next_cid are the IDs after it was read */
+void manifest_add(struct manifest *m, const char *path, const struct manifest_file *mf,
+		unsigned next_sid, unsigned next_cid);
+
+/* XXH64 of a buffer */
+uint64_t manifest_hash(const void *data, size_t len, uint64_t seed);
+
+#endif
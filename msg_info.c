@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#include "msg_info.h"
+
+/* Flags, width and precision of a conversion */
+#define SPEC_CHARS "-+ #0123456789."
+
+/* Copy a string argument, truncated if the buffer is full */
+static long msg_info_copy(struct msg_info *mi, const char *str)
+{
+	unsigned space;
+	unsigned len;
+	long off;
+
+	if (!str) {
+		str = "(null)";
+	}
+
+	/* The last byte always stays 0 */
+	if (mi->str_len >= MSG_INFO_STR - 1) {
+		return MSG_INFO_STR - 1;
+	}
+	space = MSG_INFO_STR - 1 - mi->str_len;
+
+	len = strnlen(str, space - 1);
+	off = mi->str_len;
+	memcpy(&mi->str[off], str, len);
+	mi->str[off + len] = 0;
+	mi->str_len += len + 1;
+
+	return off;
+}
+
+/*
+ * All events are used, the text so far and the new event become a
+ * single string event. Text beyond MSG_INFO_TEXT is cut like in the old
+ * info buffer.
+ */
+static void msg_info_spill(struct msg_info *mi, const char *fmt, va_list ap)
+{
+	char buf[MSG_INFO_TEXT];
+	unsigned len;
+
+	len = msg_info_render(mi, 0, buf, sizeof(buf));
+	if (len + 1 < sizeof(buf)) {
+		vsnprintf(&buf[len], sizeof(buf) - len, fmt, ap);
+		len = strlen(buf);
+	}
+
+	memcpy(mi->str, buf, len + 1);
+	mi->str_len = len + 1;
+	mi->n = 1;
+	mi->spills++;
+	mi->ev[0].fmt = "%s";
+	mi->ev[0].arg[0] = 0;
+}
+
+static void msg_info_add(struct msg_info *mi, const char *fmt, va_list ap)
+{
+	struct msg_info_event *ev;
+	const char *p = fmt;
+	unsigned n = 0;
+
+	if (mi->n >= MSG_INFO_EVENTS) {
+		msg_info_spill(mi, fmt, ap);
+		return;
+	}
+
+	ev = &mi->ev[mi->n++];
+	ev->fmt = fmt;
+
+	while ((p = strchr(p, '%'))) {
+		p++;
+		if (*p == '%') {
+			p++;
+			continue;
+		}
+		p += strspn(p, SPEC_CHARS);
+
+		/* Conversions beyond MSG_INFO_ARGS are not rendered */
+		if (n == MSG_INFO_ARGS) {
+			break;
+		}
+
+		if (*p == 'l') {
+			ev->arg[n++] = va_arg(ap, long);
+		} else if (*p == 's') {
+			ev->arg[n++] = msg_info_copy(mi, va_arg(ap, const char *));
+		} else {
+			ev->arg[n++] = va_arg(ap, int);
+		}
+	}
+}
+
+void msg_info_set(struct msg_info *mi, const char *fmt, ...)
+{
+	va_list ap;
+
+	msg_info_clear(mi);
+
+	va_start(ap, fmt);
+	msg_info_add(mi, fmt, ap);
+	va_end(ap);
+}
+
+void msg_info_append(struct msg_info *mi, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	msg_info_add(mi, fmt, ap);
+	va_end(ap);
+}
+
+/* Render events starting at first into buf, returns the text length */
+unsigned msg_info_render(const struct msg_info *mi, unsigned first, char *buf, unsigned len)
+{
+	const struct msg_info_event *ev;
+	const char *p, *q;
+	char spec[16];
+	unsigned off = 0;
+	unsigned i, n;
+	int ret;
+
+	assert(len > 0);
+
+	for (i = first; i < mi->n && off + 1 < len; i++) {
+		ev = &mi->ev[i];
+		n = 0;
+
+		for (p = ev->fmt; *p && off + 1 < len; p++) {
+			if (*p != '%') {
+				buf[off++] = *p;
+				continue;
+			}
+			if (p[1] == '%') {
+				buf[off++] = '%';
+				p++;
+				continue;
+			}
+
+			/* Format each conversion on its own */
+			if (n == MSG_INFO_ARGS) {
+				break;
+			}
+			q = p + 1 + strspn(p + 1, SPEC_CHARS);
+			if (*q == 'l') {
+				q++;
+			}
+			if ((unsigned) (q - p + 1) >= sizeof(spec)) {
+				break;
+			}
+			memcpy(spec, p, q - p + 1);
+			spec[q - p + 1] = 0;
+
+			if (*q == 's') {
+				ret = snprintf(&buf[off], len - off, spec, &mi->str[ev->arg[n]]);
+			} else if (q[-1] == 'l') {
+				ret = snprintf(&buf[off], len - off, spec, ev->arg[n]);
+			} else {
+				ret = snprintf(&buf[off], len - off, spec, (int) ev->arg[n]);
+			}
+			n++;
+
+			if (ret > 0) {
+				off += ret;
+				if (off > len - 1) {
+					off = len - 1;
+				}
+			}
+			p = q;
+		}
+	}
+	buf[off] = 0;
+
+	return off;
+}
+
+/* Text of all events, valid until the next call */
+const char *msg_info_str(const struct msg_info *mi)
+{
+	static __thread char buf[MSG_INFO_TEXT];
+
+	msg_info_render(mi, 0, buf, sizeof(buf));
+
+	return buf;
+}
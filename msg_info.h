@@ -0,0 +1,47 @@
+#ifndef MSG_INFO_H
+#define MSG_INFO_H
+
+#include <stdint.h>
+
+/*
+ * Message description, recorded as events and only rendered to text when
+ * somebody reads it. The static format string identifies the event, its
+ * arguments are captured by conversion type (int, long or string).
+ */
+
+#define MSG_INFO_EVENTS 8
+#define MSG_INFO_ARGS 3
+#define MSG_INFO_STR 128	/* Holds a full text once all events are used */
+#define MSG_INFO_TEXT 128	/* Rendered text, including the terminating 0 */
+
+struct msg_info_event {
+	const char *fmt;
+	long arg[MSG_INFO_ARGS];	/* Integer value, or offset into str for %s */
+} __attribute__((packed));
+
+struct msg_info {
+	uint8_t n;
+	uint8_t str_len;
+	uint8_t spills;		/* Events merged into text, see msg_info_spill() */
+	struct msg_info_event ev[MSG_INFO_EVENTS];
+	char str[MSG_INFO_STR];	/* Copies of string arguments */
+} __attribute__((packed));
+
+static inline void msg_info_clear(struct msg_info *mi)
+{
+	mi->n = 0;
+	mi->str_len = 0;
+	mi->spills = 0;
+}
+
+static inline int msg_info_empty(const struct msg_info *mi)
+{
+	return !mi->n;
+}
+
+void msg_info_set(struct msg_info *mi, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void msg_info_append(struct msg_info *mi, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+unsigned msg_info_render(const struct msg_info *mi, unsigned first, char *buf, unsigned len);
+const char *msg_info_str(const struct msg_info *mi);
+
+#endif
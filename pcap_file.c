@@ -0,0 +1,575 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pcap_file.h"
+#include "decompress.h"
+
+#define PCAP_MAGIC_US		0xa1b2c3d4
+#define PCAP_MAGIC_NS		0xa1b23c4d
+#define PCAPNG_BOM		0x1a2b3c4d
+
+#define PCAPNG_SHB		0x0a0d0d0a
+#define PCAPNG_IDB		1
+#define PCAPNG_SPB		3
+#define PCAPNG_EPB		6
+
+#define PCAPNG_OPT_TSRESOL	9
+
+/* Interfaces per pcapng section, packets of further ones are skipped */
+#define PCAP_MAX_IF 64
+
+/* Pages already walked are dropped from the mapping in steps of this size */
+#define PCAP_RELEASE_CHUNK (64 * 1024 * 1024)
+
+/* Window for compressed input, grown for larger blocks up to the limit */
+#define PCAP_STREAM_BUF (4 * 1024 * 1024)
+#define PCAP_STREAM_MAX (256 * 1024 * 1024)
+
+struct pcap_if {
+	uint32_t linktype;
+	uint64_t units;		/* Timestamp units per second */
+};
+
+struct pcap_file {
+	const uint8_t *map;	/* Mapped file or stream window */
+	size_t size;
+	size_t pos;
+	size_t released;
+	FILE *stream;		/* Compressed input, read through a window */
+	uint8_t *buf;
+	size_t cap;
+	int swap;
+	int ng;
+	uint32_t snaplen;	/* Classic pcap, 0 if not set */
+	struct pcap_if ifs[PCAP_MAX_IF];	/* Classic pcap uses ifs[0] */
+	unsigned n_if;
+};
+
+static uint16_t rd16(const struct pcap_file *pf, const uint8_t *p)
+{
+	uint16_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return pf->swap ? __builtin_bswap16(v) : v;
+}
+
+static uint32_t rd32(const struct pcap_file *pf, const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return pf->swap ? __builtin_bswap32(v) : v;
+}
+
+/* Network byte order, for protocol headers */
+static inline uint16_t be16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+/* 1 if n bytes are available at pos, the stream window is refilled as needed */
+static int ensure(struct pcap_file *pf, size_t n)
+{
+	size_t ret;
+	uint8_t *buf;
+
+	if (pf->size - pf->pos >= n) {
+		return 1;
+	}
+	if (!pf->stream || n > PCAP_STREAM_MAX) {
+		return 0;
+	}
+
+	memmove(pf->buf, pf->buf + pf->pos, pf->size - pf->pos);
+	pf->size -= pf->pos;
+	pf->pos = 0;
+
+	if (n > pf->cap) {
+		buf = (uint8_t *) realloc(pf->buf, n);
+		if (!buf) {
+			return 0;
+		}
+		pf->buf = buf;
+		pf->cap = n;
+	}
+	pf->map = pf->buf;
+
+	while (pf->size < n) {
+		ret = fread(pf->buf + pf->size, 1, pf->cap - pf->size, pf->stream);
+		if (!ret) {
+			return 0;
+		}
+		pf->size += ret;
+	}
+
+	return 1;
+}
+
+/* 0 if the input ended between records, -1 inside one or on read errors */
+static int end_of_input(struct pcap_file *pf)
+{
+	if (pf->size - pf->pos || (pf->stream && ferror(pf->stream))) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static void set_ts(struct timeval *tv, uint64_t ts, uint64_t units)
+{
+	uint64_t frac = ts % units;
+
+	tv->tv_sec = ts / units;
+	tv->tv_usec = units == 1000000 ? frac : (uint64_t) ((double) frac * 1000000.0 / units);
+}
+
+static int open_pcap(struct pcap_file *pf)
+{
+	uint32_t magic;
+
+	if (!ensure(pf, 24)) {
+		return -1;
+	}
+
+	memcpy(&magic, pf->map, sizeof(magic));
+	pf->swap = (magic == __builtin_bswap32(PCAP_MAGIC_US) || magic == __builtin_bswap32(PCAP_MAGIC_NS));
+
+	magic = rd32(pf, pf->map);
+	if (magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS) {
+		return -1;
+	}
+
+	pf->snaplen = rd32(pf, pf->map + 16);
+
+	/* Upper bits carry the FCS length */
+	pf->ifs[0].linktype = rd32(pf, pf->map + 20) & 0xffff;
+	pf->ifs[0].units = (magic == PCAP_MAGIC_NS ? 1000000000ULL : 1000000ULL);
+	pf->n_if = 1;
+	pf->pos = 24;
+
+	return 0;
+}
+
+/* Section header, decides the byte order of all following blocks */
+static int read_shb(struct pcap_file *pf)
+{
+	const uint8_t *block;
+	uint32_t bom;
+
+	if (!ensure(pf, 28)) {
+		return -1;
+	}
+	block = pf->map + pf->pos;
+
+	memcpy(&bom, block + 8, sizeof(bom));
+	if (bom == PCAPNG_BOM) {
+		pf->swap = 0;
+	} else if (bom == __builtin_bswap32(PCAPNG_BOM)) {
+		pf->swap = 1;
+	} else {
+		return -1;
+	}
+
+	pf->n_if = 0;
+
+	return 0;
+}
+
+static void read_idb(struct pcap_file *pf, const uint8_t *body, uint32_t len)
+{
+	struct pcap_if *pi;
+	uint16_t code, olen;
+	uint8_t res;
+	uint32_t off = 8;
+
+	if (pf->n_if >= PCAP_MAX_IF) {
+		pf->n_if++;
+		return;
+	}
+
+	pi = &pf->ifs[pf->n_if++];
+	pi->linktype = len < 8 ? 0xffff : rd16(pf, body);
+	pi->units = 1000000;
+
+	while (off + 4 <= len) {
+		code = rd16(pf, body + off);
+		olen = rd16(pf, body + off + 2);
+		off += 4;
+		if (code == 0 || off + olen > len) {
+			break;
+		}
+		if (code == PCAPNG_OPT_TSRESOL && olen >= 1) {
+			res = body[off];
+			if (res & 0x80) {
+				pi->units = 1ULL << ((res & 0x7f) < 63 ? (res & 0x7f) : 63);
+			} else {
+				pi->units = 1;
+				while (res-- && pi->units <= 1000000000000000000ULL) {
+					pi->units *= 10;
+				}
+			}
+		}
+		off += (olen + 3) & ~3;
+	}
+}
+
+static int next_pcap(struct pcap_file *pf, struct pcap_packet *pkt)
+{
+	const uint8_t *rec;
+	uint32_t caplen;
+
+	/* A capture still being written is not complete yet either */
+	if (!ensure(pf, 16)) {
+		return end_of_input(pf);
+	}
+
+	caplen = rd32(pf, pf->map + pf->pos + 8);
+	if (pf->snaplen && caplen > pf->snaplen) {
+		return -1;
+	}
+	if (!ensure(pf, 16 + (size_t) caplen)) {
+		return -1;
+	}
+	rec = pf->map + pf->pos;
+
+	pkt->ts.tv_sec = rd32(pf, rec);
+	pkt->ts.tv_usec = rd32(pf, rec + 4);
+	if (pf->ifs[0].units != 1000000) {
+		pkt->ts.tv_usec /= 1000;
+	}
+	pkt->linktype = pf->ifs[0].linktype;
+	pkt->caplen = caplen;
+	pkt->len = rd32(pf, rec + 12);
+	pkt->data = rec + 16;
+
+	pf->pos += 16 + caplen;
+
+	return 1;
+}
+
+static int next_pcapng(struct pcap_file *pf, struct pcap_packet *pkt)
+{
+	const uint8_t *block, *body;
+	uint32_t type, blen, len, ifid, caplen;
+	uint64_t ts;
+
+	while (ensure(pf, 12)) {
+		memcpy(&type, pf->map + pf->pos, sizeof(type));
+		if (type == PCAPNG_SHB && read_shb(pf) < 0) {
+			return -1;
+		}
+
+		type = rd32(pf, pf->map + pf->pos);
+		blen = rd32(pf, pf->map + pf->pos + 4);
+		if (blen < 12 || (blen & 3)) {
+			return -1;
+		}
+		if (!ensure(pf, blen)) {
+			return -1;
+		}
+		block = pf->map + pf->pos;
+
+		body = block + 8;
+		len = blen - 12;
+		pf->pos += blen;
+
+		switch (type) {
+		case PCAPNG_IDB:
+			read_idb(pf, body, len);
+			break;
+		case PCAPNG_EPB:
+			if (len < 20) {
+				return -1;
+			}
+			ifid = rd32(pf, body);
+			caplen = rd32(pf, body + 12);
+			if (caplen > len - 20) {
+				return -1;
+			}
+			if (ifid >= pf->n_if || ifid >= PCAP_MAX_IF) {
+				break;
+			}
+			ts = ((uint64_t) rd32(pf, body + 4) << 32) | rd32(pf, body + 8);
+			set_ts(&pkt->ts, ts, pf->ifs[ifid].units);
+			pkt->linktype = pf->ifs[ifid].linktype;
+			pkt->caplen = caplen;
+			pkt->len = rd32(pf, body + 16);
+			pkt->data = body + 20;
+			return 1;
+		case PCAPNG_SPB:
+			/* No timestamp, always the first interface */
+			if (len < 4 || pf->n_if < 1) {
+				break;
+			}
+			pkt->ts.tv_sec = 0;
+			pkt->ts.tv_usec = 0;
+			pkt->linktype = pf->ifs[0].linktype;
+			pkt->len = rd32(pf, body);
+			pkt->caplen = pkt->len < len - 4 ? pkt->len : len - 4;
+			pkt->data = body + 4;
+			return 1;
+		default:
+			break;
+		}
+	}
+
+	return end_of_input(pf);
+}
+
+/* Compressed captures are streamed, plain ones mapped */
+static int pcap_file_map(struct pcap_file *pf, const char *filename)
+{
+	struct stat st;
+	uint8_t magic[6];
+	void *map;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return -1;
+	}
+	if (st.st_size < 24) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (pread(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+	    decompress_detect(magic, sizeof(magic)) != DECOMPRESS_NONE) {
+		close(fd);
+		pf->stream = decompress_open(filename);
+		if (!pf->stream) {
+			return -1;
+		}
+		pf->buf = (uint8_t *) malloc(PCAP_STREAM_BUF);
+		if (!pf->buf) {
+			errno = ENOMEM;
+			return -1;
+		}
+		pf->cap = PCAP_STREAM_BUF;
+		pf->map = pf->buf;
+		return 0;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	pf->map = (const uint8_t *) map;
+	pf->size = st.st_size;
+
+	return 0;
+}
+
+struct pcap_file *pcap_file_open(const char *filename)
+{
+	struct pcap_file *pf;
+	uint32_t type;
+
+	pf = (struct pcap_file *) calloc(1, sizeof(struct pcap_file));
+	if (!pf) {
+		return NULL;
+	}
+
+	if (pcap_file_map(pf, filename) < 0) {
+		pcap_file_close(pf);
+		return NULL;
+	}
+
+	if (!ensure(pf, 4)) {
+		pcap_file_close(pf);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	memcpy(&type, pf->map, sizeof(type));
+	if (type == PCAPNG_SHB) {
+		pf->ng = 1;
+		if (read_shb(pf) < 0) {
+			pcap_file_close(pf);
+			errno = EINVAL;
+			return NULL;
+		}
+	} else if (open_pcap(pf) < 0) {
+		pcap_file_close(pf);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return pf;
+}
+
+void pcap_file_close(struct pcap_file *pf)
+{
+	int saved = errno;
+
+	if (!pf) {
+		return;
+	}
+
+	if (pf->stream) {
+		fclose(pf->stream);
+		free(pf->buf);
+	} else if (pf->map) {
+		munmap((void *) pf->map, pf->size);
+	}
+	free(pf);
+
+	errno = saved;
+}
+
+int pcap_file_next(struct pcap_file *pf, struct pcap_packet *pkt)
+{
+	size_t chunk;
+
+	/* Walked pages are read again from the file if they are ever needed */
+	if (!pf->stream && pf->pos - pf->released >= 2 * PCAP_RELEASE_CHUNK) {
+		chunk = pf->pos - pf->released - PCAP_RELEASE_CHUNK;
+		chunk &= ~(size_t) (PCAP_RELEASE_CHUNK - 1);
+		madvise((void *) (pf->map + pf->released), chunk, MADV_DONTNEED);
+		pf->released += chunk;
+	}
+
+	return pf->ng ? next_pcapng(pf, pkt) : next_pcap(pf, pkt);
+}
+
+int pcap_udp_payload(const struct pcap_packet *pkt, uint16_t *dport,
+		const uint8_t **payload, uint32_t *payload_len)
+{
+	const uint8_t *d = pkt->data;
+	uint32_t end = pkt->caplen;
+	uint32_t off, hl, ulen;
+	uint16_t etype;
+	uint8_t nh;
+
+	switch (pkt->linktype) {
+	case PCAP_LINK_ETHERNET:
+		if (end < 14) {
+			return 0;
+		}
+		etype = be16(d + 12);
+		off = 14;
+		/* 802.1Q and QinQ tags */
+		while (etype == 0x8100 || etype == 0x88a8 || etype == 0x9100) {
+			if (off + 4 > end) {
+				return 0;
+			}
+			etype = be16(d + off + 2);
+			off += 4;
+		}
+		break;
+	case PCAP_LINK_LINUX_SLL:
+		if (end < 16) {
+			return 0;
+		}
+		etype = be16(d + 14);
+		off = 16;
+		break;
+	case PCAP_LINK_LINUX_SLL2:
+		if (end < 20) {
+			return 0;
+		}
+		etype = be16(d);
+		off = 20;
+		break;
+	case PCAP_LINK_RAW:
+	case PCAP_LINK_IPV4:
+	case PCAP_LINK_IPV6:
+		if (end < 1) {
+			return 0;
+		}
+		etype = (d[0] >> 4) == 6 ? 0x86dd : 0x0800;
+		off = 0;
+		break;
+	default:
+		return 0;
+	}
+
+	switch (etype) {
+	case 0x0800:
+		if (off + 20 > end || (d[off] >> 4) != 4) {
+			return 0;
+		}
+		hl = (d[off] & 0x0f) * 4;
+		if (hl < 20 || off + hl > end || d[off + 9] != 17) {
+			return 0;
+		}
+		/* Fragments are not reassembled */
+		if (be16(d + off + 6) & 0x3fff) {
+			return 0;
+		}
+		if (be16(d + off + 2) >= hl && off + be16(d + off + 2) < end) {
+			end = off + be16(d + off + 2);
+		}
+		off += hl;
+		break;
+	case 0x86dd:
+		if (off + 40 > end || (d[off] >> 4) != 6) {
+			return 0;
+		}
+		nh = d[off + 6];
+		if (off + 40 + be16(d + off + 4) < end) {
+			end = off + 40 + be16(d + off + 4);
+		}
+		off += 40;
+		/* Hop-by-hop, routing, destination options and atomic fragments */
+		for (;;) {
+			if (nh == 0 || nh == 43 || nh == 60) {
+				if (off + 2 > end) {
+					return 0;
+				}
+				hl = (d[off + 1] + 1) * 8;
+			} else if (nh == 44) {
+				if (off + 8 > end || (be16(d + off + 2) & 0xfff9)) {
+					return 0;
+				}
+				hl = 8;
+			} else {
+				break;
+			}
+			nh = d[off];
+			off += hl;
+		}
+		if (nh != 17) {
+			return 0;
+		}
+		break;
+	default:
+		return 0;
+	}
+
+	if (off + 8 > end) {
+		return 0;
+	}
+
+	ulen = be16(d + off + 4);
+	if (ulen < 8) {
+		return 0;
+	}
+	if (off + ulen > end) {
+		ulen = end - off;
+	}
+
+	*dport = be16(d + off + 2);
+	*payload = d + off + 8;
+	*payload_len = ulen - 8;
+
+	return 1;
+}
@@ -0,0 +1,43 @@
+#ifndef PCAP_FILE_H
+#define PCAP_FILE_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+/*
+ * Reader for pcap and pcapng files. The file is mapped into memory and
+ * packets point into the mapping, nothing is copied. Compressed captures
+ * are read through a window instead. All lengths are checked, damaged
+ * files end the packet walk instead of asserting.
+ */
+
+/* Link types, values of the pcap LINKTYPE_* registry */
+#define PCAP_LINK_ETHERNET	1
+#define PCAP_LINK_RAW		101
+#define PCAP_LINK_LINUX_SLL	113
+#define PCAP_LINK_IPV4		228
+#define PCAP_LINK_IPV6		229
+#define PCAP_LINK_LINUX_SLL2	276
+
+struct pcap_packet {
+	struct timeval ts;
+	uint32_t linktype;
+	const uint8_t *data;	/* Valid until the next pcap_file_next() */
+	uint32_t caplen;
+	uint32_t len;		/* Length on the wire */
+};
+
+struct pcap_file;
+
+/* NULL with errno set if the file cannot be mapped or is no capture */
+struct pcap_file *pcap_file_open(const char *filename);
+void pcap_file_close(struct pcap_file *pf);
+
+/* 1 if a packet was returned, 0 at the end, -1 if the file is damaged or ends inside a record */
+int pcap_file_next(struct pcap_file *pf, struct pcap_packet *pkt);
+
+/* Position of the UDP payload of a packet, 0 if it is not UDP over IPv4/6 */
+int pcap_udp_payload(const struct pcap_packet *pkt, uint16_t *dport,
+		const uint8_t **payload, uint32_t *payload_len);
+
+#endif
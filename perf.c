@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <assert.h>
+
+#include "perf.h"
+#include "process.h"
+#include "failure.h"
+
+#define PERF_DIAG_SLOTS 256
+#define PERF_RATS 3
+#define PERF_HIST_BUCKETS 64
+
+struct perf_counter {
+	uint64_t count;
+	uint64_t bytes;
+};
+
+/* log2 histogram of elapsed ticks */
+struct perf_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t bucket[PERF_HIST_BUCKETS];
+};
+
+/* Allocations per ended transaction */
+struct perf_session {
+	uint64_t count;
+	uint64_t allocs;
+	uint64_t bytes;
+	uint64_t max_bytes;
+	uint64_t max_chunks;
+	uint64_t msgs;
+	uint64_t max_msgs;
+};
+
+/* Counters of one thread, summed up when dumped */
+struct perf_counters {
+	uint32_t diag_key[PERF_DIAG_SLOTS];	/* DIAG protocol + 1, 0 if unused */
+	struct perf_counter diag[PERF_DIAG_SLOTS];
+	struct perf_counter radio[PERF_RATS][16];
+	struct perf_hist timer[PERF_TIMER_MAX];
+	struct perf_session session;
+	struct perf_counters *next;
+};
+
+static const char *perf_timer_names[PERF_TIMER_MAX] = {
+	"handle_3G",
+	"handle_4G",
+	"handle_nas",
+	"handle_bcch_and_rr",
+	"sql_callback",
+	"net_send_msg",
+};
+
+static const char *perf_rat_names[PERF_RATS] = { "GSM", "UMTS", "LTE" };
+
+static __thread struct perf_counters *perf_local = NULL;
+static struct perf_counters *perf_all = NULL;
+static pthread_mutex_t perf_mutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t perf_dump_requested = 0;
+static char *perf_filename = NULL;
+static uint64_t perf_start_ticks;
+static uint64_t perf_start_ns;
+
+static uint64_t perf_now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void perf_sigusr1(int sig)
+{
+	perf_dump_requested = 1;
+}
+
+void perf_init()
+{
+	perf_start_ticks = perf_ticks();
+	perf_start_ns = perf_now_ns();
+
+	signal(SIGUSR1, perf_sigusr1);
+}
+
+/* Write the JSON dump to filename instead of stderr */
+void perf_set_output(const char *filename)
+{
+	free(perf_filename);
+	perf_filename = filename ? strdup(filename) : NULL;
+}
+
+/* Counters are allocated per thread on first use and never freed */
+static struct perf_counters *perf_get()
+{
+	struct perf_counters *pc = perf_local;
+
+	if (pc) {
+		return pc;
+	}
+
+	pc = (struct perf_counters *) calloc(1, sizeof(struct perf_counters));
+	assert(pc != NULL);
+
+	pthread_mutex_lock(&perf_mutex);
+	pc->next = perf_all;
+	perf_all = pc;
+	pthread_mutex_unlock(&perf_mutex);
+
+	perf_local = pc;
+
+	return pc;
+}
+
+static inline void perf_check_signal()
+{
+	if (perf_dump_requested) {
+		perf_dump_requested = 0;
+		perf_dump();
+	}
+}
+
+/*
+ * Slot of a DIAG protocol key (protocol + 1), taken if new. Open
+ * addressing, the table only fills up with bogus input, -1 then.
+ */
+static int perf_diag_slot(struct perf_counters *pc, uint32_t key)
+{
+	uint32_t protocol = key - 1;
+	unsigned i, slot;
+
+	slot = (protocol ^ (protocol >> 8)) % PERF_DIAG_SLOTS;
+	for (i = 0; i < PERF_DIAG_SLOTS; i++) {
+		if (pc->diag_key[slot] == key) {
+			return slot;
+		}
+		if (!pc->diag_key[slot]) {
+			pc->diag_key[slot] = key;
+			return slot;
+		}
+		slot = (slot + 1) % PERF_DIAG_SLOTS;
+	}
+
+	return -1;
+}
+
+void perf_count_diag(uint16_t protocol, unsigned len)
+{
+	struct perf_counters *pc = perf_get();
+	int slot;
+
+	perf_check_signal();
+
+	slot = perf_diag_slot(pc, (uint32_t) protocol + 1);
+	if (slot < 0) {
+		return;
+	}
+
+	pc->diag[slot].count++;
+	pc->diag[slot].bytes += len;
+}
+
+void perf_count_radio(uint8_t rat, uint8_t flags, unsigned len)
+{
+	struct perf_counters *pc = perf_get();
+
+	perf_check_signal();
+
+	if (rat >= PERF_RATS) {
+		return;
+	}
+
+	pc->radio[rat][flags & 0x0f].count++;
+	pc->radio[rat][flags & 0x0f].bytes += len;
+}
+
+void perf_time(enum perf_timer timer, uint64_t start)
+{
+	struct perf_hist *h = &perf_get()->timer[timer];
+	uint64_t t = perf_ticks() - start;
+
+	h->count++;
+	h->sum += t;
+	if (t > h->max) {
+		h->max = t;
+	}
+	h->bucket[63 - __builtin_clzll(t | 1)]++;
+}
+
+void perf_count_session(const struct arena_stats *stats, unsigned msgs)
+{
+	struct perf_session *ps = &perf_get()->session;
+
+	ps->count++;
+	ps->allocs += stats->allocs;
+	ps->bytes += stats->bytes;
+	ps->msgs += msgs;
+	if (stats->bytes > ps->max_bytes) {
+		ps->max_bytes = stats->bytes;
+	}
+	if (stats->chunks > ps->max_chunks) {
+		ps->max_chunks = stats->chunks;
+	}
+	if (msgs > ps->max_msgs) {
+		ps->max_msgs = msgs;
+	}
+}
+
+/* Sum up the counters of all threads */
+static void perf_collect(struct perf_counters *sum)
+{
+	struct perf_counters *pc;
+	unsigned i, j;
+	int slot;
+
+	memset(sum, 0, sizeof(*sum));
+
+	pthread_mutex_lock(&perf_mutex);
+	for (pc = perf_all; pc; pc = pc->next) {
+		for (i = 0; i < PERF_DIAG_SLOTS; i++) {
+			if (!pc->diag_key[i]) {
+				continue;
+			}
+			/* Slots may differ between threads */
+			slot = perf_diag_slot(sum, pc->diag_key[i]);
+			if (slot < 0) {
+				continue;
+			}
+			sum->diag[slot].count += pc->diag[i].count;
+			sum->diag[slot].bytes += pc->diag[i].bytes;
+		}
+		for (i = 0; i < PERF_RATS; i++) {
+			for (j = 0; j < 16; j++) {
+				sum->radio[i][j].count += pc->radio[i][j].count;
+				sum->radio[i][j].bytes += pc->radio[i][j].bytes;
+			}
+		}
+		for (i = 0; i < PERF_TIMER_MAX; i++) {
+			sum->timer[i].count += pc->timer[i].count;
+			sum->timer[i].sum += pc->timer[i].sum;
+			if (pc->timer[i].max > sum->timer[i].max) {
+				sum->timer[i].max = pc->timer[i].max;
+			}
+			for (j = 0; j < PERF_HIST_BUCKETS; j++) {
+				sum->timer[i].bucket[j] += pc->timer[i].bucket[j];
+			}
+		}
+		sum->session.count += pc->session.count;
+		sum->session.allocs += pc->session.allocs;
+		sum->session.bytes += pc->session.bytes;
+		sum->session.msgs += pc->session.msgs;
+		if (pc->session.max_bytes > sum->session.max_bytes) {
+			sum->session.max_bytes = pc->session.max_bytes;
+		}
+		if (pc->session.max_chunks > sum->session.max_chunks) {
+			sum->session.max_chunks = pc->session.max_chunks;
+		}
+		if (pc->session.max_msgs > sum->session.max_msgs) {
+			sum->session.max_msgs = pc->session.max_msgs;
+		}
+	}
+	pthread_mutex_unlock(&perf_mutex);
+}
+
+/* Dump all counters as JSON */
+void perf_dump()
+{
+	struct perf_counters *sum;
+	double tpns;
+	uint64_t dt;
+	unsigned i, j;
+	int first;
+	FILE *f = stderr;
+
+	sum = (struct perf_counters *) malloc(sizeof(struct perf_counters));
+	assert(sum != NULL);
+	perf_collect(sum);
+
+	/* Ticks per nanosecond since perf_init() */
+	dt = perf_now_ns() - perf_start_ns;
+	tpns = dt ? (double) (perf_ticks() - perf_start_ticks) / dt : 1.0;
+	if (tpns <= 0) {
+		tpns = 1.0;
+	}
+
+	if (perf_filename) {
+		f = fopen(perf_filename, "w");
+		if (!f) {
+			perror("perf_dump");
+			free(sum);
+			return;
+		}
+	}
+
+	fprintf(f, "{\n\t\"ticks_per_ns\": %.4f,\n\t\"diag\": [", tpns);
+	first = 1;
+	for (i = 0; i < PERF_DIAG_SLOTS; i++) {
+		if (!sum->diag_key[i]) {
+			continue;
+		}
+		fprintf(f, "%s\n\t\t{\"protocol\": \"0x%04x\", \"count\": %llu, \"bytes\": %llu}",
+			first ? "" : ",", sum->diag_key[i] - 1,
+			(unsigned long long) sum->diag[i].count, (unsigned long long) sum->diag[i].bytes);
+		first = 0;
+	}
+
+	fprintf(f, "\n\t],\n\t\"radio\": [");
+	first = 1;
+	for (i = 0; i < PERF_RATS; i++) {
+		for (j = 0; j < 16; j++) {
+			if (!sum->radio[i][j].count) {
+				continue;
+			}
+			fprintf(f, "%s\n\t\t{\"rat\": \"%s\", \"flags\": \"0x%02x\", \"count\": %llu, \"bytes\": %llu}",
+				first ? "" : ",", perf_rat_names[i], j,
+				(unsigned long long) sum->radio[i][j].count, (unsigned long long) sum->radio[i][j].bytes);
+			first = 0;
+		}
+	}
+
+	fprintf(f, "\n\t],\n\t\"timers\": {");
+	for (i = 0; i < PERF_TIMER_MAX; i++) {
+		struct perf_hist *h = &sum->timer[i];
+
+		fprintf(f, "%s\n\t\t\"%s\": {\"count\": %llu, \"total_ns\": %.0f, \"max_ns\": %.0f, \"hist\": [",
+			i ? "," : "", perf_timer_names[i], (unsigned long long) h->count,
+			h->sum / tpns, h->max / tpns);
+		first = 1;
+		for (j = 0; j < PERF_HIST_BUCKETS; j++) {
+			if (!h->bucket[j]) {
+				continue;
+			}
+			/* Upper bound of the bucket */
+			fprintf(f, "%s{\"le_ns\": %.0f, \"count\": %llu}", first ? "" : ", ",
+				(double) ((2ULL << j) - 1) / tpns, (unsigned long long) h->bucket[j]);
+			first = 0;
+		}
+		fprintf(f, "]}");
+	}
+	fprintf(f, "\n\t},\n\t\"sessions\": {\"count\": %llu, \"arena_allocs\": %llu, \"arena_bytes\": %llu, "
+		"\"max_arena_bytes\": %llu, \"max_arena_chunks\": %llu, \"msgs\": %llu, \"max_msgs\": %llu}",
+		(unsigned long long) sum->session.count, (unsigned long long) sum->session.allocs,
+		(unsigned long long) sum->session.bytes, (unsigned long long) sum->session.max_bytes,
+		(unsigned long long) sum->session.max_chunks, (unsigned long long) sum->session.msgs,
+		(unsigned long long) sum->session.max_msgs);
+	fprintf(f, ",\n\t\"failures\": ");
+	failure_dump_json(f);
+	fprintf(f, "\n}\n");
+
+	if (f != stderr) {
+		fclose(f);
+	} else {
+		fflush(f);
+	}
+
+	free(sum);
+}
@@ -0,0 +1,54 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "arena.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* Timed code paths */
+enum perf_timer {
+	PERF_HANDLE_3G,
+	PERF_HANDLE_4G,
+	PERF_HANDLE_NAS,
+	PERF_HANDLE_BCCH_RR,
+	PERF_SQL_CALLBACK,
+	PERF_NET_SEND,
+	PERF_TIMER_MAX
+};
+
+/* Cheap timestamp, TSC where available */
+static inline uint64_t perf_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* Time a statement */
+#define PERF_TIME(timer, stmt) do { \
+	uint64_t _perf_start = perf_ticks(); \
+	stmt; \
+	perf_time(timer, _perf_start); \
+} while (0)
+
+void perf_init();
+void perf_set_output(const char *filename);
+void perf_count_diag(uint16_t protocol, unsigned len);
+void perf_count_radio(uint8_t rat, uint8_t flags, unsigned len);
+void perf_time(enum perf_timer timer, uint64_t start);
+void perf_count_session(const struct arena_stats *stats, unsigned msgs);
+void perf_dump();
+
+#endif
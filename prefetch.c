@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "prefetch.h"
+#include "decompress.h"
+#include "manifest.h"
+
+/* Larger files are streamed, the kernel is asked to read their start */
+#define PREFETCH_READAHEAD (4 * 1024 * 1024)
+
+struct prefetch {
+	FILE *list;
+	struct manifest *manifest;
+	unsigned depth;
+	size_t file_max;	/* Largest file read into memory */
+	size_t budget;
+	size_t used;		/* Buffers and decompression rings of queued files */
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct prefetch_file *first;	/* Ready files in list order */
+	struct prefetch_file *last;
+	unsigned queued;	/* Handed out files count until released */
+	int done;
+	int stop;
+	int list_error;
+	unsigned line;
+};
+
+static void chop_newline(char *line)
+{
+	int newline_pos = strlen(line) - 1;
+
+	if (newline_pos >= 0 && line[newline_pos] == '\n') {
+		line[newline_pos] = '\0';
+	}
+}
+
+/*
+ * Take size bytes of the budget for pf, waits for released files unless
+ * nothing else is charged
+ */
+static void prefetch_charge(struct prefetch *p, struct prefetch_file *pf, size_t size)
+{
+	pthread_mutex_lock(&p->mutex);
+	while (p->used > 0 && p->used + size > p->budget && !p->stop) {
+		pthread_cond_wait(&p->cond, &p->mutex);
+	}
+	p->used += size;
+	pf->charge += size;
+	pthread_mutex_unlock(&p->mutex);
+}
+
+/* Called with the mutex held */
+static void prefetch_uncharge(struct prefetch *p, struct prefetch_file *pf)
+{
+	p->used -= pf->charge;
+	pf->charge = 0;
+	pthread_cond_broadcast(&p->cond);
+}
+
+/*
+ * Whole file into memory, -1 if it has to be streamed or, with
+ * pf->read_error set, if it could not be read completely
+ */
+static int prefetch_read(struct prefetch_file *pf, int fd, size_t size)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	pf->buf = (uint8_t *) malloc(size);
+	if (!pf->buf) {
+		return -1;
+	}
+
+	while (done < size) {
+		n = read(fd, pf->buf + done, size - done);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		done += n;
+	}
+
+	/* A short read means the file shrank */
+	if (done < size) {
+		pf->error = n < 0 ? errno : EIO;
+		pf->read_error = 1;
+		free(pf->buf);
+		pf->buf = NULL;
+		return -1;
+	}
+
+	pf->len = done;
+	pf->f = fmemopen(pf->buf, pf->len, "rb");
+	if (!pf->f) {
+		free(pf->buf);
+		pf->buf = NULL;
+		pf->len = 0;
+		lseek(fd, 0, SEEK_SET);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Hashing here overlaps with parsing of the previous files */
+static int prefetch_hash(struct prefetch *p, struct prefetch_file *pf, int fd)
+{
+	if (!p->manifest ||
+	    manifest_file_init(p->manifest, pf->name, fd, pf->buf, pf->len, &pf->mf) < 0) {
+		return 0;
+	}
+	pf->hashed = 1;
+	pf->seen = manifest_seen(p->manifest, &pf->mf);
+
+	return pf->seen;
+}
+
+static void prefetch_open(struct prefetch *p, struct prefetch_file *pf)
+{
+	enum decompress_format format = DECOMPRESS_NONE;
+	uint8_t magic[6];
+	struct stat st;
+	ssize_t n;
+	int fd;
+
+	session_meta_from_filename(pf->name, &pf->meta);
+
+	fd = open(pf->name, O_RDONLY);
+	if (fd < 0) {
+		pf->error = errno;
+		return;
+	}
+
+	n = pread(fd, magic, sizeof(magic), 0);
+	if (n > 0) {
+		format = decompress_detect(magic, n);
+	}
+
+	if (format == DECOMPRESS_NONE && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+	    st.st_size > 0 && (size_t) st.st_size <= p->file_max) {
+		prefetch_charge(p, pf, st.st_size);
+		if (prefetch_read(pf, fd, st.st_size) == 0) {
+			prefetch_hash(p, pf, fd);
+			close(fd);
+			return;
+		}
+
+		/* Streamed or failed, nothing is buffered */
+		pthread_mutex_lock(&p->mutex);
+		prefetch_uncharge(p, pf);
+		pthread_mutex_unlock(&p->mutex);
+
+		if (pf->read_error) {
+			close(fd);
+			return;
+		}
+	}
+
+	/* Already ingested files are not opened for reading */
+	if (prefetch_hash(p, pf, fd)) {
+		close(fd);
+		return;
+	}
+
+	posix_fadvise(fd, 0, PREFETCH_READAHEAD, POSIX_FADV_WILLNEED);
+
+	/* Compressed files start decoding right away, into their ring */
+	if (format != DECOMPRESS_NONE) {
+		prefetch_charge(p, pf, decompress_memory());
+	}
+	pf->f = decompress_fdopen(fd);
+	if (!pf->f) {
+		pf->error = errno;
+	}
+}
+
+static void *prefetch_thread(void *arg)
+{
+	struct prefetch *p = (struct prefetch *) arg;
+	struct prefetch_file *pf;
+	char *ret;
+	int error = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&p->mutex);
+		while (p->queued >= p->depth && !p->stop) {
+			pthread_cond_wait(&p->cond, &p->mutex);
+		}
+		if (p->stop) {
+			pthread_mutex_unlock(&p->mutex);
+			break;
+		}
+		p->queued++;
+		p->line++;
+		pthread_mutex_unlock(&p->mutex);
+
+		pf = (struct prefetch_file *) calloc(1, sizeof(struct prefetch_file));
+		if (!pf) {
+			error = ENOMEM;
+			break;
+		}
+
+		ret = fgets(pf->name, sizeof(pf->name), p->list);
+		if (!ret) {
+			if (ferror(p->list)) {
+				error = errno ? errno : EIO;
+			}
+			free(pf);
+			break;
+		}
+
+		chop_newline(pf->name);
+		prefetch_open(p, pf);
+
+		pthread_mutex_lock(&p->mutex);
+		if (p->last) {
+			p->last->next = pf;
+		} else {
+			p->first = pf;
+		}
+		p->last = pf;
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->mutex);
+	}
+
+	pthread_mutex_lock(&p->mutex);
+	p->done = 1;
+	p->list_error = error;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->mutex);
+
+	return NULL;
+}
+
+struct prefetch *prefetch_start(FILE *list, unsigned depth, size_t budget,
+		struct manifest *manifest)
+{
+	struct prefetch *p;
+
+	p = (struct prefetch *) calloc(1, sizeof(struct prefetch));
+	if (!p) {
+		return NULL;
+	}
+
+	p->list = list;
+	p->manifest = manifest;
+	p->depth = depth ? depth : 1;
+	p->file_max = budget / p->depth;
+	p->budget = budget;
+	pthread_mutex_init(&p->mutex, NULL);
+	pthread_cond_init(&p->cond, NULL);
+
+	if (pthread_create(&p->thread, NULL, prefetch_thread, p) != 0) {
+		pthread_cond_destroy(&p->cond);
+		pthread_mutex_destroy(&p->mutex);
+		free(p);
+		return NULL;
+	}
+
+	return p;
+}
+
+struct prefetch_file *prefetch_next(struct prefetch *p)
+{
+	struct prefetch_file *pf;
+
+	pthread_mutex_lock(&p->mutex);
+	while (!p->first && !p->done) {
+		pthread_cond_wait(&p->cond, &p->mutex);
+	}
+	pf = p->first;
+	if (pf) {
+		p->first = pf->next;
+		if (!p->first) {
+			p->last = NULL;
+		}
+		pf->next = NULL;
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	return pf;
+}
+
+void prefetch_release(struct prefetch *p, struct prefetch_file *pf)
+{
+	if (pf->f) {
+		fclose(pf->f);
+	}
+	free(pf->buf);
+
+	pthread_mutex_lock(&p->mutex);
+	prefetch_uncharge(p, pf);
+	p->queued--;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->mutex);
+
+	free(pf);
+}
+
+int prefetch_stop(struct prefetch *p, unsigned *line)
+{
+	struct prefetch_file *pf;
+	int error;
+
+	pthread_mutex_lock(&p->mutex);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->mutex);
+
+	pthread_join(p->thread, NULL);
+
+	while ((pf = p->first) != NULL) {
+		p->first = pf->next;
+		if (pf->f) {
+			fclose(pf->f);
+		}
+		free(pf->buf);
+		free(pf);
+	}
+
+	error = p->list_error;
+	if (line) {
+		*line = p->line;
+	}
+
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->mutex);
+	free(p);
+
+	return error;
+}
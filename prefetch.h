@@ -0,0 +1,50 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "session.h"
+#include "manifest.h"
+
+/*
+ * Read-ahead for file lists. A thread opens the next files of the list,
+ * reads small ones into memory and parses their names, so the parser
+ * does not wait for opens on slow storage. At most depth files are in
+ * flight, buffered contents and decompression rings stay below the
+ * memory budget.
+ */
+
+struct prefetch_file {
+	char name[FILENAME_MAX];
+	FILE *f;		/* Ready to read, NULL if the open failed or seen */
+	int error;		/* errno of the failed open or read */
+	int read_error;		/* Opened, but reading ahead failed */
+	struct file_meta meta;
+	struct manifest_file mf;
+	int hashed;		/* mf is valid */
+	int seen;		/* Already in the manifest, not opened */
+	uint8_t *buf;		/* Contents read ahead, NULL for streamed files */
+	size_t len;
+	size_t charge;		/* Part of the memory budget, buf or decompression ring */
+	struct prefetch_file *next;
+};
+
+struct prefetch;
+
+/*
+ * The thread reads file names from list, one per line. With a manifest
+ * the files are hashed as well.
+ */
+struct prefetch *prefetch_start(FILE *list, unsigned depth, size_t budget,
+		struct manifest *manifest);
+
+/* Next file in list order, NULL at the end of the list */
+struct prefetch_file *prefetch_next(struct prefetch *p);
+void prefetch_release(struct prefetch *p, struct prefetch_file *pf);
+
+/* Waits for the thread, returns errno of a failed list read and its line */
+int prefetch_stop(struct prefetch *p, unsigned *line);
+
+#endif
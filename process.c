@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <assert.h>
 #include <arpa/inet.h>
 #include <osmocom/core/gsmtap.h>
 #include <osmocom/core/msgb.h>
@@ -23,12 +24,54 @@
 #include "ccch.h"
 #include "gprs.h"
 
+/* Released messages, reused before asking malloc() */
+static __thread struct radio_message *radio_msg_pool = NULL;
+
 void process_init()
 {
 	gsm_interleave_init();
 	gprs_init();
 }
 
+/* Contents are not cleared, like malloc() */
+struct radio_message *radio_msg_alloc()
+{
+	struct radio_message *m = radio_msg_pool;
+
+	if (m) {
+		radio_msg_pool = m->next;
+		return m;
+	}
+
+	m = (struct radio_message *) malloc(sizeof(struct radio_message));
+	assert(m != NULL);
+
+	return m;
+}
+
+void radio_msg_free(struct radio_message *m)
+{
+	if (!m) {
+		return;
+	}
+
+	m->next = radio_msg_pool;
+	radio_msg_pool = m;
+}
+
+/* Return a whole message list to the pool in one step */
+void radio_msg_free_list(struct radio_message *first, struct radio_message *last)
+{
+	if (!first) {
+		return;
+	}
+
+	assert(last != NULL && last->next == NULL);
+
+	last->next = radio_msg_pool;
+	radio_msg_pool = first;
+}
+
 int process_handle_burst(struct session_info *s, struct l1ctl_burst_ind *bi)
 {
 	int ul;
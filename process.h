@@ -5,6 +5,7 @@
 #include <sys/time.h>
 
 #include "burst_desc.h"
+#include "msg_info.h"
 
 #define RAT_GSM 0
 #define RAT_UMTS 1
@@ -37,7 +38,7 @@ struct radio_message {
 	uint8_t domain;
 	uint8_t flags;	/* MSG_* */
 	struct timeval timestamp;
-	char info[128];
+	struct msg_info info;
 	uint8_t chan_nr;
 	uint8_t msg[256];
 	uint32_t msg_len;
@@ -47,6 +48,10 @@ struct radio_message {
 } __attribute__((packed));
 
 void process_init();
+
+struct radio_message *radio_msg_alloc();
+void radio_msg_free(struct radio_message *m);
+void radio_msg_free_list(struct radio_message *first, struct radio_message *last);
 //int process_handle_burst(struct session_info *s, struct l1ctl_burst_ind *bi);
 
 #endif
@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+"""Replay a corpus through the importers and compare against golden values.
+
+Every input file is run through the matching tool:
+
+    *.qdmon, *.bin, *.dlf   diag_import <file>
+    *.hex                   hex_import 1 1 < <file>
+    *.pcap                  gsmtap_import <file> 1 1
+
+The output is normalized and hashed. The hash must match the value stored
+in <corpus>/golden.json, and MB/s and messages/s per input type must not
+drop by more than --threshold compared to the stored values.
+
+Example:
+   ./replay.py corpus              # check
+   ./replay.py --update corpus     # store new golden values
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import re
+import struct
+import subprocess
+import sys
+import time
+
+TYPES = {
+    ".qdmon": "diag",
+    ".bin": "diag",
+    ".dlf": "diag",
+    ".hex": "hex",
+    ".pcap": "gsmtap",
+}
+
+# Lines that do not depend on the input
+NOISE = re.compile(r"^(PARSER_OK|DIAG_OK)$")
+
+
+def count_messages(kind, path):
+    """Number of input records, used for messages/s"""
+    with open(path, "rb") as f:
+        data = f.read()
+
+    if kind == "diag":
+        return data.count(b"\x7e")
+    if kind == "hex":
+        return sum(1 for line in data.splitlines() if line.strip())
+
+    # Classic pcap, 24 byte file header and 16 byte record headers
+    if len(data) < 24:
+        return 0
+    magic = struct.unpack("<I", data[:4])[0]
+    if magic in (0xa1b2c3d4, 0xa1b23c4d):
+        endian = "<"
+    elif magic in (0xd4c3b2a1, 0x4d3cb2a1):
+        endian = ">"
+    else:
+        return 0
+    n = 0
+    off = 24
+    while off + 16 <= len(data):
+        incl_len = struct.unpack(endian + "I", data[off + 8:off + 12])[0]
+        off += 16 + incl_len
+        n += 1
+    return n
+
+
+def command(kind, bin_dir, path):
+    if kind == "diag":
+        return [os.path.join(bin_dir, "diag_import"), path], None
+    if kind == "hex":
+        return [os.path.join(bin_dir, "hex_import"), "1", "1"], path
+    return [os.path.join(bin_dir, "gsmtap_import"), path, "1", "1"], None
+
+
+def normalize(output, path):
+    """Drop constant lines, trailing blanks and the input path"""
+    text = output.decode("utf-8", "replace")
+    text = text.replace(os.path.abspath(path), os.path.basename(path))
+    text = text.replace(path, os.path.basename(path))
+    lines = []
+    for line in text.splitlines():
+        line = line.rstrip()
+        if not line or NOISE.match(line):
+            continue
+        lines.append(line)
+    return "\n".join(lines) + "\n"
+
+
+def run_file(kind, bin_dir, path, runs):
+    """Run a tool over one file, returns (hash, best time in seconds)"""
+    cmd, stdin_path = command(kind, bin_dir, path)
+    digest = None
+    best = None
+
+    for _ in range(runs):
+        stdin = open(stdin_path, "rb") if stdin_path else subprocess.DEVNULL
+        start = time.perf_counter()
+        proc = subprocess.run(cmd, stdin=stdin, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+        elapsed = time.perf_counter() - start
+        if stdin_path:
+            stdin.close()
+
+        if proc.returncode != 0:
+            raise RuntimeError("%s exited with %d" % (" ".join(cmd), proc.returncode))
+
+        h = hashlib.sha256(normalize(proc.stdout, path).encode("utf-8")).hexdigest()
+        if digest is not None and h != digest:
+            raise RuntimeError("%s: output differs between runs" % path)
+        digest = h
+
+        if best is None or elapsed < best:
+            best = elapsed
+
+    return digest, best
+
+
+def find_inputs(corpus):
+    inputs = []
+    for root, _, files in os.walk(corpus):
+        for name in sorted(files):
+            kind = TYPES.get(os.path.splitext(name)[1].lower())
+            if kind:
+                path = os.path.join(root, name)
+                inputs.append((os.path.relpath(path, corpus), kind, path))
+    return sorted(inputs)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("corpus", metavar="CORPUS", help="Directory with input files")
+    parser.add_argument("--bin-dir", default=".", help="Directory of diag_import, hex_import and gsmtap_import")
+    parser.add_argument("--golden", help="Golden values (default CORPUS/golden.json)")
+    parser.add_argument("--update", action="store_true", help="Store hashes and throughput as new golden values")
+    parser.add_argument("--threshold", type=float, default=0.10, help="Allowed throughput drop (default 0.10)")
+    parser.add_argument("--no-timing", action="store_true", help="Only compare output hashes")
+    parser.add_argument("--runs", type=int, default=3, help="Runs per file, the fastest counts (default 3)")
+    parser.add_argument("--report", help="Write the results as JSON to REPORT")
+    args = parser.parse_args()
+
+    golden_path = args.golden or os.path.join(args.corpus, "golden.json")
+    golden = {"files": {}, "types": {}}
+    if os.path.exists(golden_path):
+        with open(golden_path) as f:
+            golden = json.load(f)
+    elif not args.update:
+        print("No golden values in %s, run with --update first" % golden_path)
+        return 1
+
+    inputs = find_inputs(args.corpus)
+    if not inputs:
+        print("No input files in %s" % args.corpus)
+        return 1
+
+    failed = 0
+    files = {}
+    types = {}
+
+    for rel, kind, path in inputs:
+        size = os.path.getsize(path)
+        msgs = count_messages(kind, path)
+        try:
+            digest, elapsed = run_file(kind, args.bin_dir, path, args.runs)
+        except (RuntimeError, OSError) as e:
+            print("FAIL  %s: %s" % (rel, e))
+            failed += 1
+            continue
+
+        files[rel] = {"type": kind, "sha256": digest, "bytes": size, "messages": msgs, "seconds": elapsed}
+
+        t = types.setdefault(kind, {"bytes": 0, "messages": 0, "seconds": 0.0})
+        t["bytes"] += size
+        t["messages"] += msgs
+        t["seconds"] += elapsed
+
+        expected = golden["files"].get(rel, {}).get("sha256")
+        if args.update or expected == digest:
+            status = "ok"
+        elif expected is None:
+            status = "NEW"
+            failed += 1
+        else:
+            status = "DIFF"
+            failed += 1
+        print("%-5s %-40s %8.2f MB/s %10.0f msgs/s" % (status, rel, size / 1e6 / elapsed, msgs / elapsed))
+
+    for rel in sorted(set(golden["files"]) - set(files)):
+        if not args.update:
+            print("GONE  %s" % rel)
+            failed += 1
+
+    for kind in sorted(types):
+        t = types[kind]
+        t["mb_s"] = t["bytes"] / 1e6 / t["seconds"] if t["seconds"] else 0.0
+        t["msgs_s"] = t["messages"] / t["seconds"] if t["seconds"] else 0.0
+
+        status = "ok"
+        ref = golden["types"].get(kind)
+        if ref and not args.update and not args.no_timing:
+            for key in ("mb_s", "msgs_s"):
+                if ref.get(key) and t[key] < ref[key] * (1.0 - args.threshold):
+                    status = "SLOW"
+            if status != "ok":
+                failed += 1
+        print("%-5s %-40s %8.2f MB/s %10.0f msgs/s" % (status, "[" + kind + "]", t["mb_s"], t["msgs_s"]))
+        if ref:
+            print("      %-40s %8.2f MB/s %10.0f msgs/s" % ("golden", ref.get("mb_s", 0.0), ref.get("msgs_s", 0.0)))
+
+    if args.report:
+        with open(args.report, "w") as f:
+            json.dump({"files": files, "types": types}, f, indent=1, sort_keys=True)
+
+    if args.update:
+        for t in types.values():
+            del t["seconds"]
+        for f in files.values():
+            del f["seconds"]
+        with open(golden_path, "w") as f:
+            json.dump({"files": files, "types": types}, f, indent=1, sort_keys=True)
+        print("Golden values written to %s" % golden_path)
+        return 1 if failed else 0
+
+    if failed:
+        print("%d check(s) failed" % failed)
+        return 1
+
+    print("All checks passed")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -4,6 +4,7 @@
 
 #include "rlcmac.h"
 #include "output.h"
+#include "trace.h"
 
 #define OLD_TIME 2000
 
@@ -53,8 +54,7 @@ void process_blocks(struct gprs_tbf *t, int ul)
 	while (t->frags[bsn].len == 0) {
 		bsn = (bsn+1)%128;
 		if (bsn == t->start_bsn) {
-			printf("no valid  blocks in current TBF!\n");
-			fflush(stdout);
+			TRACE1(TRACE_WARN, TRACE_RLC_NO_BLOCKS, t->start_bsn);
 			return;
 		}
 	}
@@ -67,13 +67,9 @@ void process_blocks(struct gprs_tbf *t, int ul)
 		/* get frament descriptor */
 		f = &t->frags[bsn];
 
-		printf(" bsn %d ", bsn);
-		fflush(stdout);
-
 		/* already processed or null */
 		if (!f->len) {
-			printf("null\n");
-			fflush(stdout);
+			TRACE1(TRACE_DEBUG, TRACE_RLC_BLOCK_NULL, bsn);
 			llc_len = 0;
 			skip = 1;
 			continue;
@@ -81,8 +77,7 @@ void process_blocks(struct gprs_tbf *t, int ul)
 
 		/* check frament age */
 		if (too_old(current_fn, f->fn)) {
-			printf("old sement\n");
-			fflush(stdout);
+			TRACE3(TRACE_DEBUG, TRACE_RLC_BLOCK_OLD, bsn, f->fn, current_fn);
 			llc_len = 0;
 			skip = 1;
 			continue;
@@ -92,8 +87,7 @@ void process_blocks(struct gprs_tbf *t, int ul)
 		current_fn = f->fn;
 
 		if (llc_len && !bsn_is_next(llc_last_bsn, bsn)) {
-			printf("missing bsn, previous %d\n", llc_last_bsn);
-			fflush(stdout);
+			TRACE2(TRACE_DEBUG, TRACE_RLC_BLOCK_MISSING, bsn, llc_last_bsn);
 			llc_len = 0;
 			skip = 1;
 			continue;
@@ -114,9 +108,7 @@ void process_blocks(struct gprs_tbf *t, int ul)
 
 			/* last TBF block? (very rare condition) */
 			if (f->last) {
-				printf("end of TBF\n");
-				fflush(stdout);
-				print_pkt(llc_data, llc_len);
+				TRACE2(TRACE_DEBUG, TRACE_RLC_TBF_END, bsn, llc_len);
 
 				net_send_llc(llc_data, llc_len, ul);
 
@@ -135,14 +127,11 @@ void process_blocks(struct gprs_tbf *t, int ul)
 			/* multiple data parts */
 			li_off = 0;
 			for (i=0; i<f->n_blocks; i++) {
-				printf("\nlime %d\n", i);
-				fflush(stdout);
 				l = &f->blocks[i];
 				if (l->used) {
 					if (llc_len) {
 						// error!
-						printf("\nlime error!\n");
-						fflush(stdout);
+						TRACE2(TRACE_WARN, TRACE_RLC_LIME_ERROR, bsn, i);
 						llc_len = 0;
 					}
 				} else {
@@ -158,9 +147,7 @@ void process_blocks(struct gprs_tbf *t, int ul)
 
 					if (!l->e || !l->m || (l->e && l->m)) {
 						/* message ends here */
-						printf("end of message reached\n");
-						fflush(stdout);
-						print_pkt(llc_data, llc_len);
+						TRACE3(TRACE_DEBUG, TRACE_RLC_LLC, bsn, llc_len, i);
 
 						net_send_llc(llc_data, llc_len, ul);
 
@@ -182,9 +169,7 @@ void process_blocks(struct gprs_tbf *t, int ul)
 			/* is spare data valid? */
 			if (l->m) {
 				if (llc_len) {
-					printf("spare and buffer not empty!\n");
-					print_pkt(llc_data, llc_len);
-					fflush(stdout);
+					TRACE2(TRACE_WARN, TRACE_RLC_SPARE, bsn, llc_len);
 				}
 				if ((f->len > li_off) && (f->len-li_off < 65536)) {
 					memcpy(llc_data, &f->data[li_off], f->len-li_off);
@@ -201,8 +186,7 @@ void process_blocks(struct gprs_tbf *t, int ul)
 	/* shift window if needed */
 	if (((t->last_bsn - t->start_bsn) % 128) > 64) {
 		t->start_bsn = (t->last_bsn - 64) % 128;
-		printf("shifting window\n");
-		fflush(stdout);
+		TRACE2(TRACE_DEBUG, TRACE_RLC_SHIFT, t->start_bsn, t->last_bsn);
 	}
 }
 
@@ -228,10 +212,10 @@ void rlc_data_handler(struct radio_message *m)
 	ul = !!(m->bb.arfcn[0] & ARFCN_UPLINK);
 	if (ul) {
 		cv = (m->msg[0] & 0x3c) >> 2;
-		printf("TFI %d BSN %d CV %d ", tfi, bsn, cv);
+		TRACE4(TRACE_DEBUG, TRACE_RLC_DATA_UL, m->chan_nr, tfi, bsn, cv);
 	} else {
 		fbi = (m->msg[1] & 0x01);
-		printf("TFI %d BSN %d FBI %d ", tfi, bsn, fbi);
+		TRACE4(TRACE_DEBUG, TRACE_RLC_DATA_DL, m->chan_nr, tfi, bsn, fbi);
 	}
 
 	/* get TBF descriptor for TFI,UL couple */
@@ -241,15 +225,14 @@ void rlc_data_handler(struct radio_message *m)
 	d_last_bsn = (m->bb.fn[0] - t->frags[t->last_bsn].fn) & 0xffffffff;
 	d_bsn = (bsn - t->last_bsn) % 128;
 
-	printf("\nfn_same_bsn %d fn_last_bsn %d delta_bsn %d old_len %d\n",
-		d_same_bsn, d_last_bsn, d_bsn, t->frags[bsn].len);
+	TRACE4(TRACE_DEBUG, TRACE_RLC_WINDOW, d_same_bsn, d_last_bsn, d_bsn, t->frags[bsn].len);
 
 	/* new/old frament decision */
 	if (d_same_bsn > OLD_TIME) {
 		if (d_last_bsn > OLD_TIME) {
 			// new tbf is starting, close old one...
 			t_prev = &tbf_table[2 * ((tfi + 1) % 32) + ul];
-			printf("clearing TBF %d, first %d last %d\n", (tfi+1)%32, t_prev->start_bsn, t_prev->last_bsn);
+			TRACE3(TRACE_DEBUG, TRACE_RLC_TBF_CLEAR, (tfi+1)%32, t_prev->start_bsn, t_prev->last_bsn);
 			f = &t_prev->frags[t_prev->last_bsn];
 
 			// ...only if data is present
@@ -258,7 +241,7 @@ void rlc_data_handler(struct radio_message *m)
 				process_blocks(t_prev, ul);
 			}
 
-			printf("new TBF, starting from %d\n", bsn);
+			TRACE1(TRACE_DEBUG, TRACE_RLC_TBF_NEW, bsn);
 			t->start_bsn = 0;
 			t->last_bsn = bsn;
 			memset(t->frags, 0, 128*sizeof(struct gprs_frag));
@@ -270,21 +253,18 @@ void rlc_data_handler(struct radio_message *m)
 			} else {
 				// out of sequence / duplicate
 				t->frags[bsn].fn = m->bb.fn[0];
-				printf("duplicate\n");
-				fflush(stdout);
+				TRACE1(TRACE_DEBUG, TRACE_RLC_DUPLICATE, bsn);
 				return;
 			}
 		}
 	} else {
 		if (d_last_bsn > OLD_TIME) {
-			printf("fucking error last_bsn!\n");
-			fflush(stdout);
+			TRACE2(TRACE_WARN, TRACE_RLC_BAD_LAST_BSN, bsn, d_last_bsn);
 			return;
 		} else {
 			// fresh frag, current tbf
 			if (d_bsn > 0) {
-				printf("fucking error d_bsn!\n");
-				fflush(stdout);
+				TRACE2(TRACE_WARN, TRACE_RLC_BAD_D_BSN, bsn, d_bsn);
 				return;
 			} else {
 				if (d_bsn < -64) {
@@ -293,8 +273,7 @@ void rlc_data_handler(struct radio_message *m)
 				} else {
 					// duplicate
 					t->frags[bsn].fn = m->bb.fn[0];
-					printf("duplicate2\n");
-					fflush(stdout);
+					TRACE1(TRACE_DEBUG, TRACE_RLC_DUPLICATE, bsn);
 					return;
 				}
 			}
@@ -324,12 +303,12 @@ void rlc_data_handler(struct radio_message *m)
 	/* optional fields for uplink, indicated in TI and PI */
 	if (ul) {
 		if (m->msg[1] & 0x01) {
-			printf("TLLI 0x%.02x%.02x%.02x%.02x ", m->msg[off],
-				m->msg[off+1], m->msg[off+2], m->msg[off+3]);
+			TRACE1(TRACE_DEBUG, TRACE_RLC_TLLI, m->msg[off] << 24 | m->msg[off+1] << 16 |
+				m->msg[off+2] << 8 | m->msg[off+3]);
 			off += 4;
 		}
 		if (m->msg[1] & 0x40) {
-			printf("PFI %d ", m->msg[off]);
+			TRACE1(TRACE_DEBUG, TRACE_RLC_PFI, m->msg[off]);
 			off += 1;
 		}
 	}
@@ -352,34 +331,8 @@ void rlc_type_handler(struct radio_message *m)
 	switch((m->msg[0] & 0xc0) >> 6) {
 	case 0:
 		/* data block */
-		printf("TS %d ", ts);
-
-		switch(m->msg_len) {
-		case 23:
-			printf("CS1 ");
-			break;
-		case 33:
-			printf("CS2 ");
-			break;
-		case 39:
-			printf("CS3 ");
-			break;
-		case 53:
-			printf("CS4 ");
-			break;
-		}
-
-		if (ul) {
-			printf("UL ");
-		} else {
-			printf("DL ");
-		}
-
 		net_send_rlcmac(m->msg, m->msg_len, ts, ul);
-		printf("DATA ");
 		rlc_data_handler(m);
-		printf("\n");
-		fflush(stdout);
 		break;
 	case 1:
 	case 2:
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/rrc/UL-DCCH-Message.h>
+#include <osmocom/rrc/DL-DCCH-Message.h>
+#include <osmocom/rrc/BCCH-BCH-Message.h>
+
+#include "umts_rrc.h"
+
+#define MAX_MSGS 65536
+
+extern void *talloc_asn1_ctx;
+
+struct bench_msg {
+	uint8_t data[256];
+	int len;
+};
+
+static struct bench_msg msgs[MAX_MSGS];
+static unsigned n_msgs = 0;
+
+static double now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Decode all messages, freeing each tree node by node */
+static unsigned run_heap(asn_TYPE_descriptor_t *td, unsigned iterations)
+{
+	unsigned i, j, ok = 0;
+	asn_dec_rval_t rv;
+	void *p;
+
+	talloc_asn1_ctx = NULL;
+
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < n_msgs; j++) {
+			p = NULL;
+			rv = uper_decode(NULL, td, &p, msgs[j].data, msgs[j].len, 0, 0);
+			if (rv.code == RC_OK && p) {
+				ok++;
+			}
+			ASN_STRUCT_FREE(*td, p);
+		}
+	}
+
+	return ok;
+}
+
+/* Decode all messages, releasing each through the arena */
+static unsigned run_arena(asn_TYPE_descriptor_t *td, unsigned iterations)
+{
+	unsigned i, j, ok = 0;
+	asn_dec_rval_t rv;
+	void *p;
+
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < n_msgs; j++) {
+			p = NULL;
+			rrc_arena_enter();
+			rv = uper_decode(NULL, td, &p, msgs[j].data, msgs[j].len, 0, 0);
+			if (rv.code == RC_OK && p) {
+				ok++;
+			}
+			rrc_arena_leave();
+		}
+	}
+
+	return ok;
+}
+
+static void report(const char *name, double t, unsigned total, unsigned ok)
+{
+	printf("%-6s %10u msgs %10u ok %10.1f ns/msg %12.0f msgs/s\n",
+		name, total, ok, t / total, total / (t / 1e9));
+}
+
+int main(int argc, char *argv[])
+{
+	char line[1024];
+	asn_TYPE_descriptor_t *td;
+	unsigned iterations = 1000;
+	unsigned ok;
+	double t;
+	int len;
+
+	if (argc < 2) {
+		printf("Usage: %s <bcch|ul_dcch|dl_dcch> [iterations] < hex_messages\n", argv[0]);
+		return -1;
+	}
+
+	if (!strcmp(argv[1], "bcch")) {
+		td = &asn_DEF_BCCH_BCH_Message;
+	} else if (!strcmp(argv[1], "ul_dcch")) {
+		td = &asn_DEF_UL_DCCH_Message;
+	} else if (!strcmp(argv[1], "dl_dcch")) {
+		td = &asn_DEF_DL_DCCH_Message;
+	} else {
+		printf("Unknown message type %s\n", argv[1]);
+		return -1;
+	}
+
+	if (argc > 2) {
+		iterations = atoi(argv[2]);
+	}
+
+	/* One hex encoded message per line */
+	while (n_msgs < MAX_MSGS && fgets(line, sizeof(line), stdin)) {
+		len = strcspn(line, "\r\n");
+		line[len] = 0;
+		if (!len) {
+			continue;
+		}
+		len = osmo_hexparse(line, msgs[n_msgs].data, sizeof(msgs[n_msgs].data));
+		if (len > 0) {
+			msgs[n_msgs++].len = len;
+		}
+	}
+
+	if (!n_msgs || !iterations) {
+		printf("No input messages\n");
+		return -1;
+	}
+
+	/* Warm up caches and the arena pool */
+	run_arena(td, 1);
+
+	t = now_ns();
+	ok = run_heap(td, iterations);
+	report("heap", now_ns() - t, n_msgs * iterations, ok);
+
+	t = now_ns();
+	ok = run_arena(td, iterations);
+	report("arena", now_ns() - t, n_msgs * iterations, ok);
+
+	rrc_arena_destroy();
+
+	return 0;
+}
@@ -2,6 +2,11 @@
 #include "output.h"
 #include "bit_func.h"
 #include "sms.h"
+#include "umts_rrc.h"
+#include "lte_nas_eps_sec.h"
+#include "perf.h"
+#include "failure.h"
+#include "trace.h"
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -42,7 +47,13 @@ static uint32_t s_id = 0;
 static struct session_info *s_pointer = 0;
 pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-struct session_info _s[2];
+struct session_info *_s = NULL;
+struct subscriber *cur_sub = NULL;
+
+static struct subscriber *sub_hash[1 << SUBSCRIBER_HASH_BITS];
+static struct subscriber *sub_list = NULL;
+static unsigned sub_count = 0;
+static void (*sub_sql_callback)(const char *) = NULL;
 
 uint32_t now = 0;
 
@@ -50,8 +61,99 @@ static void console_callback(const char *sql)
 {
 	assert(sql != NULL);
 
+	/* Left to stdio buffering, see diag_import for interactive input */
 	printf("SQL: %s", sql);
-	fflush(stdout);
+	TRACE1(TRACE_DEBUG, TRACE_SQL, strlen(sql));
+}
+
+static unsigned subscriber_hash(uint32_t appid)
+{
+	return (appid * 2654435761u) >> (32 - SUBSCRIBER_HASH_BITS);
+}
+
+static void subscriber_link(struct subscriber *sub)
+{
+	unsigned h = subscriber_hash(sub->appid);
+
+	sub->hash_next = sub_hash[h];
+	sub_hash[h] = sub;
+}
+
+static void subscriber_unlink(struct subscriber *sub)
+{
+	struct subscriber **p = &sub_hash[subscriber_hash(sub->appid)];
+
+	while (*p != sub) {
+		assert(*p != NULL);
+		p = &(*p)->hash_next;
+	}
+	*p = sub->hash_next;
+}
+
+/* New handset with fresh sessions for both domains */
+static struct subscriber *subscriber_new(uint32_t appid)
+{
+	struct subscriber *sub;
+	int i;
+
+	sub = (struct subscriber *) calloc(1, sizeof(struct subscriber));
+	assert(sub != NULL);
+
+	sub->appid = appid;
+	for (i = 0; i < 2; i++) {
+		sub->s[i].id = s_id++;
+		sub->s[i].domain = i;
+		sub->s[i].appid = appid;
+		sub->s[i].sql_callback = sub_sql_callback;
+		sub->s[i].arena = arena_create(SESSION_ARENA_SIZE);
+	}
+
+	subscriber_link(sub);
+	sub->next = sub_list;
+	sub_list = sub;
+	sub_count++;
+
+	return sub;
+}
+
+/* Make the handset with appid current, _s points to its sessions afterwards */
+struct subscriber *subscriber_select(uint32_t appid)
+{
+	struct subscriber *sub;
+
+	if (cur_sub && cur_sub->appid == appid) {
+		return cur_sub;
+	}
+
+	for (sub = sub_hash[subscriber_hash(appid)]; sub; sub = sub->hash_next) {
+		if (sub->appid == appid) {
+			break;
+		}
+	}
+
+	if (!sub) {
+		if (sub_count == 1 && !cur_sub->appid) {
+			/* A single handset without appid just gets it assigned */
+			sub = cur_sub;
+			subscriber_unlink(sub);
+			sub->appid = appid;
+			sub->s[0].appid = appid;
+			sub->s[1].appid = appid;
+			subscriber_link(sub);
+		} else {
+			sub = subscriber_new(appid);
+		}
+	}
+
+	cur_sub = sub;
+	_s = sub->s;
+
+	return sub;
+}
+
+unsigned subscriber_count()
+{
+	return sub_count;
 }
 
 void session_init(unsigned start_sid, int console, const char *gsmtap_target, int callback)
@@ -59,8 +161,16 @@ void session_init(unsigned start_sid, int console, const char *gsmtap_target, in
 	output_console = console;
 	output_gsmtap = (gsmtap_target == NULL ? 0 : 1);
 
-	// Reset both domains
-	memset(_s, 0, sizeof(_s));
+	perf_init();
+
+	// First handset, further ones are added by subscriber_select()
+	s_id = start_sid;
+	sub_sql_callback = NULL;
+	memset(sub_hash, 0, sizeof(sub_hash));
+	sub_list = NULL;
+	sub_count = 0;
+	cur_sub = subscriber_new(0);
+	_s = cur_sub->s;
 
 	switch (callback) {
 	case CALLBACK_NONE:
@@ -83,12 +193,7 @@ void session_init(unsigned start_sid, int console, const char *gsmtap_target, in
 		_s[1].sql_callback = console_callback;
 		break;
 	}
-
-	s_id = start_sid;
-
-	_s[0].id = s_id++;
-	_s[1].id = s_id++;
-	_s[1].domain = DOMAIN_PS;
+	sub_sql_callback = _s[0].sql_callback;
 
 	if (gsmtap_target != NULL)
 	{
@@ -98,19 +203,45 @@ void session_init(unsigned start_sid, int console, const char *gsmtap_target, in
 
 void session_destroy(unsigned *last_sid, unsigned *last_cid)
 {
+	struct subscriber *sub, *next;
+
 	if (msg_verbose > 1) {
 		printf("session_destroy!\n");
 	}
 
-	session_reset(&_s[0], 1);
-	_s[1].new_msg = NULL;
-	session_reset(&_s[1], 1);
+	for (sub = sub_list; sub; sub = sub->next) {
+		session_reset(&sub->s[0], 1);
+		sub->s[1].new_msg = NULL;
+		session_reset(&sub->s[1], 1);
+	}
 	*last_sid = s_id;
 
 	cell_destroy(last_cid);
 	net_destroy();
-
-	if (_s[0].sql_callback) {
+	rrc_arena_destroy();
+
+	for (sub = sub_list; sub; sub = next) {
+		next = sub->next;
+		radio_msg_free(sub->last_m);
+		rrc_bcch_free(sub->bcch);
+		arena_destroy(sub->s[0].arena);
+		arena_destroy(sub->s[1].arena);
+		free(sub);
+	}
+	memset(sub_hash, 0, sizeof(sub_hash));
+	sub_list = NULL;
+	sub_count = 0;
+	cur_sub = NULL;
+	_s = NULL;
+
+	if (msg_verbose) {
+		naseps_sec_print_stats();
+	}
+	perf_dump();
+	failure_dump();
+	trace_dump();
+
+	if (sub_sql_callback) {
 #ifdef USE_SQLITE
 		if (output_sqlite == 1) {
 			sqlite_api_destroy();
@@ -124,12 +255,27 @@ void session_destroy(unsigned *last_sid, unsigned *last_cid)
 	}
 }
 
-struct session_info *session_create(int id, char* name, uint8_t *key, int mcc, int mnc, int lac, int cid, struct gsm_sysinfo_freq *ca)
+/* Store open transactions of the current handset, like session_destroy() */
+void session_flush()
+{
+	session_reset(&_s[0], 1);
+	_s[1].new_msg = NULL;
+	session_reset(&_s[1], 1);
+}
+
+/* ID the next new transaction will get */
+unsigned session_next_id()
+{
+	return s_id;
+}
+
+struct session_info *session_create(int id, char* name, uint8_t *key, int mcc, int mnc, int lac, int cid, const struct arfcn_set *ca)
 {
 	struct session_info *ns;
 
 	ns = (struct session_info *) malloc(sizeof(struct session_info));
 	memset(ns, 0, sizeof(struct session_info));
+	ns->arena = arena_create(SESSION_ARENA_SIZE);
 
 	if (id < 0) {
 		ns->id = s_id++; 
@@ -162,7 +308,7 @@ struct session_info *session_create(int id, char* name, uint8_t *key, int mcc, i
 
 	/* Store cell ARFCNs */
 	if (ca)
-		memcpy(ns->cell_arfcns, ca, 1024*sizeof(struct gsm_sysinfo_freq));
+		memcpy(ns->cell_arfcns, ca, sizeof(ns->cell_arfcns));
 
 	ns->decoded = 1;
 	rand_init_2b(&ns->null);
@@ -207,36 +353,40 @@ int session_enumerate(int output)
 	return count;
 }
 
+/* Messages go back to the pool in one step */
 void session_free_msg_list(struct session_info *s)
 {
-	struct radio_message *m;
-
 	assert(s != NULL);
 
-	while (s->first_msg) {
-		m = s->first_msg;
-		if (msg_verbose > 2) {
-			printf("Freeing pointer %p\n", m);
-		}
-		s->first_msg = m->next;
-
-		free(m);
+	if (msg_verbose > 2) {
+		printf("Freeing %u messages\n", s->msg_count);
 	}
+
+	radio_msg_free_list(s->first_msg, s->last_msg);
+	s->first_msg = NULL;
+	s->last_msg = NULL;
 }
 
+/* Entries live in the session arena, released by arena_reset() */
 void session_free_sms_list(struct session_info *s)
 {
-	struct sms_meta *sm;
-
 	assert(s != NULL);
 
-	while (s->sms_list) {
-		sm = s->sms_list;
-
-		s->sms_list = sm->next;
+	s->sms_list = NULL;
+}
 
-		free(sm);
+/* Report allocations of the ending transaction and release its arena */
+static void session_release_arena(struct session_info *s)
+{
+	if (msg_verbose > 1) {
+		printf("Session %d allocations: arena %llu/%llu bytes in %llu chunks, %u messages\n",
+			s->id, (unsigned long long) s->arena->stats.allocs,
+			(unsigned long long) s->arena->stats.bytes,
+			(unsigned long long) s->arena->stats.chunks, s->msg_count);
 	}
+	perf_count_session(&s->arena->stats, s->msg_count);
+
+	arena_reset(s->arena);
 }
 
 void session_free(struct session_info *s)
@@ -256,6 +406,8 @@ void session_free(struct session_info *s)
 
 	session_free_msg_list(s);
 	session_free_sms_list(s);
+	session_release_arena(s);
+	arena_destroy(s->arena);
 	free(s);
 }
 
@@ -268,10 +420,10 @@ void session_stream(struct session_info *s)
 	m = s->first_msg;
 	while (m) {
 		if (m->flags & MSG_DECODED) {
-			net_send_msg(m);
+			PERF_TIME(PERF_NET_SEND, net_send_msg(m));
 #if 0
-			if (msg_verbose && m->info[0]) {
-				printf("%c %s\n", m->bb.arfcn[0] & ARFCN_UPLINK ? 'U' : 'D', m->info);
+			if (msg_verbose && !msg_info_empty(&m->info)) {
+				printf("%c %s\n", m->bb.arfcn[0] & ARFCN_UPLINK ? 'U' : 'D', msg_info_str(&m->info));
 			}
 #endif
 		}
@@ -459,13 +611,13 @@ void session_make_sql(struct session_info *s, char *query, unsigned q_len, uint8
 	char *tmsi;
 	char *new_tmsi;
 	char *tlli;
-	char *hash;
 	char *imsi;
 	char *imei;
 	char *msisdn;
 	char *pdpip;
 	char id_field[4];
 	char id_value[16];
+	struct arena_mark mark;
 
 	assert(s != NULL);
 	assert(query != NULL);
@@ -476,7 +628,8 @@ void session_make_sql(struct session_info *s, char *query, unsigned q_len, uint8
 	if (s->closed)
 		return;
 
-	/* Prepare strings */
+	/* Prepare strings, released again at the end */
+	arena_mark(s->arena, &mark);
 	if (s->id >= 0) {
 		strncpy(id_field, "id,", sizeof(id_field));
 		snprintf(id_value, sizeof(id_value), "%d,", s->id);
@@ -485,25 +638,24 @@ void session_make_sql(struct session_info *s, char *query, unsigned q_len, uint8
 		id_value[0] = 0;
 	}
 	if (not_zero(s->old_tmsi,4)) {
-		tmsi = strescape_or_null(osmo_hexdump_nospc(s->old_tmsi, 4));
+		tmsi = arena_strescape_or_null(s->arena, osmo_hexdump_nospc(s->old_tmsi, 4));
 	} else {
-		tmsi = strescape_or_null(0);
+		tmsi = arena_strescape_or_null(s->arena, 0);
 	}
 	if (not_zero(s->new_tmsi,4)) {
-		new_tmsi = strescape_or_null(osmo_hexdump_nospc(s->new_tmsi, 4));
+		new_tmsi = arena_strescape_or_null(s->arena, osmo_hexdump_nospc(s->new_tmsi, 4));
 	} else {
-		new_tmsi = strescape_or_null(0);
+		new_tmsi = arena_strescape_or_null(s->arena, 0);
 	}
 	if (not_zero(s->tlli,4)) {
-		tlli = strescape_or_null(osmo_hexdump_nospc(s->tlli, 4));
+		tlli = arena_strescape_or_null(s->arena, osmo_hexdump_nospc(s->tlli, 4));
 	} else {
-		tlli = strescape_or_null(0);
+		tlli = arena_strescape_or_null(s->arena, 0);
 	}
-	hash = strescape_or_null(s->name);
-	imsi = strescape_or_null(s->imsi);
-	imei = strescape_or_null(s->imei);
-	msisdn = strescape_or_null(s->msisdn);
-	pdpip = strescape_or_null(s->pdp_ip);
+	imsi = arena_strescape_or_null(s->arena, s->imsi);
+	imei = arena_strescape_or_null(s->arena, s->imei);
+	msisdn = arena_strescape_or_null(s->arena, s->msisdn);
+	pdpip = arena_strescape_or_null(s->arena, s->pdp_ip);
 
 	if (sqlite) {
 		snprintf(timestamp, sizeof(timestamp), "datetime(%lu, 'unixepoch')", s->timestamp.tv_sec);
@@ -554,15 +706,7 @@ void session_make_sql(struct session_info *s, char *query, unsigned q_len, uint8
 		imsi, imei, tmsi, new_tmsi, tlli, msisdn,
 		s->ms_cipher_mask, s->ue_cipher_cap, s->ue_integrity_cap);
 
-	/* Deallocate strings */
-	free(tmsi);
-	free(new_tmsi);
-	free(tlli);
-	free(hash);
-	free(imsi);
-	free(imei);
-	free(msisdn);
-	free(pdpip);
+	arena_rewind(s->arena, &mark);
 }
 
 void session_make_rand_sql(struct session_info *s, char *query, unsigned q_len)
@@ -661,20 +805,20 @@ void session_close(struct session_info *s)
 		struct sms_meta *sm;
 
 		session_make_sql(s, sql_buffer, sizeof(sql_buffer), output_sqlite);
-		s->sql_callback(sql_buffer);
+		PERF_TIME(PERF_SQL_CALLBACK, s->sql_callback(sql_buffer));
 
 		if ((s->rat == RAT_GSM) && (s->domain == DOMAIN_CS)) {
 			session_make_rand_sql(s, sql_buffer, sizeof(sql_buffer));
-			s->sql_callback(sql_buffer);
+			PERF_TIME(PERF_SQL_CALLBACK, s->sql_callback(sql_buffer));
 		}
 
 		paging_make_sql(s->id, sql_buffer, sizeof(sql_buffer));
-		s->sql_callback(sql_buffer);
+		PERF_TIME(PERF_SQL_CALLBACK, s->sql_callback(sql_buffer));
 
 		sm = s->sms_list;
 		while (sm) {
-			sms_make_sql(s->id, sm, sql_buffer, sizeof(sql_buffer));
-			s->sql_callback(sql_buffer);
+			sms_make_sql(s, sm, sql_buffer, sizeof(sql_buffer));
+			PERF_TIME(PERF_SQL_CALLBACK, s->sql_callback(sql_buffer));
 
 			sm = sm->next;
 		}
@@ -684,7 +828,7 @@ void session_close(struct session_info *s)
 				 "INSERT INTO sid_appid VALUES (%d,'%08x');\n",
 				 s->id, s->appid); 
 
-			s->sql_callback(sql_buffer);
+			PERF_TIME(PERF_SQL_CALLBACK, s->sql_callback(sql_buffer));
 		}
 
 		cell_dump(0, 1, 0);
@@ -713,6 +857,7 @@ void link_to_msg_list(struct session_info* s, struct radio_message *m)
 	m->next = NULL;
 	m->prev = s->last_msg;
 	s->last_msg = m;
+	s->msg_count++;
 }
 
 void session_reset(struct session_info *s, int forced_release)
@@ -741,20 +886,7 @@ void session_reset(struct session_info *s, int forced_release)
 	}
 
 	if (s->started && !s->closed) {
-		switch (s->rat) {
-		case RAT_GSM:
-			printf("RAT: GSM\n");
-			break;
-		case RAT_UMTS:
-			printf("RAT: 3G\n");
-			break;
-		case RAT_LTE:
-			printf("RAT: LTE\n");
-			break;
-		default:
-			printf("RAT: UNKNOWN\n");
-		}
-		fflush(stdout);
+		TRACE2(TRACE_INFO, TRACE_SESSION_CLOSE, s->rat, s->id);
 		s->cracked = 1;
 		session_close(s);
 	}
@@ -785,6 +917,10 @@ void session_reset(struct session_info *s, int forced_release)
 		strncpy(s->imsi, old_s.imsi, sizeof(s->imsi));
 	}
 	s->sql_callback = old_s.sql_callback;
+	s->arena = old_s.arena;
+
+	/* The NAS security context outlives the transaction */
+	memcpy(&s->nas_sec, &old_s.nas_sec, sizeof(s->nas_sec));
 
 	if (forced_release) {
 		s->new_msg = m;
@@ -816,16 +952,61 @@ void session_reset(struct session_info *s, int forced_release)
 
 	session_free_msg_list(&old_s);
 	session_free_sms_list(&old_s);
-	old_s.first_msg = NULL;
-	old_s.last_msg = NULL;
+	session_release_arena(&old_s);
 }
 
-static uint32_t parse_appid(const char *filename)
+/*
+ * Drop the transactions of all handsets without output, new_msg is not owned
+ * and only cleared. Handsets stay known, with their session IDs.
+ */
+void session_reset_all()
+{
+	struct subscriber *sub;
+	struct session_info *s;
+	void (*sql_callback)(const char *);
+	struct arena *arena;
+	uint32_t appid;
+	int i, id;
+
+	for (sub = sub_list; sub; sub = sub->next) {
+		radio_msg_free(sub->last_m);
+		sub->last_m = NULL;
+		memset(&sub->last_burst, 0, sizeof(sub->last_burst));
+		rrc_bcch_free(sub->bcch);
+		sub->bcch = NULL;
+
+		for (i = 0; i < 2; i++) {
+			s = &sub->s[i];
+
+			session_free_msg_list(s);
+			session_free_sms_list(s);
+			session_release_arena(s);
+
+			id = s->id;
+			appid = s->appid;
+			sql_callback = s->sql_callback;
+			arena = s->arena;
+
+			memset(s, 0, sizeof(struct session_info));
+			s->id = id;
+			s->domain = i;
+			s->appid = appid;
+			s->sql_callback = sql_callback;
+			s->arena = arena;
+		}
+	}
+
+	paging_reset();
+	now = 0;
+}
+
+/* App ID from the file name header, 0 if there is none */
+uint32_t session_appid_from_filename(const char *filename)
 {
 	char *fn_copy;
 	char *ptr;
 	char *token;
-	uint32_t appid;
+	uint32_t appid = 0;
 
 	/* We need a copy, tokenizer is not const */
 	fn_copy = strdup(filename);
@@ -833,7 +1014,7 @@ static uint32_t parse_appid(const char *filename)
 	/* Match file name header */
 	ptr = strstr(fn_copy, "2__");
 	if (!ptr) {
-		return 0;
+		goto out;
 	}
 
 	/* Skip first part */
@@ -842,24 +1023,28 @@ static uint32_t parse_appid(const char *filename)
 	/* Get and ignore first token */
 	token = strtok_r(ptr, "_", &ptr);
 	if (!token) {
-		return 0;
+		goto out;
 	}
 
 	/* Match App ID string */
 	token = strtok_r(0, "_", &ptr);
-	if (strlen(token) != 8) {
-		return 0;
+	if (!token || strlen(token) != 8) {
+		goto out;
 	}
 
 	/* Parse and return value */
-	if (sscanf(token, "%08x", &appid) == 1) {
-		return appid;
+	if (sscanf(token, "%08x", &appid) != 1) {
+		appid = 0;
 	}
 
-	return 0;
+out:
+	free(fn_copy);
+
+	return appid;
 }
 
-int session_from_filename(const char *filename, struct session_info *s)
+/* Parse capture metadata from a file name, no parser state is touched */
+int session_meta_from_filename(const char *filename, struct file_meta *fm)
 {
 	char *xgs_ptr;
 	char *qdmon_ptr;
@@ -871,8 +1056,10 @@ int session_from_filename(const char *filename, struct session_info *s)
 	struct timeval now;
 	int ret;
 
+	memset(fm, 0, sizeof(*fm));
+
 	/* Try to extract application ID */
-	s->appid = parse_appid(filename);
+	fm->appid = session_appid_from_filename(filename);
 
 	/* Locate baseband type in filename */
 	xgs_ptr = strstr(filename, "_xgs.");
@@ -931,7 +1118,8 @@ int session_from_filename(const char *filename, struct session_info *s)
 		/* Check if actual MCC/MNC values are present */
 		if (sscanf(token, "%06d", &mcc_mnc) == 1) {
 			/* Save them as part of IMSI */
-			strncpy(s->imsi, token, sizeof(s->imsi));
+			strncpy(fm->imsi, token, sizeof(fm->imsi));
+			fm->fields |= META_IMSI;
 		}
 
 		/* Advance to next token */
@@ -953,10 +1141,11 @@ int session_from_filename(const char *filename, struct session_info *s)
 	} else {
 		ts.tm_year -= 1900;
 		ts.tm_mon -= 1;
-		s->timestamp.tv_sec = mktime(&ts);
+		fm->timestamp.tv_sec = mktime(&ts);
+		fm->fields |= META_TIME;
 		/* Allow timestamps with 12h in advance */
-		if (s->timestamp.tv_sec > (now.tv_sec + 43200)) {
-			s->timestamp = now;
+		if (fm->timestamp.tv_sec > (now.tv_sec + 43200)) {
+			fm->timestamp = now;
 			fprintf(stderr, "timestamp %s is in the future! using current timestamp\n", token);
 		}
 	}
@@ -969,48 +1158,91 @@ int session_from_filename(const char *filename, struct session_info *s)
 	if (!strcmp(token, "UMTS") ||
 	    !strcmp(token, "3G")||
 	    !strcmp(token, "WCDMA")) {
-		s->rat = RAT_UMTS;
+		fm->rat = RAT_UMTS;
 	} else if (!strcmp(token, "GSM") ||
 		   !strcmp(token, "UNKNOWN") ||
 		   !strcmp(token, "UNKNWON") ||
 		   !strcmp(token, "null")) {
-		s->rat = RAT_GSM;
+		fm->rat = RAT_GSM;
 	} else if (!strcmp(token, "LTE")) {
-		s->rat = RAT_LTE;
+		fm->rat = RAT_LTE;
 	} else {
 		// unknown
 		fprintf(stderr, "unknown network type %s\n", token);
 		goto parse_error;
 	}
 
+	fm->fields |= META_RAT;
+
 	/* Cell ID */
 	token = strtok_r(0, ".", &ptr);
 	if (!token)
 		goto parse_error;
 
-	ret = sscanf(token, "%03hu%03hu-%hx-%x", &s->mcc, &s->mnc, &s->lac, &s->cid);
+	fm->fields |= META_CELL;
+	ret = sscanf(token, "%03hu%03hu-%hx-%x", &fm->mcc, &fm->mnc, &fm->lac, &fm->cid);
 	if (ret < 4) {
 		/* Sometimes LAC/CID is set to "null" */
-		s->lac = 65535;
-		s->cid = 65535;
+		fm->lac = 65535;
+		fm->cid = 65535;
 
 		if (ret < 2) {
 			/* We couldn't parse even the MCC/MNC */
 			fprintf(stderr, "unknown cellid format %s\n", token);
-			s->mcc = 65535;
-			s->mnc = 65535;
+			fm->mcc = 65535;
+			fm->mnc = 65535;
 			goto parse_error;
 		}
 	}
 
+	free(ptr_copy);
+
 	return 0;
 
 parse_error:
 	if (ptr_copy) {
 		free(ptr_copy);
 	}
-	if (auto_timestamp) {
+	fm->error = 1;
+	return -1;
+}
+
+/* Fields found in the file name replace the session values */
+void session_apply_meta(const struct file_meta *fm, struct session_info *s)
+{
+	/* Names without an appid keep the handset selected before */
+	if (fm->appid) {
+		s->appid = fm->appid;
+	}
+
+	if (fm->fields & META_IMSI) {
+		strncpy(s->imsi, fm->imsi, sizeof(s->imsi));
+	}
+	if (fm->fields & META_TIME) {
+		s->timestamp = fm->timestamp;
+	}
+	if (fm->fields & META_RAT) {
+		s->rat = fm->rat;
+	}
+	if (fm->fields & META_CELL) {
+		s->mcc = fm->mcc;
+		s->mnc = fm->mnc;
+		s->lac = fm->lac;
+		s->cid = fm->cid;
+	}
+
+	if (fm->error && auto_timestamp) {
 		gettimeofday(&s->timestamp, NULL);
 	}
-	return -1;
+}
+
+int session_from_filename(const char *filename, struct session_info *s)
+{
+	struct file_meta fm;
+	int ret;
+
+	ret = session_meta_from_filename(filename, &fm);
+	session_apply_meta(&fm, s);
+
+	return ret;
 }
@@ -10,6 +10,10 @@
 #include "rand_check.h"
 #include "assignment.h"
 #include "cell_info.h"
+#include "arena.h"
+
+/* First arena chunk of a session, enough for a few SMS */
+#define SESSION_ARENA_SIZE 16384
 
 struct frame_count {
 	uint32_t unenc;
@@ -35,6 +39,16 @@ struct lapdm_buf {
 	int16_t last_out_of_seq_msg_number;
 };
 
+/* LTE NAS security context, taken from the diag key records */
+struct nas_sec_ctx {
+	uint8_t valid;
+	uint8_t eea;
+	uint8_t eia;
+	uint8_t k_enc[16];
+	uint8_t k_int[16];
+	uint32_t count[2];	/* Next expected NAS COUNT, 0=UL 1=DL */
+} __attribute__((packed));
+
 struct session_info {
 	int id;
 	uint32_t appid;
@@ -69,6 +83,7 @@ struct session_info {
 	uint8_t integrity;
 	uint8_t cipher_nas;
 	uint8_t integrity_nas;
+	struct nas_sec_ctx nas_sec;
 	uint32_t first_fn;
 	uint32_t last_fn;
 	uint32_t duration;
@@ -147,10 +162,12 @@ struct session_info {
 	struct radio_message *first_msg;
 	struct radio_message *last_msg;
 	struct radio_message *new_msg;
+	uint32_t msg_count;
 	struct sms_meta *sms_list;
+	struct arena *arena;	/* Per transaction allocations, kept across resets */
 	struct session_info *next;
 	struct session_info *prev;
-	struct gsm_sysinfo_freq cell_arfcns[1024];
+	struct arfcn_set cell_arfcns[ASSIGN_SRC_MAX];
 	struct cell_info *ci;
 	struct rand_state null;
 	struct rand_state si5;
@@ -165,6 +182,44 @@ struct session_info {
 
 void link_to_msg_list(struct session_info* s, struct radio_message *m);
 
+/* Burst metrics of the last frame, matched to the following L2 message */
+struct burst_info {
+	uint32_t fn;
+	uint16_t arfcn[4];
+};
+
+/* Parser state of one handset, looked up by appid */
+struct subscriber {
+	uint32_t appid;
+	struct session_info s[2];	/* CS and PS domain */
+	struct radio_message *last_m;	/* Held back until the next frame */
+	struct burst_info last_burst;
+	struct bcch_rx *bcch;		/* UMTS SIB reception, see umts_rrc.c */
+	struct subscriber *hash_next;
+	struct subscriber *next;
+};
+
+#define SUBSCRIBER_HASH_BITS 12
+
+/* Capture metadata from a file name, META_* tell which fields were found */
+#define META_IMSI	0x01
+#define META_TIME	0x02
+#define META_RAT	0x04
+#define META_CELL	0x08
+
+struct file_meta {
+	uint32_t appid;
+	unsigned fields;
+	int error;		/* The name did not parse completely */
+	char imsi[GSM48_MI_SIZE];
+	struct timeval timestamp;
+	uint8_t rat;
+	uint16_t mcc;
+	uint16_t mnc;
+	uint16_t lac;
+	uint32_t cid;
+};
+
 #define CALLBACK_NONE 0
 #define CALLBACK_MYSQL 1
 #define CALLBACK_SQLITE 2
@@ -172,26 +227,37 @@ void link_to_msg_list(struct session_info* s, struct radio_message *m);
 
 #define SET_MSG_INFO(s, ... )  { \
 	assert((s)->new_msg); \
-	snprintf((s)->new_msg->info, sizeof((s)->new_msg->info), ##__VA_ARGS__); \
+	msg_info_set(&(s)->new_msg->info, ##__VA_ARGS__); \
 };
 
-#define APPEND_MSG_INFO(s, ...) snprintf((s)->new_msg->info+strlen((s)->new_msg->info), sizeof((s)->new_msg->info)-strlen((s)->new_msg->info), ##__VA_ARGS__);
+#define APPEND_MSG_INFO(s, ...) msg_info_append(&(s)->new_msg->info, ##__VA_ARGS__);
 
 void session_init(unsigned start_sid, int console, const char *gsmtap_target, int callback);
 void session_destroy();
-struct session_info *session_create(int id, char* name, uint8_t *key, int mcc, int mnc, int lac, int cid, struct gsm_sysinfo_freq *ca);
+void session_flush();
+unsigned session_next_id();
+struct session_info *session_create(int id, char* name, uint8_t *key, int mcc, int mnc, int lac, int cid, const struct arfcn_set *ca);
 void session_close(struct session_info *s);
 void session_store(struct session_info *s);
 void session_reset(struct session_info *s, int forced_release);
+void session_reset_all();
 void session_free(struct session_info *s);
+void session_free_msg_list(struct session_info *s);
+void session_free_sms_list(struct session_info *s);
 int session_enumerate();
 int session_from_filename(const char *filename, struct session_info *s);
+int session_meta_from_filename(const char *filename, struct file_meta *fm);
+void session_apply_meta(const struct file_meta *fm, struct session_info *s);
+uint32_t session_appid_from_filename(const char *filename);
+struct subscriber *subscriber_select(uint32_t appid);
+unsigned subscriber_count();
 
 extern uint8_t privacy;
 extern uint8_t msg_verbose;
 extern uint8_t auto_reset;
 extern uint8_t auto_timestamp;
-extern struct session_info _s[2];
+extern struct session_info *_s;		/* Both domains of cur_sub */
+extern struct subscriber *cur_sub;
 
 extern uint32_t now;
 
@@ -533,7 +533,8 @@ void handle_tpdu(struct session_info *s, uint8_t *msg, const unsigned len, uint8
 	uint8_t off;
 	uint8_t f_len;
 	uint8_t vp;
-	struct sms_meta *sm;
+	struct sms_meta sms;
+	struct sms_meta *sm = &sms;
 
 	assert(s != NULL);
 	assert(msg != NULL);
@@ -543,8 +544,7 @@ void handle_tpdu(struct session_info *s, uint8_t *msg, const unsigned len, uint8
 		return;
 	}
 
-	sm = (struct sms_meta *) malloc(sizeof(struct sms_meta));
-	assert(sm != NULL);
+	/* Decoded on the stack, only complete SMS go to the session arena */
 	memset(sm, 0, sizeof(*sm));
 
 	/* Store SMSC */
@@ -580,7 +580,6 @@ void handle_tpdu(struct session_info *s, uint8_t *msg, const unsigned len, uint8
 	off += f_len/2 + 1;
 	if (off >= len) {
 		APPEND_MSG_INFO(s, " <TRUNCATED>");
-		free(sm);
 		return;
 	}
 
@@ -594,7 +593,6 @@ void handle_tpdu(struct session_info *s, uint8_t *msg, const unsigned len, uint8
 
 	if (off >= len) {
 		APPEND_MSG_INFO(s, " <TRUNCATED>");
-		free(sm);
 		return;
 	}
 
@@ -619,7 +617,6 @@ void handle_tpdu(struct session_info *s, uint8_t *msg, const unsigned len, uint8
 	}
 	if (off >= len) {
 		APPEND_MSG_INFO(s, " <TRUNCATED>");
-		free(sm);
 		return;
 	}
 
@@ -649,7 +646,6 @@ void handle_tpdu(struct session_info *s, uint8_t *msg, const unsigned len, uint8
 
 	if (off > len) {
 		APPEND_MSG_INFO(s, " <TRUNCATED>");
-		free(sm);
 		return;
 	}
 
@@ -667,6 +663,8 @@ void handle_tpdu(struct session_info *s, uint8_t *msg, const unsigned len, uint8
 	//FIXME: discard normal sms, store only dcs = 192, 22, 246
 
 	/* Append SMS to list */
+	sm = (struct sms_meta *) arena_alloc(s->arena, sizeof(struct sms_meta));
+	memcpy(sm, &sms, sizeof(struct sms_meta));
 	if (s->sms_list) {
 		sm->sequence = s->sms_list->sequence+1;
 	} else {
@@ -838,7 +836,7 @@ void handle_sms(struct session_info *s, struct gsm48_hdr *dtap, unsigned len)
 	}
 }
 
-void sms_make_sql(int sid, struct sms_meta *sm, char *query, unsigned len)
+void sms_make_sql(struct session_info *s, struct sms_meta *sm, char *query, unsigned len)
 {
 	char *smsc;
 	char *msisdn;
@@ -847,22 +845,24 @@ void sms_make_sql(int sid, struct sms_meta *sm, char *query, unsigned len)
 	char *data_hex;
 	char *tar;
 	char *counter;
+	struct arena_mark mark;
 
 	assert(sm != NULL);
 	assert(query != NULL);
 
-	smsc = strescape_or_null(sm->smsc);
-	msisdn = strescape_or_null(sm->msisdn);
-	info = strescape_or_null(sm->info);
-	tar = strescape_or_null(sm->ota_tar);
-	counter = strescape_or_null(sm->ota_counter);
+	/* Strings are released again at the end */
+	arena_mark(s->arena, &mark);
+
+	smsc = arena_strescape_or_null(s->arena, sm->smsc);
+	msisdn = arena_strescape_or_null(s->arena, sm->msisdn);
+	info = arena_strescape_or_null(s->arena, sm->info);
+	tar = arena_strescape_or_null(s->arena, sm->ota_tar);
+	counter = arena_strescape_or_null(s->arena, sm->ota_counter);
 	if (sm->length) { 
-		data_hex = strescape_or_null(osmo_hexdump_nospc(sm->data,sm->length));
-		data = malloc(strlen(data_hex)+2);
-		snprintf(data, strlen(data_hex)+2, "X%s", data_hex);
-		free(data_hex);
+		data_hex = arena_strescape_or_null(s->arena, osmo_hexdump_nospc(sm->data,sm->length));
+		data = arena_printf(s->arena, "X%s", data_hex);
 	} else {
-		data = strdup("'<NO DATA>'"); 
+		data = "'<NO DATA>'";
 	}
 
 	snprintf(query, len, "INSERT INTO sms_meta (id,sequence,from_network,pid,dcs,alphabet,"
@@ -875,15 +875,12 @@ void sms_make_sql(int sid, struct sms_meta *sm, char *query, unsigned len)
 		"%d,%d,%d,%d,%d,%d,"
 		"%d,%d,%d,%s,%s,%d,"
 		"%s,%s,%s,%d,%d,%d,%s);\n",
-		sid, sm->sequence, sm->from_network, sm->pid, sm->dcs, sm->alphabet,
+		s->id, sm->sequence, sm->from_network, sm->pid, sm->dcs, sm->alphabet,
 		sm->class, sm->udhi, sm->concat, sm->concat_frag, sm->concat_total,
 		sm->src_port, sm->dst_port, sm->ota, sm->ota_iei, sm->ota_enc, sm->ota_enc_algo,
 		sm->ota_sign, sm->ota_sign_algo, sm->ota_counter_type, counter, tar, sm->ota_por,
 		smsc, msisdn, info, sm->length, sm->udh_length, sm->real_length, data);
 
-	free(smsc);
-	free(msisdn);
-	free(info);
-	free(data);
+	arena_rewind(s->arena, &mark);
 }
 
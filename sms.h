@@ -75,7 +75,8 @@ struct sms_meta {
 
 void handle_sms(struct session_info *s, struct gsm48_hdr *dtap, unsigned len);
 void handle_cpdata(struct session_info *s, uint8_t *data, unsigned len);
+void handle_tpdu(struct session_info *s, uint8_t *msg, const unsigned len, uint8_t from_network, char *smsc);
 void handle_rpdata(struct session_info *s, uint8_t *data, unsigned len, uint8_t from_network);
-void sms_make_sql(int sid, struct sms_meta *sm, char *query, unsigned len);
+void sms_make_sql(struct session_info *s, struct sms_meta *sm, char *query, unsigned len);
 
 #endif
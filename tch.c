@@ -7,6 +7,7 @@
 
 #include "gsm_interleave.h"
 #include "l3_handler.h"
+#include "perf.h"
 
 int process_tch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *msg)
 {
@@ -148,7 +149,7 @@ int process_tch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *msg
 			return 0;
 		}
 
-		m = malloc(sizeof(struct radio_message));
+		m = radio_msg_alloc();
 		memcpy(&m->bb, bb, sizeof(*bb));
 		m->chan_nr = bi->chan_nr;
 		m->flags = MSG_FACCH|MSG_DECODED;
@@ -159,7 +160,7 @@ int process_tch(struct session_info *s, struct l1ctl_burst_ind *bi, uint8_t *msg
 
 		handle_lapdm(s, &s->chan_facch[ul], m->msg, m->msg_len, m->bb.fn[0], ul);
 
-		net_send_msg(m);
+		PERF_TIME(PERF_NET_SEND, net_send_msg(m));
 
 		/* check overlapping status */
 		if ((bi->bits[14] & 0x30) == 0x30) {
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <assert.h>
+
+#include "trace.h"
+#include "perf.h"
+#include "process.h"
+
+/* Records per thread, a power of two */
+#define TRACE_RING_SIZE 4096
+
+struct trace_ring {
+	uint64_t head;		/* Records written so far, only the owner stores it */
+	uint32_t thread;
+	struct trace_ring *next;
+	struct trace_record rec[TRACE_RING_SIZE];
+};
+
+static const char *trace_formats[TRACE_EVENT_MAX] = {
+	"RAT: %s session %d",	/* Rendered by trace_render() */
+	"SQL: %d bytes",
+	"SACCH report old=%d new=%d",
+	"TS %d TFI %d BSN %d CV %d",
+	"TS %d TFI %d BSN %d FBI %d",
+	"fn_same_bsn %d fn_last_bsn %d delta_bsn %d old_len %d",
+	"TLLI 0x%08x",
+	"PFI %d",
+	"clearing TBF %d, first %d last %d",
+	"new TBF, starting from %d",
+	"duplicate bsn %d",
+	"error last_bsn, bsn %d d_last_bsn %d",
+	"error d_bsn, bsn %d d_bsn %d",
+	"no valid blocks in current TBF, start %d",
+	"bsn %d null",
+	"bsn %d old segment fn %d current %d",
+	"bsn %d missing, previous %d",
+	"bsn %d end of TBF, llc len %d",
+	"bsn %d lime %d error",
+	"bsn %d end of message, llc len %d lime %d",
+	"bsn %d spare and buffer not empty, llc len %d",
+	"shifting window start %d last %d",
+};
+
+static const char *trace_level_names[] = { "ERROR", "WARN", "INFO", "DEBUG" };
+
+static __thread struct trace_ring *trace_local = NULL;
+static struct trace_ring *trace_all = NULL;
+static uint32_t trace_threads = 0;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char *trace_filename = NULL;
+static uint64_t trace_start_ticks;
+static uint64_t trace_start_ns;
+
+static uint64_t trace_now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Rings are allocated per thread on first use and never freed */
+static struct trace_ring *trace_get()
+{
+	struct trace_ring *r = trace_local;
+
+	if (r) {
+		return r;
+	}
+
+	r = (struct trace_ring *) calloc(1, sizeof(struct trace_ring));
+	assert(r != NULL);
+
+	pthread_mutex_lock(&trace_mutex);
+	if (!trace_all) {
+		trace_start_ticks = perf_ticks();
+		trace_start_ns = trace_now_ns();
+	}
+	r->thread = trace_threads++;
+	r->next = trace_all;
+	trace_all = r;
+	pthread_mutex_unlock(&trace_mutex);
+
+	trace_local = r;
+
+	return r;
+}
+
+/* No locks, only the owning thread writes to its ring */
+void trace_log(enum trace_level level, enum trace_event event,
+		int32_t a0, int32_t a1, int32_t a2, int32_t a3)
+{
+	struct trace_ring *r = trace_get();
+	uint64_t head = r->head;
+	struct trace_record *rec = &r->rec[head & (TRACE_RING_SIZE - 1)];
+
+	rec->ticks = perf_ticks();
+	rec->event = event;
+	rec->level = level;
+	rec->pad = 0;
+	rec->thread = r->thread;
+	rec->arg[0] = a0;
+	rec->arg[1] = a1;
+	rec->arg[2] = a2;
+	rec->arg[3] = a3;
+
+	/* Publish the record for trace_dump() */
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_set_output(const char *filename)
+{
+	free(trace_filename);
+	trace_filename = filename ? strdup(filename) : NULL;
+}
+
+/*
+ * Write all rings to the output file. Rings of threads which are still
+ * logging may have their oldest records overwritten while being copied.
+ */
+void trace_dump()
+{
+	struct trace_header h;
+	struct trace_thread t;
+	struct trace_ring *r;
+	uint64_t head, first, dt, i;
+	FILE *f;
+
+	if (!trace_filename) {
+		return;
+	}
+
+	f = fopen(trace_filename, "wb");
+	if (!f) {
+		perror("trace_dump");
+		return;
+	}
+
+	pthread_mutex_lock(&trace_mutex);
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+	h.version = TRACE_VERSION;
+	h.n_events = TRACE_EVENT_MAX;
+	h.start_ticks = trace_start_ticks;
+	dt = trace_now_ns() - trace_start_ns;
+	h.ticks_per_ns = dt ? (double) (perf_ticks() - trace_start_ticks) / dt : 1.0;
+	if (h.ticks_per_ns <= 0) {
+		h.ticks_per_ns = 1.0;
+	}
+	fwrite(&h, sizeof(h), 1, f);
+
+	for (r = trace_all; r; r = r->next) {
+		head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+		t.thread = r->thread;
+		t.count = head - first;
+		t.dropped = first;
+		fwrite(&t, sizeof(t), 1, f);
+
+		for (i = first; i < head; i++) {
+			fwrite(&r->rec[i & (TRACE_RING_SIZE - 1)], sizeof(struct trace_record), 1, f);
+		}
+	}
+
+	pthread_mutex_unlock(&trace_mutex);
+
+	fclose(f);
+}
+
+static const char *trace_rat_name(int32_t rat)
+{
+	switch (rat) {
+	case RAT_GSM:
+		return "GSM";
+	case RAT_UMTS:
+		return "3G";
+	case RAT_LTE:
+		return "LTE";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+/* Text of one record, returns the length like snprintf() */
+int trace_render(const struct trace_record *rec, char *buf, unsigned len)
+{
+	if (rec->event >= TRACE_EVENT_MAX) {
+		return snprintf(buf, len, "unknown event %u", rec->event);
+	}
+
+	if (rec->event == TRACE_SESSION_CLOSE) {
+		return snprintf(buf, len, trace_formats[rec->event], trace_rat_name(rec->arg[0]), rec->arg[1]);
+	}
+
+	/* All other formats only take integers, unused ones are ignored */
+	return snprintf(buf, len, trace_formats[rec->event],
+		rec->arg[0], rec->arg[1], rec->arg[2], rec->arg[3]);
+}
+
+const char *trace_level_name(unsigned level)
+{
+	if (level > TRACE_DEBUG) {
+		return "?";
+	}
+
+	return trace_level_names[level];
+}
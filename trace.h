@@ -0,0 +1,101 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Binary diagnostics for hot paths. Every thread logs fixed size records
+ * into its own ring, nothing is formatted while decoding. trace_dump()
+ * writes the rings to the file set with trace_set_output(), trace_fmt
+ * turns it into text.
+ */
+
+enum trace_level {
+	TRACE_ERROR,
+	TRACE_WARN,
+	TRACE_INFO,
+	TRACE_DEBUG,
+};
+
+/* Records above this level are compiled out, e.g. -DTRACE_LEVEL=TRACE_INFO */
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_DEBUG
+#endif
+
+/* Events, the format strings live in trace.c */
+enum trace_event {
+	TRACE_SESSION_CLOSE,	/* rat, session id */
+	TRACE_SQL,		/* statement length */
+	TRACE_SACCH_REPORT,	/* old arfcn, new arfcn */
+	TRACE_RLC_DATA_UL,	/* ts, tfi, bsn, cv */
+	TRACE_RLC_DATA_DL,	/* ts, tfi, bsn, fbi */
+	TRACE_RLC_WINDOW,	/* d_same_bsn, d_last_bsn, d_bsn, old_len */
+	TRACE_RLC_TLLI,		/* tlli */
+	TRACE_RLC_PFI,		/* pfi */
+	TRACE_RLC_TBF_CLEAR,	/* tfi, start_bsn, last_bsn */
+	TRACE_RLC_TBF_NEW,	/* bsn */
+	TRACE_RLC_DUPLICATE,	/* bsn */
+	TRACE_RLC_BAD_LAST_BSN,	/* bsn, d_last_bsn */
+	TRACE_RLC_BAD_D_BSN,	/* bsn, d_bsn */
+	TRACE_RLC_NO_BLOCKS,	/* start_bsn */
+	TRACE_RLC_BLOCK_NULL,	/* bsn */
+	TRACE_RLC_BLOCK_OLD,	/* bsn, fn, current fn */
+	TRACE_RLC_BLOCK_MISSING,	/* bsn, previous bsn */
+	TRACE_RLC_TBF_END,	/* bsn, llc length */
+	TRACE_RLC_LIME_ERROR,	/* bsn, block */
+	TRACE_RLC_LLC,		/* bsn, llc length, block */
+	TRACE_RLC_SPARE,	/* bsn, llc length */
+	TRACE_RLC_SHIFT,	/* start_bsn, last_bsn */
+	TRACE_EVENT_MAX
+};
+
+#define TRACE_ARGS 4
+
+struct trace_record {
+	uint64_t ticks;		/* perf_ticks() */
+	uint16_t event;
+	uint8_t level;
+	uint8_t pad;
+	uint32_t thread;
+	int32_t arg[TRACE_ARGS];
+} __attribute__((packed));
+
+/* File layout: header, then per thread a trace_thread and its records */
+#define TRACE_MAGIC "GSMTRACE"
+#define TRACE_VERSION 1
+
+struct trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t n_events;
+	double ticks_per_ns;
+	uint64_t start_ticks;
+} __attribute__((packed));
+
+struct trace_thread {
+	uint32_t thread;
+	uint32_t count;		/* Records following */
+	uint64_t dropped;	/* Overwritten before the dump */
+} __attribute__((packed));
+
+void trace_log(enum trace_level level, enum trace_event event,
+		int32_t a0, int32_t a1, int32_t a2, int32_t a3);
+
+#define TRACE4(level, event, a0, a1, a2, a3) do { \
+	if ((level) <= TRACE_LEVEL) \
+		trace_log(level, event, a0, a1, a2, a3); \
+} while (0)
+
+#define TRACE(level, event) TRACE4(level, event, 0, 0, 0, 0)
+#define TRACE1(level, event, a0) TRACE4(level, event, a0, 0, 0, 0)
+#define TRACE2(level, event, a0, a1) TRACE4(level, event, a0, a1, 0, 0)
+#define TRACE3(level, event, a0, a1, a2) TRACE4(level, event, a0, a1, a2, 0)
+
+void trace_set_output(const char *filename);
+void trace_dump();
+
+/* Text for the formatter */
+int trace_render(const struct trace_record *rec, char *buf, unsigned len);
+const char *trace_level_name(unsigned level);
+
+#endif
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <err.h>
+
+#include "trace.h"
+
+/* Formats a binary trace written by trace_dump(), records of all threads by time */
+
+static void usage(const char *progname)
+{
+	printf("Usage: %s [-l <level>] <tracefile>\n", progname);
+	printf("	-l <level>    - Only show records up to <level> (0=error .. 3=debug)\n");
+	exit(1);
+}
+
+static int compare_ticks(const void *a, const void *b)
+{
+	const struct trace_record *ra = (const struct trace_record *) a;
+	const struct trace_record *rb = (const struct trace_record *) b;
+
+	if (ra->ticks < rb->ticks) {
+		return -1;
+	}
+
+	return ra->ticks > rb->ticks;
+}
+
+int main(int argc, char *argv[])
+{
+	struct trace_header h;
+	struct trace_thread t;
+	struct trace_record *rec = NULL;
+	size_t n = 0;
+	size_t i;
+	unsigned max_level = TRACE_DEBUG;
+	char text[256];
+	FILE *f;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "l:")) != -1) {
+		switch (ch) {
+			case 'l':
+				max_level = atoi(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(argv[0]);
+	}
+
+	f = fopen(argv[optind], "rb");
+	if (!f) {
+		err(1, "Cannot open trace file: %s", argv[optind]);
+	}
+
+	if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic))) {
+		errx(1, "Not a trace file: %s", argv[optind]);
+	}
+	if (h.version != TRACE_VERSION) {
+		errx(1, "Unsupported trace version %u", h.version);
+	}
+
+	while (fread(&t, sizeof(t), 1, f) == 1) {
+		if (t.dropped) {
+			fprintf(stderr, "thread %u: %llu older records overwritten\n",
+				t.thread, (unsigned long long) t.dropped);
+		}
+
+		rec = (struct trace_record *) realloc(rec, (n + t.count) * sizeof(struct trace_record));
+		if (t.count && !rec) {
+			errx(1, "Out of memory");
+		}
+		if (fread(&rec[n], sizeof(struct trace_record), t.count, f) != t.count) {
+			errx(1, "Truncated trace file");
+		}
+		n += t.count;
+	}
+	fclose(f);
+
+	qsort(rec, n, sizeof(struct trace_record), compare_ticks);
+
+	for (i = 0; i < n; i++) {
+		if (rec[i].level > max_level) {
+			continue;
+		}
+		trace_render(&rec[i], text, sizeof(text));
+		printf("%12.3f us T%u %-5s %s\n",
+			(double) (int64_t) (rec[i].ticks - h.start_ticks) / h.ticks_per_ns / 1000.0,
+			rec[i].thread, trace_level_name(rec[i].level), text);
+	}
+
+	free(rec);
+
+	return 0;
+}
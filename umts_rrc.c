@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <osmocom/rrc/UL-DCCH-Message.h>
 #include <osmocom/rrc/DL-DCCH-Message.h>
 #include <osmocom/rrc/UL-CCCH-Message.h>
@@ -13,11 +15,224 @@
 #include <osmocom/rrc/MCC.h>
 #include <osmocom/rrc/MNC.h>
 #include <osmocom/core/bits.h>
+#include <osmocom/core/talloc.h>
 #include <BIT_STRING.h>
 
 #include "umts_rrc.h"
 #include "l3_handler.h"
 #include "session.h"
+#include "failure.h"
+
+/* Initial pool size, larger messages spill over to the heap */
+#define RRC_ARENA_SIZE 65536
+
+/* libasn1c allocates all decoder output from this talloc context */
+extern void *talloc_asn1_ctx;
+
+static void *rrc_arena = NULL;
+static void *rrc_saved_ctx = NULL;
+
+/* Route all following ASN.1 allocations into the decoding arena */
+void rrc_arena_enter()
+{
+	if (!rrc_arena) {
+		rrc_arena = talloc_pool(NULL, RRC_ARENA_SIZE);
+		assert(rrc_arena != NULL);
+	}
+
+	rrc_saved_ctx = talloc_asn1_ctx;
+	talloc_asn1_ctx = rrc_arena;
+}
+
+/* Release every structure decoded since rrc_arena_enter() */
+void rrc_arena_leave()
+{
+	assert(rrc_arena != NULL);
+
+	talloc_free_children(rrc_arena);
+	talloc_asn1_ctx = rrc_saved_ctx;
+}
+
+void rrc_arena_destroy()
+{
+	if (rrc_arena) {
+		talloc_free(rrc_arena);
+		rrc_arena = NULL;
+	}
+}
+
+/* Largest SIB consists of 16 segments with 222 bits each */
+#define SIB_MAX_SEGMENTS	16
+#define SIB_MAX_LEN		((SIB_MAX_SEGMENTS * 222 + 7) / 8)
+#define SIB_TYPES		32
+#define BCCH_CELLS		8
+
+/* Segments of a SIB under reassembly */
+struct sib_segments {
+	uint8_t data[SIB_MAX_LEN];
+	unsigned bits;
+	int seg_count;
+	int next_index;
+};
+
+/* Last decoded raw SIB and its results */
+struct sib_cache {
+	uint8_t valid;
+	uint8_t failed;
+	unsigned bits;
+	uint8_t data[SIB_MAX_LEN];
+	char info[32];
+	int mcc;
+	int mnc;
+	int lac;
+	int cid;
+};
+
+struct bcch_cell {
+	uint8_t valid;
+	int cid;
+	long mib_tag;
+	unsigned last_use;
+	struct sib_cache sib[SIB_TYPES];
+};
+
+/* Cells are shared by all handsets */
+static struct bcch_cell bcch_cells[BCCH_CELLS];
+static unsigned bcch_use = 0;
+
+/*
+ * BCCH reception of one handset. The cell is only known once its SIB3
+ * was seen. Until then, e.g. after a new MIB value tag or carrier, SIBs
+ * are decoded and not cached. Segments belong to the received carrier,
+ * not to a cached cell.
+ */
+struct bcch_rx {
+	struct bcch_cell *cell;
+	int cid;
+	int confirmed;
+	long mib_tag;
+	int arfcn;
+	struct sib_segments seg[SIB_TYPES];
+};
+
+/* State of the current handset, allocated on its first BCCH message */
+static struct bcch_rx *bcch_rx_get()
+{
+	struct bcch_rx *rx = cur_sub->bcch;
+
+	if (rx) {
+		return rx;
+	}
+
+	rx = (struct bcch_rx *) calloc(1, sizeof(struct bcch_rx));
+	assert(rx != NULL);
+	rx->mib_tag = -1;
+	rx->arfcn = -1;
+	cur_sub->bcch = rx;
+
+	return rx;
+}
+
+void rrc_bcch_free(struct bcch_rx *rx)
+{
+	free(rx);
+}
+
+/* Cache of the confirmed cell, NULL if another handset reused its entry */
+static struct bcch_cell *bcch_rx_cell(struct bcch_rx *rx)
+{
+	if (rx->confirmed && (!rx->cell->valid || rx->cell->cid != rx->cid)) {
+		rx->confirmed = 0;
+	}
+
+	return rx->confirmed ? rx->cell : NULL;
+}
+
+/* Find cell by CID, replace least recently used entry if unknown */
+static struct bcch_cell *bcch_cell_get(int cid)
+{
+	struct bcch_cell *c = &bcch_cells[0];
+	int i;
+
+	for (i = 0; i < BCCH_CELLS; i++) {
+		if (bcch_cells[i].valid && (bcch_cells[i].cid == cid)) {
+			c = &bcch_cells[i];
+			goto found;
+		}
+		if (!bcch_cells[i].valid || (bcch_cells[i].last_use < c->last_use)) {
+			c = &bcch_cells[i];
+		}
+	}
+
+	memset(c, 0, sizeof(*c));
+	c->valid = 1;
+	c->cid = cid;
+	c->mib_tag = -1;
+found:
+	c->last_use = ++bcch_use;
+	return c;
+}
+
+/*
+ * Forget all cells, entries are cleared on reuse. The handsets' states
+ * go with their subscribers.
+ */
+void rrc_bcch_reset()
+{
+	int i;
+
+	for (i = 0; i < BCCH_CELLS; i++) {
+		bcch_cells[i].valid = 0;
+	}
+	bcch_use = 0;
+}
+
+/* Switch to the cache of the cell named by SIB3 */
+static void bcch_cell_confirm(struct bcch_rx *rx, int cid)
+{
+	rx->cell = bcch_cell_get(cid);
+	rx->cid = cid;
+
+	/* A new value tag invalidates all cached SIBs of this cell */
+	if (rx->cell->mib_tag != rx->mib_tag) {
+		memset(rx->cell->sib, 0, sizeof(rx->cell->sib));
+		rx->cell->mib_tag = rx->mib_tag;
+	}
+
+	rx->confirmed = 1;
+}
+
+/* Append bit string to a reassembly buffer */
+static int sib_append(struct sib_segments *sg, BIT_STRING_t *frame)
+{
+	unsigned i, pos, bits;
+
+	bits = frame->size * 8 - frame->bits_unused;
+	if (sg->bits + bits > SIB_MAX_LEN * 8) {
+		return 1;
+	}
+
+	if (!(sg->bits % 8)) {
+		memcpy(&sg->data[sg->bits / 8], frame->buf, frame->size);
+	} else {
+		for (i = 0; i < bits; i++) {
+			pos = sg->bits + i;
+			if (frame->buf[i / 8] & (0x80 >> (i % 8))) {
+				sg->data[pos / 8] |= 0x80 >> (pos % 8);
+			} else {
+				sg->data[pos / 8] &= ~(0x80 >> (pos % 8));
+			}
+		}
+	}
+	sg->bits += bits;
+
+	/* Clear padding bits for raw comparison */
+	if (sg->bits % 8) {
+		sg->data[sg->bits / 8] &= 0xff00 >> (sg->bits % 8);
+	}
+
+	return 0;
+}
 
 int handle_dcch_ul(struct session_info *s, uint8_t *msg, size_t len)
 {
@@ -44,6 +259,7 @@ int handle_dcch_ul(struct session_info *s, uint8_t *msg, size_t len)
 		/* Integrity present */
 		if (len < 6) {
 			SET_MSG_INFO(s, "SANITY CHECK FAILED (HMAC_LEN)");
+			failure_record(FAIL_RRC_HMAC_LEN, msg, len);
 			return 1;
 		}
 		msg_type = ((msg[4] & 0x07) << 2) | (msg[5] >> 6);
@@ -102,9 +318,12 @@ int handle_dcch_ul(struct session_info *s, uint8_t *msg, size_t len)
 
 	/* Apply ASN.1 decoder to extract needed information */
 	if (need_to_parse) {
+		rrc_arena_enter();
 		rv = uper_decode(NULL, &asn_DEF_UL_DCCH_Message, (void **) &dcch, msg, len, 0, 0);
 		if ((rv.code != RC_OK) || !dcch) {
 			SET_MSG_INFO(s, "ASN.1 PARSING ERROR");
+			failure_record(FAIL_RRC_ASN1, msg, len);
+			rrc_arena_leave();
 			return 1;
 		}
 
@@ -134,7 +353,7 @@ int handle_dcch_ul(struct session_info *s, uint8_t *msg, size_t len)
 			handle_dtap(s, nas, nas_len, 0, 1);
 		}
 
-		ASN_STRUCT_FREE(asn_DEF_UL_DCCH_Message, dcch);
+		rrc_arena_leave();
 	}
 
 #if 0
@@ -179,6 +398,7 @@ int handle_dcch_dl(struct session_info *s, uint8_t *msg, size_t len)
 	if (msg[0] & 0x80) {
 		if (len < 6) {
 			SET_MSG_INFO(s, "SANITY CHECK FAILED (HMAC_LEN)");
+			failure_record(FAIL_RRC_HMAC_LEN, msg, len);
 			return 1;
 		}
 		msg_type = ((msg[4] & 0x07) << 2) | (msg[5] >> 6);
@@ -236,9 +456,12 @@ int handle_dcch_dl(struct session_info *s, uint8_t *msg, size_t len)
 
 	if (need_to_parse) {
 		/* Call ASN.1 decoder */
+		rrc_arena_enter();
 		rv = uper_decode(NULL, &asn_DEF_DL_DCCH_Message, (void **) &dcch, msg, len, 0, 0);
 		if ((rv.code != RC_OK) || !dcch) {
 			SET_MSG_INFO(s, "ASN.1 PARSING ERROR");
+			failure_record(FAIL_RRC_ASN1, msg, len);
+			rrc_arena_leave();
 			return 1;
 		}
 
@@ -327,7 +550,7 @@ int handle_dcch_dl(struct session_info *s, uint8_t *msg, size_t len)
 		}
 
 dl_end:
-		ASN_STRUCT_FREE(asn_DEF_DL_DCCH_Message, dcch);
+		rrc_arena_leave();
 	}
 
 	#if 0
@@ -356,6 +579,7 @@ int handle_ccch_ul(struct session_info *s, uint8_t *msg, size_t len)
 	if (msg[0] & 0x80) {
 		if (len < 5) {
 			SET_MSG_INFO(s, "SANITY CHECK FAILED (HMAC_LEN)");
+			failure_record(FAIL_RRC_HMAC_LEN, msg, len);
 			return 1;
 		}
 		msg_type = (msg[4] & 0x07);
@@ -392,6 +616,7 @@ int handle_ccch_dl(struct session_info *s, uint8_t *msg, size_t len)
 	if (msg[0] & 0x80) {
 		if (len < 5) {
 			SET_MSG_INFO(s, "SANITY CHECK FAILED (HMAC_LEN)");
+			failure_record(FAIL_RRC_HMAC_LEN, msg, len);
 			return 1;
 		}
 		msg_type = (msg[4] & 0x07);
@@ -420,10 +645,11 @@ int handle_ccch_dl(struct session_info *s, uint8_t *msg, size_t len)
 }
 
 /* Analyze system information type 0 (MIB) frame */
-void handle_umts_sib_0_frame(struct session_info *s, BIT_STRING_t *frame)
+int handle_umts_sib_0_frame(struct session_info *s, BIT_STRING_t *frame)
 {
 	unsigned len, i;
 	MasterInformationBlock_t *sib = NULL;
+	struct bcch_rx *rx;
 	asn_dec_rval_t rv;
 	len = frame->size;
 	MCC_t *mcc = NULL;
@@ -433,7 +659,14 @@ void handle_umts_sib_0_frame(struct session_info *s, BIT_STRING_t *frame)
 
 	rv = uper_decode(NULL, &asn_DEF_MasterInformationBlock, (void **) &sib, frame->buf, len, 0, 0);
 	if ((rv.code != RC_OK) || !sib) {
-		return;
+		return 1;
+	}
+
+	/* Updated or other cell, wait for SIB3 */
+	rx = bcch_rx_get();
+	if (rx->mib_tag != sib->mib_ValueTag) {
+		rx->mib_tag = sib->mib_ValueTag;
+		rx->confirmed = 0;
 	}
 
 	/* Extract MCC and MNC */
@@ -447,7 +680,7 @@ void handle_umts_sib_0_frame(struct session_info *s, BIT_STRING_t *frame)
 		mnc = &sib->plmn_Type.choice.gsm_MAP_and_ANSI_41.plmn_Identity.mnc;
 		break;
 	default:
-		return;
+		return 1;
 	}
 
 	for (i = 0; i < mcc->list.count; i++) {
@@ -462,12 +695,11 @@ void handle_umts_sib_0_frame(struct session_info *s, BIT_STRING_t *frame)
 	s->mcc = n_mcc;
 	s->mnc = n_mnc;
 
-	/* FIXME: When freeing, the whole program exits. */
-	ASN_STRUCT_FREE(asn_DEF_MasterInformationBlock, sib);
+	return 0;
 }
 
 /* Analyze system information type 1 frame */
-void handle_umts_sib_1_frame(struct session_info *s, BIT_STRING_t *frame)
+int handle_umts_sib_1_frame(struct session_info *s, BIT_STRING_t *frame)
 {
 	unsigned len, i;
 	SysInfoType1_t *sib = NULL;
@@ -477,7 +709,7 @@ void handle_umts_sib_1_frame(struct session_info *s, BIT_STRING_t *frame)
 
 	rv = uper_decode(NULL, &asn_DEF_SysInfoType1, (void **) &sib, frame->buf, len, 0, 0);
 	if ((rv.code != RC_OK) || !sib) {
-		return;
+		return 1;
 	}
 
 	/* Extract LAC */
@@ -488,11 +720,11 @@ void handle_umts_sib_1_frame(struct session_info *s, BIT_STRING_t *frame)
 	APPEND_MSG_INFO(s, " SIB1 LAC %d", lac);
 	s->lac = lac;
 
-	ASN_STRUCT_FREE(asn_DEF_SysInfoType1, sib);
+	return 0;
 }
 
 /* Analyze system information type 3 frame */
-void handle_umts_sib_3_frame(struct session_info *s, BIT_STRING_t *frame)
+int handle_umts_sib_3_frame(struct session_info *s, BIT_STRING_t *frame)
 {
 	unsigned len;
 	SysInfoType3_t *sib = NULL;
@@ -502,7 +734,7 @@ void handle_umts_sib_3_frame(struct session_info *s, BIT_STRING_t *frame)
 
 	rv = uper_decode(NULL, &asn_DEF_SysInfoType3, (void **) &sib, frame->buf, len, 0, 0);
 	if ((rv.code != RC_OK) || !sib) {
-		return;
+		return 1;
 	}
 
 	/* Extract CID */
@@ -514,11 +746,11 @@ void handle_umts_sib_3_frame(struct session_info *s, BIT_STRING_t *frame)
 	APPEND_MSG_INFO(s, " SIB3 CID %d", cid);
 	s->cid = cid;
 
-	//ASN_STRUCT_FREE(asn_DEF_SysInfoType3, sib);
+	return 0;
 }
 
 /* Analyze system information type 5 frame */
-void handle_umts_sib_5_frame(struct session_info *s, BIT_STRING_t *frame)
+int handle_umts_sib_5_frame(struct session_info *s, BIT_STRING_t *frame)
 {
 	unsigned len;
 	SysInfoType5_t *sib = NULL;
@@ -527,16 +759,16 @@ void handle_umts_sib_5_frame(struct session_info *s, BIT_STRING_t *frame)
 
 	rv = uper_decode(NULL, &asn_DEF_SysInfoType5, (void **) &sib, frame->buf, len, 0, 0);
 	if ((rv.code != RC_OK) || !sib) {
-		return;
+		return 1;
 	}
 
 	APPEND_MSG_INFO(s, " SIB5");
 
-	ASN_STRUCT_FREE(asn_DEF_SysInfoType5, sib);
+	return 0;
 }
 
 /* Analyze system information type 7 frame */
-void handle_umts_sib_7_frame(struct session_info *s, BIT_STRING_t *frame)
+int handle_umts_sib_7_frame(struct session_info *s, BIT_STRING_t *frame)
 {
 	unsigned len;
 	SysInfoType7_t *sib = NULL;
@@ -545,16 +777,16 @@ void handle_umts_sib_7_frame(struct session_info *s, BIT_STRING_t *frame)
 
 	rv = uper_decode(NULL, &asn_DEF_SysInfoType7, (void **) &sib, frame->buf, len, 0, 0);
 	if ((rv.code != RC_OK) || !sib) {
-		return;
+		return 1;
 	}
 
 	APPEND_MSG_INFO(s, " SIB7");
 
-	ASN_STRUCT_FREE(asn_DEF_SysInfoType7, sib);
+	return 0;
 }
 
 /* Analyze system information type 11 frame */
-void handle_umts_sib_11_frame(struct session_info *s, BIT_STRING_t *frame)
+int handle_umts_sib_11_frame(struct session_info *s, BIT_STRING_t *frame)
 {
 	unsigned len;
 	SysInfoType11_t *sib = NULL;
@@ -563,35 +795,114 @@ void handle_umts_sib_11_frame(struct session_info *s, BIT_STRING_t *frame)
 
 	rv = uper_decode(NULL, &asn_DEF_SysInfoType11, (void **) &sib, frame->buf, len, 0, 0);
 	if ((rv.code != RC_OK) || !sib) {
-		return;
+		return 1;
 	}
 
 	APPEND_MSG_INFO(s, " SIB11");
 
-	ASN_STRUCT_FREE(asn_DEF_SysInfoType11, sib);
+	return 0;
 }
 
-void handle_umts_sib(struct session_info *s, CompleteSIBshort_t *sib)
+/* Decode a complete SIB unless its raw bytes are unchanged */
+void handle_umts_sib_data(struct session_info *s, long sib_type, BIT_STRING_t *frame)
 {
-	switch (sib->sib_Type) {
+	struct bcch_rx *rx = bcch_rx_get();
+	struct bcch_cell *c;
+	struct sib_cache *e;
+	struct sib_segments sg;
+	unsigned first_event, spills;
+	int ret;
+
+	if (sib_type < 0 || sib_type >= SIB_TYPES) {
+		APPEND_MSG_INFO(s, " SIB%ld", sib_type);
+		return;
+	}
+
+	/* Normalize padding before comparison */
+	sg.bits = 0;
+	if (sib_append(&sg, frame)) {
+		return;
+	}
+
+	c = bcch_rx_cell(rx);
+	e = c ? &c->sib[sib_type] : NULL;
+	if (e && e->valid && (e->bits == sg.bits) && !memcmp(e->data, sg.data, (sg.bits + 7) / 8)) {
+		/* Unchanged, replay cached results */
+		if (!e->failed) {
+			switch (sib_type) {
+			case 0:
+				s->mcc = e->mcc;
+				s->mnc = e->mnc;
+				break;
+			case 1:
+				s->lac = e->lac;
+				break;
+			case 3:
+				s->cid = e->cid;
+				break;
+			}
+		}
+		APPEND_MSG_INFO(s, "%s", e->info);
+		return;
+	}
+
+	first_event = s->new_msg->info.n;
+	spills = s->new_msg->info.spills;
+
+	switch (sib_type) {
 	case 0: /* SIB0 (MIB) */
-		handle_umts_sib_0_frame(s, &sib->sib_Data_variable);
+		ret = handle_umts_sib_0_frame(s, frame);
 		break;
-
 	case 1: /* SIB1 */
-		handle_umts_sib_1_frame(s, &sib->sib_Data_variable);
+		ret = handle_umts_sib_1_frame(s, frame);
 		break;
-	
 	case 3: /* SIB3 */
-		handle_umts_sib_3_frame(s, &sib->sib_Data_variable);
+		ret = handle_umts_sib_3_frame(s, frame);
+		break;
+	case 5: /* SIB5 */
+		ret = handle_umts_sib_5_frame(s, frame);
 		break;
-			
 	case 7: /* SIB7 */
-		handle_umts_sib_7_frame(s, &sib->sib_Data_variable);
+		ret = handle_umts_sib_7_frame(s, frame);
+		break;
+	case 11: /* SIB11 */
+		ret = handle_umts_sib_11_frame(s, frame);
 		break;
 	default:
-		APPEND_MSG_INFO(s, " SIB%d", sib->sib_Type);
+		APPEND_MSG_INFO(s, " SIB%ld", sib_type);
+		ret = 0;
+	}
+
+	/* SIB3 names the cell, its cache is used from now on */
+	if (sib_type == 3 && !ret) {
+		bcch_cell_confirm(rx, s->cid);
+		e = &rx->cell->sib[sib_type];
+	}
+
+	/* The MIB handler may have reset the confirmation */
+	if (!e || !bcch_rx_cell(rx)) {
+		return;
+	}
+
+	/* Events of this SIB were merged with earlier text */
+	if (s->new_msg->info.spills != spills) {
+		return;
 	}
+
+	e->valid = 1;
+	e->failed = ret;
+	e->bits = sg.bits;
+	memcpy(e->data, sg.data, (sg.bits + 7) / 8);
+	msg_info_render(&s->new_msg->info, first_event, e->info, sizeof(e->info));
+	e->mcc = s->mcc;
+	e->mnc = s->mnc;
+	e->lac = s->lac;
+	e->cid = s->cid;
+}
+
+void handle_umts_sib(struct session_info *s, CompleteSIBshort_t *sib)
+{
+	handle_umts_sib_data(s, sib->sib_Type, &sib->sib_Data_variable);
 }
 
 void handle_umts_sib_list(struct session_info *s, CompleteSIB_List_t *sib_list)
@@ -603,180 +914,165 @@ void handle_umts_sib_list(struct session_info *s, CompleteSIB_List_t *sib_list)
 	}
 }
 
+/* Start reassembly of a segmented SIB */
+void handle_umts_sib_first(struct session_info *s, long sib_type, long seg_count, BIT_STRING_t *frame)
+{
+	struct sib_segments *sg;
+
+	APPEND_MSG_INFO(s, " SIB%ld [0/%ld]", sib_type, seg_count);
+
+	if (sib_type < 0 || sib_type >= SIB_TYPES) {
+		return;
+	}
+
+	sg = &bcch_rx_get()->seg[sib_type];
+	sg->bits = 0;
+	sg->next_index = 1;
+	sg->seg_count = seg_count;
+	if (sib_append(sg, frame)) {
+		sg->seg_count = 0;
+	}
+}
+
+/* Add subsequent or last segment, decode SIB when complete */
+void handle_umts_sib_next(struct session_info *s, long sib_type, long index, BIT_STRING_t *frame, int last)
+{
+	struct sib_segments *sg;
+	BIT_STRING_t sib;
+
+	APPEND_MSG_INFO(s, " SIB%ld [%ld/-]", sib_type, index);
+
+	if (sib_type < 0 || sib_type >= SIB_TYPES) {
+		return;
+	}
+
+	sg = &bcch_rx_get()->seg[sib_type];
+
+	/* Drop SIB on missing or unexpected segments */
+	if (!sg->seg_count || (index != sg->next_index) || (index >= sg->seg_count) ||
+	    (last != (index == sg->seg_count - 1)) || sib_append(sg, frame)) {
+		sg->seg_count = 0;
+		return;
+	}
+	sg->next_index++;
+
+	if (last) {
+		memset(&sib, 0, sizeof(sib));
+		sib.buf = sg->data;
+		sib.size = (sg->bits + 7) / 8;
+		sib.bits_unused = sib.size * 8 - sg->bits;
+		sg->seg_count = 0;
+		handle_umts_sib_data(s, sib_type, &sib);
+	}
+}
+
 int handle_umts_bcch(struct session_info *s, uint8_t *msg, size_t len)
 {
 	BCCH_BCH_Message_t *bcch = NULL;
-        asn_dec_rval_t rv;
+	asn_dec_rval_t rv;
+	SystemInformation_BCH_t *si;
+	struct bcch_rx *rx;
 
-	/* Decode */
-        rv = uper_decode(NULL, &asn_DEF_BCCH_BCH_Message, (void **) &bcch, msg, len, 0, 0);
-        if ((rv.code != RC_OK) || !bcch) {
+	/* Decode, nested SIB decodes share the same arena */
+	rrc_arena_enter();
+	rv = uper_decode(NULL, &asn_DEF_BCCH_BCH_Message, (void **) &bcch, msg, len, 0, 0);
+	if ((rv.code != RC_OK) || !bcch) {
 		SET_MSG_INFO(s, "ASN.1 PARSING ERROR");
+		failure_record(FAIL_RRC_ASN1, msg, len);
+		rrc_arena_leave();
 		return -1;
 	}
 	
 	SET_MSG_INFO(s, "BCCH");
 
-	// check sequence and reset buffer on jumps
-	// bcch->message.sfn_Prime;
+	/* Another carrier is another cell, wait for SIB3 */
+	rx = bcch_rx_get();
+	if (s->arfcn != rx->arfcn) {
+		rx->arfcn = s->arfcn;
+		rx->confirmed = 0;
+	}
+
+	si = &bcch->message;
 
 	/* Inspect decoding results */
-	switch (bcch->message.payload.present) {
+	switch (si->payload.present) {
 		/* Frames that include only a single segment (simple case) */
 		case SystemInformation_BCH__payload_PR_firstSegment:
-			/* First */
-			APPEND_MSG_INFO(s, " SIB%d [0/%d]",
-				bcch->message.payload.choice.firstSegment.sib_Type,
-				bcch->message.payload.choice.firstSegment.seg_Count
-				);
-/*
-			&bcch->message.payload.choice.firstSegment.sib_Data_fixed,
-			bcch->message.payload.choice.firstSegment.sib_Type,
-			0,
-			bcch->message.payload.choice.firstSegment.seg_Count
-*/
+			handle_umts_sib_first(s,
+				si->payload.choice.firstSegment.sib_Type,
+				si->payload.choice.firstSegment.seg_Count,
+				&si->payload.choice.firstSegment.sib_Data_fixed);
 			break;
 
 		case SystemInformation_BCH__payload_PR_subsequentSegment:
-			/* Subsequent */
-			APPEND_MSG_INFO(s, " SIB%d [%d/-]",
-				bcch->message.payload.choice.firstSegment.sib_Type,
-				bcch->message.payload.choice.subsequentSegment.segmentIndex
-				);
-/*
-			&bcch->message.payload.choice.subsequentSegment.sib_Data_fixed,
-			bcch->message.payload.choice.firstSegment.sib_Type,
-			bcch->message.payload.choice.subsequentSegment.segmentIndex,
-			0
-*/
+			handle_umts_sib_next(s,
+				si->payload.choice.subsequentSegment.sib_Type,
+				si->payload.choice.subsequentSegment.segmentIndex,
+				&si->payload.choice.subsequentSegment.sib_Data_fixed, 0);
 			break;
 
 		case SystemInformation_BCH__payload_PR_lastSegmentShort:
-			/* Last short */
-			APPEND_MSG_INFO(s, " SIB%d [%d/-]",
-				bcch->message.payload.choice.firstSegment.sib_Type,
-				bcch->message.payload.choice.subsequentSegment.segmentIndex
-				);
-/*
-			&bcch->message.payload.choice.lastSegmentShort.sib_Data_variable,
-			bcch->message.payload.choice.firstSegment.sib_Type,
-			bcch->message.payload.choice.subsequentSegment.segmentIndex,
-			0
-*/
+			handle_umts_sib_next(s,
+				si->payload.choice.lastSegmentShort.sib_Type,
+				si->payload.choice.lastSegmentShort.segmentIndex,
+				&si->payload.choice.lastSegmentShort.sib_Data_variable, 1);
 			break;
 
 		case SystemInformation_BCH__payload_PR_lastSegment:
-			/* Last */
-			APPEND_MSG_INFO(s, " SIB%d [%d/-]",
-				bcch->message.payload.choice.lastSegment.sib_Type,
-				bcch->message.payload.choice.lastSegment.segmentIndex
-				);
-/*
-			&bcch->message.payload.choice.lastSegment.sib_Data_fixed,
-			bcch->message.payload.choice.lastSegment.sib_Type,
-			bcch->message.payload.choice.lastSegment.segmentIndex,
-			0
-*/
+			handle_umts_sib_next(s,
+				si->payload.choice.lastSegment.sib_Type,
+				si->payload.choice.lastSegment.segmentIndex,
+				&si->payload.choice.lastSegment.sib_Data_fixed, 1);
 			break;
 
 		/* Frames that combine multiple segements and lists */	
 		case SystemInformation_BCH__payload_PR_lastAndFirst:
-			/* Last */
-			APPEND_MSG_INFO(s, " SIB%d [%d/-]",
-				bcch->message.payload.choice.lastAndFirst.lastSegmentShort.sib_Type,
-				bcch->message.payload.choice.lastAndFirst.lastSegmentShort.segmentIndex
-				);
-/*
-			&bcch->message.payload.choice.lastAndFirst.lastSegmentShort.sib_Data_variable,
-			bcch->message.payload.choice.lastAndFirst.lastSegmentShort.sib_Type,
-			bcch->message.payload.choice.lastAndFirst.lastSegmentShort.segmentIndex,
-			0
-*/
-			
-			/* First */
-			APPEND_MSG_INFO(s, " SIB%d [0/%d]",
-				bcch->message.payload.choice.lastAndFirst.firstSegment.sib_Type,
-				bcch->message.payload.choice.lastAndFirst.firstSegment.seg_Count
-				);
-/*
-			&bcch_sib_5_data,&bcch->message.payload.choice.lastAndFirst.firstSegment.sib_Data_variable,
-			bcch->message.payload.choice.lastAndFirst.firstSegment.sib_Type,
-			0,
-			bcch->message.payload.choice.lastAndFirst.firstSegment.seg_Count
-*/
+			handle_umts_sib_next(s,
+				si->payload.choice.lastAndFirst.lastSegmentShort.sib_Type,
+				si->payload.choice.lastAndFirst.lastSegmentShort.segmentIndex,
+				&si->payload.choice.lastAndFirst.lastSegmentShort.sib_Data_variable, 1);
+			handle_umts_sib_first(s,
+				si->payload.choice.lastAndFirst.firstSegment.sib_Type,
+				si->payload.choice.lastAndFirst.firstSegment.seg_Count,
+				&si->payload.choice.lastAndFirst.firstSegment.sib_Data_variable);
 			break;
 
 		case SystemInformation_BCH__payload_PR_lastAndComplete:
-			/* Last */
-			APPEND_MSG_INFO(s, " SIB%d [%d/-]",
-				bcch->message.payload.choice.lastAndComplete.lastSegmentShort.sib_Type,
-				bcch->message.payload.choice.lastAndComplete.lastSegmentShort.segmentIndex
-				);
-/*
-			&bcch->message.payload.choice.lastAndComplete.lastSegmentShort.sib_Data_variable,
-			bcch->message.payload.choice.lastAndComplete.lastSegmentShort.sib_Type,
-			bcch->message.payload.choice.lastAndComplete.lastSegmentShort.segmentIndex,
-			0
-*/
-
-			/* Complete */
-			handle_umts_sib_list(s, &bcch->message.payload.choice.lastAndComplete.completeSIB_List);
+			handle_umts_sib_next(s,
+				si->payload.choice.lastAndComplete.lastSegmentShort.sib_Type,
+				si->payload.choice.lastAndComplete.lastSegmentShort.segmentIndex,
+				&si->payload.choice.lastAndComplete.lastSegmentShort.sib_Data_variable, 1);
+			handle_umts_sib_list(s, &si->payload.choice.lastAndComplete.completeSIB_List);
 			break;
 
 		case SystemInformation_BCH__payload_PR_lastAndCompleteAndFirst:
-			/* Last */
-			APPEND_MSG_INFO(s, " SIB%d [%d/-]",
-				bcch->message.payload.choice.lastAndCompleteAndFirst.lastSegmentShort.sib_Type,
-				bcch->message.payload.choice.lastAndCompleteAndFirst.lastSegmentShort.segmentIndex
-				);
-/*
-			&bcch->message.payload.choice.lastAndCompleteAndFirst.lastSegmentShort.sib_Data_variable,
-			bcch->message.payload.choice.lastAndCompleteAndFirst.lastSegmentShort.sib_Type,
-			bcch->message.payload.choice.lastAndCompleteAndFirst.lastSegmentShort.segmentIndex,
-			0
-*/
-
-			/* Complete, list */
-			handle_umts_sib_list(s, &bcch->message.payload.choice.lastAndCompleteAndFirst.completeSIB_List);
-
-			/* First */
-			APPEND_MSG_INFO(s, " SIB%d [0/%d]",
-				bcch->message.payload.choice.lastAndCompleteAndFirst.firstSegment.sib_Type,
-				bcch->message.payload.choice.lastAndCompleteAndFirst.firstSegment.seg_Count
-				);
-/*
-			&bcch->message.payload.choice.lastAndCompleteAndFirst.firstSegment.sib_Data_variable,
-			bcch->message.payload.choice.lastAndCompleteAndFirst.firstSegment.sib_Type,
-			0,
-			bcch->message.payload.choice.lastAndCompleteAndFirst.firstSegment.seg_Count
-*/
+			handle_umts_sib_next(s,
+				si->payload.choice.lastAndCompleteAndFirst.lastSegmentShort.sib_Type,
+				si->payload.choice.lastAndCompleteAndFirst.lastSegmentShort.segmentIndex,
+				&si->payload.choice.lastAndCompleteAndFirst.lastSegmentShort.sib_Data_variable, 1);
+			handle_umts_sib_list(s, &si->payload.choice.lastAndCompleteAndFirst.completeSIB_List);
+			handle_umts_sib_first(s,
+				si->payload.choice.lastAndCompleteAndFirst.firstSegment.sib_Type,
+				si->payload.choice.lastAndCompleteAndFirst.firstSegment.seg_Count,
+				&si->payload.choice.lastAndCompleteAndFirst.firstSegment.sib_Data_variable);
 			break;
 
 		case SystemInformation_BCH__payload_PR_completeSIB_List:
-			/* Complete, list */
-			handle_umts_sib_list(s, &bcch->message.payload.choice.completeSIB_List);
+			handle_umts_sib_list(s, &si->payload.choice.completeSIB_List);
 			break;
 
 		case SystemInformation_BCH__payload_PR_completeAndFirst:
-			/* Complete, list */
-			handle_umts_sib_list(s, &bcch->message.payload.choice.completeAndFirst.completeSIB_List);
-
-			/* First */
-			APPEND_MSG_INFO(s, " SIB%d [0/%d]",
-				bcch->message.payload.choice.completeAndFirst.firstSegment.sib_Type,
-				bcch->message.payload.choice.completeAndFirst.firstSegment.seg_Count
-				);
-/*
-			&bcch->message.payload.choice.completeAndFirst.firstSegment.sib_Data_variable,
-			bcch->message.payload.choice.completeAndFirst.firstSegment.sib_Type,
-			0,
-			bcch->message.payload.choice.completeAndFirst.firstSegment.seg_Count
-*/
+			handle_umts_sib_list(s, &si->payload.choice.completeAndFirst.completeSIB_List);
+			handle_umts_sib_first(s,
+				si->payload.choice.completeAndFirst.firstSegment.sib_Type,
+				si->payload.choice.completeAndFirst.firstSegment.seg_Count,
+				&si->payload.choice.completeAndFirst.firstSegment.sib_Data_variable);
 			break;
 
 		case SystemInformation_BCH__payload_PR_completeSIB:
-			/* Complete, single */
-			handle_umts_sib(s, &bcch->message.payload.choice.completeSIB);
+			handle_umts_sib_data(s,
+				si->payload.choice.completeSIB.sib_Type,
+				&si->payload.choice.completeSIB.sib_Data_fixed);
 			break;
 
 		/* No data */
@@ -787,8 +1083,7 @@ int handle_umts_bcch(struct session_info *s, uint8_t *msg, size_t len)
 			break;
 	}
 	
-	/* Missing ASN.1 free() */
-	ASN_STRUCT_FREE(asn_DEF_BCCH_BCH_Message, bcch);
+	rrc_arena_leave();
 
 	return 0;
 }
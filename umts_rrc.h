@@ -9,5 +9,10 @@ int handle_dcch_dl(struct session_info *s, uint8_t *msg, size_t len);
 int handle_ccch_ul(struct session_info *s, uint8_t *msg, size_t len);
 int handle_ccch_dl(struct session_info *s, uint8_t *msg, size_t len);
 int handle_umts_bcch(struct session_info *s, uint8_t *msg, size_t len);
+void rrc_arena_enter();
+void rrc_arena_leave();
+void rrc_arena_destroy();
+void rrc_bcch_reset();
+void rrc_bcch_free(struct bcch_rx *rx);
 
 #endif